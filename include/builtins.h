@@ -1,5 +1,6 @@
 #pragma once
 #include <stdbool.h>
+#include <stdio.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -8,6 +9,12 @@ extern "C" {
 bool is_builtin(const char *cmd);
 int run_builtin_parent(char *const argv[]);
 
+/* Builtins that touch no shell state and read no input: pipelines may run
+   them on a thread, with run_builtin_to() writing to 'out' (127 if 'argv'
+   is not one of them). */
+bool builtin_has_thread_form(const char *cmd);
+int  run_builtin_to(char *const argv[], FILE *out);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,21 @@
+#pragma once
+#include "exec.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * `on` command prefix (per pipeline stage):
+ *
+ *   on [-n NICE] [-s POLICY[:PRIO]] [CPUS] CMD [ARG...]
+ *
+ * CPUS is a list like "0-3,6"; POLICY is other|batch|idle|fifo|rr.
+ * Fills 'out' and returns the number of argv words consumed (0 when
+ * argv[0] is not "on"), or -1 on a usage error (message already printed).
+ */
+int cpuctl_parse_on(char *const argv[], exec_sched_t *out);
+
+#ifdef __cplusplus
+}
+#endif
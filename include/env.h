@@ -0,0 +1,53 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * The exported environment, as the envp handed to execve().
+ *
+ * A copy of environ (strings in one block, plus a name -> slot hash) is
+ * kept and rebuilt only after a variable changes. A launch with
+ * `NAME=value cmd` assignments then costs one pointer-array copy with
+ * the assigned slots swapped: no setenv() in the shell, no string copies,
+ * no /usr/bin/env process. Shell code changes variables through
+ * env_set()/env_unset() so the copy knows to rebuild (a changed environ
+ * pointer is caught as well, but a direct setenv() of an existing name
+ * may not be).
+ */
+
+/* Same as setenv(name, value, 1) / unsetenv(name), and mark the copy stale.
+   env_set() reuses its own strings for a name it set before, where
+   setenv() would keep a copy of every value (loops, `read`). */
+int env_set(const char *name, const char *value);
+int env_unset(const char *name);
+
+/* Length of NAME in a "NAME=value" word, or 0 if it is not an assignment. */
+size_t env_assign_name_len(const char *word);
+
+/* Set 'n' "NAME=value" words in the shell's environment for good: a line
+   that is only assignments. */
+void env_assign(char *const assign[], int n);
+
+/* envp for a launch with 'n' "NAME=value" words layered over the
+   environment (later words win). Returns NULL when n == 0 (inherit
+   environ as is); otherwise a malloc'd NULL-terminated array whose strings
+   are borrowed from the cache and 'assign': free() only the array, after
+   the child has been started. */
+char **env_launch(char *const assign[], int n);
+
+/* Apply 'n' assignments to the shell's own environment until env_pop():
+   for builtins and functions run with `NAME=value` prefixes. Returns the
+   undo record (NULL when n == 0 or on allocation failure). */
+char **env_push(char *const assign[], int n);
+void   env_pop(char **saved);
+
+/* Times the cached envp was rebuilt (for tests and benches). */
+uint64_t env_rebuilds(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -9,25 +9,99 @@ extern "C" {
 #endif
 
 
+/* CPU placement / priority applied in the child before execv (see `on`).
+   Fields left at their "unset" value inherit from the shell. */
+#define EXEC_MAX_CPUS   1024
+#define EXEC_CPU_WORDS  (EXEC_MAX_CPUS / (8 * sizeof(unsigned long)))
+typedef struct exec_sched {
+    bool          has_affinity;
+    unsigned long affinity[EXEC_CPU_WORDS]; // bit N = CPU N allowed
+    bool          has_nice;
+    int           nice;                     // absolute nice level (-20..19)
+    int           policy;                   // -1 = inherit, else SCHED_* constant
+    int           rt_priority;              // for SCHED_FIFO / SCHED_RR
+} exec_sched_t;
+
+/* Resource limits applied in the child with setrlimit (see `ulimit`).
+   Values are in base units: seconds, bytes, descriptor count, bytes. */
+enum { EXEC_RLIM_CPU, EXEC_RLIM_AS, EXEC_RLIM_NOFILE, EXEC_RLIM_CORE, EXEC_RLIM_COUNT };
+#define EXEC_RLIM_UNLIMITED (~0ULL)
+typedef struct exec_limits {
+    bool               set[EXEC_RLIM_COUNT];
+    unsigned long long value[EXEC_RLIM_COUNT];
+} exec_limits_t;
+
+/* Descriptor wiring for a child: an ordered list of dup2/close steps,
+   computed once in the parent by exec_fdplan_build() and replayed by
+   exec_fdplan_apply() in the child with no allocation. */
+#define EXEC_FDPLAN_STEPS 48
+#define EXEC_FDPLAN_MAXFD 64        // redirectable descriptors are 0..63
+typedef enum { FDSTEP_DUP2, FDSTEP_CLOSE, FDSTEP_KEEP } exec_fdstep_kind_t;
+typedef struct {
+    unsigned char kind;             // FDSTEP_*; KEEP = clear FD_CLOEXEC on dst
+    int src, dst;
+} exec_fdstep_t;
+typedef struct exec_fdplan {
+    int                nsteps;
+    exec_fdstep_t      steps[EXEC_FDPLAN_STEPS];
+    unsigned long long targets;     // bit N: plan sets or closes fd N
+    unsigned long long keep;        // bit N: fd N is open after the plan
+    int                fd_ceiling;  // highest fd the plan touches (incl. scratch)
+} exec_fdplan_t;
+
+/* Requested final state: 'dst' refers to what parent fd 'src' refers to
+   right now (src == -1: 'dst' closed). Each dst appears at most once. */
+typedef struct { int dst, src; } exec_fdmove_t;
+
+/* Order the moves so no source is clobbered before it is read, breaking
+   cycles through a scratch fd. Identity moves cost nothing (or one
+   FD_CLOEXEC clear). Returns 0, or -1 if the plan does not fit. */
+int  exec_fdplan_build(exec_fdplan_t *plan, const exec_fdmove_t *moves, int n);
+void exec_fdplan_apply(const exec_fdplan_t *plan);
+/* Child only: close every fd >= 3 the plan did not leave open. */
+void exec_fdplan_close_rest(const exec_fdplan_t *plan);
+
 /* Options for launching a single command (stdio wiring + bg/fg).
    Use -1 to inherit the shell's current fd for any stream.
-   Note: err_fd is reserved; we don't parse 2> yet. */
+   When fdplan is set it replaces in_fd/out_fd/err_fd entirely. */
 typedef struct exec_opts {
     int  in_fd;       // -1 = inherit STDIN
     int  out_fd;      // -1 = inherit STDOUT
     int  err_fd;      // -1 = inherit STDERR
     bool background;  // true = do not wait in launcher
+    const exec_sched_t *sched; // NULL = inherit affinity/nice/policy
+    const exec_limits_t *limits; // NULL = session limits only
+    const exec_fdplan_t *fdplan; // NULL = plan built from in/out/err_fd
+    char *const *env; // 'nenv' "NAME=value" words layered over environ (see env.h)
+    int  nenv;
 } exec_opts_t;
 
+/* Session-wide limits: applied to every child run_command() starts,
+   underneath any per-launch exec_opts_t.limits. The shell itself keeps
+   its own limits, so a runaway job cannot take the shell down with it. */
+void exec_session_limit_set(int which, unsigned long long value);
+void exec_session_limit_clear(int which);
+const exec_limits_t *exec_session_limits(void);
+
 /* Execute a full pipeline (already parsed).
    Returns 0 on success, non-zero on failure. */
 int exec_pipeline(const pipeline_t *pl);
 
+/* Same, for the last command of a run that exits with its status (`-c`,
+   a script's final command): a single foreground external command replaces
+   the shell instead of being forked, so it keeps the shell's PID and its
+   exit status is the process's. Anything else (builtins, pipelines, `&`,
+   `timeout`, background jobs still to reap, transcript/jsonl/trace
+   recording) goes through exec_pipeline(), whose result is returned. */
+int exec_pipeline_final(const pipeline_t *pl);
+
 /* Person A launcher (implemented elsewhere; do not implement in Person B).
    - abs_path must be absolute OR contain '/' (no PATH search via execvp).
    - argv is NULL-terminated (argv[0] = program).
    - If opts->background == true: parent does NOT wait; out_pid gets child PID.
    - If opts->background == false: waits; out_status gets waitpid() status.
+   - opts->env assignments reach the child through execve; the shell's
+     environment is untouched.
    Returns 0 on success, -1 on fork/exec/wait errors. */
 int run_command(const char *abs_path,
                 char *const argv[],
@@ -35,6 +109,33 @@ int run_command(const char *abs_path,
                 pid_t *out_pid,
                 int *out_status);
 
+/* Child-side half of run_command(): wire fds per 'plan', close the rest,
+   apply sched and limits (session limits underneath), then execve (envp)
+   or execv (NULL envp). Never returns; 126 = setup failed, 127 = exec failed. */
+void exec_child(const char *path, char *const argv[], char *const envp[],
+                const exec_fdplan_t *plan, const exec_sched_t *sched,
+                const exec_limits_t *limits) __attribute__((noreturn));
+
+/* Session limits overlaid with 'launch' (may be NULL): what a child gets. */
+void exec_limits_effective(const exec_limits_t *launch, exec_limits_t *out);
+
+/* Words of a stage as the command sees them (see pipeline_exec.c): glob
+   words become their sorted matches, other words get ~ / $VAR expansion
+   when 'words' is set. Returns a malloc'd NULL-terminated argv, or NULL. */
+char **exec_expand_argv(char *const argv[], char *const glob[], bool words);
+
+/* PATH search for a command name (run_command() uses execv, not execvp).
+   Names containing '/' are returned as-is. Returns a malloc'd path or NULL. */
+char *resolve_cmd_path(const char *cmd);
+
+/* Close every descriptor >= lowfd (close_range, with a loop fallback).
+   Used in children once stdio is wired. */
+void exec_close_fds_from(int lowfd);
+
+/* pidfd for a child (readable once it exits, close-on-exec), or -1 on
+   kernels without pidfd_open; callers fall back to polling. */
+int exec_pidfd_open(pid_t pid);
+
 /* Convenience wait wrapper for a single foreground child. */
 int wait_for_child(pid_t pid, int *out_status);
 
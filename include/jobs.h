@@ -1,4 +1,6 @@
 #pragma once
+#include <poll.h>
+#include <stdio.h>
 #include <sys/types.h>
 
 /* Initialize the job table. Call once at startup. */
@@ -15,15 +17,66 @@ int  jobs_next_id(void);
  *
  * On registration, prints:   [Job] PID
  * On completion (reaped), prints: [Job] + done CMDLINE
+ * (or "+ timeout" when a `timeout` prefix stopped it)
  */
 
 void jobs_register(int job_id, pid_t pid, const char *cmdline);
 
-/* Non-blocking reap; call once per REPL tick to print completed jobs. */
+/*
+ * Job slots: at most N background jobs run at once (default = online CPUs).
+ * Launches beyond the limit are queued with jobs_enqueue() and started in
+ * job-id order as running jobs are reaped.
+ */
+typedef int  (*job_launch_fn)(void *ctx, pid_t *out_pid); /* 0 on success */
+typedef void (*job_free_fn)(void *ctx);
+
+/* n <= 0 restores the default (online CPUs). */
+void jobs_set_slots(int n);
+int  jobs_get_slots(void);
+int  jobs_running_count(void);
+int  jobs_queued_count(void);
+
+/* 1 if a background job may start right now without exceeding the limit. */
+int  jobs_slot_available(void);
+
+/* Queue a job; 'launch' is called later with 'ctx', which the table owns
+   (freed with 'ctx_free' once launched or dropped). Returns 0, or -1 if full. */
+int  jobs_enqueue(int job_id, const char *cmdline,
+                  job_launch_fn launch, void *ctx, job_free_fn ctx_free);
+
+/* Record that 'pid' was reaped by someone else (e.g. a builtin's own
+   waitpid(-1) loop). Prints the completion notice if it was a job's PID.
+   Returns 1 if it matched a job, 0 otherwise. */
+int  jobs_notify_exit(pid_t pid, int status);
+
+/* Non-blocking reap; call once per REPL tick to print completed jobs.
+   Also starts queued jobs whose slot has freed up. */
 void jobs_mark_done_nonblocking(void);
 
+/* pidfds (POLLIN once the job exits) for up to 'max' running jobs, for a
+   caller that sleeps in its own poll(); the caller closes them. Sets
+   *fallback if some running job is not covered (then poll with a timeout).
+   Returns how many were filled in. */
+int  jobs_pollfds(struct pollfd *pf, int max, int *fallback);
+
+/* Job id for "%N", or for a PID (the last stage's); -1 if no such job.
+   Finished jobs are found as long as their table slot is not reused. */
+int  jobs_lookup(const char *spec);
+
+/*
+ * Block until the jobs 'ids' (every active job when n == 0) have finished
+ * and return the exit status of the last one listed (0 when n == 0; 127
+ * for an unknown id). With 'any': until the first of those still running
+ * finishes; its id goes to *which, and 127 means nothing was running.
+ * Sleeps in poll() on the jobs' pidfds, so it wakes as a child exits.
+ */
+int  jobs_wait(const int *ids, int n, int any, int *which);
+
 /* Block until all active background jobs complete (used by builtin exit). */
 void jobs_wait_all(void);
 
 /* Print active background jobs for the `jobs` builtin. */
-void jobs_print_active(void);
\ No newline at end of file
+void jobs_print_active(void);
+/* Same, to 'out'; only reads the table (safe from a pipeline thread
+   while the shell waits on the other stages). */
+void jobs_fprint_active(FILE *out);
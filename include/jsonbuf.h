@@ -0,0 +1,36 @@
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * A growable buffer that JSON records are formatted into (the transcript,
+ * `--jsonl` and trace writers share it).
+ *
+ * The text is kept NUL-terminated. If growing it fails the buffer stops
+ * taking text and 'failed' stays set until jsonbuf_reset(): the caller
+ * drops the record it was building rather than write a truncated one.
+ */
+typedef struct {
+    char  *p;
+    size_t len, cap;
+    bool   failed;
+} jsonbuf_t;
+
+void jsonbuf_put(jsonbuf_t *b, const char *s, size_t n);
+void jsonbuf_printf(jsonbuf_t *b, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+/* 's' as a quoted JSON string */
+void jsonbuf_str(jsonbuf_t *b, const char *s);
+
+/* Cut the text back to 'len' bytes and clear 'failed'; the memory stays. */
+void jsonbuf_reset(jsonbuf_t *b, size_t len);
+
+void jsonbuf_free(jsonbuf_t *b);
+
+#ifdef __cplusplus
+}
+#endif
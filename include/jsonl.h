@@ -0,0 +1,77 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/resource.h>
+#include <sys/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * jsonl_run() (`shell --jsonl` in the unbuilt src/main.c): a line protocol
+ * for programs driving the shell.
+ *
+ * Every input line is run as a script line (so `a; b`, `&&`, `if ...; fi`
+ * work) and the shell answers with JSON records, one per line, with no
+ * prompt and no `[N] + done` notices on the protocol stream:
+ *
+ *   {"ev":"start","seq":1,"cmd":"grep x f | wc -l"}
+ *   {"ev":"run","seq":1,"cmd":"grep x f | wc -l","pids":[812,813],
+ *    "status":[0,0],"ms":2.104,"user_ms":0.912,"sys_ms":0.770}
+ *   {"ev":"end","seq":1,"status":0,"ms":2.311}
+ *   {"ev":"bg","seq":2,"cmd":"make &","job":1,"pids":[820]}
+ *   {"ev":"job","job":1,"pid":820,"status":0,"ms":5210.007,
+ *    "user_ms":4100.250,"sys_ms":390.118,"maxrss_kb":81234}
+ *
+ * seq numbers input lines from 1. "run" is a foreground pipeline (a line
+ * may hold several): a pid is null for a stage that ran inside the shell,
+ * a status is the exit code, 128+N for signal N, or -1 if the stage never
+ * started; user_ms/sys_ms are what its children used. "bg" is a
+ * background launch ("queued":true and no pids while it waits for a job
+ * slot), "job" its completion, whenever that happens. "end" closes a line
+ * with its $?. At end of input the shell waits for its jobs, so every
+ * "bg" gets its "job" before the stream ends; `exit N` ends it early.
+ *
+ * The protocol fds are the shell's own: if the input is fd 0, commands
+ * get /dev/null as stdin, and if the records go to fd 1, commands' stdout
+ * goes to fd 2. A controller may pipeline any number of lines: records
+ * are collected in memory and written when no further input is waiting,
+ * so a burst of N lines costs a handful of write(2)s, and a lone line is
+ * answered at once.
+ */
+#define JSONL_BUF_FLUSH (64 * 1024)     /* write out once this much is held */
+
+/* Read lines from 'in_fd' and write records to 'out_fd' until end of
+   input or `exit`. Returns the last line's $? (N for `exit N`). */
+int  jsonl_run(int in_fd, int out_fd);
+
+bool jsonl_active(void);
+
+/* ---- records (no-ops unless jsonl_run() is active) ---- */
+
+/* Foreground pipeline finished. 'pids' entries <= 0 are null; 'ru' (may
+   be NULL) is the children's usage over the run. */
+void jsonl_pipeline(const char *cmd, const pid_t *pids, const int *status, int n,
+                    int64_t ns, const struct rusage *ru);
+
+/* Background launch: started ('n' pids) or queued (n == 0, 'queued'). */
+void jsonl_bg(const char *cmd, int job, const pid_t *pids, int n, bool queued);
+
+/* Background job reaped; 'ru' (may be NULL) from wait4(). */
+void jsonl_job(int job, pid_t pid, int status, int64_t ns, const struct rusage *ru);
+
+/* ---- used by jsonl_run() (src/jsonl_run.c) ---- */
+
+/* Start collecting records for 'out_fd' / write out what is held / stop. */
+void jsonl_begin(int out_fd);
+void jsonl_flush(void);
+void jsonl_end(void);
+
+/* Line 'seq' starts / ended with 'status' after 'ns'. */
+void jsonl_start(long seq, const char *cmd);
+void jsonl_line_end(long seq, int status, int64_t ns);
+
+#ifdef __cplusplus
+}
+#endif
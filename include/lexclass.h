@@ -0,0 +1,53 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Character classes for the lexer (src/parser.c), from one 256-entry
+ * table instead of isspace() (which follows the locale) and a chain of
+ * comparisons per byte.
+ *
+ * A word character is any byte with no class bit; lexclass_span() finds
+ * how many of them start a string, 16 or 32 at a time:
+ *   AVX2  two vpshufb nibble lookups classify 32 bytes exactly
+ *   SSE2  16 bytes against the 13 delimiters (compare chain)
+ *   scalar  the table, one byte at a time
+ * The widest the CPU supports is picked on first use. Loads are aligned,
+ * so the scan may read past the terminating NUL but never into the next
+ * page.
+ */
+enum {
+    LEX_C_SPACE = 0x01,     /* ' ' \t \n \v \f \r (isspace() in the C locale) */
+    LEX_C_OP    = 0x02,     /* < > | & */
+    LEX_C_QUOTE = 0x04,     /* " ' */
+    LEX_C_ESC   = 0x08,     /* \ */
+    LEX_C_GLOB  = 0x10,     /* * ? [ : the word becomes a glob pattern */
+    LEX_C_NUL   = 0x20,
+};
+#define LEX_C_STOP  0xFF    /* any class: ends a run of word characters */
+
+extern const uint8_t lex_class[256];
+
+static inline int lex_is_space(int c) { return lex_class[(unsigned char)c] & LEX_C_SPACE; }
+
+/* Number of word characters (class 0) at the start of 's'. */
+size_t lexclass_span(const char *s);
+
+/* Implementations, for tests and benchmarks. LEX_SCAN_BYTE turns the fast
+   path off: the lexer goes back to copying one character per step. */
+typedef enum {
+    LEX_SCAN_AUTO, LEX_SCAN_BYTE, LEX_SCAN_SCALAR, LEX_SCAN_SSE2, LEX_SCAN_AVX2
+} lex_scan_t;
+
+/* Use 'impl' from now on (AUTO: the best available). Returns the one in
+   effect, which is a narrower one if the CPU lacks 'impl'. */
+lex_scan_t lexclass_force(lex_scan_t impl);
+const char *lexclass_name(lex_scan_t impl);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,71 @@
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Allocation profiling for the shell core.
+ *
+ * Hot-path allocations go through ms_malloc() and friends, tagged with the
+ * call site category they serve. Off (the default), each is the libc call
+ * plus one flag test. On (`memstats on`, or SHELL_MEMSTATS=1 at startup),
+ * every tagged block is entered in a pointer table so its category can
+ * be credited when ms_free() releases it: per category we keep allocation
+ * count, bytes requested, live bytes and peak live bytes, and the same
+ * counts for the last top-level command: everything from the end of
+ * the command before it (so its parsing too) to the end of its
+ * exec_pipeline().
+ *
+ * ms_free() of an untagged pointer is a plain free(); a tagged block
+ * released with plain free() stays "live" until its address is reused.
+ */
+typedef enum {
+    MS_LEX,         /* token text and glob patterns */
+    MS_PARSE,       /* stages, argv/glob arrays, redirections */
+    MS_ENV,         /* $VAR expansion of parsed words */
+    MS_ARGV,        /* exec_expand_argv(), expand_arg() */
+    MS_GLOB,        /* pathglob matches and walk state */
+    MS_JOIN,        /* argv_join(), transcript text */
+    MS_REDIR,       /* redirection paths (maybe_map_to_repo) */
+    MS_EXEC,        /* per-pipeline pids/pipes/clocks, PATH lookup, envp */
+    MS_SCRIPT,      /* script images, interpreter frames */
+    MS_NSITES
+} ms_site_t;
+
+void *ms_malloc(ms_site_t site, size_t n);
+void *ms_calloc(ms_site_t site, size_t count, size_t n);
+void *ms_realloc(ms_site_t site, void *p, size_t n);
+char *ms_strdup(ms_site_t site, const char *s);
+void  ms_free(void *p);
+
+void ms_enable(bool on);
+bool ms_enabled(void);
+void ms_reset(void);
+
+/* Bracket one command's execution; nested pairs are ignored. */
+void ms_command_begin(void);
+void ms_command_end(void);
+
+typedef struct {
+    uint64_t allocs, bytes;
+    int64_t  live, peak;        /* a command's live can go negative */
+} ms_counts_t;
+
+/* Totals (last == false) or the last finished command's delta. */
+ms_counts_t ms_get(ms_site_t site, bool last);
+
+/*
+ * memstats [-r] [on | off]
+ *   Table of allocations, bytes, live and peak bytes per category, with
+ *   the previous command's allocations and bytes; on/off switches
+ *   profiling (counts start at zero when turned on), -r clears them.
+ */
+int builtin_memstats(char *const argv[]);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,20 @@
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * parallel [-j N] [-k] CMD [ARG...] [::: INPUT...]
+ *
+ * Runs CMD once per INPUT (or per stdin line when ':::' is absent), at most
+ * N at a time (default: job slots). '{}' in CMD/ARGs is replaced by the
+ * input; without '{}' the input is appended as the last argument.
+ * -k buffers each task's stdout and prints it in input order.
+ * Returns 0 if every task exited 0, else the number of failed tasks (max 100).
+ */
+int builtin_parallel(char *const argv[]);
+
+#ifdef __cplusplus
+}
+#endif
@@ -12,6 +12,10 @@ typedef enum {
     TK_LT,    // <
     TK_GT,    // >
     TK_DGT,   // >>
+    TK_LTAMP, // <&  (dup/close input fd)
+    TK_GTAMP, // >&  (dup/close output fd)
+    TK_AMPGT, // &>  (stdout+stderr, truncate)
+    TK_AMPDGT,// &>> (stdout+stderr, append)
     TK_BAR,   // |
     TK_AMP,   // & (must be trailing; applies to whole pipeline)
     TK_EOL,   // end of line/input
@@ -22,18 +26,40 @@ typedef enum {
 typedef struct {
     token_kind_t kind;
     char *lexeme;          // NULL unless kind == TK_WORD
+    char *pattern;         // TK_WORD with an unquoted * ? [ : glob pattern, quoted
+                           // characters backslash-escaped (malloc'd); else NULL
+    int   fd;              // explicit fd before a redirection ("2>"), else -1
 } token_t;
 
-// Per-command (stage) redirections
+// One redirection, applied left to right like sh: "N<path", "N>path",
+// "N>>path", "N>&M" / "N<&M" (dup), "N>&-" (close).
+typedef enum {
+    REDIR_IN,              // fd <- open(path, O_RDONLY)
+    REDIR_OUT,             // fd <- open(path, O_TRUNC)
+    REDIR_APPEND,          // fd <- open(path, O_APPEND)
+    REDIR_DUP,             // fd <- whatever src_fd refers to at that point
+    REDIR_CLOSE            // fd closed
+} redir_kind_t;
+
+typedef struct {
+    redir_kind_t kind;
+    int   fd;              // target descriptor
+    int   src_fd;          // REDIR_DUP only
+    char *path;            // REDIR_IN/OUT/APPEND only
+} redir_op_t;
+
+// Per-command (stage) redirections, in source order
 typedef struct {
-    char *in_path;         // for '<'  (nullable)
-    char *out_path;        // for '>'  (truncate; nullable)
-    char *append_path;     // for '>>' (append; nullable)
+    redir_op_t *ops;
+    int         nops;
 } redir_t;
 
 // One pipeline stage: argv + redirections
 typedef struct {
     char **argv;           // NULL-terminated; argv[0] is the program
+    char **glob;           // parallel to argv: glob[i] is argv[i]'s pattern or NULL
+                           // for a literal word; the array is NULL if no word globs.
+                           // Expanded against the filesystem at exec time.
     redir_t redir;         // redirection info
 } cmd_t;
 
@@ -47,9 +73,24 @@ typedef struct {
 // Parse a command line into a pipeline AST. Returns 0 on success, nonzero on syntax error.
 int parse_line(const char *line, pipeline_t *out);
 
+// Same, but leaves $VAR in words unexpanded: for bodies that are parsed once
+// and run many times, expanded per run with pipeline_expand_env().
+int parse_line_raw(const char *line, pipeline_t *out);
+
+// Expand $VAR in every word (and glob pattern) of 'pl' in place.
+void pipeline_expand_env(pipeline_t *pl);
+
 // Free all allocations inside 'out' (safe to call on a zeroed struct).
 void free_pipeline(pipeline_t *pl);
 
+// Deep-copy 'src' into 'dst' (free with free_pipeline). Returns 0 on success.
+int pipeline_dup(const pipeline_t *src, pipeline_t *dst);
+
+// Number of leading NAME=value words in argv: the stage's environment
+// assignments ("CC=gcc make"), which the executor peels off before the
+// command word. All of argv may be assignments.
+int argv_assignments(char *const argv[]);
+
 // Join argv into a printable string (caller frees).
 char *argv_join(char *const argv[]);
 
@@ -0,0 +1,37 @@
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Pathname expansion: '*', '?', '[...]' (with '!'/'^' negation and
+ * ranges) and '**' (any depth of directories, not following symlinks).
+ * Patterns come from the lexer with quoted metacharacters backslash-escaped.
+ * A leading '.' in a name must be matched explicitly; "." and ".." never
+ * match. A trailing '/' only matches directories.
+ */
+typedef struct {
+    char  **v;      // malloc'd paths
+    size_t  n, cap;
+} pathglob_list_t;
+
+/* Append the matches of 'pattern' to 'out', sorted bytewise. Returns the
+   number added (0 = no match), or -1 on allocation failure. */
+long pathglob_expand(const char *pattern, pathglob_list_t *out);
+void pathglob_list_free(pathglob_list_t *l);
+
+/* Does one path component 'name' match 'pat'? (no '/' handling) */
+bool pathglob_match(const char *pat, const char *name);
+
+/* Threads for '**' walks; 0 = online CPUs (capped at 16). */
+void pathglob_set_threads(int n);
+
+/* Sort paths bytewise (multikey quicksort: shared prefixes compared once). */
+void pathglob_sort(char **v, size_t n);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,44 @@
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * read [-r] [-d DELIM] [-u FD] [NAME...]
+ *
+ * Reads one line (up to DELIM, default newline) from FD (default 0) and
+ * splits it on $IFS into the NAMEs, the last one taking the rest of the
+ * line (no NAME: all of it goes to REPLY). Without -r a backslash quotes
+ * the next character and backslash-newline continues the line. Status 1
+ * at end of input (a partial last line is still assigned), 2 on a usage
+ * error.
+ *
+ * Input is read a block at a time and what follows the line waits in a
+ * per-fd buffer for the next `read`. Whatever else could read the fd must
+ * see those bytes first, so they are handed back before the shell forks
+ * (readbuf_sync_all()) and before it rewires the fd (readbuf_release()):
+ *   regular files, block devices  lseek() back over them;
+ *   pipes, FIFOs                  blocks are peeked with tee() into a
+ *                                 private pipe, and only the bytes used
+ *                                 are taken from the real one;
+ *   anything else (ttys, sockets) one byte per read(2).
+ * Blocks restart at READBUF_MIN after a hand-back and double up to
+ * READBUF_MAX, so a loop that forks on every line does not pull a large
+ * block for each one.
+ */
+#define READBUF_MIN 128
+#define READBUF_MAX 65536
+
+/* Hand back every fd's unread bytes (before a fork, and at exit). */
+void readbuf_sync_all(void);
+
+/* Hand back 'fd's unread bytes and forget what it refers to (before the
+   shell dup2()s over it). */
+void readbuf_release(int fd);
+
+int builtin_read(char *const argv[]);
+
+#ifdef __cplusplus
+}
+#endif
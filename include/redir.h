@@ -0,0 +1,44 @@
+#pragma once
+#include "parser.h"
+#include "exec.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Parent-side state for one stage's redirections: the descriptors the
+   shell opened for it plus the dup2 plan that wires them into the child. */
+#define REDIR_MAX_OPEN 16
+typedef struct {
+    exec_fdplan_t plan;
+    int           owned[REDIR_MAX_OPEN]; // fds opened here (O_CLOEXEC)
+    int           nowned;
+} redir_stage_t;
+
+/*
+ * Open every file in 'r' (creating missing parent dirs for > and >>),
+ * resolve the list left to right on top of the pipe ends (-1 = none),
+ * and build the stage's minimal dup2 plan. Returns 0, or -1 after
+ * printing the error (nothing left open).
+ */
+int  redir_prepare(const redir_t *r, int pipe_in, int pipe_out, redir_stage_t *st);
+
+/* Close the shell's copies once the child has been started. */
+void redir_release(redir_stage_t *st);
+
+/* open(path, flags | O_CLOEXEC, 0644), creating missing parent directories
+   (cached, so repeated targets under the same tree cost one open). */
+int  open_redir_target(const char *path, int flags);
+
+/* Run a plan in the shell itself (builtins): apply it, saving every fd it
+   touches into 'saved' (indexed by fd); redir_restore() undoes it. */
+int  redir_apply_saved(const exec_fdplan_t *plan, int saved[EXEC_FDPLAN_MAXFD]);
+void redir_restore(const exec_fdplan_t *plan, int saved[EXEC_FDPLAN_MAXFD]);
+
+/* Apply the plan in the shell for good (`exec` with only redirections),
+   then release the stage: the fds it opened survive only as their targets. */
+void redir_apply_keep(redir_stage_t *st);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,26 @@
+#pragma once
+#include "exec.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * ulimit [-t SECS] [-v KIB] [-n FILES] [-c KIB] [CMD [ARG...]]
+ *
+ * Without CMD: show or set session-wide limits for every command the
+ * shell launches (the shell's own limits are left alone).
+ * With CMD: the limits apply to that command only (a stage prefix).
+ * Values may be "unlimited". They set the soft limit, capped at the hard
+ * one, which is never changed: a command can raise a limit back itself.
+ */
+int builtin_ulimit(char *const argv[]);
+
+/* Stage prefix form. Merges the limits into 'out' and returns the number
+   of argv words consumed; 0 if argv is not "ulimit ... CMD", -1 on a usage
+   error (message already printed). */
+int rlimits_parse_prefix(char *const argv[], exec_limits_t *out);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,65 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Compiled shell scripts with control flow:
+ *
+ *   if LIST; then LIST; [elif LIST; then LIST;]... [else LIST;] fi
+ *   while LIST; do LIST; done          until LIST; do LIST; done
+ *   for NAME in WORD...; do LIST; done
+ *   NAME() { LIST; }                   { LIST; }
+ *   CMD && CMD    CMD || CMD           break [N]  continue [N]  return [N]
+ *
+ * Commands are separated by ';' or newlines; '#' starts a comment.
+ * A script is compiled once into a flat array of uint32 records plus a
+ * string table (layout in src/script.c). The interpreter walks those
+ * records in place, so loop and function bodies are never re-parsed, and
+ * the same image can be written to disk and mapped back (see source.c).
+ * $VAR in words is expanded each time the command runs; the loop variable
+ * and function arguments ($1, $2, ...) are environment variables.
+ */
+typedef struct script script_t;
+
+/* Compile 'text' (len bytes, modified in place). A script with a syntax
+   error still compiles: running it reports the error. NULL only on OOM. */
+script_t *script_compile(char *text, size_t len);
+
+/* Wrap a stored image (w[nw], s[ns]) without copying. On success the script
+   owns 'map' (munmap'd on the last release); NULL if the records are
+   malformed, in which case the caller keeps 'map'. */
+script_t *script_from_image(const uint32_t *w, size_t nw, const char *s, size_t ns,
+                            void *map, size_t maplen);
+
+/* Functions defined by a script keep it alive after the caller releases it. */
+void script_retain(script_t *sc);
+void script_release(script_t *sc);
+
+/* The image, for writing it out. */
+const uint32_t *script_words(const script_t *sc, size_t *nw);
+const char     *script_strings(const script_t *sc, size_t *ns);
+uint32_t        script_ncmds(const script_t *sc);   /* simple commands, for logs */
+
+/* Run; 'file' names the script in messages. Returns the last status, 2 on a
+   syntax error, or 2001+N after `exit N` (like the exit builtin). */
+int script_run(script_t *sc, const char *file);
+
+/* Report a syntax error without running anything: 2 if there was one, else 0. */
+int script_check(const script_t *sc, const char *file);
+
+/* Compile and run 'text' in one go. */
+int script_run_text(const char *text);
+
+/* Same, for a process that exits with the result (`-c`, a server worker):
+   a simple external command the script ends on (last in the list, or on
+   the taken side of a final if / && / ||) is exec'd in place of the
+   process, see exec_pipeline_final(). Returns only when it was not. */
+int script_run_text_final(const char *text);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,80 @@
+#pragma once
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Shell server: one long-lived shell runs commands for many clients.
+ *
+ * `serve SOCKET` listens on a SOCK_SEQPACKET Unix socket. Each request
+ * carries a command text, the cwd to run it in, NAME=value overrides and
+ * (SCM_RIGHTS) the stdin, stdout and stderr it should use. The server
+ * forks a worker per request, which takes those fds, chdir()s, applies
+ * the overrides and runs the text through the script interpreter (so
+ * exec_pipeline() for each command, with `;`, `&&`, `if`, ... as in a
+ * script); the reply is its exit status. Requests on different
+ * connections run concurrently; a connection carries one at a time, so a
+ * client reuses it for the next command. Workers are reaped through
+ * pidfds. SIGINT or SIGTERM stops the server, removes the socket and
+ * returns 0 from `serve`.
+ *
+ * A request runs anything as the server's owner, so only that user may
+ * connect: the socket is mode 0600, and a connection whose SO_PEERCRED uid
+ * is not the server's effective uid is closed unread.
+ *
+ * Against a fresh `sh -c` per command, a request skips exec, dynamic
+ * linking and shell start-up: a warm, small process forks instead.
+ * bin/shc is the client: `shc SOCKET [NAME=value...] COMMAND`.
+ */
+#define SERVER_MAGIC    0x31565348u     /* "SHV1" */
+#define SERVER_MSG_MAX  65536           /* header + strings */
+#define SERVER_MAX_CONN 256
+
+/* Request: this header then 'len' bytes: cwd, command, env[nenv]
+   ("NAME=value"), each NUL-terminated, in one message. */
+typedef struct {
+    uint32_t magic;
+    uint32_t len;
+    uint32_t nenv;
+    uint32_t reserved;
+} server_req_t;
+
+/* Reply: $? of the command (128+N if a signal ended the worker), or -1
+   with 'err' set if the request was refused. */
+typedef struct {
+    int32_t status;
+    int32_t err;
+} server_rep_t;
+
+/* ---- server (src/server.c) ---- */
+
+/* Serve on 'path' until SIGINT/SIGTERM. Returns 0, or -1 if it could not
+   listen. */
+int server_run(const char *path);
+
+/* serve SOCKET */
+int builtin_serve(char *const argv[]);
+
+/* ---- client (src/server_client.c, libc only) ---- */
+
+/* Connected socket, or -1. */
+int server_connect(const char *path);
+
+/* Send one request; 'fds' are the command's stdin, stdout, stderr.
+   Returns 0, or -1 with errno set (E2BIG: it does not fit a message). */
+int server_send(int sock, const char *cmd, const char *cwd,
+                char *const env[], int nenv, const int fds[3]);
+
+/* Wait for the reply to the request in flight: its status, or -1 with
+   errno set. */
+int server_recv(int sock);
+
+/* server_send() then server_recv(). */
+int server_call(int sock, const char *cmd, const char *cwd,
+                char *const env[], int nenv, const int fds[3]);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,27 @@
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Bump whenever the compiled script format or the cache layout changes; cache
+   files written by another version are ignored and rewritten. */
+#define SOURCE_CACHE_VERSION 3
+
+/*
+ * source [-n] FILE   (also spelled ". FILE")
+ *
+ * Runs FILE in the current shell, control flow included (see script.h).
+ * The compiled form is cached on disk under $SHELL_CACHE_DIR (default
+ * ${XDG_CACHE_HOME:-$HOME/.cache}/shell), keyed
+ * by the script's path, size, mtime and SOURCE_CACHE_VERSION, and is
+ * memory-mapped on later loads instead of re-parsing. -n loads the script
+ * (filling the cache) without running it.
+ * Returns the status of the last command, 2 on a syntax error, 1 if FILE
+ * can't be read.
+ */
+int builtin_source(char *const argv[]);
+
+#ifdef __cplusplus
+}
+#endif
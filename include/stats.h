@@ -0,0 +1,57 @@
+#pragma once
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Per-command latency statistics for the session.
+ *
+ * Each command name (basename of argv[0]) gets, in fixed memory:
+ *   spawn  launch call until the child exists (fork, or the zygote round
+ *          trip): the parent-side cost that grows with the shell's RSS
+ *   run    launch until the foreground command is reaped (builtins: the
+ *          call itself)
+ *   exits  exit code counts (0..255) plus deaths by signal
+ * Histograms are log-linear: 16 linear sub-buckets per power of two, so a
+ * reported percentile is within 1/16 (6.25%) of the true value. Values are
+ * nanoseconds. The table holds STATS_MAX_CMDS names; later names share one
+ * "(other)" row. Recording is two clock reads and a few increments.
+ */
+#define STATS_MAX_CMDS  128
+#define STATS_NAME_MAX  32
+
+typedef enum { STATS_SPAWN, STATS_RUN, STATS_NMETRICS } stats_metric_t;
+
+/* Exit statuses for stats_exit(): 0..255, or STATS_SIGNALED(sig). */
+#define STATS_SIGNALED(sig) (256 + (sig))
+
+uint64_t stats_now(void);                        /* CLOCK_MONOTONIC, ns */
+
+/* 'name' may be a path; only its last component is used. */
+void stats_spawn(const char *name, uint64_t ns);
+void stats_exit(const char *name, uint64_t run_ns, int status);
+/* Same, from a waitpid() status. */
+void stats_exit_wait(const char *name, uint64_t run_ns, int wstatus);
+
+/* Value at percentile p (0..100) of a command's metric, as the upper edge
+   of its bucket (exact for the max). 0 if nothing was recorded. */
+uint64_t stats_percentile(const char *name, stats_metric_t m, double p);
+
+void stats_reset(void);
+
+/*
+ * stats [-r] [--csv] [NAME...]
+ *   Table of count, spawn and run p50/p90/p99/max and failures per command
+ *   (or just NAMEs, with their exit distribution). --csv dumps the raw
+ *   non-empty buckets instead:
+ *     command,metric,lo_ns,hi_ns,count      metric = spawn | run
+ *     command,exit,CODE,,count               CODE = 0..255 or SIGnum
+ *   -r clears everything after printing.
+ */
+int builtin_stats(char *const argv[]);
+
+#ifdef __cplusplus
+}
+#endif
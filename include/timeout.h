@@ -0,0 +1,55 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * timeout [-s SIG] [-k GRACE] DURATION CMD [ARG...]
+ *
+ * Stage prefix on the first stage of a pipeline; covers every stage.
+ * When DURATION runs out the shell itself sends SIG (default TERM) to
+ * the stages still running, then KILL after GRACE (default 2s; -k 0
+ * never escalates). No helper process: a foreground pipeline is waited
+ * on through pidfds with poll(), a background one is handed to a
+ * watchdog thread. A pipeline stopped this way exits TIMEOUT_STATUS.
+ *
+ * Durations are decimal numbers with an optional ms, s (default), m, h
+ * or d suffix: "0.5", "250ms", "2m".
+ */
+#define TIMEOUT_STATUS        124
+#define TIMEOUT_GRACE_DEFAULT (2 * 1000000000LL)
+
+typedef struct exec_timeout {
+    int64_t ns;             /* run time allowed */
+    int64_t grace_ns;       /* SIG -> KILL; 0 = never KILL */
+    int     sig;
+} exec_timeout_t;
+
+/* "1.5", "200ms", ... -> nanoseconds. Returns 0, or -1 if malformed. */
+int timeout_parse_duration(const char *s, int64_t *ns);
+
+/* Prefix form: fills 'out' and returns the number of argv words consumed,
+   0 if argv[0] is not "timeout", -1 on a usage error (message printed). */
+int timeout_parse_prefix(char *const argv[], exec_timeout_t *out);
+
+/* Foreground: reap all 'n' children, enforcing 't'. status[i] receives
+   each wait status (-1 if it could not be reaped). Returns 1 if the
+   deadline fired, 0 if everything finished in time. */
+int timeout_wait(const pid_t *pids, int n, const exec_timeout_t *t, int *status);
+
+/* Background: the watchdog enforces 't' on 'pids' from now on. The job is
+   keyed by its last pid, which the job table reaps; pidfds keep a stage
+   that was reaped early from having its pid reused under the signal. */
+int timeout_watch(const pid_t *pids, int n, const exec_timeout_t *t);
+
+/* Job table hook once 'pid' has been reaped: drops its watch, and returns
+   true if the deadline fired (the job gets TIMEOUT_STATUS). */
+bool timeout_reaped(pid_t pid);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,55 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Execution timeline in Chrome trace-event JSON (opens in Perfetto or
+ * chrome://tracing).
+ *
+ * Off by default. `trace FILE` (or SHELL_TRACE=FILE at startup) starts
+ * recording; `trace -c` stops and writes FILE. Events are fixed-size
+ * records claimed with one atomic add in a preallocated buffer, so an
+ * event costs a clock read and a memcpy; the JSON is only produced when
+ * the trace is written. A full buffer drops events (and says so in the
+ * file's metadata) rather than growing.
+ *
+ * Tracks: the shell's own (parse, resolve, spawn, wait), one per child
+ * pid (its lifetime, launch to reap, named after the command) and one per
+ * pipeline thread running a builtin stage.
+ */
+#define TRACE_EVENTS_DEFAULT (1u << 16)
+#define TRACE_DETAIL_MAX     48
+
+typedef enum {
+    TRACE_PARSE,        /* parse_line() */
+    TRACE_RESOLVE,      /* resolve_cmd_path() */
+    TRACE_SPAWN,        /* run_command(): launch until the child exists */
+    TRACE_WAIT,         /* foreground wait for a command or pipeline */
+    TRACE_STAGE,        /* a stage's lifetime, on its own track */
+    TRACE_JOB,          /* a background job's lifetime, on its own track */
+    TRACE_NKINDS
+} trace_kind_t;
+
+bool trace_active(void);
+
+/* One complete event from t0 to t1 (stats_now() ns). 'track' is 0 for the
+   shell's own track, else a child pid or thread id. 'detail' (may be NULL)
+   is copied, truncated to TRACE_DETAIL_MAX - 1 bytes. */
+void trace_event(trace_kind_t kind, uint64_t t0, uint64_t t1, int track, const char *detail);
+
+/* Start recording into a buffer of 'cap' events (0: the default), written
+   to 'path' by trace_close() (also at exit). */
+int  trace_open(const char *path, uint32_t cap);
+/* Stop and write the file. Returns 0, or -1 if it could not be written. */
+int  trace_close(void);
+
+/* trace [FILE | -c]: start, stop and write, or show the state. */
+int builtin_trace(char *const argv[]);
+
+#ifdef __cplusplus
+}
+#endif
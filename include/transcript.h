@@ -0,0 +1,57 @@
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Session transcript: one JSON object per line, appended to a log file.
+ *
+ *   {"ts":"2026-01-02T03:04:05.678Z","event":"run","cwd":"/home/op",
+ *    "cmd":"grep x f | wc -l","job":null,"status":[0,1],"ms":3.250}
+ *
+ * event is "run" (foreground, status per stage), "bg" (background launch
+ * or queued, status null) or "done" (background job reaped; status is
+ * its last stage). A status is the exit code, 128+N for signal N, or -1
+ * if the stage never started.
+ *
+ * Recording only formats into memory: records go into one of two
+ * fixed-size buffers and a writer thread appends the other to the file
+ * when the first is half full or after TRANSCRIPT_FLUSH_MS without one.
+ * The prompt never waits for the disk; if the writer falls behind and
+ * both buffers are full, records are dropped and the next one written is
+ * preceded by {"event":"dropped","count":N}.
+ */
+#define TRANSCRIPT_BUF_DEFAULT  (256 * 1024)   /* per buffer; two are used */
+#define TRANSCRIPT_FLUSH_MS     250
+
+/* Start logging to 'path' (O_APPEND, created 0600), replacing any current
+   transcript. 'bufsize' 0 = TRANSCRIPT_BUF_DEFAULT. Returns 0 or -1. */
+int  transcript_open(const char *path, size_t bufsize);
+
+/* Write out everything recorded so far and stop. */
+void transcript_close(void);
+
+/* Block until everything recorded so far is in the file. */
+void transcript_flush(void);
+
+bool transcript_active(void);
+
+/* Queue one record. 'status' has 'nstatus' entries (NULL: null), 'job' <= 0
+   is null, 'ns' < 0 leaves out the duration. Never blocks on I/O. */
+void transcript_record(const char *event, const char *cmd, int job,
+                       const int *status, int nstatus, int64_t ns);
+
+/*
+ * transcript [FILE | -c | -f]
+ *   FILE starts logging there, -c stops, -f flushes; no argument prints
+ *   the file, record/byte counts and drops.
+ */
+int builtin_transcript(char *const argv[]);
+
+#ifdef __cplusplus
+}
+#endif
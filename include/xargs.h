@@ -0,0 +1,24 @@
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * xargs [-0] [-r] [-n MAX] [-s SIZE] [-P N] [CMD [ARG...]] [::: ITEM...]
+ *
+ * Runs CMD ARG... with as many ITEMs appended as fit in one exec: items
+ * are packed until argv + environment would exceed ARG_MAX (less 2 KiB
+ * headroom), -s SIZE bytes, or -n MAX items. Items come after ':::' or
+ * from stdin, split on blanks/newlines (no quote processing) or on NULs
+ * with -0; commands get /dev/null as stdin in that case. -P runs up to N
+ * batches at once (0 = job slots). -r skips the run when there are no
+ * items. CMD defaults to echo.
+ * Returns 0, 123 if any batch exited non-zero, 125 if one was killed,
+ * 127 if CMD is not found, 1 on errors (e.g. an item too long to exec).
+ */
+int builtin_xargs(char *const argv[]);
+
+#ifdef __cplusplus
+}
+#endif
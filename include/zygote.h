@@ -0,0 +1,34 @@
+#pragma once
+#include <stdbool.h>
+#include <sys/types.h>
+#include "exec.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Optional fork server for run_command().
+ *
+ * zygote_start() forks a small helper that keeps only its end of a Unix
+ * socketpair. run_command() then ships each launch to it (path, argv,
+ * environment, sched/limits, and the child's stdio/redirect fds plus the
+ * shell's cwd via SCM_RIGHTS); the helper clones the command with
+ * CLONE_PARENT, so it is still the shell's child for waitpid()/jobs and
+ * only the helper's tiny address space is copied. Start it early, before
+ * the shell grows. If the helper is gone, run_command() forks as before.
+ */
+int  zygote_start(void);        // 0 on success (or already running), -1 on error
+void zygote_stop(void);
+bool zygote_active(void);
+
+/* Launch through the helper. Returns the child's PID, or -1 with errno set
+   (the caller falls back to fork). 'envp' NULL = the shell's environ;
+   'plan' is in shell fd numbers. */
+pid_t zygote_spawn(const char *path, char *const argv[], char *const envp[],
+                   const exec_fdplan_t *plan,
+                   const exec_sched_t *sched, const exec_limits_t *limits);
+
+#ifdef __cplusplus
+}
+#endif
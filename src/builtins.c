@@ -1,5 +1,17 @@
 #define _POSIX_C_SOURCE 200809L
 #include "builtins.h"
+#include "exec.h"
+#include "jobs.h"
+#include "parallel.h"
+#include "rlimits.h"
+#include "source.h"
+#include "memstats.h"
+#include "trace.h"
+#include "readbuf.h"
+#include "server.h"
+#include "stats.h"
+#include "transcript.h"
+#include "xargs.h"
 
 #include <errno.h>
 #include <limits.h>
@@ -7,6 +19,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
 // --- cd --------------------------------------------------------------------
@@ -23,18 +36,20 @@ static int bi_cd(char *const argv[]) {
     return 0;
 }
 
-static int bi_pwd(char *const argv[]) {
+static int bi_pwd_to(char *const argv[], FILE *out) {
     (void)argv;  // unused
     char buf[PATH_MAX];
     if (!getcwd(buf, sizeof(buf))) {
         perror("pwd");
         return 1;
     }
-    printf("%s\n", buf);
-    fflush(stdout);
+    fprintf(out, "%s\n", buf);
+    fflush(out);
     return 0;
 }
 
+static int bi_pwd(char *const argv[]) { return bi_pwd_to(argv, stdout); }
+
 static int bi_exit(char *const argv[]) {
     int code = 0;
     if (argv[1]) {
@@ -43,20 +58,247 @@ static int bi_exit(char *const argv[]) {
     return 2001 + (code & 0xFF);
 }
 
+// --- exec ------------------------------------------------------------------
+// exec CMD [ARG...]: this process becomes CMD. As a whole command the
+// pipeline executor handles it (prefixes, redirections, replacing the shell
+// itself); what reaches here is a pipeline stage's child.
+static int bi_exec(char *const argv[]) {
+    if (!argv[1]) return 0;
+    char *path = resolve_cmd_path(argv[1]);
+    if (!path) {
+        fprintf(stderr, "exec: %s: not found\n", argv[1]);
+        return 127;
+    }
+    readbuf_sync_all();
+    fflush(NULL);
+    execv(path, argv + 1);
+    int err = errno;
+    fprintf(stderr, "exec: %s: %s\n", path, strerror(err));
+    ms_free(path);
+    return err == ENOENT ? 127 : 126;
+}
+
+// --- jobs ------------------------------------------------------------------
+static int bi_jobs(char *const argv[]) {
+    (void)argv;
+    jobs_print_active();
+    jobs_mark_done_nonblocking();
+    return 0;
+}
+
+// Pipeline-thread form: list only; reaping there would steal the stages' children
+static int bi_jobs_to(char *const argv[], FILE *out) {
+    (void)argv;
+    jobs_fprint_active(out);
+    return 0;
+}
+
+// wait [-n] [%JOB | PID ...]: block until the jobs finish (-n: the first
+// of them); status of the last one listed, or of the one that finished
+static int bi_wait(char *const argv[]) {
+    int i = 1, any = 0;
+    if (argv[i] && strcmp(argv[i], "-n") == 0) { any = 1; i++; }
+    int n = 0;
+    while (argv[i + n]) n++;
+
+    int *ids = n ? (int *)malloc((size_t)n * sizeof(int)) : NULL;
+    if (n && !ids) { perror("wait: malloc"); return 1; }
+    int nids = 0, last_unknown = 0;
+    for (int k = 0; k < n; ++k) {
+        int id = jobs_lookup(argv[i + k]);
+        last_unknown = id < 0;
+        if (id < 0) fprintf(stderr, "wait: %s: no such job\n", argv[i + k]);
+        else ids[nids++] = id;
+    }
+    int rc = n && !nids ? 127 : jobs_wait(ids, nids, any, NULL);
+    if (!any && last_unknown) rc = 127;
+    free(ids);
+    return rc;
+}
+
+// jobslots [N]: show or set the background job-slot limit (0 = online CPUs)
+static int bi_jobslots(char *const argv[]) {
+    if (argv[1]) {
+        char *end = NULL;
+        long n = strtol(argv[1], &end, 10);
+        if (!end || *end || n < 0 || n > INT_MAX) {
+            fprintf(stderr, "jobslots: invalid slot count: %s\n", argv[1]);
+            return 1;
+        }
+        jobs_set_slots((int)n);
+        jobs_mark_done_nonblocking();   /* a larger limit may start queued jobs */
+        return 0;
+    }
+    printf("%d slots, %d running, %d queued\n",
+           jobs_get_slots(), jobs_running_count(), jobs_queued_count());
+    fflush(stdout);
+    return 0;
+}
+
+// --- true / false / test ---------------------------------------------------
+static int bi_true(char *const argv[])  { (void)argv; return 0; }
+static int bi_false(char *const argv[]) { (void)argv; return 1; }
+
+static bool test_int(const char *s, long *out) {
+    char *end = NULL;
+    errno = 0;
+    *out = strtol(s, &end, 10);
+    return *s && !*end && errno == 0;
+}
+
+/* Unary test "OP ARG": 0/1, or -1 if OP isn't a unary operator. */
+static int test_unary(const char *op, const char *arg) {
+    struct stat st;
+    if (strcmp(op, "-n") == 0) return *arg ? 0 : 1;
+    if (strcmp(op, "-z") == 0) return *arg ? 1 : 0;
+    if (strcmp(op, "-e") == 0) return stat(arg, &st) == 0 ? 0 : 1;
+    if (strcmp(op, "-f") == 0) return stat(arg, &st) == 0 && S_ISREG(st.st_mode) ? 0 : 1;
+    if (strcmp(op, "-d") == 0) return stat(arg, &st) == 0 && S_ISDIR(st.st_mode) ? 0 : 1;
+    return -1;
+}
+
+/* Binary test "A OP B": 0/1, 2 on a bad integer, -1 if OP isn't binary. */
+static int test_binary(const char *a, const char *op, const char *b) {
+    if (strcmp(op, "=") == 0)  return strcmp(a, b) == 0 ? 0 : 1;
+    if (strcmp(op, "!=") == 0) return strcmp(a, b) != 0 ? 0 : 1;
+    static const char *const ops[] = { "-eq", "-ne", "-lt", "-le", "-gt", "-ge" };
+    for (int k = 0; k < 6; ++k) {
+        if (strcmp(op, ops[k]) != 0) continue;
+        long x, y;
+        if (!test_int(a, &x) || !test_int(b, &y)) {
+            fprintf(stderr, "test: integer expression expected\n");
+            return 2;
+        }
+        bool r = k == 0 ? x == y : k == 1 ? x != y : k == 2 ? x < y
+               : k == 3 ? x <= y : k == 4 ? x > y : x >= y;
+        return r ? 0 : 1;
+    }
+    return -1;
+}
+
+/* POSIX test by argument count: 0-3 arguments, '!' negates the rest. */
+static int test_eval(char *const *a, int n) {
+    if (n == 0) return 1;
+    if (strcmp(a[0], "!") == 0 && n > 1) {
+        int r = test_eval(a + 1, n - 1);
+        return r == 2 ? 2 : !r;
+    }
+    if (n == 1) return *a[0] ? 0 : 1;
+    if (n == 2) {
+        int r = test_unary(a[0], a[1]);
+        if (r >= 0) return r;
+    } else if (n == 3) {
+        int r = test_binary(a[0], a[1], a[2]);
+        if (r >= 0) return r;
+    }
+    fprintf(stderr, "test: unsupported expression\n");
+    return 2;
+}
+
+// test EXPR / [ EXPR ]: 0 true, 1 false, 2 error
+static int bi_test(char *const argv[]) {
+    int n = 0;
+    while (argv[n + 1]) n++;
+    if (strcmp(argv[0], "[") == 0) {
+        if (n == 0 || strcmp(argv[n], "]") != 0) {
+            fprintf(stderr, "[: missing ']'\n");
+            return 2;
+        }
+        n--;
+    }
+    return test_eval(argv + 1, n);
+}
+
+typedef struct {
+    const char *name;
+    int (*fn)(char *const argv[]);
+} builtin_t;
+
+static const builtin_t BUILTINS[] = {
+    { "cd",       bi_cd },
+    { "pwd",      bi_pwd },
+    { "exit",     bi_exit },
+    { "exec",     bi_exec },
+    { "jobs",     bi_jobs },
+    { "jobslots", bi_jobslots },
+    { "wait",     bi_wait },
+    { "parallel", builtin_parallel },
+    { "ulimit",   builtin_ulimit },
+    { "source",   builtin_source },
+    { ".",        builtin_source },
+    { "xargs",    builtin_xargs },
+    { "stats",    builtin_stats },
+    { "transcript", builtin_transcript },
+    { "memstats", builtin_memstats },
+    { "trace",    builtin_trace },
+    { "read",     builtin_read },
+    { "serve",    builtin_serve },
+    { "true",     bi_true },
+    { ":",        bi_true },
+    { "false",    bi_false },
+    { "test",     bi_test },
+    { "[",        bi_test },
+};
+
+/*
+ * Builtins with an output-only form: no stdin, no shell state, output only
+ * through 'out'. In a foreground pipeline these run on a thread writing
+ * straight into the stage's pipe instead of in a forked child.
+ */
+typedef struct {
+    const char *name;
+    int (*to)(char *const argv[], FILE *out);
+} builtin_to_t;
+
+static int bi_true_to(char *const argv[], FILE *out)  { (void)out; return bi_true(argv); }
+static int bi_false_to(char *const argv[], FILE *out) { (void)out; return bi_false(argv); }
+static int bi_test_to(char *const argv[], FILE *out)  { (void)out; return bi_test(argv); }
+
+static const builtin_to_t BUILTINS_TO[] = {
+    { "pwd",   bi_pwd_to },
+    { "jobs",  bi_jobs_to },
+    { "true",  bi_true_to },
+    { ":",     bi_true_to },
+    { "false", bi_false_to },
+    { "test",  bi_test_to },
+    { "[",     bi_test_to },
+};
+
+static const builtin_to_t *find_builtin_to(const char *cmd) {
+    if (!cmd) return NULL;
+    for (size_t i = 0; i < sizeof(BUILTINS_TO)/sizeof(BUILTINS_TO[0]); ++i) {
+        if (strcmp(cmd, BUILTINS_TO[i].name) == 0) return &BUILTINS_TO[i];
+    }
+    return NULL;
+}
+
+bool builtin_has_thread_form(const char *cmd) {
+    return find_builtin_to(cmd) != NULL;
+}
+
+int run_builtin_to(char *const argv[], FILE *out) {
+    const builtin_to_t *b = argv ? find_builtin_to(argv[0]) : NULL;
+    return b ? b->to(argv, out) : 127;
+}
+
+static const builtin_t *find_builtin(const char *cmd) {
+    if (!cmd) return NULL;
+    for (size_t i = 0; i < sizeof(BUILTINS)/sizeof(BUILTINS[0]); ++i) {
+        if (strcmp(cmd, BUILTINS[i].name) == 0) return &BUILTINS[i];
+    }
+    return NULL;
+}
+
 bool is_builtin(const char *cmd) {
-    if (!cmd) return false;
-    return strcmp(cmd, "cd") == 0 ||
-           strcmp(cmd, "pwd") == 0 ||
-           strcmp(cmd, "exit") == 0;
+    return find_builtin(cmd) != NULL;
 }
 
 int run_builtin_parent(char *const argv[]) {
     if (!argv || !argv[0]) return 0;
 
-    if (strcmp(argv[0], "cd") == 0)   return bi_cd(argv);
-    if (strcmp(argv[0], "pwd") == 0)  return bi_pwd(argv);
-    if (strcmp(argv[0], "exit") == 0) return bi_exit(argv);
+    const builtin_t *b = find_builtin(argv[0]);
+    if (b) return b->fn(argv);
 
     // Not a builtin—should not get here if caller checks is_builtin().
     return 127;
-}
\ No newline at end of file
+}
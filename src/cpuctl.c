@@ -0,0 +1,115 @@
+// src/cpuctl.c — `on` prefix: CPU affinity, nice level and scheduling policy
+#define _GNU_SOURCE             /* SCHED_BATCH, SCHED_IDLE */
+#define _POSIX_C_SOURCE 200809L
+#include "cpuctl.h"
+
+#include <limits.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define WORD_BITS (8 * sizeof(unsigned long))
+
+static void on_usage(void) {
+    fprintf(stderr, "usage: on [-n NICE] [-s POLICY[:PRIO]] [CPUS] CMD [ARG...]\n");
+}
+
+static int parse_int(const char *s, long lo, long hi, int *out) {
+    char *end = NULL;
+    long v = strtol(s, &end, 10);
+    if (!s[0] || !end || *end || v < lo || v > hi) return -1;
+    *out = (int)v;
+    return 0;
+}
+
+/* "0-3,6" -> bitmask. Returns -1 if 's' is not a CPU list. */
+static int parse_cpu_list(const char *s, unsigned long mask[EXEC_CPU_WORDS]) {
+    memset(mask, 0, EXEC_CPU_WORDS * sizeof(unsigned long));
+    if (!*s) return -1;
+    while (*s) {
+        char *end = NULL;
+        if (*s < '0' || *s > '9') return -1;
+        long lo = strtol(s, &end, 10), hi = lo;
+        if (*end == '-') {
+            s = end + 1;
+            if (*s < '0' || *s > '9') return -1;
+            hi = strtol(s, &end, 10);
+        }
+        if (lo > hi || hi >= EXEC_MAX_CPUS) return -1;
+        for (long c = lo; c <= hi; ++c) mask[c / WORD_BITS] |= 1UL << (c % WORD_BITS);
+        s = end;
+        if (*s == ',') s++;
+        else if (*s) return -1;
+    }
+    return 0;
+}
+
+static int parse_policy(const char *s, exec_sched_t *out) {
+    char name[16];
+    const char *colon = strchr(s, ':');
+    size_t n = colon ? (size_t)(colon - s) : strlen(s);
+    if (n == 0 || n >= sizeof(name)) return -1;
+    memcpy(name, s, n);
+    name[n] = '\0';
+
+    if      (strcmp(name, "other") == 0) out->policy = SCHED_OTHER;
+#ifdef SCHED_BATCH
+    else if (strcmp(name, "batch") == 0) out->policy = SCHED_BATCH;
+#endif
+#ifdef SCHED_IDLE
+    else if (strcmp(name, "idle")  == 0) out->policy = SCHED_IDLE;
+#endif
+    else if (strcmp(name, "fifo")  == 0) out->policy = SCHED_FIFO;
+    else if (strcmp(name, "rr")    == 0) out->policy = SCHED_RR;
+    else return -1;
+
+    out->rt_priority = 0;
+    if (out->policy == SCHED_FIFO || out->policy == SCHED_RR) {
+        int lo = sched_get_priority_min(out->policy);
+        int hi = sched_get_priority_max(out->policy);
+        out->rt_priority = lo;
+        if (colon && parse_int(colon + 1, lo, hi, &out->rt_priority) != 0) return -1;
+    } else if (colon) {
+        return -1;  /* priorities only apply to real-time policies */
+    }
+    return 0;
+}
+
+int cpuctl_parse_on(char *const argv[], exec_sched_t *out) {
+    if (!argv || !argv[0] || strcmp(argv[0], "on") != 0) return 0;
+
+    memset(out, 0, sizeof(*out));
+    out->policy = -1;
+
+    int i = 1;
+    for (; argv[i] && argv[i][0] == '-' && argv[i][1]; ++i) {
+        if (strcmp(argv[i], "-n") == 0 && argv[i + 1]) {
+            if (parse_int(argv[++i], -20, 19, &out->nice) != 0) {
+                fprintf(stderr, "on: bad nice level: %s\n", argv[i]);
+                return -1;
+            }
+            out->has_nice = true;
+        } else if (strcmp(argv[i], "-s") == 0 && argv[i + 1]) {
+            if (parse_policy(argv[++i], out) != 0) {
+                fprintf(stderr, "on: bad scheduling policy: %s\n", argv[i]);
+                return -1;
+            }
+        } else {
+            on_usage();
+            return -1;
+        }
+    }
+
+    /* Optional CPU list: only taken if the word looks like one. */
+    if (argv[i] && parse_cpu_list(argv[i], out->affinity) == 0) {
+        out->has_affinity = true;
+        i++;
+    }
+
+    if (!argv[i]) { on_usage(); return -1; }
+    fprintf(stderr, "[on] affinity=%d nice=%s%d policy=%d prio=%d -> '%s'\n",
+            out->has_affinity, out->has_nice ? "" : "(inherit)", out->nice,
+            out->policy, out->rt_priority, argv[i]);
+    return i;
+}
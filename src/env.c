@@ -0,0 +1,295 @@
+// src/env.c — cached envp for execve() and `NAME=value cmd` overlays
+#define _DEFAULT_SOURCE             /* putenv */
+#define _POSIX_C_SOURCE 200809L
+#include "env.h"
+#include "memstats.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+extern char **environ;
+
+/* Copy of environ: v[0..n) point into 'block'; 'slot' maps a name hash to
+   index + 1 (0 = empty), open addressing over a power-of-two table. */
+static struct {
+    char    **v;
+    size_t    n;
+    char     *block;
+    uint32_t *slot;
+    size_t    nslots;
+    char    **base;                 /* environ when built */
+    bool      stale;
+    uint64_t  rebuilds;
+} E = { .stale = true };
+
+static pthread_mutex_t env_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static uint32_t name_hash(const char *s, size_t len) {
+    uint32_t h = 2166136261u;                   /* FNV-1a */
+    for (size_t i = 0; i < len; ++i) h = (h ^ (unsigned char)s[i]) * 16777619u;
+    return h;
+}
+
+static size_t entry_name_len(const char *e) {
+    const char *eq = strchr(e, '=');
+    return eq ? (size_t)(eq - e) : strlen(e);
+}
+
+size_t env_assign_name_len(const char *w) {
+    if (!w || !((*w >= 'A' && *w <= 'Z') || (*w >= 'a' && *w <= 'z') || *w == '_')) return 0;
+    size_t i = 1;
+    while ((w[i] >= 'A' && w[i] <= 'Z') || (w[i] >= 'a' && w[i] <= 'z') ||
+           (w[i] >= '0' && w[i] <= '9') || w[i] == '_') i++;
+    return w[i] == '=' ? i : 0;
+}
+
+#define ENV_NAME_MAX 256
+
+/* NAME of an assignment word into 'name' (ENV_NAME_MAX bytes); 0 if 'w' is
+   not one or the name is too long. */
+static size_t word_name(const char *w, char *name) {
+    size_t len = env_assign_name_len(w);
+    if (!len || len >= ENV_NAME_MAX) return 0;
+    memcpy(name, w, len);
+    name[len] = '\0';
+    return len;
+}
+
+/* Index of 'name' in v[] through its slot table, or -1. */
+static long lookup(char *const *v, const uint32_t *slot, size_t nslots,
+                   const char *name, size_t len) {
+    for (size_t i = name_hash(name, len) & (nslots - 1);; i = (i + 1) & (nslots - 1)) {
+        uint32_t s = slot[i];
+        if (s == 0) return -1;
+        const char *e = v[s - 1];
+        if (strncmp(e, name, len) == 0 && e[len] == '=') return (long)s - 1;
+    }
+}
+
+static int rebuild(void) {
+    size_t n = 0, bytes = 0;
+    for (char **e = environ; e && *e; ++e) { n++; bytes += strlen(*e) + 1; }
+    size_t nslots = 16;
+    while (nslots < 2 * n) nslots *= 2;
+
+    char **v = (char **)malloc((n + 1) * sizeof(char *));
+    char *block = (char *)malloc(bytes ? bytes : 1);
+    uint32_t *slot = (uint32_t *)calloc(nslots, sizeof(uint32_t));
+    if (!v || !block || !slot) {
+        perror("env: malloc");
+        free(v); free(block); free(slot);
+        return -1;
+    }
+    char *p = block;
+    size_t k = 0;
+    for (char **e = environ; e && *e; ++e) {
+        size_t len = entry_name_len(*e);
+        if (lookup(v, slot, nslots, *e, len) >= 0) continue;   /* first wins, as getenv */
+        v[k] = p;
+        p = stpcpy(p, *e) + 1;
+        size_t i = name_hash(*e, len) & (nslots - 1);
+        while (slot[i]) i = (i + 1) & (nslots - 1);
+        slot[i] = (uint32_t)(k + 1);
+        k++;
+    }
+    v[k] = NULL;
+
+    free(E.block);
+    free(E.v);
+    free(E.slot);
+    E.v = v;
+    E.n = k;
+    E.block = block;
+    E.slot = slot;
+    E.nslots = nslots;
+    E.base = environ;
+    E.stale = false;
+    E.rebuilds++;
+    fprintf(stderr, "[env] rebuilt envp: %zu vars, %zu bytes\n", k, bytes);
+    return 0;
+}
+
+static void mark_stale(void) {
+    pthread_mutex_lock(&env_lock);
+    E.stale = true;
+    pthread_mutex_unlock(&env_lock);
+}
+
+/* "NAME=value" strings env_set() puts in environ itself. setenv() keeps a
+   copy of every value it is ever given, so a loop assigning a new value
+   per line would grow without bound; these two buffers per name take
+   turns instead (the one not in environ is rewritten, so a getenv()
+   result survives the next set). While environ[slot] is still ours the
+   new string is swapped into it directly; otherwise putenv() finds it. */
+typedef struct {
+    char  *buf[2];
+    size_t cap[2];
+    int    cur;                     /* buf[cur] was put in environ last */
+    char **base;                    /* ... at base[slot] (environ then) */
+    size_t slot;
+} owned_var_t;
+
+static owned_var_t *Own;
+static size_t       nown, capown;
+
+static owned_var_t *owned_find(const char *name, size_t len, bool add) {
+    for (size_t i = 0; i < nown; ++i) {
+        const char *s = Own[i].buf[Own[i].cur];
+        if (strncmp(s, name, len) == 0 && s[len] == '=') return &Own[i];
+    }
+    if (!add) return NULL;
+    if (nown == capown) {
+        size_t cap = capown ? capown * 2 : 8;
+        owned_var_t *n = (owned_var_t *)realloc(Own, cap * sizeof(*n));
+        if (!n) return NULL;
+        Own = n;
+        capown = cap;
+    }
+    memset(&Own[nown], 0, sizeof(Own[nown]));
+    Own[nown].cur = 1;
+    return &Own[nown++];
+}
+
+int env_set(const char *name, const char *value) {
+    size_t len = strlen(name), vlen = strlen(value);
+    if (!len || strchr(name, '=')) return setenv(name, value, 1);   /* EINVAL */
+    owned_var_t *o = owned_find(name, len, true);
+    int rc;
+    if (!o) {
+        rc = setenv(name, value, 1);
+    } else {
+        int k = !o->cur;
+        if (o->cap[k] < len + vlen + 2) {
+            size_t cap = len + vlen + 2 > 32 ? len + vlen + 2 : 32;
+            char *b = (char *)realloc(o->buf[k], cap);
+            if (!b) {
+                if (!o->buf[!k]) nown--;
+                return -1;
+            }
+            o->buf[k] = b;
+            o->cap[k] = cap;
+        }
+        memcpy(o->buf[k], name, len);
+        o->buf[k][len] = '=';
+        memcpy(o->buf[k] + len + 1, value, vlen + 1);
+        /* The array only moves when it grows, and unsetenv() shifts
+           entries down within it: the same base keeps base[slot] valid */
+        if (o->buf[!k] && o->base && environ == o->base && environ[o->slot] == o->buf[!k]) {
+            environ[o->slot] = o->buf[k];
+            rc = 0;
+        } else {
+            rc = putenv(o->buf[k]);
+            o->base = NULL;
+            for (size_t i = 0; rc == 0 && environ[i]; ++i)
+                if (environ[i] == o->buf[k]) { o->base = environ; o->slot = i; break; }
+        }
+        if (rc == 0) {
+            o->cur = k;
+        } else if (!o->buf[!k]) {       /* new name that never made it in */
+            free(o->buf[k]);
+            nown--;
+        }
+    }
+    mark_stale();
+    return rc;
+}
+
+int env_unset(const char *name) {
+    int rc = unsetenv(name);
+    owned_var_t *o = owned_find(name, strlen(name), false);
+    if (o) {
+        free(o->buf[0]);
+        free(o->buf[1]);
+        *o = Own[--nown];
+    }
+    mark_stale();
+    return rc;
+}
+
+void env_assign(char *const assign[], int n) {
+    char name[ENV_NAME_MAX];
+    for (int k = 0; assign && k < n; ++k) {
+        size_t len = word_name(assign[k], name);
+        if (len) setenv(name, assign[k] + len + 1, 1);
+    }
+    mark_stale();
+}
+
+char **env_launch(char *const assign[], int n) {
+    if (!assign || n <= 0) return NULL;
+    pthread_mutex_lock(&env_lock);
+    if ((E.stale || E.base != environ) && rebuild() != 0) {
+        pthread_mutex_unlock(&env_lock);
+        return NULL;
+    }
+    char **out = (char **)ms_malloc(MS_EXEC, (E.n + (size_t)n + 1) * sizeof(char *));
+    if (!out) {
+        pthread_mutex_unlock(&env_lock);
+        perror("env: malloc");
+        return NULL;
+    }
+    memcpy(out, E.v, E.n * sizeof(char *));
+    size_t m = E.n;
+    for (int k = 0; k < n; ++k) {
+        size_t len = env_assign_name_len(assign[k]);
+        if (!len) continue;
+        long at = lookup(E.v, E.slot, E.nslots, assign[k], len);
+        if (at < 0) {
+            /* New name: appended, unless an earlier word already added it */
+            for (size_t j = E.n; j < m; ++j)
+                if (strncmp(out[j], assign[k], len + 1) == 0) { at = (long)j; break; }
+        }
+        if (at >= 0) out[at] = assign[k];
+        else         out[m++] = assign[k];
+    }
+    out[m] = NULL;
+    pthread_mutex_unlock(&env_lock);
+    return out;
+}
+
+char **env_push(char *const assign[], int n) {
+    if (!assign || n <= 0) return NULL;
+    /* Undo entries, newest first: "NAME=old" to restore, "NAME" to unset */
+    char **saved = (char **)calloc((size_t)n + 1, sizeof(char *));
+    if (!saved) { perror("env: malloc"); return NULL; }
+    int ns = 0;
+    char name[ENV_NAME_MAX];
+    for (int k = 0; k < n; ++k) {
+        size_t len = word_name(assign[k], name);
+        if (!len) continue;
+        const char *old = getenv(name);
+        size_t sz = len + (old ? strlen(old) + 2 : 1);
+        char *undo = (char *)malloc(sz);
+        if (!undo) break;
+        if (old) snprintf(undo, sz, "%s=%s", name, old);
+        else     memcpy(undo, name, len + 1);
+        memmove(saved + 1, saved, (size_t)ns * sizeof(char *));
+        saved[0] = undo;
+        ns++;
+        setenv(name, assign[k] + len + 1, 1);
+    }
+    mark_stale();
+    return saved;
+}
+
+void env_pop(char **saved) {
+    if (!saved) return;
+    for (char **u = saved; *u; ++u) {
+        char *eq = strchr(*u, '=');
+        if (eq) { *eq = '\0'; setenv(*u, eq + 1, 1); }
+        else    unsetenv(*u);
+        free(*u);
+    }
+    free(saved);
+    mark_stale();
+}
+
+uint64_t env_rebuilds(void) {
+    pthread_mutex_lock(&env_lock);
+    uint64_t n = E.rebuilds;
+    pthread_mutex_unlock(&env_lock);
+    return n;
+}
@@ -1,6 +1,13 @@
 // src/exec.c
+#define _GNU_SOURCE             /* sched_setaffinity, CPU_SET */
 #define _POSIX_C_SOURCE 200809L
 #include "exec.h"
+#include "zygote.h"
+#include "stats.h"
+#include "env.h"
+#include "memstats.h"
+#include "trace.h"
+#include "readbuf.h"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -12,13 +19,224 @@
 #include <ctype.h>
 #include <pwd.h>        /* getpwuid */
 #include <sys/types.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
 
-/* Apply caller-provided stdio fds (Person B passes them via exec_opts_t). */
-static void apply_fds(const exec_opts_t *o){
-    if (!o) return;
-    if (o->in_fd  >= 0)  { fprintf(stderr, "[exec] dup2(in_fd=%d -> 0)\n",  o->in_fd);  dup2(o->in_fd,  STDIN_FILENO); }
-    if (o->out_fd >= 0)  { fprintf(stderr, "[exec] dup2(out_fd=%d -> 1)\n", o->out_fd); dup2(o->out_fd, STDOUT_FILENO); }
-    if (o->err_fd >= 0)  { fprintf(stderr, "[exec] dup2(err_fd=%d -> 2)\n", o->err_fd); dup2(o->err_fd, STDERR_FILENO); }
+/* ----- descriptor plans ----- */
+static int fdplan_push(exec_fdplan_t *p, int kind, int src, int dst){
+    if (p->nsteps >= EXEC_FDPLAN_STEPS) return -1;
+    p->steps[p->nsteps].kind = (unsigned char)kind;
+    p->steps[p->nsteps].src = src;
+    p->steps[p->nsteps].dst = dst;
+    p->nsteps++;
+    if (dst > p->fd_ceiling) p->fd_ceiling = dst;
+    return 0;
+}
+
+/* Lowest fd >= from that is not open in this process. */
+static int free_fd_from(int from){
+    while (fcntl(from, F_GETFD) >= 0) from++;
+    return from;
+}
+
+int exec_fdplan_build(exec_fdplan_t *plan, const exec_fdmove_t *moves, int n){
+    memset(plan, 0, sizeof(*plan));
+    plan->fd_ceiling = -1;
+    if (n > EXEC_FDPLAN_MAXFD) return -1;
+
+    exec_fdmove_t pend[EXEC_FDPLAN_MAXFD];
+    int np = 0, hi = 2;
+    for (int i = 0; i < n; ++i){
+        int d = moves[i].dst, s = moves[i].src;
+        if (d < 0 || d >= EXEC_FDPLAN_MAXFD) return -1;
+        plan->targets |= 1ULL << d;
+        if (s >= 0) plan->keep |= 1ULL << d;
+        if (d > hi) hi = d;
+        if (s > hi) hi = s;
+        if (s == d){
+            /* Already in place; a shell-owned fd only needs CLOEXEC cleared */
+            int fl = fcntl(d, F_GETFD);
+            if (fl >= 0 && (fl & FD_CLOEXEC) && fdplan_push(plan, FDSTEP_KEEP, d, d) != 0) return -1;
+            continue;
+        }
+        pend[np++] = moves[i];
+    }
+
+    int scratch = -1;
+    while (np > 0){
+        /* Any move whose target no other pending move still reads from? */
+        int pick = -1;
+        for (int i = 0; i < np && pick < 0; ++i){
+            int busy = 0;
+            for (int j = 0; j < np; ++j)
+                if (j != i && pend[j].src == pend[i].dst){ busy = 1; break; }
+            if (!busy) pick = i;
+        }
+        if (pick >= 0){
+            int rc = pend[pick].src < 0 ? fdplan_push(plan, FDSTEP_CLOSE, -1, pend[pick].dst)
+                                        : fdplan_push(plan, FDSTEP_DUP2, pend[pick].src, pend[pick].dst);
+            if (rc != 0) return -1;
+            pend[pick] = pend[--np];
+            continue;
+        }
+        /* Only cycles left: park one target in a scratch fd and retarget its readers */
+        if (scratch < 0) scratch = free_fd_from(hi + 1);
+        int d = pend[0].dst;
+        if (fdplan_push(plan, FDSTEP_DUP2, d, scratch) != 0) return -1;
+        for (int j = 0; j < np; ++j) if (pend[j].src == d) pend[j].src = scratch;
+    }
+    if (scratch >= 0 && fdplan_push(plan, FDSTEP_CLOSE, -1, scratch) != 0) return -1;
+
+    fprintf(stderr, "[exec] fd plan:");
+    for (int i = 0; i < plan->nsteps; ++i){
+        const exec_fdstep_t *st = &plan->steps[i];
+        if (st->kind == FDSTEP_DUP2)       fprintf(stderr, " %d<-%d", st->dst, st->src);
+        else if (st->kind == FDSTEP_CLOSE) fprintf(stderr, " %d<&-", st->dst);
+        else                               fprintf(stderr, " keep:%d", st->dst);
+    }
+    fprintf(stderr, "\n");
+    return 0;
+}
+
+void exec_fdplan_apply(const exec_fdplan_t *plan){
+    if (!plan) return;
+    for (int i = 0; i < plan->nsteps; ++i){
+        const exec_fdstep_t *st = &plan->steps[i];
+        switch (st->kind){
+            case FDSTEP_DUP2:  dup2(st->src, st->dst); break;
+            case FDSTEP_CLOSE: close(st->dst); break;
+            case FDSTEP_KEEP:  fcntl(st->dst, F_SETFD, 0); break;
+        }
+    }
+}
+
+void exec_fdplan_close_rest(const exec_fdplan_t *plan){
+    int top = 2;
+    if (plan){
+        for (int fd = 3; fd < EXEC_FDPLAN_MAXFD; ++fd)
+            if (plan->keep & (1ULL << fd)) top = fd;
+        for (int fd = 3; fd < top; ++fd)
+            if (!(plan->keep & (1ULL << fd))) close(fd);
+    }
+    exec_close_fds_from(top + 1);
+}
+
+void exec_close_fds_from(int lowfd){
+#ifdef SYS_close_range
+    if (syscall(SYS_close_range, (unsigned)lowfd, ~0U, 0) == 0) return;
+#endif
+    long max = sysconf(_SC_OPEN_MAX);
+    if (max < 0 || max > 65536) max = 65536;
+    for (int fd = lowfd; fd < max; ++fd) close(fd);
+}
+
+int exec_pidfd_open(pid_t pid){
+#ifdef SYS_pidfd_open
+    return (int)syscall(SYS_pidfd_open, pid, 0);
+#else
+    (void)pid;
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+/* Apply CPU affinity, scheduling policy and nice level (child only).
+   Returns 0 on success, -1 after printing why. */
+static int apply_sched(const exec_sched_t *s){
+    if (!s) return 0;
+    if (s->has_affinity){
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (int cpu = 0; cpu < EXEC_MAX_CPUS && cpu < CPU_SETSIZE; ++cpu){
+            if (s->affinity[cpu / (8 * sizeof(unsigned long))] &
+                (1UL << (cpu % (8 * sizeof(unsigned long)))))
+                CPU_SET(cpu, &set);
+        }
+        if (sched_setaffinity(0, sizeof(set), &set) < 0){
+            perror("on: sched_setaffinity");
+            return -1;
+        }
+    }
+    if (s->policy >= 0){
+        struct sched_param sp = { .sched_priority = s->rt_priority };
+        if (sched_setscheduler(0, s->policy, &sp) < 0){
+            perror("on: sched_setscheduler");
+            return -1;
+        }
+    }
+    if (s->has_nice && setpriority(PRIO_PROCESS, 0, s->nice) < 0){
+        perror("on: setpriority");
+        return -1;
+    }
+    return 0;
+}
+
+/* ----- resource limits ----- */
+static exec_limits_t session_limits;
+
+void exec_session_limit_set(int which, unsigned long long value){
+    if (which < 0 || which >= EXEC_RLIM_COUNT) return;
+    session_limits.set[which] = true;
+    session_limits.value[which] = value;
+}
+
+void exec_session_limit_clear(int which){
+    if (which < 0 || which >= EXEC_RLIM_COUNT) return;
+    session_limits.set[which] = false;
+}
+
+const exec_limits_t *exec_session_limits(void){
+    return &session_limits;
+}
+
+void exec_limits_effective(const exec_limits_t *launch, exec_limits_t *out){
+    for (int r = 0; r < EXEC_RLIM_COUNT; ++r){
+        const exec_limits_t *src = (launch && launch->set[r]) ? launch : &session_limits;
+        out->set[r] = src->set[r];
+        out->value[r] = src->value[r];
+    }
+}
+
+/* Apply session limits overlaid with per-launch ones (child only). Only
+   the soft limit is set, clamped to the hard one: a value above it would
+   fail, and lowering the hard limit could never be undone by the command. */
+static int apply_limits(const exec_limits_t *launch){
+    static const int RES[EXEC_RLIM_COUNT] = {
+        [EXEC_RLIM_CPU] = RLIMIT_CPU, [EXEC_RLIM_AS] = RLIMIT_AS,
+        [EXEC_RLIM_NOFILE] = RLIMIT_NOFILE, [EXEC_RLIM_CORE] = RLIMIT_CORE,
+    };
+    exec_limits_t eff;
+    exec_limits_effective(launch, &eff);
+    for (int r = 0; r < EXEC_RLIM_COUNT; ++r){
+        if (!eff.set[r]) continue;
+        struct rlimit rl;
+        if (getrlimit(RES[r], &rl) < 0){
+            perror("ulimit: getrlimit");
+            return -1;
+        }
+        rlim_t want = eff.value[r] == EXEC_RLIM_UNLIMITED ? RLIM_INFINITY : (rlim_t)eff.value[r];
+        rl.rlim_cur = rl.rlim_max != RLIM_INFINITY && (want == RLIM_INFINITY || want > rl.rlim_max)
+                    ? rl.rlim_max : want;
+        if (setrlimit(RES[r], &rl) < 0){
+            perror("ulimit: setrlimit");
+            return -1;
+        }
+    }
+    return 0;
+}
+
+void exec_child(const char *path, char *const argv[], char *const envp[],
+                const exec_fdplan_t *plan, const exec_sched_t *sched,
+                const exec_limits_t *limits){
+    exec_fdplan_apply(plan);
+    exec_fdplan_close_rest(plan);   /* no stray shell fds in the command */
+    if (apply_sched(sched) != 0) _exit(126);
+    if (apply_limits(limits) != 0) _exit(126);
+    if (envp) execve(path, argv, envp);
+    else      execv(path, argv);    /* no execvp per project rules */
+    fprintf(stderr, "exec failed: %s: %s\n", path, strerror(errno));
+    _exit(127);
 }
 
 int wait_for_child(pid_t pid, int *out_status){
@@ -47,7 +265,7 @@ char *expand_arg(const char *arg) {
         }
         if (!home) home = "";
         size_t len = strlen(home) + strlen(arg);
-        char *res = (char*)malloc(len + 1);
+        char *res = (char*)ms_malloc(MS_ARGV, len + 1);
         if (!res) { perror("malloc"); return NULL; }
         strcpy(res, home);
         strcat(res, arg + 1);
@@ -64,14 +282,14 @@ char *expand_arg(const char *arg) {
         }
         var[i] = '\0';
         const char *val = getenv(var);
-        char *out = strdup(val ? val : "");
+        char *out = ms_strdup(MS_ARGV, val ? val : "");
         if (!out) { perror("strdup"); return NULL; }
         fprintf(stderr, "[exec] expand_arg: '%s' -> '%s' ($VAR)\n", arg, out);
         return out;
     }
 
     /* No expansion */
-    char *copy = strdup(arg);
+    char *copy = ms_strdup(MS_ARGV, arg);
     if (!copy) { perror("strdup"); return NULL; }
     fprintf(stderr, "[exec] expand_arg: '%s' (no change)\n", arg);
     return copy;
@@ -85,34 +303,68 @@ int run_command(const char *abs_path,
                 int *out_status)
 {
     if (!abs_path || !argv) { errno = EINVAL; return -1; }
+    readbuf_sync_all();         /* the child may read what `read` buffered */
 
-    fprintf(stderr, "[exec] run_command: path='%s' bg=%d in=%d out=%d err=%d\n",
+    fprintf(stderr, "[exec] run_command: path='%s' bg=%d in=%d out=%d err=%d sched=%d limits=%d\n",
             abs_path,
             (int)(opts ? opts->background : 0),
             (opts ? opts->in_fd  : -2),
             (opts ? opts->out_fd : -2),
-            (opts ? opts->err_fd : -2));
+            (opts ? opts->err_fd : -2),
+            (int)(opts && opts->sched),
+            (int)(opts && opts->limits));
     if (argv){
         fprintf(stderr, "[exec] argv:");
         for (int i=0; argv[i]; ++i) fprintf(stderr, " [%d]='%s'", i, argv[i]);
         fprintf(stderr, "\n");
     }
 
-    pid_t pid = fork();
+    /* Wire stdio: caller's plan, or one derived from in/out/err_fd */
+    exec_fdplan_t local;
+    const exec_fdplan_t *plan = opts ? opts->fdplan : NULL;
+    if (opts && !plan){
+        exec_fdmove_t mv[3];
+        int n = 0;
+        if (opts->in_fd  >= 0) mv[n++] = (exec_fdmove_t){ STDIN_FILENO,  opts->in_fd };
+        if (opts->out_fd >= 0) mv[n++] = (exec_fdmove_t){ STDOUT_FILENO, opts->out_fd };
+        if (opts->err_fd >= 0) mv[n++] = (exec_fdmove_t){ STDERR_FILENO, opts->err_fd };
+        if (n > 0){
+            if (exec_fdplan_build(&local, mv, n) != 0){ errno = EINVAL; return -1; }
+            plan = &local;
+        }
+    }
+
+    /* `NAME=value cmd`: cached envp with the assigned slots swapped */
+    char **envp = opts ? env_launch(opts->env, opts->nenv) : NULL;
+    if (opts && opts->nenv > 0 && !envp) return -1;
+
+    /* Zygote first: its fork cost doesn't grow with the shell's RSS */
+    uint64_t t0 = stats_now();
+    pid_t pid = -1;
+    if (zygote_active()){
+        pid = zygote_spawn(abs_path, argv, envp, plan, opts ? opts->sched : NULL,
+                           opts ? opts->limits : NULL);
+        if (pid < 0) fprintf(stderr, "[exec] zygote launch failed (%s), forking\n", strerror(errno));
+    }
+
+    if (pid < 0) pid = fork();
     if (pid < 0){
         perror("fork");
+        ms_free(envp);
         return -1;
     }
 
     if (pid == 0){
         /* Child */
-        if (opts) apply_fds(opts);
-        execv(abs_path, argv); /* no execvp per project rules */
-        fprintf(stderr, "exec failed: %s: %s\n", abs_path, strerror(errno));
-        _exit(127);
+        exec_child(abs_path, argv, envp, plan, opts ? opts->sched : NULL,
+                   opts ? opts->limits : NULL);
     }
 
     /* Parent */
+    ms_free(envp);
+    uint64_t t1 = stats_now();
+    stats_spawn(argv[0], t1 - t0);
+    if (trace_active()) trace_event(TRACE_SPAWN, t0, t1, 0, argv[0]);
     if (out_pid) *out_pid = pid;
 
     if (opts && opts->background){
@@ -121,5 +373,14 @@ int run_command(const char *abs_path,
         return 0;
     }
 
-    return wait_for_child(pid, out_status);
+    int status;
+    if (wait_for_child(pid, &status) != 0) return -1;
+    uint64_t t2 = stats_now();
+    stats_exit_wait(argv[0], t2 - t0, status);
+    if (trace_active()) {
+        trace_event(TRACE_WAIT, t1, t2, 0, argv[0]);
+        trace_event(TRACE_STAGE, t0, t2, (int)pid, argv[0]);
+    }
+    if (out_status) *out_status = status;
+    return 0;
 }
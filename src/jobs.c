@@ -1,89 +1,329 @@
+#define _DEFAULT_SOURCE             /* wait4 */
+#define _POSIX_C_SOURCE 200809L
 #include "jobs.h"
+#include "transcript.h"
+#include "jsonl.h"
+#include "timeout.h"
+#include "exec.h"
+#include "trace.h"
+#include <errno.h>
+#include <poll.h>
+#include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include <sys/resource.h>
 #include <sys/wait.h>
 #include <unistd.h>
 #include <time.h>
 
-#define MAX_JOBS 32
+#define MAX_JOBS 1024
 
 typedef struct {
     int   id;
     pid_t pid;            /* PID of the last stage of pipeline or single process */
     int   active;         /* 1 = active, 0 = done/free */
+    int   finished;       /* done: 'code' is valid until the slot is reused */
+    int   code;           /* exit code, 128+N for signal N, TIMEOUT_STATUS */
+    int   queued;         /* 1 = waiting for a job slot (pid not valid yet) */
     char  cmd[256];       /* store original command line (<= 200 chars spec) */
+    job_launch_fn launch; /* queued jobs only */
+    void         *ctx;
+    job_free_fn   ctx_free;
+    int64_t started;      /* CLOCK_MONOTONIC ns at launch, for the transcript */
 } job_t;
 
 static job_t JOBS[MAX_JOBS];
 static int next_id = 1;
+static int slots = 0;     /* 0 = not yet resolved; see jobs_get_slots() */
+static const struct rusage *reap_ru;   /* usage of the pid being notified, if known */
+
+static void job_drop_ctx(job_t *j){
+    if (j->ctx && j->ctx_free) j->ctx_free(j->ctx);
+    j->launch = NULL; j->ctx = NULL; j->ctx_free = NULL;
+}
 
 void jobs_init(void){
     memset(JOBS, 0, sizeof(JOBS));
     next_id = 1;
+    slots = 0;
 }
 
 int jobs_next_id(void){
     return next_id;
 }
 
-void jobs_register(int job_id, pid_t pid, const char *cmdline){
+static int64_t now_ns(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static job_t *job_alloc(int job_id, const char *cmdline){
     for (int i = 0; i < MAX_JOBS; ++i){
         if (!JOBS[i].active){
+            memset(&JOBS[i], 0, sizeof(JOBS[i]));
             JOBS[i].id = job_id;
-            JOBS[i].pid = pid;
             JOBS[i].active = 1;
+            JOBS[i].started = now_ns();
             snprintf(JOBS[i].cmd, sizeof(JOBS[i].cmd), "%s", cmdline ? cmdline : "");
             if (job_id >= next_id) next_id = job_id + 1;
-            return;
+            return &JOBS[i];
         }
     }
     fprintf(stderr, "job table full\n");
+    return NULL;
+}
+
+void jobs_register(int job_id, pid_t pid, const char *cmdline){
+    job_t *j = job_alloc(job_id, cmdline);
+    if (j) j->pid = pid;
+}
+
+/* ---------- job slots ---------- */
+
+void jobs_set_slots(int n){
+    slots = n > 0 ? n : 0;
+}
+
+int jobs_get_slots(void){
+    if (slots <= 0){
+        long n = sysconf(_SC_NPROCESSORS_ONLN);
+        slots = n > 0 ? (int)n : 1;
+    }
+    return slots;
+}
+
+int jobs_running_count(void){
+    int n = 0;
+    for (int i = 0; i < MAX_JOBS; ++i)
+        if (JOBS[i].active && !JOBS[i].queued) n++;
+    return n;
+}
+
+int jobs_queued_count(void){
+    int n = 0;
+    for (int i = 0; i < MAX_JOBS; ++i)
+        if (JOBS[i].active && JOBS[i].queued) n++;
+    return n;
+}
+
+int jobs_slot_available(void){
+    /* Queued jobs go first so launches stay in submission order. */
+    return jobs_queued_count() == 0 && jobs_running_count() < jobs_get_slots();
+}
+
+int jobs_enqueue(int job_id, const char *cmdline,
+                 job_launch_fn launch, void *ctx, job_free_fn ctx_free){
+    job_t *j = job_alloc(job_id, cmdline);
+    if (!j){
+        if (ctx && ctx_free) ctx_free(ctx);
+        return -1;
+    }
+    j->queued   = 1;
+    j->pid      = -1;
+    j->launch   = launch;
+    j->ctx      = ctx;
+    j->ctx_free = ctx_free;
+    fprintf(stderr, "[jobs] queued job #%d (%d/%d slots busy)\n",
+            job_id, jobs_running_count(), jobs_get_slots());
+    return 0;
+}
+
+/* Start queued jobs, lowest id first, while slots are free. */
+static void jobs_start_queued(void){
+    while (jobs_running_count() < jobs_get_slots()){
+        job_t *next = NULL;
+        for (int i = 0; i < MAX_JOBS; ++i){
+            if (JOBS[i].active && JOBS[i].queued && (!next || JOBS[i].id < next->id))
+                next = &JOBS[i];
+        }
+        if (!next) return;
+
+        pid_t pid = -1;
+        int rc = next->launch ? next->launch(next->ctx, &pid) : -1;
+        job_drop_ctx(next);
+        next->queued = 0;
+        if (rc != 0 || pid <= 0){
+            fprintf(stderr, "[%d] launch failed: %s\n", next->id, next->cmd);
+            next->active = 0;
+            next->finished = 1;
+            next->code = 127;
+            continue;
+        }
+        next->pid = pid;
+        next->started = now_ns();
+        fprintf(stderr, "[jobs] started queued job #%d pid=%d\n", next->id, (int)pid);
+    }
+}
+
+int jobs_notify_exit(pid_t pid, int status){
+    int hit = 0;
+    bool timed_out = timeout_reaped(pid);
+    for (int i = 0; i < MAX_JOBS; ++i){
+        if (JOBS[i].active && !JOBS[i].queued && JOBS[i].pid == pid){
+            printf("[%d] + %s %s\n", JOBS[i].id, timed_out ? "timeout" : "done", JOBS[i].cmd);
+            fflush(stdout);
+            JOBS[i].code = timed_out ? TIMEOUT_STATUS
+                         : WIFEXITED(status) ? WEXITSTATUS(status)
+                         : WIFSIGNALED(status) ? 128 + WTERMSIG(status) : -1;
+            if (transcript_active())
+                transcript_record("done", JOBS[i].cmd, JOBS[i].id, &JOBS[i].code, 1,
+                                  now_ns() - JOBS[i].started);
+            if (jsonl_active())
+                jsonl_job(JOBS[i].id, pid, JOBS[i].code, now_ns() - JOBS[i].started, reap_ru);
+            if (trace_active())
+                trace_event(TRACE_JOB, (uint64_t)JOBS[i].started, (uint64_t)now_ns(),
+                            (int)pid, JOBS[i].cmd);
+            JOBS[i].active = 0;
+            JOBS[i].finished = 1;
+            hit = 1;
+        }
+    }
+    return hit;
 }
 
 /* Reap all finished children without blocking; print completion notices. */
 void jobs_mark_done_nonblocking(void){
     int status;
     pid_t pid;
-    while ((pid = waitpid(-1, &status, WNOHANG)) > 0){
-        for (int i = 0; i < MAX_JOBS; ++i){
-            if (JOBS[i].active && JOBS[i].pid == pid){
-                printf("[%d] + done %s\n", JOBS[i].id, JOBS[i].cmd);
-                fflush(stdout);
-                JOBS[i].active = 0;
-            }
-        }
+    struct rusage ru;
+    while ((pid = wait4(-1, &status, WNOHANG, &ru)) > 0){
+        reap_ru = &ru;
+        jobs_notify_exit(pid, status);
+        reap_ru = NULL;
     }
+    jobs_start_queued();
 }
 
-/* Polling loop for foreground wait (signals not required by spec) */
-void jobs_wait_all(void){
-    int any;
-    do {
-        any = 0;
-        for (int i = 0; i < MAX_JOBS; ++i){
-            if (JOBS[i].active){ any = 1; break; }
+int jobs_pollfds(struct pollfd *pf, int max, int *fallback){
+    int n = 0;
+    for (int i = 0; i < MAX_JOBS; ++i){
+        if (!JOBS[i].active || JOBS[i].queued) continue;
+        int fd = n < max ? exec_pidfd_open(JOBS[i].pid) : -1;
+        if (fd < 0){ *fallback = 1; continue; }
+        pf[n++] = (struct pollfd){ fd, POLLIN, 0 };
+    }
+    return n;
+}
+
+/* ---------- waiting ---------- */
+
+/* Active job, else the finished one still holding its slot. */
+static job_t *job_by_id(int id){
+    job_t *done = NULL;
+    for (int i = 0; i < MAX_JOBS; ++i){
+        if (JOBS[i].id != id) continue;
+        if (JOBS[i].active) return &JOBS[i];
+        if (JOBS[i].finished) done = &JOBS[i];
+    }
+    return done;
+}
+
+int jobs_lookup(const char *spec){
+    if (!spec || !*spec) return -1;
+    const char *s = spec[0] == '%' ? spec + 1 : spec;
+    char *end = NULL;
+    long v = strtol(s, &end, 10);
+    if (!*s || *end || v <= 0) return -1;
+    if (spec[0] == '%') return job_by_id((int)v) ? (int)v : -1;
+
+    int id = -1;
+    for (int i = 0; i < MAX_JOBS; ++i){
+        if (!JOBS[i].queued && JOBS[i].pid == (pid_t)v && (JOBS[i].active || JOBS[i].finished)){
+            if (JOBS[i].active) return JOBS[i].id;
+            if (JOBS[i].id > id) id = JOBS[i].id;  /* pid reused: the newest */
         }
-        if (any){
-            jobs_mark_done_nonblocking();
-            struct timespec ts;
-            ts.tv_sec = 0;
-            ts.tv_nsec = 50 * 1000 * 1000; // 50 ms
-            nanosleep(&ts, NULL);
+    }
+    return id;
+}
+
+/* Block until one of the running jobs we care about exits: the 'want'
+   ones, or every running job while one of them is still queued (it only
+   starts once some job frees a slot). pidfds make this a single poll();
+   without them, a 50 ms sleep. */
+static void wait_for_exit(const int *want, int nwant){
+    int queued = 0;
+    for (int k = 0; k < nwant; ++k){
+        job_t *j = job_by_id(want[k]);
+        if (j && j->active && j->queued) queued = 1;
+    }
+    struct pollfd pf[MAX_JOBS];
+    nfds_t np = 0;
+    int fallback = 0;
+    for (int i = 0; i < MAX_JOBS; ++i){
+        if (!JOBS[i].active || JOBS[i].queued) continue;
+        int wanted = queued;
+        for (int k = 0; !wanted && k < nwant; ++k) wanted = JOBS[i].id == want[k];
+        if (!wanted) continue;
+        int fd = exec_pidfd_open(JOBS[i].pid);
+        if (fd < 0){ fallback = 1; continue; }
+        pf[np++] = (struct pollfd){ fd, POLLIN, 0 };
+    }
+    if (np > 0 || fallback){
+        fprintf(stderr, "[jobs] waiting on %d pidfd(s)%s\n", (int)np, fallback ? " + polling" : "");
+        if (poll(pf, np, fallback ? 50 : -1) < 0 && errno != EINTR) perror("wait: poll");
+    }
+    for (nfds_t k = 0; k < np; ++k) close(pf[k].fd);
+}
+
+int jobs_wait(const int *ids, int n, int any, int *which){
+    jobs_mark_done_nonblocking();
+    int *want = (int *)malloc((size_t)(n > 0 ? n : MAX_JOBS) * sizeof(int));
+    if (!want){ perror("wait: malloc"); return 1; }
+    int nwant = 0;
+    for (int k = 0; k < n; ++k){
+        job_t *j = job_by_id(ids[k]);
+        if (!any || (j && j->active)) want[nwant++] = ids[k];   /* -n: still running */
+    }
+    for (int i = 0; n == 0 && i < MAX_JOBS; ++i)
+        if (JOBS[i].active) want[nwant++] = JOBS[i].id;
+    if (any && nwant == 0){ free(want); return 127; }
+
+    int first = -1;
+    for (;;){
+        int pending = 0;
+        for (int k = 0; k < nwant; ++k){
+            job_t *j = job_by_id(want[k]);
+            if (j && j->active) pending = 1;
+            else if (first < 0) first = want[k];
         }
-    } while (any);
+        if (any ? first >= 0 : !pending) break;
+        wait_for_exit(want, nwant);
+        jobs_mark_done_nonblocking();
+    }
+
+    int rc = 0;
+    if (any){
+        if (which) *which = first;
+        rc = job_by_id(first)->code;
+    } else if (n > 0){
+        job_t *j = job_by_id(ids[n - 1]);
+        rc = j ? j->code : 127;
+    }
+    free(want);
+    return rc;
+}
+
+void jobs_wait_all(void){
+    jobs_wait(NULL, 0, 0, NULL);
 }
 
 /* Print active background jobs (for 'jobs' builtin) */
-void jobs_print_active(void){
+void jobs_fprint_active(FILE *out){
     int any = 0;
     for (int i = 0; i < MAX_JOBS; ++i){
         if (JOBS[i].active){
             any = 1;
-            printf("[%d] %s\n", JOBS[i].id, JOBS[i].cmd);
+            fprintf(out, "[%d] %-7s %s\n", JOBS[i].id,
+                    JOBS[i].queued ? "queued" : "running", JOBS[i].cmd);
         }
     }
     if (!any) {
-        printf("no active background processes\n");
+        fprintf(out, "no active background processes\n");
     }
-    fflush(stdout);
+    fflush(out);
+}
+
+void jobs_print_active(void){
+    jobs_fprint_active(stdout);
 }
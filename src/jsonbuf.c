@@ -0,0 +1,75 @@
+// src/jsonbuf.c — growable buffer for JSON records
+#define _POSIX_C_SOURCE 200809L
+#include "jsonbuf.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+void jsonbuf_put(jsonbuf_t *b, const char *s, size_t n) {
+    if (b->failed) return;
+    if (b->len + n + 1 > b->cap) {
+        size_t cap = b->cap ? b->cap : 256;
+        while (b->len + n + 1 > cap) cap *= 2;
+        char *np = (char *)realloc(b->p, cap);
+        if (!np) { b->failed = true; return; }
+        b->p = np;
+        b->cap = cap;
+    }
+    memcpy(b->p + b->len, s, n);
+    b->len += n;
+    b->p[b->len] = '\0';
+}
+
+void jsonbuf_printf(jsonbuf_t *b, const char *fmt, ...) {
+    char tmp[128];
+    va_list ap, again;
+    va_start(ap, fmt);
+    va_copy(again, ap);
+    int n = vsnprintf(tmp, sizeof(tmp), fmt, ap);
+    va_end(ap);
+    if (n < 0) {
+        b->failed = true;
+    } else if ((size_t)n < sizeof(tmp)) {
+        jsonbuf_put(b, tmp, (size_t)n);
+    } else {
+        char *big = (char *)malloc((size_t)n + 1);
+        if (big) {
+            vsnprintf(big, (size_t)n + 1, fmt, again);
+            jsonbuf_put(b, big, (size_t)n);
+            free(big);
+        } else {
+            b->failed = true;
+        }
+    }
+    va_end(again);
+}
+
+void jsonbuf_str(jsonbuf_t *b, const char *s) {
+    jsonbuf_put(b, "\"", 1);
+    for (const unsigned char *p = (const unsigned char *)s; *p; ++p) {
+        const unsigned char *run = p;
+        while (*p >= 0x20 && *p != '"' && *p != '\\') p++;
+        if (p > run) jsonbuf_put(b, (const char *)run, (size_t)(p - run));
+        if (!*p) break;
+        if (*p == '"' || *p == '\\') { char e[2] = { '\\', (char)*p }; jsonbuf_put(b, e, 2); }
+        else if (*p == '\n') jsonbuf_put(b, "\\n", 2);
+        else if (*p == '\t') jsonbuf_put(b, "\\t", 2);
+        else jsonbuf_printf(b, "\\u%04x", *p);
+    }
+    jsonbuf_put(b, "\"", 1);
+}
+
+void jsonbuf_reset(jsonbuf_t *b, size_t len) {
+    if (len < b->len) b->len = len;
+    if (b->p) b->p[b->len] = '\0';
+    b->failed = false;
+}
+
+void jsonbuf_free(jsonbuf_t *b) {
+    free(b->p);
+    b->p = NULL;
+    b->len = b->cap = 0;
+    b->failed = false;
+}
@@ -0,0 +1,145 @@
+// src/jsonl.c — `--jsonl` records, collected in memory and written in bursts
+#define _POSIX_C_SOURCE 200809L
+#include "jsonl.h"
+#include "jsonbuf.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static struct {
+    pthread_mutex_t mu;
+    bool   active;
+    int    fd;
+    long   seq;                 /* line being run, for run/bg records */
+    jsonbuf_t b;                /* records not yet written */
+    size_t rec;                 /* where the one being built starts */
+} J = { .mu = PTHREAD_MUTEX_INITIALIZER, .fd = -1 };
+
+bool jsonl_active(void) { return J.active; }
+
+/* ---------- formatting (J.mu held) ---------- */
+
+static double tv_ms(struct timeval tv) {
+    return (double)tv.tv_sec * 1e3 + (double)tv.tv_usec / 1e3;
+}
+
+static void jb_usage(const struct rusage *ru, bool rss) {
+    if (!ru) return;
+    jsonbuf_printf(&J.b, ",\"user_ms\":%.3f,\"sys_ms\":%.3f",
+                   tv_ms(ru->ru_utime), tv_ms(ru->ru_stime));
+    if (rss) jsonbuf_printf(&J.b, ",\"maxrss_kb\":%ld", ru->ru_maxrss);
+}
+
+static void write_all(const char *p, size_t n) {
+    while (n > 0) {
+        ssize_t w = write(J.fd, p, n);
+        if (w < 0 && errno == EINTR) continue;
+        if (w <= 0) {
+            fprintf(stderr, "jsonl: write: %s\n", strerror(errno));
+            return;
+        }
+        p += w;
+        n -= (size_t)w;
+    }
+}
+
+static bool rec_begin(const char *ev) {
+    if (!J.active) return false;
+    pthread_mutex_lock(&J.mu);
+    J.rec = J.b.len;
+    jsonbuf_printf(&J.b, "{\"ev\":\"%s\"", ev);
+    return true;
+}
+
+static void rec_end(void) {
+    jsonbuf_put(&J.b, "}\n", 2);
+    if (J.b.failed) jsonbuf_reset(&J.b, J.rec);    /* out of memory: drop the record */
+    if (J.b.len >= JSONL_BUF_FLUSH) {
+        write_all(J.b.p, J.b.len);
+        jsonbuf_reset(&J.b, 0);
+    }
+    pthread_mutex_unlock(&J.mu);
+}
+
+/* ---------- session ---------- */
+
+void jsonl_begin(int out_fd) {
+    pthread_mutex_lock(&J.mu);
+    J.fd = out_fd;
+    J.seq = 0;
+    jsonbuf_reset(&J.b, 0);
+    J.active = true;
+    pthread_mutex_unlock(&J.mu);
+}
+
+void jsonl_flush(void) {
+    pthread_mutex_lock(&J.mu);
+    if (J.b.len > 0 && J.fd >= 0) write_all(J.b.p, J.b.len);
+    jsonbuf_reset(&J.b, 0);
+    pthread_mutex_unlock(&J.mu);
+}
+
+void jsonl_end(void) {
+    jsonl_flush();
+    pthread_mutex_lock(&J.mu);
+    J.active = false;
+    J.fd = -1;
+    jsonbuf_free(&J.b);
+    pthread_mutex_unlock(&J.mu);
+}
+
+/* ---------- records ---------- */
+
+void jsonl_start(long seq, const char *cmd) {
+    if (!rec_begin("start")) return;
+    J.seq = seq;
+    jsonbuf_printf(&J.b, ",\"seq\":%ld,\"cmd\":", seq);
+    jsonbuf_str(&J.b, cmd);
+    rec_end();
+}
+
+void jsonl_line_end(long seq, int status, int64_t ns) {
+    if (!rec_begin("end")) return;
+    jsonbuf_printf(&J.b, ",\"seq\":%ld,\"status\":%d,\"ms\":%.3f", seq, status, (double)ns / 1e6);
+    rec_end();
+}
+
+void jsonl_pipeline(const char *cmd, const pid_t *pids, const int *status, int n,
+                    int64_t ns, const struct rusage *ru) {
+    if (!rec_begin("run")) return;
+    jsonbuf_printf(&J.b, ",\"seq\":%ld,\"cmd\":", J.seq);
+    jsonbuf_str(&J.b, cmd ? cmd : "");
+    jsonbuf_put(&J.b, ",\"pids\":[", 9);
+    for (int i = 0; i < n; ++i) {
+        if (pids && pids[i] > 0) jsonbuf_printf(&J.b, "%s%d", i ? "," : "", (int)pids[i]);
+        else                     jsonbuf_printf(&J.b, "%snull", i ? "," : "");
+    }
+    jsonbuf_put(&J.b, "],\"status\":[", 12);
+    for (int i = 0; i < n; ++i) jsonbuf_printf(&J.b, "%s%d", i ? "," : "", status ? status[i] : -1);
+    jsonbuf_printf(&J.b, "],\"ms\":%.3f", (double)ns / 1e6);
+    jb_usage(ru, false);
+    rec_end();
+}
+
+void jsonl_bg(const char *cmd, int job, const pid_t *pids, int n, bool queued) {
+    if (!rec_begin("bg")) return;
+    jsonbuf_printf(&J.b, ",\"seq\":%ld,\"cmd\":", J.seq);
+    jsonbuf_str(&J.b, cmd ? cmd : "");
+    jsonbuf_printf(&J.b, ",\"job\":%d,\"pids\":[", job);
+    for (int i = 0; i < n; ++i) jsonbuf_printf(&J.b, "%s%d", i ? "," : "", (int)pids[i]);
+    jsonbuf_put(&J.b, "]", 1);
+    if (queued) jsonbuf_put(&J.b, ",\"queued\":true", 14);
+    rec_end();
+}
+
+void jsonl_job(int job, pid_t pid, int status, int64_t ns, const struct rusage *ru) {
+    if (!rec_begin("job")) return;
+    jsonbuf_printf(&J.b, ",\"job\":%d,\"pid\":%d,\"status\":%d,\"ms\":%.3f",
+                   job, (int)pid, status, (double)ns / 1e6);
+    jb_usage(ru, true);
+    rec_end();
+}
@@ -0,0 +1,123 @@
+// src/jsonl_run.c — `--jsonl` loop: one input line in, records out
+#define _POSIX_C_SOURCE 200809L
+#include "jsonl.h"
+#include "exec.h"               /* EXEC_FDPLAN_MAXFD */
+#include "jobs.h"
+#include "readbuf.h"
+#include "script.h"
+#include "stats.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define JSONL_MAX_POLL 64       /* job pidfds watched while idle */
+
+static bool input_ready(int fd) {
+    struct pollfd pf = { fd, POLLIN, 0 };
+    return poll(&pf, 1, 0) > 0;
+}
+
+/* Idle: everything held goes out, then sleep until input arrives, reaping
+   (and reporting) jobs as they finish meanwhile. */
+static void wait_input(int fd) {
+    jsonl_flush();
+    for (;;) {
+        struct pollfd pf[1 + JSONL_MAX_POLL];
+        int fallback = 0;
+        pf[0] = (struct pollfd){ fd, POLLIN, 0 };
+        int n = 1 + jobs_pollfds(pf + 1, JSONL_MAX_POLL, &fallback);
+        int r = poll(pf, (nfds_t)n, fallback ? 50 : -1);
+        for (int i = 1; i < n; ++i) close(pf[i].fd);
+        if (r < 0 && errno != EINTR) { perror("jsonl: poll"); return; }
+        jobs_mark_done_nonblocking();
+        jsonl_flush();
+        if (r > 0 && pf[0].revents) return;
+    }
+}
+
+int jsonl_run(int in_fd, int out_fd) {
+    /* The protocol fds live above every redirectable fd and are closed in
+       children; commands get /dev/null and stderr in their place */
+    int in  = fcntl(in_fd, F_DUPFD_CLOEXEC, EXEC_FDPLAN_MAXFD);
+    int out = fcntl(out_fd, F_DUPFD_CLOEXEC, EXEC_FDPLAN_MAXFD);
+    if (in < 0 || out < 0) {
+        perror("jsonl: fcntl");
+        if (in >= 0) close(in);
+        if (out >= 0) close(out);
+        return 1;
+    }
+    if (in_fd == 0) {
+        readbuf_release(0);
+        int nul = open("/dev/null", O_RDONLY);
+        if (nul >= 0 && nul != 0) { dup2(nul, 0); close(nul); }
+    }
+    if (out_fd == 1) {
+        fflush(stdout);
+        dup2(2, 1);
+    }
+    jsonl_begin(out);
+    fprintf(stderr, "[jsonl] reading fd %d, records to fd %d\n", in_fd, out_fd);
+
+    char  *buf = NULL;
+    size_t len = 0, cap = 0, start = 0;
+    long   seq = 0;
+    int    last = 0;
+    bool   eof = false;
+    for (;;) {
+        char *nl = len > start ? (char *)memchr(buf + start, '\n', len - start) : NULL;
+        if (!nl && !eof) {
+            if (start > 0) {
+                memmove(buf, buf + start, len - start);
+                len -= start;
+                start = 0;
+            }
+            if (len + 1 >= cap) {
+                size_t ncap = cap ? cap * 2 : 4096;
+                char *nb = (char *)realloc(buf, ncap);
+                if (!nb) { perror("jsonl: realloc"); break; }
+                buf = nb;
+                cap = ncap;
+            }
+            if (!input_ready(in)) wait_input(in);
+            ssize_t n = read(in, buf + len, cap - len - 1);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) eof = true;
+            else        len += (size_t)n;
+            continue;
+        }
+        if (!nl && start == len) break;
+
+        /* One line: [start, nl) or the unterminated rest at end of input */
+        char *line = buf + start;
+        size_t ll = nl ? (size_t)(nl - line) : len - start;
+        line[ll] = '\0';
+        if (ll > 0 && line[ll - 1] == '\r') line[ll - 1] = '\0';
+        start += ll + (nl ? 1 : 0);
+
+        jsonl_start(++seq, line);
+        uint64_t t0 = stats_now();
+        int rc = script_run_text(line);
+        bool quit = rc > 2000;
+        last = quit ? (rc - 2001) & 0xFF : rc;
+        jsonl_line_end(seq, last, (int64_t)(stats_now() - t0));
+        jobs_mark_done_nonblocking();
+        if (quit) break;
+    }
+    free(buf);
+
+    /* Every "bg" gets its "job" before the stream ends */
+    jobs_wait_all();
+    jsonl_end();
+    fprintf(stderr, "[jsonl] %ld line(s), last status %d\n", seq, last);
+
+    if (in_fd == 0) dup2(in, 0);
+    if (out_fd == 1) { fflush(stdout); dup2(out, 1); }
+    close(in);
+    close(out);
+    return last;
+}
@@ -0,0 +1,148 @@
+// src/lexclass.c — lexer character classes and word-run scanning (AVX2/SSE2/scalar)
+#define _POSIX_C_SOURCE 200809L
+#include "lexclass.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define LEX_X86 1
+#include <immintrin.h>
+#endif
+
+const uint8_t lex_class[256] = {
+    ['\0'] = LEX_C_NUL,
+    ['\t'] = LEX_C_SPACE, ['\n'] = LEX_C_SPACE, ['\v'] = LEX_C_SPACE,
+    ['\f'] = LEX_C_SPACE, ['\r'] = LEX_C_SPACE, [' ']  = LEX_C_SPACE,
+    ['<']  = LEX_C_OP,    ['>']  = LEX_C_OP,    ['|']  = LEX_C_OP,    ['&'] = LEX_C_OP,
+    ['"']  = LEX_C_QUOTE, ['\''] = LEX_C_QUOTE,
+    ['\\'] = LEX_C_ESC,
+    ['*']  = LEX_C_GLOB,  ['?']  = LEX_C_GLOB,  ['[']  = LEX_C_GLOB,
+};
+
+/* ---------- scanners: all stop at the NUL, which has a class ---------- */
+
+static size_t span_byte(const char *s) {
+    (void)s;
+    return 0;
+}
+
+static size_t span_scalar(const char *s) {
+    const unsigned char *p = (const unsigned char *)s;
+    while (!lex_class[p[0]]) {
+        if (lex_class[p[1]]) return (size_t)(p + 1 - (const unsigned char *)s);
+        if (lex_class[p[2]]) return (size_t)(p + 2 - (const unsigned char *)s);
+        if (lex_class[p[3]]) return (size_t)(p + 3 - (const unsigned char *)s);
+        p += 4;
+    }
+    return (size_t)(p - (const unsigned char *)s);
+}
+
+#ifdef LEX_X86
+/* Bit N set: byte N has a class. */
+#define EQ(c) _mm_cmpeq_epi8(x, _mm_set1_epi8(c))
+static inline unsigned sse2_stops(__m128i x) {
+    /* \0 and \t..\r: x <= 0x0D and (x == 0 or x >= 9), by saturating subtracts */
+    __m128i lo = _mm_cmpeq_epi8(_mm_subs_epu8(x, _mm_set1_epi8(0x0D)), _mm_setzero_si128());
+    __m128i ctl = _mm_and_si128(lo, _mm_or_si128(EQ(0), _mm_cmpeq_epi8(
+                      _mm_subs_epu8(_mm_set1_epi8(9), x), _mm_setzero_si128())));
+    __m128i a = _mm_or_si128(_mm_or_si128(EQ(' '), EQ('"')), _mm_or_si128(EQ('&'), EQ('\'')));
+    __m128i b = _mm_or_si128(_mm_or_si128(EQ('*'), EQ('<')), _mm_or_si128(EQ('>'), EQ('?')));
+    __m128i c = _mm_or_si128(_mm_or_si128(EQ('['), EQ('\\')), EQ('|'));
+    __m128i m = _mm_or_si128(_mm_or_si128(ctl, a), _mm_or_si128(b, c));
+    return (unsigned)_mm_movemask_epi8(m);
+}
+#undef EQ
+
+/* Aligned 16-byte loads: the block holding the NUL is the last one read,
+   and an aligned block never straddles a page. */
+static size_t span_sse2(const char *s) {
+    size_t off = (uintptr_t)s & 15;
+    const __m128i *p = (const __m128i *)(const void *)(s - off);
+    unsigned mask = sse2_stops(_mm_load_si128(p)) >> off;
+    if (mask) return (size_t)__builtin_ctz(mask);
+    size_t n = 16 - off;
+    for (;;) {
+        mask = sse2_stops(_mm_load_si128(++p));
+        if (mask) return n + (size_t)__builtin_ctz(mask);
+        n += 16;
+    }
+}
+
+/* Nibble lookup: byte x has a class iff LO[x & 15] & HI[x >> 4] != 0. Each
+   bit is one high nibble's group: 0x0_ {\0 \t..\r}, 0x2_ {space " & ' *},
+   0x3_ {< > ?}, 0x5_ {[ \}, 0x7_ {|}. */
+__attribute__((target("avx2")))
+static inline uint32_t avx2_stops(__m256i x, __m256i lo_t, __m256i hi_t) {
+    const __m256i nib = _mm256_set1_epi8(0x0F);
+    __m256i lo = _mm256_shuffle_epi8(lo_t, _mm256_and_si256(x, nib));
+    __m256i hi = _mm256_shuffle_epi8(hi_t, _mm256_and_si256(_mm256_srli_epi16(x, 4), nib));
+    __m256i none = _mm256_cmpeq_epi8(_mm256_and_si256(lo, hi), _mm256_setzero_si256());
+    return ~(uint32_t)_mm256_movemask_epi8(none);
+}
+
+__attribute__((target("avx2")))
+static size_t span_avx2(const char *s) {
+    const __m256i lo_t = _mm256_setr_epi8(
+        0x03, 0, 0x02, 0, 0, 0, 0x02, 0x02, 0, 0x01, 0x03, 0x09, 0x1D, 0x01, 0x04, 0x04,
+        0x03, 0, 0x02, 0, 0, 0, 0x02, 0x02, 0, 0x01, 0x03, 0x09, 0x1D, 0x01, 0x04, 0x04);
+    const __m256i hi_t = _mm256_setr_epi8(
+        0x01, 0, 0x02, 0x04, 0, 0x08, 0, 0x10, 0, 0, 0, 0, 0, 0, 0, 0,
+        0x01, 0, 0x02, 0x04, 0, 0x08, 0, 0x10, 0, 0, 0, 0, 0, 0, 0, 0);
+    size_t off = (uintptr_t)s & 31;
+    const __m256i *p = (const __m256i *)(const void *)(s - off);
+    uint32_t mask = avx2_stops(_mm256_load_si256(p), lo_t, hi_t) >> off;
+    if (mask) return (size_t)__builtin_ctz(mask);
+    size_t n = 32 - off;
+    for (;;) {
+        mask = avx2_stops(_mm256_load_si256(++p), lo_t, hi_t);
+        if (mask) return n + (size_t)__builtin_ctz(mask);
+        n += 32;
+    }
+}
+#endif
+
+/* ---------- dispatch ---------- */
+
+static size_t span_init(const char *s);
+static size_t (*span_fn)(const char *) = span_init;
+
+static size_t span_init(const char *s) {
+    lexclass_force(LEX_SCAN_AUTO);
+    return __atomic_load_n(&span_fn, __ATOMIC_ACQUIRE)(s);
+}
+
+size_t lexclass_span(const char *s) {
+    return __atomic_load_n(&span_fn, __ATOMIC_ACQUIRE)(s);
+}
+
+lex_scan_t lexclass_force(lex_scan_t impl) {
+    bool avx2 = false, sse2 = false;
+#ifdef LEX_X86
+    __builtin_cpu_init();
+    avx2 = __builtin_cpu_supports("avx2");
+    sse2 = __builtin_cpu_supports("sse2");
+#endif
+    if (impl == LEX_SCAN_AUTO) impl = LEX_SCAN_AVX2;
+    if (impl == LEX_SCAN_AVX2 && !avx2) impl = LEX_SCAN_SSE2;
+    if (impl == LEX_SCAN_SSE2 && !sse2) impl = LEX_SCAN_SCALAR;
+
+    size_t (*fn)(const char *) = impl == LEX_SCAN_BYTE ? span_byte : span_scalar;
+#ifdef LEX_X86
+    if (impl == LEX_SCAN_SSE2) fn = span_sse2;
+    if (impl == LEX_SCAN_AVX2) fn = span_avx2;
+#endif
+    __atomic_store_n(&span_fn, fn, __ATOMIC_RELEASE);
+    fprintf(stderr, "[lex] word scan: %s\n", lexclass_name(impl));
+    return impl;
+}
+
+const char *lexclass_name(lex_scan_t impl) {
+    switch (impl) {
+    case LEX_SCAN_BYTE:   return "byte";
+    case LEX_SCAN_SCALAR: return "scalar";
+    case LEX_SCAN_SSE2:   return "sse2";
+    case LEX_SCAN_AVX2:   return "avx2";
+    default:              return "auto";
+    }
+}
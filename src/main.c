@@ -10,6 +10,10 @@
 #include "prompt.h"   // A
 #include "exec.h"     // A
 #include "jobs.h"     // A
+#include "transcript.h"
+#include "jsonl.h"
+#include "script.h"
+#include "zygote.h"
 
 /* ---- Person C: provide these ---- */
 // parser.h
@@ -54,8 +58,17 @@ static int is_blank(const char *s){
     return 1;
 }
 
-int main(void){
+int main(int argc, char **argv){
+    if (getenv("SHELL_ZYGOTE")) zygote_start();  // fork server, while the shell is still small
     jobs_init(); // A: background job system
+    if (argc > 1 && strcmp(argv[1], "--jsonl") == 0)
+        return jsonl_run(0, 1);  // programs: line in, JSON records out, no prompt
+    if (argc > 2 && strcmp(argv[1], "-c") == 0) {
+        int rc = script_run_text_final(argv[2]);  // last command exec'd, not forked
+        return rc > 2000 ? (rc - 2001) & 0xFF : rc;
+    }
+    const char *tlog = getenv("SHELL_TRANSCRIPT");
+    if (tlog && *tlog) transcript_open(tlog, 0);
 
     for (;;) {
         show_prompt(); // A
@@ -66,6 +79,7 @@ int main(void){
         if (nread == -1){
             putchar('\n');
             jobs_wait_all(); // A: ensure bg tasks finish
+            transcript_close();
             free(line);
             return 0;
         }
@@ -95,6 +109,7 @@ int main(void){
             free(line);
             if (should_quit){
                 jobs_wait_all();       // A: required by spec
+                transcript_close();
                 return 0;              // C prints history before returning true
             }
             jobs_mark_done_nonblocking(); // A
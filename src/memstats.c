@@ -0,0 +1,233 @@
+// src/memstats.c — per-category allocation counters and the `memstats` builtin
+#define _POSIX_C_SOURCE 200809L
+#include "memstats.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char *const SITE_NAMES[MS_NSITES] = {
+    "lex", "parse", "env", "argv", "glob", "join", "redir", "exec", "script",
+};
+
+/* Open-addressing pointer table: block -> (size, site). */
+typedef struct {
+    void    *p;             /* NULL = empty, MS_TOMB = deleted */
+    size_t   size;
+    int      site;
+} ms_ent_t;
+
+#define MS_TOMB ((void *)1)
+
+static struct {
+    int          on;        /* read without the lock: a stale read only
+                               tags or misses one block */
+    ms_counts_t  total[MS_NSITES];
+    ms_counts_t  cmd[MS_NSITES];     /* since the last command ended */
+    ms_counts_t  last[MS_NSITES];
+    int          depth;
+    ms_ent_t    *tab;
+    size_t       cap, used;     /* used counts tombstones too */
+} M;
+
+static pthread_mutex_t ms_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t  ms_once = PTHREAD_ONCE_INIT;
+
+static void ms_init(void) {
+    const char *e = getenv("SHELL_MEMSTATS");
+    if (e && *e && strcmp(e, "0") != 0) __atomic_store_n(&M.on, 1, __ATOMIC_RELAXED);
+}
+
+bool ms_enabled(void) {
+    pthread_once(&ms_once, ms_init);
+    return __atomic_load_n(&M.on, __ATOMIC_RELAXED);
+}
+
+static size_t slot_of(const void *p, size_t cap) {
+    uintptr_t h = (uintptr_t)p >> 4;
+    h ^= h >> 17;
+    h *= 0x9E3779B97F4A7C15ull;
+    return (size_t)(h >> 7) & (cap - 1);
+}
+
+static ms_ent_t *find(const void *p) {
+    if (!M.tab) return NULL;
+    for (size_t i = slot_of(p, M.cap);; i = (i + 1) & (M.cap - 1)) {
+        if (M.tab[i].p == p) return &M.tab[i];
+        if (!M.tab[i].p) return NULL;
+    }
+}
+
+static int grow(void) {
+    size_t cap = M.cap ? M.cap * 2 : 4096;
+    ms_ent_t *t = (ms_ent_t *)calloc(cap, sizeof(ms_ent_t));
+    if (!t) return -1;
+    size_t used = 0;
+    for (size_t k = 0; k < M.cap; ++k) {
+        void *p = M.tab[k].p;
+        if (!p || p == MS_TOMB) continue;
+        size_t i = slot_of(p, cap);
+        while (t[i].p) i = (i + 1) & (cap - 1);
+        t[i] = M.tab[k];
+        used++;
+    }
+    free(M.tab);
+    M.tab = t;
+    M.cap = cap;
+    M.used = used;
+    return 0;
+}
+
+static void credit(ms_counts_t *c, int64_t live_delta, bool alloc) {
+    if (alloc) { c->allocs++; c->bytes += (uint64_t)live_delta; }
+    c->live += live_delta;
+    if (c->live > c->peak) c->peak = c->live;
+}
+
+/* Under ms_lock. */
+static void untrack(ms_ent_t *e) {
+    credit(&M.total[e->site], -(int64_t)e->size, false);
+    credit(&M.cmd[e->site], -(int64_t)e->size, false);
+    e->p = MS_TOMB;
+}
+
+static void track(void *p, size_t n, ms_site_t site) {
+    if (!p) return;
+    pthread_mutex_lock(&ms_lock);
+    ms_ent_t *e = find(p);
+    if (e) untrack(e);             /* released with plain free(), reused */
+    if ((M.used + 1) * 4 >= M.cap * 3 && grow() != 0) {
+        pthread_mutex_unlock(&ms_lock);
+        return;
+    }
+    size_t i = slot_of(p, M.cap);
+    while (M.tab[i].p && M.tab[i].p != MS_TOMB) i = (i + 1) & (M.cap - 1);
+    if (!M.tab[i].p) M.used++;
+    M.tab[i] = (ms_ent_t){ p, n, (int)site };
+    credit(&M.total[site], (int64_t)n, true);
+    credit(&M.cmd[site], (int64_t)n, true);
+    pthread_mutex_unlock(&ms_lock);
+}
+
+static void forget(void *p) {
+    pthread_mutex_lock(&ms_lock);
+    ms_ent_t *e = find(p);
+    if (e) untrack(e);
+    pthread_mutex_unlock(&ms_lock);
+}
+
+void *ms_malloc(ms_site_t site, size_t n) {
+    void *p = malloc(n);
+    if (ms_enabled()) track(p, n, site);
+    return p;
+}
+
+void *ms_calloc(ms_site_t site, size_t count, size_t n) {
+    void *p = calloc(count, n);
+    if (ms_enabled()) track(p, count * n, site);
+    return p;
+}
+
+void *ms_realloc(ms_site_t site, void *p, size_t n) {
+    if (!ms_enabled()) return realloc(p, n);
+    if (p) forget(p);               /* before: 'p' is gone once realloc moves it */
+    void *np = realloc(p, n);
+    track(np, n, site);
+    return np;
+}
+
+char *ms_strdup(ms_site_t site, const char *s) {
+    char *p = strdup(s);
+    if (p && ms_enabled()) track(p, strlen(p) + 1, site);
+    return p;
+}
+
+void ms_free(void *p) {
+    if (p && ms_enabled()) forget(p);
+    free(p);
+}
+
+void ms_reset(void) {
+    pthread_mutex_lock(&ms_lock);
+    memset(M.total, 0, sizeof(M.total));
+    memset(M.cmd, 0, sizeof(M.cmd));
+    memset(M.last, 0, sizeof(M.last));
+    free(M.tab);
+    M.tab = NULL;
+    M.cap = M.used = 0;
+    pthread_mutex_unlock(&ms_lock);
+}
+
+void ms_enable(bool on) {
+    pthread_once(&ms_once, ms_init);
+    if (on && !ms_enabled()) ms_reset();
+    __atomic_store_n(&M.on, on ? 1 : 0, __ATOMIC_RELAXED);
+}
+
+void ms_command_begin(void) {
+    if (!ms_enabled()) return;
+    pthread_mutex_lock(&ms_lock);
+    M.depth++;
+    pthread_mutex_unlock(&ms_lock);
+}
+
+void ms_command_end(void) {
+    if (!ms_enabled()) return;
+    pthread_mutex_lock(&ms_lock);
+    if (M.depth > 0 && --M.depth == 0) {
+        memcpy(M.last, M.cmd, sizeof(M.last));
+        memset(M.cmd, 0, sizeof(M.cmd));
+    }
+    pthread_mutex_unlock(&ms_lock);
+}
+
+ms_counts_t ms_get(ms_site_t site, bool last) {
+    pthread_mutex_lock(&ms_lock);
+    ms_counts_t c = last ? M.last[site] : M.total[site];
+    pthread_mutex_unlock(&ms_lock);
+    return c;
+}
+
+// ---- builtin ------------------------------------------------------------------
+
+int builtin_memstats(char *const argv[]) {
+    bool reset = false;
+    for (int i = 1; argv[i]; ++i) {
+        if (strcmp(argv[i], "-r") == 0)        reset = true;
+        else if (strcmp(argv[i], "on") == 0)   ms_enable(true);
+        else if (strcmp(argv[i], "off") == 0)  ms_enable(false);
+        else {
+            fprintf(stderr, "usage: memstats [-r] [on | off]\n");
+            return 2;
+        }
+    }
+    if (argv[1] && !reset) return 0;
+    if (!ms_enabled()) {
+        printf("memstats off (memstats on, or SHELL_MEMSTATS=1)\n");
+        fflush(stdout);
+        return 0;
+    }
+
+    pthread_mutex_lock(&ms_lock);
+    printf("%-8s %10s %12s %10s %10s %10s %12s\n",
+           "SITE", "ALLOCS", "BYTES", "LIVE", "PEAK", "LAST", "LAST_BYTES");
+    ms_counts_t sum = {0}, lsum = {0};
+    for (int s = 0; s < MS_NSITES; ++s) {
+        const ms_counts_t *c = &M.total[s], *l = &M.last[s];
+        printf("%-8s %10llu %12llu %10lld %10lld %10llu %12llu\n", SITE_NAMES[s],
+               (unsigned long long)c->allocs, (unsigned long long)c->bytes,
+               (long long)c->live, (long long)c->peak,
+               (unsigned long long)l->allocs, (unsigned long long)l->bytes);
+        sum.allocs += c->allocs; sum.bytes += c->bytes; sum.live += c->live;
+        lsum.allocs += l->allocs; lsum.bytes += l->bytes;
+    }
+    printf("%-8s %10llu %12llu %10lld %10s %10llu %12llu\n", "total",
+           (unsigned long long)sum.allocs, (unsigned long long)sum.bytes, (long long)sum.live,
+           "-", (unsigned long long)lsum.allocs, (unsigned long long)lsum.bytes);
+    fflush(stdout);
+    pthread_mutex_unlock(&ms_lock);
+
+    if (reset) ms_reset();
+    return 0;
+}
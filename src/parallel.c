@@ -0,0 +1,330 @@
+// src/parallel.c — `parallel` builtin: in-shell fan-out over run_command()
+#define _POSIX_C_SOURCE 200809L
+#include "parallel.h"
+#include "exec.h"
+#include "jobs.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/*
+ * Scheduling: every worker slot owns a contiguous range of task indices
+ * (its deque) and takes work from the front, so neighbouring inputs finish
+ * close together and ordered output can be flushed early. A slot whose
+ * range runs dry steals the back half of the largest remaining range.
+ * Ranges are plain [head, tail) index pairs, so stealing allocates nothing.
+ */
+typedef struct {
+    size_t head, tail;    /* remaining tasks [head, tail) */
+    pid_t  pid;           /* running task's pid, -1 if idle */
+    size_t cur;           /* index of the running task */
+} worker_t;
+
+typedef struct {
+    const char *input;
+    FILE *out;            /* -k: buffered stdout, NULL otherwise */
+    int   status;         /* exit code (128+sig if signalled) */
+    bool  done;
+} task_t;
+
+typedef struct {
+    char *const *tmpl;    /* command template (argv-style, NULL-terminated) */
+    task_t  *tasks;
+    size_t   ntasks;
+    worker_t *workers;
+    int      nworkers;
+    bool     keep_order;
+    size_t   next_flush;  /* -k: first task not yet printed */
+    int      failures;
+} par_t;
+
+static void par_usage(void) {
+    fprintf(stderr, "usage: parallel [-j N] [-k] CMD [ARG...] [::: INPUT...]\n");
+}
+
+/* Replace every "{}" in 'arg' with 'input'. Returns malloc'd string. */
+static char *subst_braces(const char *arg, const char *input, bool *used) {
+    size_t ilen = strlen(input), n = 0;
+    for (const char *p = strstr(arg, "{}"); p; p = strstr(p + 2, "{}")) n++;
+    if (n == 0) return strdup(arg);
+    *used = true;
+
+    char *out = (char *)malloc(strlen(arg) + n * ilen + 1);
+    if (!out) return NULL;
+    char *w = out;
+    for (const char *p = arg;;) {
+        const char *b = strstr(p, "{}");
+        if (!b) { strcpy(w, p); break; }
+        memcpy(w, p, (size_t)(b - p)); w += b - p;
+        memcpy(w, input, ilen);         w += ilen;
+        p = b + 2;
+    }
+    return out;
+}
+
+static void free_argv(char **argv) {
+    if (!argv) return;
+    for (size_t i = 0; argv[i]; ++i) free(argv[i]);
+    free(argv);
+}
+
+/* Build the argv for one task from the template. */
+static char **build_task_argv(char *const tmpl[], const char *input) {
+    size_t n = 0;
+    while (tmpl[n]) n++;
+    char **av = (char **)calloc(n + 2, sizeof(char *));
+    if (!av) return NULL;
+
+    bool used = false;
+    for (size_t i = 0; i < n; ++i) {
+        av[i] = subst_braces(tmpl[i], input, &used);
+        if (!av[i]) { free_argv(av); return NULL; }
+    }
+    if (!used) {
+        av[n] = strdup(input);
+        if (!av[n]) { free_argv(av); return NULL; }
+    }
+    return av;
+}
+
+static void report(const par_t *P, size_t i) {
+    fprintf(stderr, "parallel: task %zu (%s): exit %d\n",
+            i + 1, P->tasks[i].input, P->tasks[i].status);
+}
+
+/* -k: print every finished task's buffered output that is next in order. */
+static void flush_ordered(par_t *P) {
+    fflush(stdout);
+    while (P->next_flush < P->ntasks && P->tasks[P->next_flush].done) {
+        task_t *t = &P->tasks[P->next_flush];
+        if (t->out) {
+            char buf[8192];
+            size_t n;
+            rewind(t->out);
+            while ((n = fread(buf, 1, sizeof(buf), t->out)) > 0) {
+                for (size_t off = 0; off < n;) {
+                    ssize_t w = write(STDOUT_FILENO, buf + off, n - off);
+                    if (w < 0) { if (errno == EINTR) continue; break; }
+                    off += (size_t)w;
+                }
+            }
+            fclose(t->out);
+            t->out = NULL;
+        }
+        report(P, P->next_flush);
+        P->next_flush++;
+    }
+}
+
+static void finish_task(par_t *P, size_t i, int status) {
+    task_t *t = &P->tasks[i];
+    t->status = status;
+    t->done = true;
+    if (status != 0) P->failures++;
+    if (P->keep_order) flush_ordered(P);
+    else report(P, i);
+}
+
+/* Take the back half of the largest remaining range. */
+static bool steal(par_t *P, worker_t *w) {
+    worker_t *victim = NULL;
+    size_t best = 0;
+    for (int k = 0; k < P->nworkers; ++k) {
+        size_t left = P->workers[k].tail - P->workers[k].head;
+        if (left > best) { best = left; victim = &P->workers[k]; }
+    }
+    if (!victim) return false;
+    size_t mid = victim->head + best / 2;  /* best==1: take the only task */
+    w->head = mid;
+    w->tail = victim->tail;
+    victim->tail = mid;
+    return true;
+}
+
+/* Launch the next task for worker 'w'; leaves it idle when no work is left. */
+static void start_next(par_t *P, worker_t *w) {
+    w->pid = -1;
+    for (;;) {
+        if (w->head == w->tail && !steal(P, w)) return;
+        size_t i = w->head++;
+        task_t *t = &P->tasks[i];
+
+        char **av = build_task_argv(P->tmpl, t->input);
+        char *abs = av ? resolve_cmd_path(av[0]) : NULL;
+        if (P->keep_order && (t->out = tmpfile()) != NULL)
+            fcntl(fileno(t->out), F_SETFD, FD_CLOEXEC);
+
+        pid_t pid = -1;
+        int rc = -1;
+        if (abs && (!P->keep_order || t->out)) {
+            exec_opts_t opts = { -1, t->out ? fileno(t->out) : -1, -1, true, NULL, NULL, NULL, NULL, 0 };
+            rc = run_command(abs, av, &opts, &pid, NULL);
+        } else if (av && !abs) {
+            fprintf(stderr, "parallel: %s: command not found\n", av[0]);
+        }
+        free(abs);
+        free_argv(av);
+
+        if (rc == 0 && pid > 0) {
+            w->pid = pid;
+            w->cur = i;
+            return;
+        }
+        finish_task(P, i, 127);   /* launch failed: try the next one */
+    }
+}
+
+/* Read newline-separated inputs from stdin. Returns NULL (errno set) if
+   stdin can't be read in full; no input at all is an empty vector. */
+static char **read_stdin_inputs(size_t *out_n) {
+    char **v = NULL;
+    size_t n = 0, cap = 0;
+    char *line = NULL;
+    size_t lcap = 0;
+    ssize_t len;
+    bool failed = false;
+    while ((len = getline(&line, &lcap, stdin)) >= 0) {
+        if (len > 0 && line[len - 1] == '\n') line[--len] = '\0';
+        if (len == 0) continue;
+        if (n == cap) {
+            cap = cap ? cap * 2 : 64;
+            char **nv = (char **)realloc(v, cap * sizeof(char *));
+            if (!nv) { failed = true; break; }
+            v = nv;
+        }
+        v[n] = strdup(line);
+        if (!v[n]) { failed = true; break; }
+        n++;
+    }
+    if (!failed && ferror(stdin)) failed = true;
+    int saved = errno;
+    free(line);
+    clearerr(stdin);
+    if (!failed && !v && !(v = (char **)calloc(1, sizeof(char *)))) {
+        failed = true;
+        saved = errno;
+    }
+    if (failed) {
+        for (size_t k = 0; k < n; ++k) free(v[k]);
+        free(v);
+        errno = saved;
+        return NULL;
+    }
+    *out_n = n;
+    return v;
+}
+
+int builtin_parallel(char *const argv[]) {
+    int njobs = 0;
+    bool keep = false;
+    int i = 1;
+
+    for (; argv[i] && argv[i][0] == '-'; ++i) {
+        if (strcmp(argv[i], "-k") == 0) { keep = true; continue; }
+        if (strcmp(argv[i], "-j") == 0 && argv[i + 1]) {
+            char *end = NULL;
+            long v = strtol(argv[++i], &end, 10);
+            if (!end || *end || v <= 0 || v > INT_MAX) { par_usage(); return 2; }
+            njobs = (int)v;
+            continue;
+        }
+        if (strcmp(argv[i], "--") == 0) { ++i; break; }
+        par_usage();
+        return 2;
+    }
+
+    /* Split CMD ... from ::: INPUT ... */
+    int cmd_start = i, sep = -1;
+    for (int k = i; argv[k]; ++k) {
+        if (strcmp(argv[k], ":::") == 0) { sep = k; break; }
+    }
+    int cmd_end = sep >= 0 ? sep : cmd_start;
+    if (sep < 0) while (argv[cmd_end]) cmd_end++;
+    if (cmd_end == cmd_start) { par_usage(); return 2; }
+
+    char **tmpl = (char **)calloc((size_t)(cmd_end - cmd_start) + 1, sizeof(char *));
+    if (!tmpl) { perror("calloc"); return 1; }
+    for (int k = cmd_start; k < cmd_end; ++k) tmpl[k - cmd_start] = argv[k];
+
+    char **stdin_inputs = NULL;
+    size_t ntasks = 0;
+    if (sep >= 0) {
+        for (int k = sep + 1; argv[k]; ++k) ntasks++;
+    } else {
+        stdin_inputs = read_stdin_inputs(&ntasks);
+        if (!stdin_inputs) {
+            perror("parallel: reading inputs");
+            free(tmpl);
+            return 1;
+        }
+    }
+
+    par_t P = {0};
+    P.tmpl = tmpl;
+    P.ntasks = ntasks;
+    P.keep_order = keep;
+    P.nworkers = njobs > 0 ? njobs : jobs_get_slots();
+    if ((size_t)P.nworkers > ntasks) P.nworkers = ntasks ? (int)ntasks : 1;
+    P.tasks = (task_t *)calloc(ntasks ? ntasks : 1, sizeof(task_t));
+    P.workers = (worker_t *)calloc((size_t)P.nworkers, sizeof(worker_t));
+    if (!P.tasks || !P.workers) {
+        perror("calloc");
+        free(P.tasks); free(P.workers); free(tmpl);
+        for (size_t k = 0; stdin_inputs && k < ntasks; ++k) free(stdin_inputs[k]);
+        free(stdin_inputs);
+        return 1;
+    }
+    for (size_t k = 0; k < ntasks; ++k)
+        P.tasks[k].input = sep >= 0 ? argv[sep + 1 + (int)k] : stdin_inputs[k];
+
+    fprintf(stderr, "[parallel] %zu task(s) on %d worker(s)%s\n",
+            ntasks, P.nworkers, keep ? " (ordered)" : "");
+
+    /* Contiguous initial ranges, then start one task per worker. */
+    for (int w = 0; w < P.nworkers; ++w) {
+        P.workers[w].head = ntasks * (size_t)w / (size_t)P.nworkers;
+        P.workers[w].tail = ntasks * (size_t)(w + 1) / (size_t)P.nworkers;
+        P.workers[w].pid = -1;
+    }
+    for (int w = 0; w < P.nworkers; ++w) start_next(&P, &P.workers[w]);
+
+    for (;;) {
+        int running = 0;
+        for (int w = 0; w < P.nworkers; ++w) running += P.workers[w].pid > 0;
+        if (!running) break;
+
+        int status;
+        pid_t r = waitpid(-1, &status, 0);
+        if (r < 0) {
+            if (errno == EINTR) continue;
+            perror("waitpid");
+            break;
+        }
+        worker_t *owner = NULL;
+        for (int w = 0; w < P.nworkers; ++w)
+            if (P.workers[w].pid == r) { owner = &P.workers[w]; break; }
+        if (!owner) { jobs_notify_exit(r, status); continue; } /* a background job */
+
+        int code = WIFEXITED(status) ? WEXITSTATUS(status)
+                 : WIFSIGNALED(status) ? 128 + WTERMSIG(status) : 1;
+        finish_task(&P, owner->cur, code);
+        start_next(&P, owner);
+    }
+
+    int failures = P.failures;
+    for (size_t k = 0; k < ntasks; ++k) if (P.tasks[k].out) fclose(P.tasks[k].out);
+    for (size_t k = 0; stdin_inputs && k < ntasks; ++k) free(stdin_inputs[k]);
+    free(stdin_inputs);
+    free(P.tasks);
+    free(P.workers);
+    free(tmpl);
+    return failures > 100 ? 100 : failures;
+}
@@ -3,20 +3,25 @@
 // =============================
 #define _POSIX_C_SOURCE 200809L
 #include "parser.h"
-#include <ctype.h>
+#include "env.h"      // env_assign_name_len
+#include "memstats.h" // ms_malloc & co., by call site
+#include "stats.h"    // stats_now
+#include "trace.h"
+#include "lexclass.h" // lex_class, lexclass_span
+#include <stdbool.h>
 #include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 /* ---------- small utils ---------- */
-static void *xmalloc(size_t n) {
-    void *p = malloc(n);
+static void *xmalloc(ms_site_t site, size_t n) {
+    void *p = ms_malloc(site, n);
     if (!p) { perror("malloc"); exit(1); }
     return p;
 }
-static char *xstrdup(const char *s) {
-    char *p = strdup(s);
+static char *xstrdup(ms_site_t site, const char *s) {
+    char *p = ms_strdup(site, s);
     if (!p) { perror("strdup"); exit(1); }
     return p;
 }
@@ -31,34 +36,59 @@ typedef struct { const char *s; size_t i; } lex_t;
 static int  l_peekc(lex_t *L) { return L->s[L->i]; }
 static int  l_getc (lex_t *L) { return L->s[L->i] ? L->s[L->i++] : '\0'; }
 static void l_skip_ws(lex_t *L) {
-    while (isspace((unsigned char)l_peekc(L))) L->i++;
+    while (lex_is_space(l_peekc(L))) L->i++;
 }
 
 static token_t tok_make(token_kind_t k, char *lex) {
-    token_t t; t.kind = k; t.lexeme = lex; return t;
+    token_t t; t.kind = k; t.lexeme = lex; t.pattern = NULL; t.fd = -1; return t;
 }
 
+static bool is_glob_meta(int c) {
+    return c == '*' || c == '?' || c == '[' || c == ']' || c == '\\';
+}
+
+/* Besides the word itself, build its glob pattern: the same characters
+   with quoted/escaped metacharacters backslash-escaped, so that "*.c" or
+   \* stay literal while *.c globs. Kept only if an unquoted * ? [ occurs. */
 static token_t lex_word(lex_t *L) {
     char *buf = NULL; size_t cap = 0, len = 0;
-#define PUT(ch) do { \
-    if (len + 1 >= cap) { \
-        size_t newcap = cap ? cap * 2 : 32; \
-        char *nbuf = (char *)realloc(buf, newcap); \
-        if (!nbuf) { perror("realloc"); free(buf); return tok_make(TK_ERR, NULL); } \
-        buf = nbuf; cap = newcap; \
+    char *pat = NULL; size_t pcap = 0, plen = 0;
+    bool globby = false;
+#define GROWN(b, c, l, n) do { \
+    if (l + (n) + 1 >= c) { \
+        size_t newcap = c ? c * 2 : 32; \
+        while (l + (n) + 1 >= newcap) newcap *= 2; \
+        char *nbuf = (char *)ms_realloc(MS_LEX, b, newcap); \
+        if (!nbuf) { perror("realloc"); ms_free(buf); ms_free(pat); return tok_make(TK_ERR, NULL); } \
+        b = nbuf; c = newcap; \
     } \
-    buf[len++] = (char)(ch); \
 } while (0)
+#define GROW(b, c, l) GROWN(b, c, l, 0)
+#define PUT(ch) do { GROW(buf, cap, len); buf[len++] = (char)(ch); } while (0)
+#define PAT(ch) do { GROW(pat, pcap, plen); pat[plen++] = (char)(ch); } while (0)
+#define PUTQ(ch) do { PUT(ch); if (is_glob_meta(ch)) PAT('\\'); PAT(ch); } while (0)
 
     for (;;) {
+        /* A run of plain word characters goes to both buffers at once */
+        size_t run = lexclass_span(L->s + L->i);
+        if (run > 0) {
+            GROWN(buf, cap, len, run);
+            GROWN(pat, pcap, plen, run);
+            memcpy(buf + len, L->s + L->i, run);
+            memcpy(pat + plen, L->s + L->i, run);
+            len += run;
+            plen += run;
+            L->i += run;
+        }
+
         int c = l_peekc(L);
-        if (c == '\0' || isspace((unsigned char)c) || c=='<' || c=='>' || c=='|' || c=='&') break;
+        if (lex_class[(unsigned char)c] & (LEX_C_NUL | LEX_C_SPACE | LEX_C_OP)) break;
 
         if (c == '\\') {           /* escape next char outside quotes */
             (void)l_getc(L);
             int n = l_getc(L);
             if (n == '\0') break;
-            PUT(n);
+            PUTQ(n);
             continue;
         }
 
@@ -67,43 +97,92 @@ static token_t lex_word(lex_t *L) {
             for (;;) {
                 int q = l_getc(L);
                 if (q == '\0') {        /* unclosed quote */
-                    free(buf);
+                    ms_free(buf);
+                    ms_free(pat);
                     return tok_make(TK_ERR, NULL);
                 }
                 if (q == quote) break;  /* end of quoted run */
 
                 if (q == '\\') {        /* preserve backslash + next char inside quotes */
                     int n = l_getc(L);
-                    if (n == '\0') { free(buf); return tok_make(TK_ERR, NULL); }
-                    PUT('\\');
-                    PUT(n);
+                    if (n == '\0') { ms_free(buf); ms_free(pat); return tok_make(TK_ERR, NULL); }
+                    PUTQ('\\');
+                    PUTQ(n);
                 } else {
-                    PUT(q);
+                    PUTQ(q);
                 }
             }
             continue;
         }
 
         /* normal character */
-        PUT(l_getc(L));
+        c = l_getc(L);
+        if (c == '*' || c == '?' || c == '[') globby = true;
+        PUT(c);
+        PAT(c);
     }
 
     PUT('\0');
-    return tok_make(TK_WORD, buf ? buf : xstrdup(""));
+    PAT('\0');
+#undef PUTQ
+#undef PAT
+#undef PUT
+#undef GROW
+#undef GROWN
+    token_t t = tok_make(TK_WORD, buf);
+    if (globby) t.pattern = pat;
+    else ms_free(pat);
+    return t;
+}
+
+/* '<', '>', '>>', '<&', '>&' at L->i; 'fd' is an IO number seen just before. */
+static token_t lex_redir_op(lex_t *L, int fd) {
+    token_t t;
+    int c = l_getc(L);
+    if (c == '<') {
+        if (l_peekc(L) == '&') { (void)l_getc(L); t = tok_make(TK_LTAMP, NULL); }
+        else t = tok_make(TK_LT, NULL);
+    } else if (l_peekc(L) == '>') {
+        (void)l_getc(L); t = tok_make(TK_DGT, NULL);
+    } else if (l_peekc(L) == '&') {
+        (void)l_getc(L); t = tok_make(TK_GTAMP, NULL);
+    } else {
+        t = tok_make(TK_GT, NULL);
+    }
+    t.fd = fd;
+    return t;
 }
 
 static token_t lex_next(lex_t *L) {
     l_skip_ws(L);
     int c = l_peekc(L);
     if (c == '\0') return tok_make(TK_EOL, NULL);
-    if (c == '<') { (void)l_getc(L); return tok_make(TK_LT,  NULL); }
-    if (c == '>') {
-        (void)l_getc(L);
-        if (l_peekc(L) == '>') { (void)l_getc(L); return tok_make(TK_DGT, NULL); }
-        return tok_make(TK_GT, NULL);
+
+    /* IO number: digits immediately followed by '<' or '>' ("2>", "10<&0") */
+    if (c >= '0' && c <= '9') {
+        size_t j = L->i;
+        int fd = 0;
+        while (L->s[j] >= '0' && L->s[j] <= '9') {
+            if (fd < 100000) fd = fd * 10 + (L->s[j] - '0');
+            j++;
+        }
+        if (L->s[j] == '<' || L->s[j] == '>') {
+            L->i = j;
+            return lex_redir_op(L, fd);
+        }
     }
+
+    if (c == '<' || c == '>') return lex_redir_op(L, -1);
     if (c == '|') { (void)l_getc(L); return tok_make(TK_BAR, NULL); }
-    if (c == '&') { (void)l_getc(L); return tok_make(TK_AMP, NULL); }
+    if (c == '&') {
+        (void)l_getc(L);
+        if (l_peekc(L) == '>') {
+            (void)l_getc(L);
+            if (l_peekc(L) == '>') { (void)l_getc(L); return tok_make(TK_AMPDGT, NULL); }
+            return tok_make(TK_AMPGT, NULL);
+        }
+        return tok_make(TK_AMP, NULL);
+    }
     return lex_word(L);
 }
 
@@ -116,7 +195,7 @@ typedef struct {
 
 static void p_init(parser_t *P, const char *s) {
     P->L.s = s; P->L.i = 0; P->have_la = 0;
-    P->la.kind = TK_ERR; P->la.lexeme = NULL;
+    P->la.kind = TK_ERR; P->la.lexeme = NULL; P->la.pattern = NULL;
 }
 static token_t p_peek(parser_t *P) {
     if (!P->have_la) { P->la = lex_next(&P->L); P->have_la = 1; }
@@ -130,27 +209,87 @@ static token_t p_get(parser_t *P) {
 
 /* ---------- AST helpers ---------- */
 static void redir_init(redir_t *r) {
-    r->in_path = NULL; r->out_path = NULL; r->append_path = NULL;
+    r->ops = NULL; r->nops = 0;
+}
+static void redir_free(redir_t *r) {
+    for (int i = 0; i < r->nops; ++i) ms_free(r->ops[i].path);
+    ms_free(r->ops);
+    redir_init(r);
 }
 static void cmd_init(cmd_t *c) {
     c->argv = NULL;
+    c->glob = NULL;
     redir_init(&c->redir);
 }
+static void cmd_free(cmd_t *c) {
+    if (c->argv) {
+        for (size_t i = 0; c->argv[i]; ++i) {
+            ms_free(c->argv[i]);
+            if (c->glob) ms_free(c->glob[i]);
+        }
+        ms_free(c->argv);
+    }
+    ms_free(c->glob);
+    redir_free(&c->redir);
+    cmd_init(c);
+}
+
+/* 'pattern' may be NULL (literal word); c->glob is created on the first one.
+   '*n' words are in c->argv, which has room for '*cap' pointers; both grow
+   by doubling so a line of many words is not copied once per word. */
+static int push_arg(cmd_t *c, size_t *n, size_t *cap, const char *w, const char *pattern) {
+    if (*n + 2 > *cap) {
+        size_t ncap = *cap ? *cap * 2 : 8;
+        char **nv = (char **)ms_realloc(MS_PARSE, c->argv, sizeof(char*) * ncap);
+        if (!nv) { perror("realloc"); exit(1); }
+        c->argv = nv;
+        if (c->glob) {
+            char **ng = (char **)ms_realloc(MS_PARSE, c->glob, sizeof(char*) * ncap);
+            if (!ng) { perror("realloc"); exit(1); }
+            c->glob = ng;
+        }
+        *cap = ncap;
+    }
+    c->argv[*n] = xstrdup(MS_PARSE, w);
+    c->argv[*n + 1] = NULL;
 
-static int push_arg(cmd_t *c, const char *w) {
-    size_t n = 0;
-    if (c->argv) { while (c->argv[n]) n++; }
-    char **nv = (char **)xmalloc(sizeof(char*) * (n + 2));
-    for (size_t i = 0; i < n; ++i) nv[i] = c->argv[i];
-    nv[n] = xstrdup(w);
-    nv[n+1] = NULL;
-    free(c->argv);
-    c->argv = nv;
+    if (pattern && !c->glob) {
+        c->glob = (char **)xmalloc(MS_PARSE, sizeof(char*) * *cap);
+        for (size_t i = 0; i < *n; ++i) c->glob[i] = NULL;
+    }
+    if (c->glob) {
+        c->glob[*n] = pattern ? xstrdup(MS_PARSE, pattern) : NULL;
+        c->glob[*n + 1] = NULL;
+    }
+    (*n)++;
     return 0;
 }
-static int set_once(char **slot, const char *path) {
-    if (*slot) return -1;
-    *slot = xstrdup(path);
+static void push_redir(redir_t *r, redir_kind_t kind, int fd, int src_fd, const char *path) {
+    redir_op_t *nv = (redir_op_t *)ms_realloc(MS_PARSE, r->ops, sizeof(redir_op_t) * (size_t)(r->nops + 1));
+    if (!nv) { perror("realloc"); exit(1); }
+    r->ops = nv;
+    redir_op_t *op = &r->ops[r->nops++];
+    op->kind = kind;
+    op->fd = fd;
+    op->src_fd = src_fd;
+    op->path = path ? xstrdup(MS_PARSE, path) : NULL;
+}
+
+/* Target of "N>&WORD" / "N<&WORD": a descriptor number, "-" (close), or,
+   for ">&" only, a file name meaning "&>WORD". */
+static int push_dup_redir(cmd_t *out, token_t op, const char *word) {
+    int fd = op.fd >= 0 ? op.fd : (op.kind == TK_LTAMP ? 0 : 1);
+    if (strcmp(word, "-") == 0) { push_redir(&out->redir, REDIR_CLOSE, fd, -1, NULL); return 0; }
+
+    const char *p = word;
+    while (*p >= '0' && *p <= '9') p++;
+    if (*word && !*p && p - word < 6) {
+        push_redir(&out->redir, REDIR_DUP, fd, atoi(word), NULL);
+        return 0;
+    }
+    if (op.kind != TK_GTAMP || op.fd >= 0) return -1;
+    push_redir(&out->redir, REDIR_OUT, 1, -1, word);
+    push_redir(&out->redir, REDIR_DUP, 2, 1, NULL);
     return 0;
 }
 
@@ -159,6 +298,7 @@ static int set_once(char **slot, const char *path) {
 static int parse_stage(parser_t *P, cmd_t *out, int *saw_word) {
     cmd_init(out);
     *saw_word = 0;
+    size_t argc = 0, argcap = 0;
 
     for (;;) {
         token_t t = p_peek(P);
@@ -166,32 +306,45 @@ static int parse_stage(parser_t *P, cmd_t *out, int *saw_word) {
             case TK_WORD:
                 (void)p_get(P);
                 *saw_word = 1;
-                push_arg(out, t.lexeme);
-                free(t.lexeme);
+                push_arg(out, &argc, &argcap, t.lexeme, t.pattern);
+                ms_free(t.lexeme);
+                ms_free(t.pattern);
                 break;
 
-            case TK_LT: {
-                (void)p_get(P);
-                token_t a = p_get(P);
-                if (a.kind != TK_WORD) return -1; /* need a path */
-                if (set_once(&out->redir.in_path, a.lexeme) < 0) { free(a.lexeme); return -1; }
-                free(a.lexeme);
-                break;
-            }
-            case TK_GT: {
-                (void)p_get(P);
-                token_t a = p_get(P);
-                if (a.kind != TK_WORD) return -1;
-                if (set_once(&out->redir.out_path, a.lexeme) < 0) { free(a.lexeme); return -1; }
-                free(a.lexeme);
-                break;
-            }
-            case TK_DGT: {
+            case TK_LT:
+            case TK_GT:
+            case TK_DGT:
+            case TK_LTAMP:
+            case TK_GTAMP:
+            case TK_AMPGT:
+            case TK_AMPDGT: {
                 (void)p_get(P);
                 token_t a = p_get(P);
-                if (a.kind != TK_WORD) return -1;
-                if (set_once(&out->redir.append_path, a.lexeme) < 0) { free(a.lexeme); return -1; }
-                free(a.lexeme);
+                ms_free(a.pattern);        /* redirection targets are not globbed */
+                if (a.kind != TK_WORD) { ms_free(a.lexeme); return -1; } /* need a target */
+                int rc = 0;
+                switch (t.kind) {
+                    case TK_LT:
+                        push_redir(&out->redir, REDIR_IN, t.fd >= 0 ? t.fd : 0, -1, a.lexeme);
+                        break;
+                    case TK_GT:
+                        push_redir(&out->redir, REDIR_OUT, t.fd >= 0 ? t.fd : 1, -1, a.lexeme);
+                        break;
+                    case TK_DGT:
+                        push_redir(&out->redir, REDIR_APPEND, t.fd >= 0 ? t.fd : 1, -1, a.lexeme);
+                        break;
+                    case TK_AMPGT:
+                    case TK_AMPDGT:
+                        push_redir(&out->redir, t.kind == TK_AMPGT ? REDIR_OUT : REDIR_APPEND,
+                                   1, -1, a.lexeme);
+                        push_redir(&out->redir, REDIR_DUP, 2, 1, NULL);
+                        break;
+                    default:
+                        rc = push_dup_redir(out, t, a.lexeme);
+                        break;
+                }
+                ms_free(a.lexeme);
+                if (rc != 0) return -1;
                 break;
             }
 
@@ -208,7 +361,7 @@ static int parse_stage(parser_t *P, cmd_t *out, int *saw_word) {
     }
 }
 
-int parse_line(const char *line, pipeline_t *out) {
+static int parse_line_impl(const char *line, pipeline_t *out, bool expand) {
     if (!line || !out) return -1;
     memset(out, 0, sizeof(*out));
 
@@ -221,36 +374,23 @@ int parse_line(const char *line, pipeline_t *out) {
     for (;;) {
         int saw = 0;
         cmd_t c;
-        if (parse_stage(&P, &c, &saw) != 0) goto syntax_err;
-        if (!saw) goto syntax_err; /* empty stage like "|" or blank */
-
-        /* redir conflict: cannot have both > and >> */
-        if (c.redir.out_path && c.redir.append_path) {
-            if (c.argv) {
-                for (char **p = c.argv; *p; ++p) free(*p);
-                free(c.argv);
-                c.argv = NULL;
-            }
-            free(c.redir.in_path);     c.redir.in_path = NULL;
-            free(c.redir.out_path);    c.redir.out_path = NULL;
-            free(c.redir.append_path); c.redir.append_path = NULL;
+        if (parse_stage(&P, &c, &saw) != 0 || !saw) { /* !saw: empty stage like "|" */
+            cmd_free(&c);
             goto syntax_err;
         }
 
-        cmd_t *nv = (cmd_t *)realloc(stages, sizeof(cmd_t) * (n + 1));
+        cmd_t *nv = (cmd_t *)ms_realloc(MS_PARSE, stages, sizeof(cmd_t) * (n + 1));
         if (!nv) { perror("realloc"); exit(1); }
         stages = nv;
         stages[n++] = c;
 
         /* DEBUG: show parsed stage summary */
         fprintf(stderr,
-                "[parse] stage=%d argv0=%s argc=%d in=%s out=%s app=%s bg=%d\n",
+                "[parse] stage=%d argv0=%s argc=%d redirs=%d bg=%d\n",
                 n-1,
                 (c.argv && c.argv[0]) ? c.argv[0] : "(null)",
                 ({ int ac=0; if(c.argv){ while(c.argv[ac]) ac++; } ac; }),
-                c.redir.in_path     ? c.redir.in_path     : "-",
-                c.redir.out_path    ? c.redir.out_path    : "-",
-                c.redir.append_path ? c.redir.append_path : "-",
+                c.redir.nops,
                 0);
 
         token_t sep = p_peek(&P);
@@ -273,7 +413,7 @@ int parse_line(const char *line, pipeline_t *out) {
     if (n == 0) goto syntax_err;
 
     /* Apply environment variable expansion to argv tokens of every stage */
-    for (int i = 0; i < n; i++) {
+    for (int i = 0; expand && i < n; i++) {
         expand_env_vars(&stages[i]);
     }
 
@@ -283,40 +423,77 @@ int parse_line(const char *line, pipeline_t *out) {
 
 syntax_err:
     if (stages) {
-        for (int i = 0; i < n; ++i) {
-            if (stages[i].argv) {
-                for (char **p = stages[i].argv; *p; ++p) free(*p);
-                free(stages[i].argv);
-            }
-            free(stages[i].redir.in_path);
-            free(stages[i].redir.out_path);
-            free(stages[i].redir.append_path);
-        }
-        free(stages);
+        for (int i = 0; i < n; ++i) cmd_free(&stages[i]);
+        ms_free(stages);
     }
     memset(out, 0, sizeof(*out));
     return -1;
 }
 
+static int parse_line_traced(const char *line, pipeline_t *out, bool expand) {
+    if (!trace_active()) return parse_line_impl(line, out, expand);
+    uint64_t t0 = stats_now();
+    int rc = parse_line_impl(line, out, expand);
+    trace_event(TRACE_PARSE, t0, stats_now(), 0, line);
+    return rc;
+}
+
+int parse_line(const char *line, pipeline_t *out) {
+    return parse_line_traced(line, out, true);
+}
+
+int parse_line_raw(const char *line, pipeline_t *out) {
+    return parse_line_traced(line, out, false);
+}
+
+void pipeline_expand_env(pipeline_t *pl) {
+    for (int i = 0; pl && i < pl->nstages; i++) {
+        expand_env_vars(&pl->stages[i]);
+    }
+}
+
 void free_pipeline(pipeline_t *pl) {
     if (!pl || !pl->stages) return;
-    for (int i = 0; i < pl->nstages; ++i) {
-        cmd_t *c = &pl->stages[i];
-        if (c->argv) { for (char **p = c->argv; *p; ++p) free(*p); free(c->argv); }
-        free(c->redir.in_path);
-        free(c->redir.out_path);
-        free(c->redir.append_path);
-    }
-    free(pl->stages);
+    for (int i = 0; i < pl->nstages; ++i) cmd_free(&pl->stages[i]);
+    ms_free(pl->stages);
     pl->stages = NULL;
     pl->nstages = 0;
     pl->background = 0;
 }
 
+int pipeline_dup(const pipeline_t *src, pipeline_t *dst) {
+    if (!src || !dst) return -1;
+    memset(dst, 0, sizeof(*dst));
+    if (src->nstages <= 0) return 0;
+
+    dst->stages = (cmd_t *)xmalloc(MS_PARSE, sizeof(cmd_t) * (size_t)src->nstages);
+    for (int i = 0; i < src->nstages; ++i) {
+        const cmd_t *s = &src->stages[i];
+        cmd_t *d = &dst->stages[i];
+        cmd_init(d);
+        size_t argc = 0, argcap = 0;
+        for (size_t k = 0; s->argv && s->argv[k]; ++k)
+            push_arg(d, &argc, &argcap, s->argv[k], s->glob ? s->glob[k] : NULL);
+        for (int k = 0; k < s->redir.nops; ++k) {
+            const redir_op_t *op = &s->redir.ops[k];
+            push_redir(&d->redir, op->kind, op->fd, op->src_fd, op->path);
+        }
+    }
+    dst->nstages = src->nstages;
+    dst->background = src->background;
+    return 0;
+}
+
+int argv_assignments(char *const argv[]) {
+    int n = 0;
+    while (argv && argv[n] && env_assign_name_len(argv[n])) n++;
+    return n;
+}
+
 char *argv_join(char *const argv[]) {
     size_t len = 0;
     for (int i = 0; argv && argv[i]; ++i) len += strlen(argv[i]) + 1;
-    char *s = (char *)xmalloc(len + 1);
+    char *s = (char *)xmalloc(MS_JOIN, len + 1);
     s[0] = '\0';
     for (int i = 0; argv && argv[i]; ++i) {
         strcat(s, argv[i]);
@@ -356,7 +533,7 @@ static char *expand_env_token(const char *token) {
         }
     }
     buffer[pos] = '\0';
-    return xstrdup(buffer);
+    return xstrdup(MS_ENV, buffer);
 }
 
 /* Apply expansion to every argv entry in a command (free old token) */
@@ -364,7 +541,12 @@ static void expand_env_vars(cmd_t *cmd) {
     if (!cmd || !cmd->argv) return;
     for (int i = 0; cmd->argv[i] != NULL; i++) {
         char *expanded = expand_env_token(cmd->argv[i]);
-        free(cmd->argv[i]);
+        ms_free(cmd->argv[i]);
         cmd->argv[i] = expanded;
+        if (cmd->glob && cmd->glob[i]) {
+            expanded = expand_env_token(cmd->glob[i]);
+            ms_free(cmd->glob[i]);
+            cmd->glob[i] = expanded;
+        }
     }
 }
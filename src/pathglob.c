@@ -0,0 +1,527 @@
+// src/pathglob.c — pathname expansion: getdents64 reader, parallel '**' walk
+#define _GNU_SOURCE                 /* syscall() */
+#define _POSIX_C_SOURCE 200809L
+#include "pathglob.h"
+#include "memstats.h"
+
+#include <dirent.h>             /* DT_* */
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#define PG_DIRBUF      (256 * 1024)  /* one getdents64 call reads thousands of entries */
+#define PG_MAX_THREADS 16
+
+static int g_threads = 0;
+
+void pathglob_set_threads(int n) {
+    g_threads = n < 0 ? 0 : n;
+}
+
+static int walk_threads(void) {
+    if (g_threads > 0) return g_threads > PG_MAX_THREADS ? PG_MAX_THREADS : g_threads;
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    if (n < 1) n = 1;
+    return n > PG_MAX_THREADS ? PG_MAX_THREADS : (int)n;
+}
+
+// ---- result list -----------------------------------------------------------
+
+void pathglob_list_free(pathglob_list_t *l) {
+    if (!l) return;
+    for (size_t i = 0; i < l->n; ++i) ms_free(l->v[i]);
+    ms_free(l->v);
+    l->v = NULL;
+    l->n = l->cap = 0;
+}
+
+static bool list_push(pathglob_list_t *l, char *s) {
+    if (!s) return false;
+    if (l->n == l->cap) {
+        size_t cap = l->cap ? l->cap * 2 : 64;
+        char **nv = (char **)ms_realloc(MS_GLOB, l->v, cap * sizeof(char *));
+        if (!nv) { ms_free(s); return false; }
+        l->v = nv;
+        l->cap = cap;
+    }
+    l->v[l->n++] = s;
+    return true;
+}
+
+static char *join2(const char *pre, size_t plen, const char *name, size_t nlen, bool slash) {
+    char *s = (char *)ms_malloc(MS_GLOB, plen + nlen + 2);
+    if (!s) return NULL;
+    memcpy(s, pre, plen);
+    memcpy(s + plen, name, nlen);
+    if (slash) s[plen + nlen++] = '/';
+    s[plen + nlen] = '\0';
+    return s;
+}
+
+// ---- matcher ---------------------------------------------------------------
+
+/* One bracket expression at p ('['). Sets *next past ']' and returns
+   whether c is in the set; returns -1 if the bracket is unterminated
+   (then '[' is an ordinary character). */
+static int match_class(const char *p, unsigned char c, const char **next) {
+    const char *q = p + 1;
+    bool neg = false, hit = false;
+    if (*q == '!' || *q == '^') { neg = true; q++; }
+    bool first = true;
+    while (*q && (*q != ']' || first)) {
+        first = false;
+        unsigned char lo = (unsigned char)*q;
+        if (*q == '\\' && q[1]) lo = (unsigned char)*++q;
+        q++;
+        unsigned char hi = lo;
+        if (*q == '-' && q[1] && q[1] != ']') {
+            q++;
+            hi = (unsigned char)*q;
+            if (*q == '\\' && q[1]) hi = (unsigned char)*++q;
+            q++;
+        }
+        if (lo <= c && c <= hi) hit = true;
+    }
+    if (*q != ']') return -1;
+    *next = q + 1;
+    return hit != neg;
+}
+
+bool pathglob_match(const char *p, const char *s) {
+    const char *star_p = NULL, *star_s = NULL;
+    for (;;) {
+        if (*p == '*') {
+            while (*p == '*') p++;
+            if (!*p) return true;
+            star_p = p;
+            star_s = s;
+            continue;
+        }
+        if (!*s) return !*p;
+        const char *np = p + 1;
+        bool ok;
+        if (*p == '?') {
+            ok = true;
+        } else if (*p == '[') {
+            int r = match_class(p, (unsigned char)*s, &np);
+            ok = r < 0 ? *s == '[' : r == 1;
+            if (r < 0) np = p + 1;
+        } else if (*p == '\\' && p[1]) {
+            ok = p[1] == *s;
+            np = p + 2;
+        } else {
+            ok = *p && *p == *s;
+        }
+        if (ok) { p = np; s++; continue; }
+        if (!star_p) return false;
+        p = star_p;
+        s = ++star_s;
+    }
+}
+
+static bool has_meta(const char *s) {
+    for (; *s; ++s) {
+        if (*s == '\\' && s[1]) { s++; continue; }
+        if (*s == '*' || *s == '?' || *s == '[') return true;
+    }
+    return false;
+}
+
+static void unescape(char *s) {
+    char *w = s;
+    for (; *s; ++s) {
+        if (*s == '\\' && s[1]) s++;
+        *w++ = *s;
+    }
+    *w = '\0';
+}
+
+/* Hidden names need the pattern to start with a literal '.' */
+static bool name_ok(const char *pat, const char *name) {
+    if (name[0] == '.') {
+        if (name[1] == '\0' || (name[1] == '.' && name[2] == '\0')) return false;
+        if (!(pat[0] == '.' || (pat[0] == '\\' && pat[1] == '.'))) return false;
+    }
+    return pathglob_match(pat, name);
+}
+
+// ---- directory reader ------------------------------------------------------
+
+struct pg_dirent64 {
+    uint64_t       d_ino;
+    int64_t        d_off;
+    unsigned short d_reclen;
+    unsigned char  d_type;
+    char           d_name[];
+};
+
+typedef struct {
+    char   *buf;                /* PG_DIRBUF, one per thread */
+} pg_reader_t;
+
+/* Call fn(ctx, dfd, name, type) for every entry of 'dir' ("" = cwd).
+   type is a DT_* value; DT_UNKNOWN is resolved with fstatat. */
+typedef bool (*pg_entry_fn)(void *ctx, int dfd, const char *name, size_t nlen, unsigned char type);
+
+static bool read_dir(pg_reader_t *rd, const char *dir, pg_entry_fn fn, void *ctx) {
+    int fd = open(*dir ? dir : ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) return true;                /* unreadable: no matches, not an error */
+    bool ok = true;
+    for (;;) {
+        long n = syscall(SYS_getdents64, fd, rd->buf, PG_DIRBUF);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        for (long off = 0; off < n && ok; ) {
+            struct pg_dirent64 *d = (struct pg_dirent64 *)(rd->buf + off);
+            off += d->d_reclen;
+            const char *nm = d->d_name;
+            if (nm[0] == '.' && (nm[1] == '\0' || (nm[1] == '.' && nm[2] == '\0'))) continue;
+            unsigned char type = d->d_type;
+            if (type == DT_UNKNOWN) {
+                struct stat st;
+                if (fstatat(fd, nm, &st, AT_SYMLINK_NOFOLLOW) == 0) {
+                    type = S_ISDIR(st.st_mode) ? DT_DIR : S_ISLNK(st.st_mode) ? DT_LNK : DT_REG;
+                }
+            }
+            ok = fn(ctx, fd, nm, strlen(nm), type);
+        }
+        if (!ok) break;
+    }
+    close(fd);
+    return ok;
+}
+
+/* Directory test for descending through a plain component: follows symlinks. */
+static bool entry_is_dir(int dfd, const char *name, unsigned char type) {
+    if (type == DT_DIR) return true;
+    if (type != DT_LNK) return false;
+    struct stat st;
+    return fstatat(dfd, name, &st, 0) == 0 && S_ISDIR(st.st_mode);
+}
+
+// ---- expansion -------------------------------------------------------------
+
+typedef struct {
+    char  **comps;              /* components, '**' runs collapsed */
+    size_t  ncomps;
+    bool    dir_only;           /* pattern ended in '/' */
+} pg_pat_t;
+
+static bool expand_from(const pg_pat_t *P, size_t i, const char *pre, pg_reader_t *rd,
+                        pathglob_list_t *out, bool nested);
+
+typedef struct {
+    const pg_pat_t  *P;
+    size_t           i;
+    const char      *pre;
+    size_t           plen;
+    pathglob_list_t *out;       /* matches (last component) or subdirs to enter */
+    bool             last;
+} pg_step_t;
+
+static bool step_entry(void *ctx, int dfd, const char *name, size_t nlen, unsigned char type) {
+    pg_step_t *S = (pg_step_t *)ctx;
+    if (!name_ok(S->P->comps[S->i], name)) return true;
+    bool slash = !S->last || S->P->dir_only;
+    if (slash && !entry_is_dir(dfd, name, type)) return true;
+    return list_push(S->out, join2(S->pre, S->plen, name, nlen, slash));
+}
+
+// '**': a shared stack of directories drained by a pool of walkers. Each
+// walker matches the component after '**' against the entries it reads, so
+// the common '**/x' and '**/*.c' forms finish in a single pass.
+
+typedef struct {
+    const pg_pat_t  *P;
+    size_t           rest;      /* index of the first component after '**' */
+    pthread_mutex_t  mu;
+    pthread_cond_t   cv;
+    char           **stack;
+    size_t           sn, scap;
+    int              busy;      /* walkers holding a directory */
+    bool             failed;
+} pg_walk_t;
+
+typedef struct {
+    pg_walk_t       *W;
+    pg_reader_t      rd;
+    pathglob_list_t  out;
+    const char      *pre;       /* directory being read */
+    size_t           plen;
+} pg_walker_t;
+
+static bool walk_push(pg_walk_t *W, char *dir) {
+    if (!dir) return false;
+    pthread_mutex_lock(&W->mu);
+    if (W->sn == W->scap) {
+        size_t cap = W->scap ? W->scap * 2 : 256;
+        char **ns = (char **)ms_realloc(MS_GLOB, W->stack, cap * sizeof(char *));
+        if (!ns) { pthread_mutex_unlock(&W->mu); ms_free(dir); return false; }
+        W->stack = ns;
+        W->scap = cap;
+    }
+    W->stack[W->sn++] = dir;
+    pthread_cond_signal(&W->cv);
+    pthread_mutex_unlock(&W->mu);
+    return true;
+}
+
+static bool walk_entry(void *ctx, int dfd, const char *name, size_t nlen, unsigned char type) {
+    pg_walker_t *K = (pg_walker_t *)ctx;
+    pg_walk_t *W = K->W;
+    const pg_pat_t *P = W->P;
+    /* '**' descends into real, non-hidden directories only */
+    if (type == DT_DIR && name[0] != '.' &&
+        !walk_push(W, join2(K->pre, K->plen, name, nlen, true))) return false;
+
+    if (W->rest == P->ncomps) {             /* trailing '**': everything below */
+        if (name[0] == '.') return true;
+        if (P->dir_only && type != DT_DIR) return true;
+        return list_push(&K->out, join2(K->pre, K->plen, name, nlen, P->dir_only));
+    }
+    if (W->rest + 1 == P->ncomps) {         /* '**' then one last component */
+        if (!name_ok(P->comps[W->rest], name)) return true;
+        if (P->dir_only && !entry_is_dir(dfd, name, type)) return true;
+        return list_push(&K->out, join2(K->pre, K->plen, name, nlen, P->dir_only));
+    }
+    return true;
+}
+
+static void *walk_main(void *arg) {
+    pg_walker_t *K = (pg_walker_t *)arg;
+    pg_walk_t *W = K->W;
+    for (;;) {
+        pthread_mutex_lock(&W->mu);
+        while (W->sn == 0 && W->busy > 0 && !W->failed) pthread_cond_wait(&W->cv, &W->mu);
+        if (W->sn == 0 || W->failed) {
+            pthread_cond_broadcast(&W->cv);
+            pthread_mutex_unlock(&W->mu);
+            return NULL;
+        }
+        char *dir = W->stack[--W->sn];
+        W->busy++;
+        pthread_mutex_unlock(&W->mu);
+
+        K->pre = dir;
+        K->plen = strlen(dir);
+        bool ok = read_dir(&K->rd, dir, walk_entry, K);
+        /* several components after the '**': expand them from this directory */
+        if (ok && W->rest + 1 < W->P->ncomps)
+            ok = expand_from(W->P, W->rest, dir, &K->rd, &K->out, true);
+        ms_free(dir);
+
+        pthread_mutex_lock(&W->mu);
+        W->busy--;
+        if (!ok) W->failed = true;
+        if ((W->sn == 0 && W->busy == 0) || W->failed) pthread_cond_broadcast(&W->cv);
+        pthread_mutex_unlock(&W->mu);
+    }
+}
+
+static bool walk_globstar(const pg_pat_t *P, size_t i, const char *pre, pg_reader_t *rd,
+                          pathglob_list_t *out, bool nested) {
+    pg_walk_t W = { .P = P, .rest = i + 1 };
+    pthread_mutex_init(&W.mu, NULL);
+    pthread_cond_init(&W.cv, NULL);
+    bool ok = walk_push(&W, ms_strdup(MS_GLOB, pre));
+
+    /* a '**' reached from inside another walk stays on that walker's thread */
+    int n = nested ? 1 : walk_threads();
+    pg_walker_t *K = (pg_walker_t *)ms_calloc(MS_GLOB, (size_t)n, sizeof(*K));
+    pthread_t *tid = (pthread_t *)ms_calloc(MS_GLOB, (size_t)n, sizeof(pthread_t));
+    if (!K || !tid) ok = false;
+    int started = 0;
+    if (ok) {
+        K[0].W = &W;
+        K[0].rd = *rd;
+        for (int t = 1; t < n; ++t) {
+            K[t].W = &W;
+            K[t].rd.buf = (char *)ms_malloc(MS_GLOB, PG_DIRBUF);
+            if (!K[t].rd.buf || pthread_create(&tid[t], NULL, walk_main, &K[t]) != 0) {
+                ms_free(K[t].rd.buf);
+                K[t].rd.buf = NULL;
+                break;
+            }
+            started++;
+        }
+        walk_main(&K[0]);
+        for (int t = 1; t <= started; ++t) pthread_join(tid[t], NULL);
+        if (started + 1 < n)
+            fprintf(stderr, "[glob] ** walk: started %d of %d walker(s)\n", started + 1, n);
+        ok = !W.failed;
+        for (int t = 0; t <= started && ok; ++t) {
+            for (size_t k = 0; k < K[t].out.n; ++k) {
+                if (!list_push(out, K[t].out.v[k])) { ok = false; K[t].out.v[k] = NULL; break; }
+                K[t].out.v[k] = NULL;
+            }
+        }
+    }
+    for (int t = 0; K && t < n; ++t) {
+        pathglob_list_free(&K[t].out);
+        if (t > 0) ms_free(K[t].rd.buf);
+    }
+    for (size_t k = 0; k < W.sn; ++k) ms_free(W.stack[k]);
+    ms_free(W.stack);
+    ms_free(K);
+    ms_free(tid);
+    pthread_cond_destroy(&W.cv);
+    pthread_mutex_destroy(&W.mu);
+    return ok;
+}
+
+/* Match components i.. below 'pre' ("" or a path ending in '/'). */
+static bool expand_from(const pg_pat_t *P, size_t i, const char *pre, pg_reader_t *rd,
+                        pathglob_list_t *out, bool nested) {
+    size_t plen = strlen(pre);
+    if (i == P->ncomps) {                   /* reached through a trailing '/' */
+        return plen == 0 || list_push(out, ms_strdup(MS_GLOB, pre));
+    }
+    const char *c = P->comps[i];
+    bool last = i + 1 == P->ncomps;
+
+    if (strcmp(c, "**") == 0) return walk_globstar(P, i, pre, rd, out, nested);
+
+    if (!has_meta(c)) {
+        char *lit = ms_strdup(MS_GLOB, c);
+        if (!lit) return false;
+        unescape(lit);
+        char *path = join2(pre, plen, lit, strlen(lit), !last || P->dir_only);
+        ms_free(lit);
+        if (!path) return false;
+        if (!last) {
+            bool ok = expand_from(P, i + 1, path, rd, out, nested);
+            ms_free(path);
+            return ok;
+        }
+        struct stat st;
+        if (lstat(path, &st) != 0 || (P->dir_only && stat(path, &st) != 0) ||
+            (P->dir_only && !S_ISDIR(st.st_mode))) {
+            ms_free(path);
+            return true;
+        }
+        return list_push(out, path);
+    }
+
+    if (last) {
+        pg_step_t S = { P, i, pre, plen, out, true };
+        return read_dir(rd, pre, step_entry, &S);
+    }
+    /* the reader's buffer is busy until read_dir returns: collect the
+       matching subdirectories first, then descend */
+    pathglob_list_t subs = {0};
+    pg_step_t S = { P, i, pre, plen, &subs, false };
+    bool ok = read_dir(rd, pre, step_entry, &S);
+    for (size_t k = 0; k < subs.n && ok; ++k) ok = expand_from(P, i + 1, subs.v[k], rd, out, nested);
+    pathglob_list_free(&subs);
+    return ok;
+}
+
+/* Split on '/'; a leading '/' becomes the "/" prefix. */
+static bool split_pattern(const char *pattern, pg_pat_t *P, char **root) {
+    size_t len = strlen(pattern);
+    P->comps = (char **)ms_calloc(MS_GLOB, len / 2 + 2, sizeof(char *));
+    if (!P->comps) return false;
+    *root = ms_strdup(MS_GLOB, pattern[0] == '/' ? "/" : "");
+    if (!*root) return false;
+    P->dir_only = len > 1 && pattern[len - 1] == '/';
+    for (const char *s = pattern; *s; ) {
+        while (*s == '/') s++;
+        if (!*s) break;
+        const char *e = s;
+        while (*e && *e != '/') e++;
+        bool star2 = e - s == 2 && s[0] == '*' && s[1] == '*';
+        bool prev2 = P->ncomps > 0 && strcmp(P->comps[P->ncomps - 1], "**") == 0;
+        if (!(star2 && prev2)) {
+            char *c = strndup(s, (size_t)(e - s));
+            if (!c) return false;
+            P->comps[P->ncomps++] = c;
+        }
+        s = e;
+    }
+    return true;
+}
+
+long pathglob_expand(const char *pattern, pathglob_list_t *out) {
+    pg_pat_t P = {0};
+    char *root = NULL;
+    pg_reader_t rd = { (char *)ms_malloc(MS_GLOB, PG_DIRBUF) };
+    size_t base = out->n;
+    bool ok = rd.buf && split_pattern(pattern, &P, &root);
+    if (ok && P.ncomps == 0) ok = list_push(out, ms_strdup(MS_GLOB, root));   /* "/" */
+    else if (ok) ok = expand_from(&P, 0, root, &rd, out, false);
+
+    for (size_t k = 0; k < P.ncomps; ++k) ms_free(P.comps[k]);
+    ms_free(P.comps);
+    ms_free(root);
+    ms_free(rd.buf);
+    if (!ok) {
+        fprintf(stderr, "[glob] %s: out of memory\n", pattern);
+        for (size_t k = base; k < out->n; ++k) ms_free(out->v[k]);
+        out->n = base;
+        return -1;
+    }
+    pathglob_sort(out->v + base, out->n - base);
+    return (long)(out->n - base);
+}
+
+// ---- sort ------------------------------------------------------------------
+
+static inline int ch_at(const char *s, size_t d) {
+    return (unsigned char)s[d];
+}
+
+static void swap_p(char **v, size_t a, size_t b) {
+    char *t = v[a]; v[a] = v[b]; v[b] = t;
+}
+
+static void ins_sort(char **v, size_t n, size_t d) {
+    for (size_t i = 1; i < n; ++i) {
+        for (size_t j = i; j > 0 && strcmp(v[j - 1] + d, v[j] + d) > 0; --j) swap_p(v, j - 1, j);
+    }
+}
+
+/* Bentley–Sedgewick three-way radix quicksort on byte d. Directory listings
+   share long prefixes ("src/module/file_00123"), which this compares once
+   per partition level instead of once per strcmp. */
+static void mkqsort(char **v, size_t n, size_t d) {
+    while (n > 12) {
+        int piv = ch_at(v[n / 2], d);
+        size_t lt = 0, gt = n, i = 0;
+        /* v[0..lt) < piv, v[lt..i) == piv, v[gt..n) > piv */
+        while (i < gt) {
+            int c = ch_at(v[i], d);
+            if (c < piv) swap_p(v, lt++, i++);
+            else if (c > piv) swap_p(v, i, --gt);
+            else i++;
+        }
+        mkqsort(v, lt, d);
+        mkqsort(v + gt, n - gt, d);
+        if (piv == 0) return;               /* equal strings: done */
+        v += lt;
+        n = gt - lt;
+        d++;
+    }
+    ins_sort(v, n, d);
+}
+
+void pathglob_sort(char **v, size_t n) {
+    if (n < 2) return;
+    /* matches usually share their directory: skip it in one pass instead
+       of one partition level per byte */
+    size_t lcp = strlen(v[0]);
+    for (size_t i = 1; i < n && lcp; ++i) {
+        size_t k = 0;
+        while (k < lcp && v[i][k] == v[0][k]) k++;
+        lcp = k;
+    }
+    mkqsort(v, n, lcp);
+}
@@ -1,13 +1,28 @@
 // src/pipeline_exec.c
+#define _GNU_SOURCE             /* pipe2 */
 #define _POSIX_C_SOURCE 200809L
 #include "parser.h"     // pipeline_t, cmd_t, redir_t, argv_join
 #include "exec.h"       // run_command, exec_opts_t, wait_for_child
 #include "builtins.h"
 #include "jobs.h"
+#include "cpuctl.h"
+#include "rlimits.h"
+#include "timeout.h"
+#include "redir.h"
+#include "pathglob.h"
+#include "stats.h"
+#include "transcript.h"
+#include "env.h"
+#include "memstats.h"
+#include "trace.h"
+#include "readbuf.h"
+#include "jsonl.h"
 
 #include <unistd.h>
 #include <sys/wait.h>
 #include <errno.h>
+#include <pthread.h>
+#include <signal.h>
 #include <string.h>
 #include <stdio.h>
 #include <fcntl.h>
@@ -16,48 +31,20 @@
 #include <limits.h>
 #include <stdbool.h>
 #include <sys/types.h>
+#include <sys/syscall.h>
+#include <sys/resource.h>
+#include <sys/time.h>
 
 /* Provided by src/exec.c */
 extern char *expand_arg(const char *arg);
 
-/* Capture the initial working directory so we can place test artifacts
-   (for example, files under tests/tmp) in the repo even if the shell ran `cd /`. */
-static const char *get_initial_cwd(void) {
-    static char buf[PATH_MAX];
-    static int  init = 0;
-    if (!init) {
-        if (!getcwd(buf, sizeof(buf))) {
-            strcpy(buf, "."); /* best-effort */
-        }
-        init = 1;
-        fprintf(stderr, "[pipe] initial cwd: %s\n", buf);
-    }
-    return buf;
-}
-
-/* If path starts with "tests/", remap to initial repo cwd.
-   Returns a malloc'd string (caller frees) or NULL on error. */
-static char *maybe_map_to_repo(const char *path) {
-    if (!path) return strdup("");
-    if (path[0] == '/') return strdup(path);
-    if (strncmp(path, "tests/", 6) != 0)   return strdup(path);
-
-    const char *root = get_initial_cwd();
-    size_t need = strlen(root) + 1 + strlen(path) + 1;
-    char *full = (char*)malloc(need);
-    if (!full) { perror("malloc"); return NULL; }
-    snprintf(full, need, "%s/%s", root, path);
-    fprintf(stderr, "[pipe] map relative '%s' -> '%s'\n", path, full);
-    return full;
-}
-
 /* ---------- helper: PATH search (because run_command uses execv, not execvp) ---------- */
-static char *resolve_cmd_path(const char *cmd) {
+static char *path_search(const char *cmd) {
     if (!cmd || !*cmd) return NULL;
 
     /* If it already contains a '/', treat it as a path and return a copy. */
     if (strchr(cmd, '/')) {
-        return strdup(cmd);
+        return ms_strdup(MS_EXEC, cmd);
     }
 
     const char *path = getenv("PATH");
@@ -91,7 +78,7 @@ static char *resolve_cmd_path(const char *cmd) {
         }
 
         if (access(cand, X_OK) == 0) {
-            return strdup(cand);
+            return ms_strdup(MS_EXEC, cand);
         }
 
         if (*p == ':') p++;
@@ -100,241 +87,400 @@ static char *resolve_cmd_path(const char *cmd) {
     return NULL; /* not found in PATH */
 }
 
-/* ---------- mkdir -p for a file path's parent dir ---------- */
-static int mkdir_p_for_file(const char *filepath, mode_t mode){
-    if (!filepath || !*filepath) return 0;
-
-    /* Extract parent directory from filepath */
-    char tmp[PATH_MAX];
-    size_t L = strnlen(filepath, sizeof(tmp));
-    if (L == 0 || L >= sizeof(tmp)) return -1;
-    memcpy(tmp, filepath, L);
-    tmp[L] = '\0';
-
-    char *slash = strrchr(tmp, '/');
-    if (!slash) return 0; /* no parent dir needed */
-    if (slash == tmp) {
-        /* parent is "/" */
-        return 0;
-    }
-    *slash = '\0'; /* tmp now holds parent directory path */
-
-    /* Build progressively: split on '/' */
-    char build[PATH_MAX];
-    build[0] = '\0';
+char *resolve_cmd_path(const char *cmd) {
+    if (!trace_active()) return path_search(cmd);
+    uint64_t t0 = stats_now();
+    char *abs = path_search(cmd);
+    trace_event(TRACE_RESOLVE, t0, stats_now(), 0, cmd);
+    return abs;
+}
 
-    const char *src = tmp;
-    if (src[0] == '/') {
-        strcpy(build, "/");
-        src++; /* skip first slash */
-    }
+/* Make room for one more entry plus the NULL terminator. */
+static bool argv_reserve(pathglob_list_t *l) {
+    if (l->n + 1 < l->cap) return true;
+    size_t cap = l->cap ? l->cap * 2 : 8;
+    char **nv = (char **)ms_realloc(MS_ARGV, l->v, cap * sizeof(char *));
+    if (!nv) { perror("realloc"); return false; }
+    l->v = nv;
+    l->cap = cap;
+    return true;
+}
 
-    while (*src) {
-        /* Find next component */
-        const char *next = strchr(src, '/');
-        size_t comp_len = next ? (size_t)(next - src) : strlen(src);
-        if (comp_len == 0) { src = next ? next + 1 : src + comp_len; continue; }
-
-        // BEFORE adding the next component, ensure build ends with '/'
-        size_t blen = strlen(build);
-        if (blen == 0 || build[blen - 1] != '/') {
-            if (blen + 1 >= sizeof(build)) return -1;
-            build[blen++] = '/';
-            build[blen] = '\0';
+/* Glob words (glob[i] set) become their sorted matches, or stay as typed
+   when nothing matches. Other words go through expand_arg (~ and $VAR)
+   when 'words' is set; builtins get their words as parsed. */
+char **exec_expand_argv(char *const argv[], char *const glob[], bool words) {
+    if (!argv) return NULL;
+    pathglob_list_t out = {0};
+
+    for (size_t i = 0; argv[i]; ++i) {
+        const char *pat = glob ? glob[i] : NULL;
+        if (pat) {
+            char *tilde = pat[0] == '~' ? expand_arg(pat) : NULL;
+            long got = pathglob_expand(tilde ? tilde : pat, &out);
+            fprintf(stderr, "[pipe] expand_argv: [%zu] glob '%s' -> %ld match(es)\n",
+                    i, tilde ? tilde : pat, got);
+            ms_free(tilde);
+            if (got < 0) { pathglob_list_free(&out); return NULL; }
+            if (got > 0) continue;
         }
+        char *e = words && !pat ? expand_arg(argv[i]) : NULL;   /* may strdup("") or copy */
+        if (!e) { e = ms_strdup(MS_ARGV, argv[i]); }     /* fallback */
+        if (words && !pat)
+            fprintf(stderr, "[pipe] expand_argv: [%zu] '%s' -> '%s'\n", i, argv[i], e);
+        if (!e || !argv_reserve(&out)) { ms_free(e); pathglob_list_free(&out); return NULL; }
+        out.v[out.n++] = e;
+    }
+    if (!argv_reserve(&out)) { pathglob_list_free(&out); return NULL; }
+    out.v[out.n] = NULL;
+    return out.v;
+}
 
-        // Append the component
-        if (blen + comp_len >= sizeof(build)) return -1;
-        strncat(build, src, comp_len);
+static void free_argv(char **argv) {
+    if (!argv) return;
+    for (size_t i = 0; argv[i]; ++i) ms_free(argv[i]);
+    ms_free(argv);
+}
 
+/* ---------- builtins ---------- */
 
-        fprintf(stderr, "[pipe] mkdir -p: '%s'\n", build);
-        int rc = mkdir(build, mode);
-        if (rc != 0 && errno != EEXIST) {
-            fprintf(stderr, "[pipe] mkdir failed: %s: %s\n", build, strerror(errno));
-            return -1;
-        }
+/* Helper: run a single-stage builtin in the parent with possible redirections.
+   The first 'nassign' words are NAME=value assignments, in effect for the call. */
+static int run_builtin_with_redir(cmd_t *cmd, int nassign) {
+    char *const *argv = cmd->argv + nassign;
+    char *const *glob = cmd->glob ? cmd->glob + nassign : NULL;
+    redir_stage_t rs;
+    int saved[EXEC_FDPLAN_MAXFD];
+    int result = 0;
 
-        src = next ? next + 1 : src + comp_len;
+    if (redir_prepare(&cmd->redir, -1, -1, &rs) != 0) return -1;
+    if (redir_apply_saved(&rs.plan, saved) != 0) {
+        redir_release(&rs);
+        return -1;
     }
-    return 0;
-}
 
-/* Expand all argv entries using expand_arg (~ and $VAR); returns a new argv[]. */
-static char **expand_argv(char *const argv[]) {
-    if (!argv) return NULL;
-    size_t n = 0;
-    while (argv[n]) n++;
-
-    char **nv = (char **)calloc(n + 1, sizeof(char *));
-    if (!nv) { perror("calloc"); return NULL; }
+    fprintf(stderr, "[pipe] builtin(parent): argv0='%s' assignments=%d\n",
+            argv[0] ? argv[0] : "(null)", nassign);
+    char **undo = env_push(cmd->argv, nassign);
+    uint64_t t0 = stats_now();
+    if (glob) {
+        char **xargv = exec_expand_argv(argv, glob, false);
+        result = xargv ? run_builtin_parent(xargv) : -1;
+        free_argv(xargv);
+    } else {
+        result = run_builtin_parent(argv);
+    }
+    env_pop(undo);
 
-    for (size_t i = 0; i < n; ++i) {
-        char *e = expand_arg(argv[i]);       /* may strdup("") or copy */
-        if (!e) { e = strdup(argv[i]); }     /* fallback */
-        nv[i] = e;
-        fprintf(stderr, "[pipe] expand_argv: [%zu] '%s' -> '%s'\n", i, argv[i], nv[i]);
+    /* For test harness: treat single-stage 'exit' as success */
+    if (argv[0] && strcmp(argv[0], "exit") == 0) {
+        result = 0;
     }
-    nv[n] = NULL;
-    return nv;
-}
+    stats_exit(argv[0], stats_now() - t0, result >= 0 && result < 256 ? result : 1);
 
-static void free_argv(char **argv) {
-    if (!argv) return;
-    for (size_t i = 0; argv[i]; ++i) free(argv[i]);
-    free(argv);
+    redir_restore(&rs.plan, saved);
+    redir_release(&rs);
+    return result;
 }
 
-/* ---------- redirection helpers ---------- */
-static int open_redir_files(const redir_t *redir, int *in_fd, int *out_fd) {
-    *in_fd = -1;
-    *out_fd = -1;
-
-    /* Resolve targets (map any "tests/" path to repo root when needed) */
-    char *mapped_out = NULL;
-    char *mapped_app = NULL;
-
-    if (redir->in_path) {
-        fprintf(stderr, "[pipe] open_redir_files: in '< %s'\n", redir->in_path);
-        *in_fd = open(redir->in_path, O_RDONLY);
-        if (*in_fd < 0) {
-            perror(redir->in_path);
-            goto fail;
+/* ---------- stage prefixes ---------- */
+
+/* Launch controls peeled off a stage's leading `NAME=value` words, then
+   `on ...` / `ulimit ... CMD` / `timeout ... CMD`. */
+typedef struct {
+    exec_sched_t   sched;
+    exec_limits_t  limits;
+    exec_timeout_t timeout;
+    bool has_sched, has_limits, has_timeout;
+    char *const *assign;        /* argv itself: the first nassign words */
+    int  nassign;
+} stage_ctl_t;
+
+/* Returns the number of prefix words before the real command, -1 on error. */
+static int parse_stage_prefixes(char *const argv[], stage_ctl_t *ctl) {
+    memset(ctl, 0, sizeof(*ctl));
+    if (!argv) return 0;
+    ctl->assign = argv;
+    ctl->nassign = argv_assignments(argv);
+    int skip = ctl->nassign;
+    for (;;) {
+        int n = cpuctl_parse_on(argv + skip, &ctl->sched);
+        if (n < 0) return -1;
+        if (n > 0) { ctl->has_sched = true; skip += n; continue; }
+
+        n = rlimits_parse_prefix(argv + skip, &ctl->limits);
+        if (n < 0) return -1;
+        if (n > 0) { ctl->has_limits = true; skip += n; continue; }
+
+        n = timeout_parse_prefix(argv + skip, &ctl->timeout);
+        if (n < 0) return -1;
+        if (n > 0) { ctl->has_timeout = true; skip += n; continue; }
+
+        if (skip > ctl->nassign && argv[skip] && is_builtin(argv[skip])) {
+            fprintf(stderr, "%s: prefix cannot be applied to a builtin\n", argv[skip]);
+            return -1;
         }
+        return skip;
     }
+}
 
-    if (redir->out_path) {
-        mapped_out = maybe_map_to_repo(redir->out_path);
-        if (!mapped_out) goto fail;
-        fprintf(stderr, "[pipe] open_redir_files: out '> %s' (mapped='%s')\n",
-                redir->out_path, mapped_out);
-        if (mkdir_p_for_file(mapped_out, 0755) != 0) {
-            fprintf(stderr, "[pipe] mkdir_p_for_file failed for '%s'\n", mapped_out);
-        }
-        *out_fd = open(mapped_out, O_WRONLY | O_CREAT | O_TRUNC, 0644);
-        if (*out_fd < 0) {
-            perror(mapped_out);
-            goto fail;
-        }
-    } else if (redir->append_path) {
-        mapped_app = maybe_map_to_repo(redir->append_path);
-        if (!mapped_app) goto fail;
-        fprintf(stderr, "[pipe] open_redir_files: out '>> %s' (mapped='%s')\n",
-                redir->append_path, mapped_app);
-        if (mkdir_p_for_file(mapped_app, 0755) != 0) {
-            fprintf(stderr, "[pipe] mkdir_p_for_file failed for '%s'\n", mapped_app);
-        }
-        *out_fd = open(mapped_app, O_WRONLY | O_CREAT | O_APPEND, 0644);
-        if (*out_fd < 0) {
-            perror(mapped_app);
-            goto fail;
-        }
-    }
+static exec_opts_t stage_opts(const exec_fdplan_t *plan, bool bg, const stage_ctl_t *ctl) {
+    exec_opts_t o = { -1, -1, -1, bg,
+                      ctl->has_sched  ? &ctl->sched  : NULL,
+                      ctl->has_limits ? &ctl->limits : NULL,
+                      plan, ctl->assign, ctl->nassign };
+    return o;
+}
 
-    free(mapped_out);
-    free(mapped_app);
-    return 0;
+/* ---------- exec in place ---------- */
 
-fail:
-    if (*in_fd  >= 0) { close(*in_fd);  *in_fd  = -1; }
-    if (*out_fd >= 0) { close(*out_fd); *out_fd = -1; }
-    free(mapped_out);
-    free(mapped_app);
-    return -1;
+/* execve skips atexit handlers and stdio buffers: everything the shell
+   still holds goes out before its image is replaced. */
+static void exec_flush_shell(void) {
+    readbuf_sync_all();
+    if (jsonl_active()) jsonl_flush();
+    transcript_flush();
+    if (trace_active()) trace_close();
+    fflush(NULL);
 }
 
-/* ---------- builtins ---------- */
+/* Replace the shell with the external command in 'cmd' (its first 'skip'
+   words are the prefixes in 'ctl'). Returns only if it cannot: 127 when
+   the command is not found (nothing printed), -1 on other errors. */
+static int exec_in_place(cmd_t *cmd, int skip, const stage_ctl_t *ctl) {
+    redir_stage_t rs;
+    if (redir_prepare(&cmd->redir, -1, -1, &rs) != 0) return -1;
+    char **xargv = exec_expand_argv(cmd->argv + skip, cmd->glob ? cmd->glob + skip : NULL, true);
+    if (!xargv) { redir_release(&rs); return -1; }
+
+    char *abs = resolve_cmd_path(xargv[0]);
+    char **envp = NULL;
+    if (!abs || (ctl->nassign > 0 && !(envp = env_launch(ctl->assign, ctl->nassign)))) {
+        int rc = abs ? -1 : 127;
+        ms_free(abs);
+        free_argv(xargv);
+        redir_release(&rs);
+        return rc;
+    }
+    fprintf(stderr, "[pipe] exec in place: '%s' pid=%d\n", abs, (int)getpid());
+    exec_flush_shell();
+    exec_child(abs, xargv, envp, &rs.plan,
+               ctl->has_sched ? &ctl->sched : NULL, ctl->has_limits ? &ctl->limits : NULL);
+}
 
-/* Extend parent-run builtins to include "jobs" (prints to stdout; respects redirection). */
-static int run_builtin_parent_ext(char *const argv[]) {
-    if (argv && argv[0] && strcmp(argv[0], "jobs") == 0) {
-        jobs_print_active();
-        jobs_mark_done_nonblocking();
+/* `exec [CMD [ARG...]]` as a whole command. Words after `exec` take the
+   usual prefixes; assignments before it stay set, as for a special
+   builtin. With no command the redirections last for the rest of the
+   session; otherwise this returns only if CMD could not be started.
+   Failure: CMD not found on PATH returns 127 and the shell goes on; once
+   it is found, a failed execve (or setup) ends the shell itself with
+   127 (126), after its redirections were applied, as exec_child() does. */
+static int exec_builtin(cmd_t *cmd, int skip, const stage_ctl_t *outer) {
+    env_assign(outer->assign, outer->nassign);
+    cmd_t rest = *cmd;
+    rest.argv += skip + 1;
+    if (rest.glob) rest.glob += skip + 1;
+
+    if (!rest.argv[0]) {
+        redir_stage_t rs;
+        if (redir_prepare(&cmd->redir, -1, -1, &rs) != 0) return 1;
+        redir_apply_keep(&rs);
+        fprintf(stderr, "[pipe] exec: %d redirection(s) kept\n", cmd->redir.nops);
         return 0;
     }
-    return run_builtin_parent(argv);
+
+    stage_ctl_t ctl;
+    int n = parse_stage_prefixes(rest.argv, &ctl);
+    if (n < 0) return 1;
+    if (!rest.argv[n]) {
+        env_assign(ctl.assign, ctl.nassign);
+        return 0;
+    }
+    if (ctl.has_timeout || is_builtin(rest.argv[n])) {
+        fprintf(stderr, "exec: %s: %s\n", rest.argv[n],
+                ctl.has_timeout ? "timeout needs the shell to wait" : "not an external command");
+        return 1;
+    }
+    int rc = exec_in_place(&rest, n, &ctl);
+    if (rc == 127) fprintf(stderr, "exec: %s: not found\n", rest.argv[n]);
+    return rc < 0 ? 1 : rc;
 }
 
-/* Helper: run a single-stage builtin in the parent with possible redirections */
-static int run_builtin_with_redir(cmd_t *cmd) {
-    int saved_stdin  = -1;
-    int saved_stdout = -1;
-    int in_fd = -1, out_fd = -1;
-    int result = 0;
+/* Per-stage launch time, for stats once the stage is reaped. */
+typedef struct {
+    uint64_t    t0;
+    const char *name;
+} stage_clock_t;
 
-    if (open_redir_files(&cmd->redir, &in_fd, &out_fd) != 0) return -1;
+/* Transcript form of a wait status: exit code, or 128+N for signal N. */
+static int stage_code(int status) {
+    if (WIFEXITED(status))   return WEXITSTATUS(status);
+    if (WIFSIGNALED(status)) return 128 + WTERMSIG(status);
+    return -1;
+}
 
-    if (in_fd >= 0) {
-        saved_stdin = dup(STDIN_FILENO);
-        if (saved_stdin < 0 || dup2(in_fd, STDIN_FILENO) < 0) {
-            perror("dup2 stdin");
-            result = -1;
-            goto cleanup;
-        }
+/* ---------- builtin stages on threads ----------
+   A builtin with an output-only form (see builtins.h) in a foreground
+   pipeline runs on a thread of the shell instead of a forked child. The
+   thread owns close-on-exec copies of its pipe ends, so the reader sees
+   EOF when it finishes. Threads start only after every child of the
+   pipeline has been forked: no child is ever forked while one of them
+   holds a stdio or allocator lock. */
+typedef enum { ST_NONE, ST_READY, ST_RUNNING, ST_DONE } stage_thread_state_t;
+typedef struct {
+    stage_thread_state_t state;
+    pthread_t  thr;
+    char     **argv;            /* expanded, or the stage's own words */
+    char     **owned;           /* what to free_argv() afterwards */
+    int        in_fd, out_fd;
+    int        rc;
+    int        tid;             /* its trace track */
+} stage_thread_t;
+
+static void *stage_thread_main(void *arg) {
+    stage_thread_t *st = (stage_thread_t *)arg;
+    st->tid = (int)syscall(SYS_gettid);
+
+    /* A reader that already exited must cost this stage, not the shell:
+       with SIGPIPE blocked the write fails with EPIPE, and the signal
+       left pending on this thread is taken back below. */
+    sigset_t pipe_set;
+    sigemptyset(&pipe_set);
+    sigaddset(&pipe_set, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &pipe_set, NULL);
+
+    FILE *out = fdopen(st->out_fd, "w");
+    if (!out) {
+        perror("fdopen");
+        close(st->out_fd);
+        st->rc = 1;
+    } else {
+        st->rc = run_builtin_to(st->argv, out);
+        fclose(out);
     }
-
-    if (out_fd >= 0) {
-        saved_stdout = dup(STDOUT_FILENO);
-        if (saved_stdout < 0 || dup2(out_fd, STDOUT_FILENO) < 0) {
-            perror("dup2 stdout");
-            result = -1;
-            goto cleanup;
-        }
+    if (st->in_fd >= 0) close(st->in_fd);
+
+    sigset_t pending;
+    sigpending(&pending);
+    if (sigismember(&pending, SIGPIPE)) {
+        struct timespec zero = { 0, 0 };
+        sigtimedwait(&pipe_set, NULL, &zero);
+        st->rc = 128 + SIGPIPE;             /* as if the child had been killed */
     }
+    return NULL;
+}
 
-    fprintf(stderr, "[pipe] builtin(parent): argv0='%s'\n",
-            cmd->argv && cmd->argv[0] ? cmd->argv[0] : "(null)");
-    result = run_builtin_parent_ext(cmd->argv);
-
-    /* For test harness: treat single-stage 'exit' as success */
-    if (cmd->argv && cmd->argv[0] && strcmp(cmd->argv[0], "exit") == 0) {
-        result = 0;
+/* Give stage 'st' its own descriptors and words. Returns 0, or -1 (nothing
+   left to release). */
+static int stage_thread_prepare(stage_thread_t *st, char *const *argv, char *const *glob,
+                                int in_fd, int out_fd) {
+    memset(st, 0, sizeof(*st));
+    st->in_fd = -1;
+    st->out_fd = fcntl(out_fd >= 0 ? out_fd : STDOUT_FILENO, F_DUPFD_CLOEXEC, 3);
+    if (st->out_fd < 0) { perror("fcntl"); return -1; }
+    if (in_fd >= 0 && (st->in_fd = fcntl(in_fd, F_DUPFD_CLOEXEC, 3)) < 0) {
+        perror("fcntl");
+        close(st->out_fd);
+        return -1;
+    }
+    st->owned = glob ? exec_expand_argv(argv, glob, false) : NULL;
+    st->argv = glob ? st->owned : (char **)argv;
+    if (!st->argv) {
+        close(st->out_fd);
+        if (st->in_fd >= 0) close(st->in_fd);
+        return -1;
     }
+    st->state = ST_READY;
+    return 0;
+}
 
-cleanup:
-    if (saved_stdin  >= 0) { dup2(saved_stdin,  STDIN_FILENO);  close(saved_stdin); }
-    if (saved_stdout >= 0) { dup2(saved_stdout, STDOUT_FILENO); close(saved_stdout); }
-    if (in_fd  >= 0) close(in_fd);
-    if (out_fd >= 0) close(out_fd);
-    return result;
+static void stage_thread_start(stage_thread_t *st) {
+    int rc = pthread_create(&st->thr, NULL, stage_thread_main, st);
+    if (rc == 0) { st->state = ST_RUNNING; return; }
+    /* No thread: run it here; the other stages are already running */
+    fprintf(stderr, "[pipe] pthread_create: %s; running builtin inline\n", strerror(rc));
+    stage_thread_main(st);
+    st->state = ST_DONE;
 }
 
-/* ---------- main entry ---------- */
-int exec_pipeline(const pipeline_t *pl) {
-    if (!pl || pl->nstages == 0) {
-        fprintf(stderr, "exec_pipeline: empty pipeline\n");
-        return -1;
+/* Join a started stage, or release one the pipeline gave up on before
+   starting it. Returns its status (-1 if it never ran). */
+static int stage_thread_finish(stage_thread_t *st) {
+    if (st->state == ST_RUNNING) {
+        pthread_join(st->thr, NULL);
+    } else if (st->state == ST_READY) {
+        close(st->out_fd);
+        if (st->in_fd >= 0) close(st->in_fd);
+        st->rc = -1;
     }
+    if (st->state != ST_NONE) free_argv(st->owned);
+    st->state = ST_NONE;
+    return st->rc;
+}
 
+/* ---------- launcher ----------
+   Runs 'pl'. Foreground: waits and returns the exit status. Background:
+   stores the representative (last-stage) PID in *bg_pid and returns 0
+   without registering the job; exec_pipeline() owns job bookkeeping.
+   'stage_status' (NULL, or nstages entries preset to -1) receives each
+   foreground stage's stage_code(), 'stage_pid' (NULL, or nstages entries
+   preset to 0) each forked stage's PID. */
+static int exec_pipeline_run(const pipeline_t *pl, pid_t *bg_pid, int *stage_status,
+                             pid_t *stage_pid) {
+    *bg_pid = -1;
     fprintf(stderr, "[pipe] exec_pipeline: nstages=%d bg=%d\n", pl->nstages, pl->background);
 
     /* -------- Single-stage fast path -------- */
     if (pl->nstages == 1) {
         cmd_t *cmd = &pl->stages[0];
 
+        /* Optional `on ...` / `ulimit ... CMD` prefixes for the child */
+        stage_ctl_t ctl;
+        int skip = parse_stage_prefixes(cmd->argv, &ctl);
+        if (skip < 0) return -1;
+        char *const *argv = cmd->argv ? cmd->argv + skip : NULL;
+
+        /* Only assignments: they set shell variables */
+        if (argv && !argv[0]) {
+            env_assign(ctl.assign, ctl.nassign);
+            if (stage_status) stage_status[0] = 0;
+            return 0;
+        }
+
+        if (argv && argv[0] && strcmp(argv[0], "exec") == 0) {
+            int erc = exec_builtin(cmd, skip, &ctl);
+            if (stage_status) stage_status[0] = erc;
+            return erc;
+        }
+
         /* Builtin in parent so it can affect shell state (e.g., cd) */
-        if (cmd->argv && cmd->argv[0] && is_builtin(cmd->argv[0])) {
-            return run_builtin_with_redir(cmd);
+        if (argv && argv[0] && is_builtin(argv[0])) {
+            int brc = run_builtin_with_redir(cmd, skip);
+            if (stage_status) stage_status[0] = brc;
+            return brc;
         }
 
         /* External command with optional redirs */
-        int in_fd, out_fd;
-        if (open_redir_files(&cmd->redir, &in_fd, &out_fd) != 0) return -1;
+        redir_stage_t rs;
+        if (redir_prepare(&cmd->redir, -1, -1, &rs) != 0) return -1;
 
         /* Expand argv entries (~ and $VAR) */
-        char **xargv = expand_argv(cmd->argv);
-        if (!xargv) { if (in_fd>=0) close(in_fd); if (out_fd>=0) close(out_fd); return -1; }
+        char **xargv = exec_expand_argv(argv, cmd->glob ? cmd->glob + skip : NULL, true);
+        if (!xargv) { redir_release(&rs); return -1; }
 
-        exec_opts_t opts = (exec_opts_t){ in_fd, out_fd, -1, pl->background };
+        /* Under `timeout` the launch never waits: timeout_wait() or the
+           watchdog owns the child */
+        exec_opts_t opts = stage_opts(&rs.plan, pl->background || ctl.has_timeout, &ctl);
         pid_t pid = -1;
         int status = 0;
+        uint64_t t0 = stats_now();
 
         int rc = -1;
         char *abs = resolve_cmd_path(xargv[0]);
         if (abs) {
             fprintf(stderr, "[pipe] single exec: '%s'\n", abs);
             rc = run_command(abs, xargv, &opts, &pid, &status);
-            free(abs);
+            ms_free(abs);
         } else if (strchr(xargv[0], '/')) {
             fprintf(stderr, "[pipe] single exec (direct path): '%s'\n", xargv[0]);
             rc = run_command(xargv[0], xargv, &opts, &pid, &status);
@@ -343,54 +489,74 @@ int exec_pipeline(const pipeline_t *pl) {
         }
 
         free_argv(xargv);
-        if (in_fd  >= 0) close(in_fd);
-        if (out_fd >= 0) close(out_fd);
+        redir_release(&rs);
 
         if (rc != 0) return -1;
+        if (stage_pid) stage_pid[0] = pid;
 
-        /* Background: register job and return immediately */
+        /* Background: hand the PID back and return immediately */
         if (pl->background && pid > 0) {
-            char *desc = argv_join(cmd->argv);
-            int jid = jobs_next_id();
-            jobs_register(jid, pid, desc ? desc : "(bg)");
-            fprintf(stderr, "[pipe] registered background job #%d pid=%d desc=%s\n",
-                    jid, (int)pid, desc ? desc : "(bg)");
-            free(desc);
+            *bg_pid = pid;
+            if (ctl.has_timeout) timeout_watch(&pid, 1, &ctl.timeout);
             return 0;
         }
 
+        bool timed_out = false;
+        if (ctl.has_timeout) {
+            uint64_t tw = stats_now();
+            timed_out = timeout_wait(&pid, 1, &ctl.timeout, &status) > 0;
+            if (status == -1) return -1;
+            uint64_t t1 = stats_now();
+            stats_exit_wait(argv[0], t1 - t0, status);
+            if (trace_active()) {
+                trace_event(TRACE_WAIT, tw, t1, 0, argv[0]);
+                trace_event(TRACE_STAGE, t0, t1, (int)pid, argv[0]);
+            }
+        }
+
         /* Foreground: return child's exit status */
+        if (stage_status) stage_status[0] = stage_code(status);
+        if (timed_out) return TIMEOUT_STATUS;
         return WIFEXITED(status) ? WEXITSTATUS(status) : 1;
     }
 
     /* -------- Multi-stage pipeline -------- */
-    pid_t *pids = (pid_t *)malloc(pl->nstages * sizeof(pid_t));
+    pid_t *pids = (pid_t *)ms_malloc(MS_EXEC, pl->nstages * sizeof(pid_t));
     if (!pids) return -1;
+    stage_clock_t *clk = (stage_clock_t *)ms_malloc(MS_EXEC, pl->nstages * sizeof(stage_clock_t));
+    if (!clk) { ms_free(pids); return -1; }
+
+    /* `timeout` on the first stage covers the whole pipeline */
+    exec_timeout_t pl_timeout = {0};
+    bool has_timeout = false;
+    stage_thread_t *threads = NULL;     /* allocated with the first one */
 
     int **pipes = NULL;
     if (pl->nstages > 1) {
-        pipes = (int **)malloc((pl->nstages - 1) * sizeof(int *));
-        if (!pipes) { free(pids); return -1; }
+        pipes = (int **)ms_malloc(MS_EXEC, (pl->nstages - 1) * sizeof(int *));
+        if (!pipes) { ms_free(clk); ms_free(pids); return -1; }
 
         for (int i = 0; i < pl->nstages - 1; i++) {
-            pipes[i] = (int *)malloc(2 * sizeof(int));
+            pipes[i] = (int *)ms_malloc(MS_EXEC, 2 * sizeof(int));
             if (!pipes[i]) {
-                for (int j = 0; j < i; j++) free(pipes[j]);
-                free(pipes);
-                free(pids);
+                for (int j = 0; j < i; j++) ms_free(pipes[j]);
+                ms_free(pipes);
+                ms_free(clk);
+                ms_free(pids);
                 return -1;
             }
-            if (pipe(pipes[i]) < 0) {
+            if (pipe2(pipes[i], O_CLOEXEC) < 0) {
                 perror("pipe");
                 for (int j = 0; j <= i; j++) {
                     if (pipes[j]) {
                         if (pipes[j][0] >= 0) close(pipes[j][0]);
                         if (pipes[j][1] >= 0) close(pipes[j][1]);
-                        free(pipes[j]);
+                        ms_free(pipes[j]);
                     }
                 }
-                free(pipes);
-                free(pids);
+                ms_free(pipes);
+                ms_free(clk);
+                ms_free(pids);
                 return -1;
             }
             fprintf(stderr, "[pipe] created pipe[%d]: r=%d w=%d\n", i, pipes[i][0], pipes[i][1]);
@@ -399,85 +565,81 @@ int exec_pipeline(const pipeline_t *pl) {
 
     for (int i = 0; i < pl->nstages; i++) {
         cmd_t *cmd = &pl->stages[i];
-        int in_fd = -1, out_fd = -1;
-
-        /* Input setup */
-        if (i == 0) {
-            if (cmd->redir.in_path) {
-                in_fd = open(cmd->redir.in_path, O_RDONLY);
-                if (in_fd < 0) { perror(cmd->redir.in_path); goto pipeline_cleanup; }
+        int in_fd  = i > 0                ? pipes[i-1][0] : -1;
+        int out_fd = i < pl->nstages - 1  ? pipes[i][1]   : -1;
+
+        stage_ctl_t ctl;
+        int skip = parse_stage_prefixes(cmd->argv, &ctl);
+        if (skip < 0) goto pipeline_cleanup;
+        char *const *argv = cmd->argv ? cmd->argv + skip : NULL;
+        if (ctl.has_timeout) {
+            if (i > 0) {
+                fprintf(stderr, "timeout: must start the pipeline\n");
+                goto pipeline_cleanup;
             }
-        } else {
-            in_fd = pipes[i-1][0];
+            pl_timeout = ctl.timeout;
+            has_timeout = true;
         }
 
-        /* Output setup */
-        if (i == pl->nstages - 1) {
-            if (cmd->redir.out_path) {
-                char *mapped = maybe_map_to_repo(cmd->redir.out_path);
-                if (!mapped) goto pipeline_cleanup;
-                if (mkdir_p_for_file(mapped, 0755) != 0) {
-                    fprintf(stderr, "[pipe] mkdir_p_for_file failed for '%s'\n", mapped);
-                }
-                out_fd = open(mapped, O_WRONLY | O_CREAT | O_TRUNC, 0644);
-                if (out_fd < 0) { perror(mapped); free(mapped); if (i==0 && in_fd>=0 && cmd->redir.in_path) close(in_fd); goto pipeline_cleanup; }
-                fprintf(stderr, "[pipe] stage %d out '> %s' (mapped)\n", i, mapped);
-                free(mapped);
-            } else if (cmd->redir.append_path) {
-                char *mapped = maybe_map_to_repo(cmd->redir.append_path);
-                if (!mapped) goto pipeline_cleanup;
-                if (mkdir_p_for_file(mapped, 0755) != 0) {
-                    fprintf(stderr, "[pipe] mkdir_p_for_file failed for '%s'\n", mapped);
-                }
-                out_fd = open(mapped, O_WRONLY | O_CREAT | O_APPEND, 0644);
-                if (out_fd < 0) { perror(mapped); free(mapped); if (i==0 && in_fd>=0 && cmd->redir.in_path) close(in_fd); goto pipeline_cleanup; }
-                fprintf(stderr, "[pipe] stage %d out '>> %s' (mapped)\n", i, mapped);
-                free(mapped);
-            }
-        } else {
-            out_fd = pipes[i][1];
-        }
+        /* Every stage honours its own redirections, applied after the pipe ends */
+        redir_stage_t rs;
+        if (redir_prepare(&cmd->redir, in_fd, out_fd, &rs) != 0) goto pipeline_cleanup;
 
         fprintf(stderr, "[pipe] stage %d/%d: argv0='%s' in_fd=%d out_fd=%d builtin=%d\n",
-                i, pl->nstages-1, cmd->argv && cmd->argv[0] ? cmd->argv[0] : "(null)",
-                in_fd, out_fd, (cmd->argv && cmd->argv[0] && is_builtin(cmd->argv[0])) ? 1 : 0);
-
-        if (cmd->argv && cmd->argv[0] && is_builtin(cmd->argv[0])) {
-            /* Builtins in pipelines must run in a child */
+                i, pl->nstages-1, argv && argv[0] ? argv[0] : "(null)",
+                in_fd, out_fd, (argv && argv[0] && is_builtin(argv[0])) ? 1 : 0);
+
+        clk[i].name = argv ? argv[0] : NULL;
+        clk[i].t0 = stats_now();
+        if (argv && argv[0] && skip == 0 && cmd->redir.nops == 0 && !pl->background &&
+            !has_timeout && builtin_has_thread_form(argv[0])) {
+            /* Output-only builtin in the foreground: a thread, started below */
+            if (!threads) {
+                threads = (stage_thread_t *)ms_calloc(MS_EXEC, pl->nstages, sizeof(stage_thread_t));
+                if (!threads) { redir_release(&rs); goto pipeline_cleanup; }
+            }
+            if (stage_thread_prepare(&threads[i], argv, cmd->glob, in_fd, out_fd) != 0) {
+                redir_release(&rs);
+                goto pipeline_cleanup;
+            }
+            pids[i] = 0;
+            fprintf(stderr, "[pipe] stage %d: builtin '%s' on a thread\n", i, argv[0]);
+        } else if (argv && (!argv[0] || is_builtin(argv[0]))) {
+            /* Builtins (and assignment-only stages) in pipelines run in a child */
+            readbuf_sync_all();
             pids[i] = fork();
-            if (pids[i] < 0) { perror("fork"); goto pipeline_cleanup; }
+            if (pids[i] < 0) { perror("fork"); redir_release(&rs); goto pipeline_cleanup; }
+            if (pids[i] > 0) stats_spawn(clk[i].name, stats_now() - clk[i].t0);
             if (pids[i] == 0) {
-                if (in_fd  >= 0) dup2(in_fd,  STDIN_FILENO);
-                if (out_fd >= 0) dup2(out_fd, STDOUT_FILENO);
+                exec_fdplan_apply(&rs.plan);
 
-                /* Close all pipe fds in child */
-                for (int j = 0; j < pl->nstages - 1; j++) {
-                    if (pipes[j][0] >= 0) close(pipes[j][0]);
-                    if (pipes[j][1] >= 0) close(pipes[j][1]);
-                }
-                if (i == 0 && in_fd >= 0 && cmd->redir.in_path) close(in_fd);
-                if (i == pl->nstages - 1 && out_fd >= 0 &&
-                    (cmd->redir.out_path || cmd->redir.append_path)) close(out_fd);
+                /* Drop every other pipe end / redirect fd so readers see EOF */
+                exec_fdplan_close_rest(&rs.plan);
 
                 fprintf(stderr, "[pipe] builtin(child) exec: argv0='%s'\n",
-                        cmd->argv && cmd->argv[0] ? cmd->argv[0] : "(null)");
-                int rc = run_builtin_parent_ext(cmd->argv);
+                        argv[0] ? argv[0] : "(null)");
+                if (!argv[0]) _exit(0);
+                env_assign(ctl.assign, ctl.nassign);
+                char **bargv = cmd->glob ? exec_expand_argv(argv, cmd->glob + skip, false)
+                                         : (char **)argv;
+                int rc = bargv ? run_builtin_parent(bargv) : 1;
+                readbuf_sync_all();     /* a `read` stage shares the offset with the shell */
                 _exit(rc);
             }
         } else {
             /* External command: non-waiting launch; we'll wait after all are spawned */
-            exec_opts_t opts = (exec_opts_t){ in_fd, out_fd, -1, true };
+            exec_opts_t opts = stage_opts(&rs.plan, true, &ctl);
 
             /* Expand argv for this stage */
-            char **xargv = expand_argv(cmd->argv);
-            if (!xargv) goto pipeline_cleanup;
+            char **xargv = exec_expand_argv(argv, cmd->glob ? cmd->glob + skip : NULL, true);
+            if (!xargv) { redir_release(&rs); goto pipeline_cleanup; }
 
             int launch_rc = -1;
             char *abs = resolve_cmd_path(xargv[0]);
             if (abs) {
                 fprintf(stderr, "[pipe] stage %d exec: '%s'\n", i, abs);
                 launch_rc = run_command(abs, xargv, &opts, &pids[i], NULL);
-                free(abs);
+                ms_free(abs);
             } else if (strchr(xargv[0], '/')) {
                 fprintf(stderr, "[pipe] stage %d exec (direct path): '%s'\n", i, xargv[0]);
                 launch_rc = run_command(xargv[0], xargv, &opts, &pids[i], NULL);
@@ -488,71 +650,234 @@ int exec_pipeline(const pipeline_t *pl) {
             free_argv(xargv);
 
             if (launch_rc != 0) {
+                redir_release(&rs);
                 goto pipeline_cleanup;
             }
         }
+        redir_release(&rs);
 
         /* Parent: close ends that this stage used */
-        if (i < pl->nstages - 1 && pipes[i][1] >= 0) close(pipes[i][1]);    /* writer closed */
-        if (i > 0              && pipes[i-1][0] >= 0) close(pipes[i-1][0]); /* reader closed */
+        if (i < pl->nstages - 1 && pipes[i][1] >= 0) { close(pipes[i][1]); pipes[i][1] = -1; }
+        if (i > 0              && pipes[i-1][0] >= 0) { close(pipes[i-1][0]); pipes[i-1][0] = -1; }
+    }
 
-        if (i == 0 && in_fd >= 0 && cmd->redir.in_path) close(in_fd);
-        if (i == pl->nstages - 1 && out_fd >= 0 &&
-            (cmd->redir.out_path || cmd->redir.append_path)) close(out_fd);
+    /* Every child is forked: the thread stages can start */
+    for (int i = 0; stage_pid && i < pl->nstages; i++) stage_pid[i] = pids[i];
+    if (threads) {
+        fflush(stdout);
+        for (int i = 0; i < pl->nstages; i++)
+            if (threads[i].state == ST_READY) stage_thread_start(&threads[i]);
     }
 
-    /* Background pipeline: register and return immediately */
+    /* Background pipeline: hand back the last stage's PID and return immediately */
     if (pl->background) {
-        pid_t rep = pids[pl->nstages - 1];
-        char *desc = argv_join(pl->stages[0].argv);
-        int jid = jobs_next_id();
-        jobs_register(jid, rep, desc ? desc : "(pipeline bg)");
-        fprintf(stderr, "[pipe] registered pipeline background job #%d pid=%d desc=%s\n",
-                jid, (int)rep, desc ? desc : "(pipeline bg)");
-        free(desc);
-
-        for (int i = 0; i < pl->nstages - 1; i++) free(pipes[i]);
-        free(pipes);
-        free(pids);
+        *bg_pid = pids[pl->nstages - 1];
+        if (has_timeout) timeout_watch(pids, pl->nstages, &pl_timeout);
+
+        for (int i = 0; i < pl->nstages - 1; i++) ms_free(pipes[i]);
+        ms_free(pipes);
+        ms_free(clk);
+        ms_free(pids);
         return 0;
     }
 
-    /* Wait (foreground only) */
+    /* Wait (foreground only); under `timeout` every stage is reaped up front */
     int final_status = 0;
+    uint64_t wait_t0 = stats_now();
+    int *waited = has_timeout ? (int *)ms_malloc(MS_EXEC, pl->nstages * sizeof(int)) : NULL;
+    bool timed_out = waited && timeout_wait(pids, pl->nstages, &pl_timeout, waited) > 0;
     fprintf(stderr, "[pipe] Waiting for %d pipeline processes\n", pl->nstages);
     for (int i = 0; i < pl->nstages; i++) {
-        int status;
-        pid_t r = waitpid(pids[i], &status, 0);
+        if (threads && threads[i].state != ST_NONE) {
+            int code = stage_thread_finish(&threads[i]);
+            int tid = threads[i].tid;               /* set by the thread, read after the join */
+            fprintf(stderr, "[pipe] thread stage %d finished status=%d\n", i, code);
+            uint64_t now = stats_now();
+            stats_exit(clk[i].name, now - clk[i].t0, code >= 0 && code < 256 ? code : 1);
+            if (trace_active() && tid > 0) trace_event(TRACE_STAGE, clk[i].t0, now, tid, clk[i].name);
+            if (stage_status) stage_status[i] = code;
+            if (i == pl->nstages - 1) final_status = code;
+            continue;
+        }
+        int status = waited ? waited[i] : 0;
+        pid_t r = waited ? (status == -1 ? -1 : pids[i]) : waitpid(pids[i], &status, 0);
         if (r < 0) {
-            perror("waitpid");
+            if (!waited) perror("waitpid");
             final_status = -1;
         } else {
             fprintf(stderr, "[pipe] pid=%d finished status=%d (exited=%d exitcode=%d)\n",
                     (int)pids[i], status, WIFEXITED(status) ? 1 : 0,
                     WIFEXITED(status) ? WEXITSTATUS(status) : -1);
+            /* Reaped in stage order: a stage that finished early is charged
+               until its predecessors are reaped. */
+            uint64_t now = stats_now();
+            stats_exit_wait(clk[i].name, now - clk[i].t0, status);
+            if (trace_active()) trace_event(TRACE_STAGE, clk[i].t0, now, (int)pids[i], clk[i].name);
+            if (stage_status) stage_status[i] = stage_code(status);
             if (i == pl->nstages - 1) {
                 final_status = WIFEXITED(status) ? WEXITSTATUS(status) : 1;
             }
         }
     }
+    if (timed_out) final_status = TIMEOUT_STATUS;
+    if (trace_active()) trace_event(TRACE_WAIT, wait_t0, stats_now(), 0, "pipeline");
     fprintf(stderr, "[pipe] All pipeline processes finished, final=%d\n", final_status);
 
-    for (int i = 0; i < pl->nstages - 1; i++) free(pipes[i]);
-    free(pipes);
-    free(pids);
+    ms_free(waited);
+    ms_free(threads);
+
+    for (int i = 0; i < pl->nstages - 1; i++) ms_free(pipes[i]);
+    ms_free(pipes);
+    ms_free(clk);
+    ms_free(pids);
     return final_status;
 
 pipeline_cleanup:
+    for (int i = 0; threads && i < pl->nstages; i++) stage_thread_finish(&threads[i]);
+    ms_free(threads);
     if (pipes) {
         for (int i = 0; i < pl->nstages - 1; i++) {
             if (pipes[i]) {
                 if (pipes[i][0] >= 0) close(pipes[i][0]);
                 if (pipes[i][1] >= 0) close(pipes[i][1]);
-                free(pipes[i]);
+                ms_free(pipes[i]);
             }
         }
-        free(pipes);
+        ms_free(pipes);
     }
-    free(pids);
+    ms_free(clk);
+    ms_free(pids);
     return -1;
 }
+
+/* ---------- background jobs + job slots ---------- */
+
+static int launch_queued_job(void *ctx, pid_t *out_pid) {
+    return exec_pipeline_run((const pipeline_t *)ctx, out_pid, NULL, NULL) == 0 && *out_pid > 0 ? 0 : -1;
+}
+
+static void free_queued_job(void *ctx) {
+    free_pipeline((pipeline_t *)ctx);
+    ms_free(ctx);
+}
+
+/* "a x | b y &": the command text as the transcript records it. */
+static char *pipeline_text(const pipeline_t *pl) {
+    size_t len = 0, cap = 64;
+    char *out = (char *)ms_malloc(MS_JOIN, cap);
+    if (!out) return NULL;
+    out[0] = '\0';
+    for (int i = 0; i < pl->nstages; ++i) {
+        char *stage = argv_join(pl->stages[i].argv);
+        const char *parts[2] = { i ? " | " : "", stage ? stage : "" };
+        for (int k = 0; k < 2; ++k) {
+            size_t n = strlen(parts[k]);
+            if (len + n + 3 > cap) {
+                while (len + n + 3 > cap) cap *= 2;
+                char *np = (char *)ms_realloc(MS_JOIN, out, cap);
+                if (!np) { ms_free(stage); ms_free(out); return NULL; }
+                out = np;
+            }
+            memcpy(out + len, parts[k], n + 1);
+            len += n;
+        }
+        ms_free(stage);
+    }
+    if (pl->background) memcpy(out + len, " &", 3);
+    return out;
+}
+
+/* ---------- main entry ---------- */
+int exec_pipeline(const pipeline_t *pl) {
+    if (!pl || pl->nstages == 0) {
+        fprintf(stderr, "exec_pipeline: empty pipeline\n");
+        return -1;
+    }
+
+    /* Reap first so slots freed since the last tick are counted as free. */
+    if (pl->background) jobs_mark_done_nonblocking();
+    ms_command_begin();
+
+    char *desc = pl->background ? argv_join(pl->stages[0].argv) : NULL;
+    bool jl = jsonl_active();
+    char *text = transcript_active() || jl ? pipeline_text(pl) : NULL;
+
+    /* All job slots busy: park a copy of the pipeline in the job table. */
+    if (pl->background && !jobs_slot_available()) {
+        pipeline_t *copy = (pipeline_t *)ms_malloc(MS_EXEC, sizeof(*copy));
+        if (!copy || pipeline_dup(pl, copy) != 0) {
+            ms_free(copy);
+            ms_free(text);
+            ms_free(desc);
+            ms_command_end();
+            return -1;
+        }
+        int jid = jobs_next_id();
+        int rc = jobs_enqueue(jid, desc, launch_queued_job, copy, free_queued_job);
+        fprintf(stderr, "[pipe] queued background job #%d desc=%s\n", jid, desc);
+        if (text && rc == 0 && transcript_active()) transcript_record("bg", text, jid, NULL, 0, -1);
+        if (jl && rc == 0) jsonl_bg(text, jid, NULL, 0, true);
+        ms_free(text);
+        ms_free(desc);
+        ms_command_end();
+        return rc;
+    }
+
+    int *stage_status = text ? (int *)ms_malloc(MS_EXEC, pl->nstages * sizeof(int)) : NULL;
+    for (int i = 0; stage_status && i < pl->nstages; ++i) stage_status[i] = -1;
+    pid_t *stage_pid = jl ? (pid_t *)ms_calloc(MS_EXEC, pl->nstages, sizeof(pid_t)) : NULL;
+    uint64_t t0 = text ? stats_now() : 0;
+    struct rusage ru0;
+    if (jl) getrusage(RUSAGE_CHILDREN, &ru0);
+
+    pid_t bg_pid = -1;
+    int rc = exec_pipeline_run(pl, &bg_pid, stage_status, stage_pid);
+
+    if (rc == 0 && pl->background && bg_pid > 0) {
+        int jid = jobs_next_id();
+        jobs_register(jid, bg_pid, desc);
+        fprintf(stderr, "[pipe] registered background job #%d pid=%d desc=%s\n",
+                jid, (int)bg_pid, desc);
+        if (text && transcript_active()) transcript_record("bg", text, jid, NULL, 0, -1);
+        if (jl) jsonl_bg(text, jid, stage_pid, stage_pid ? pl->nstages : 0, false);
+    } else if (text && !pl->background) {
+        int64_t ns = (int64_t)(stats_now() - t0);
+        if (transcript_active())
+            transcript_record("run", text, 0, stage_status, stage_status ? pl->nstages : 0, ns);
+        if (jl) {
+            /* Children reaped during the run: this pipeline's (and nothing
+               else, as jobs are only reaped between commands) */
+            struct rusage ru1;
+            getrusage(RUSAGE_CHILDREN, &ru1);
+            timersub(&ru1.ru_utime, &ru0.ru_utime, &ru1.ru_utime);
+            timersub(&ru1.ru_stime, &ru0.ru_stime, &ru1.ru_stime);
+            jsonl_pipeline(text, stage_pid, stage_status, pl->nstages, ns, &ru1);
+        }
+    }
+    ms_free(stage_pid);
+    ms_free(stage_status);
+    ms_free(text);
+    ms_free(desc);
+    ms_command_end();
+    return rc;
+}
+
+/* The process ends with this command: a foreground external command the
+   shell would only fork and wait for is exec'd in its place instead. */
+int exec_pipeline_final(const pipeline_t *pl) {
+    if (!pl || pl->nstages != 1 || pl->background) return exec_pipeline(pl);
+    /* Nothing may need the shell afterwards: jobs to reap or start, or a
+       record of how the command ended */
+    if (jobs_running_count() > 0 || jobs_queued_count() > 0 ||
+        transcript_active() || jsonl_active() || trace_active())
+        return exec_pipeline(pl);
+
+    cmd_t *cmd = &pl->stages[0];
+    stage_ctl_t ctl;
+    int skip = parse_stage_prefixes(cmd->argv, &ctl);
+    if (skip < 0 || ctl.has_timeout || !cmd->argv[skip] || is_builtin(cmd->argv[skip]))
+        return exec_pipeline(pl);
+    /* Not found: the normal path reports it */
+    int rc = exec_in_place(cmd, skip, &ctl);
+    return rc == 127 ? exec_pipeline(pl) : rc;
+}
@@ -0,0 +1,297 @@
+// src/readbuf.c — `read` builtin over per-fd block buffers
+#define _GNU_SOURCE             /* tee */
+#define _POSIX_C_SOURCE 200809L
+#include "readbuf.h"
+#include "env.h"
+#include "exec.h"               /* EXEC_FDPLAN_MAXFD */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+typedef enum { RB_UNKNOWN, RB_SEEK, RB_PIPE, RB_BYTES } rb_mode_t;
+
+/* buf[pos..len) is read but not yet used. RB_SEEK: the fd offset is past
+   all of buf. RB_PIPE: all of buf[0..len) is still in the real pipe. */
+typedef struct {
+    rb_mode_t mode;
+    char     *buf;
+    size_t    pos, len;
+    size_t    chunk;            /* next block size */
+    int       peek[2];          /* RB_PIPE: private pipe tee() copies into */
+} rb_t;
+
+static rb_t     RB[EXEC_FDPLAN_MAXFD];
+static uint64_t rb_pending;     /* bit N: RB[N] holds bytes to hand back */
+static pthread_mutex_t rb_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Line being assembled, and which of its bytes were backslash-quoted */
+static char          *L;
+static unsigned char *Q;
+static size_t         Ln, Lcap;
+
+/* Read exactly n bytes (they are known to be there). */
+static int read_full(int fd, char *p, size_t n) {
+    while (n > 0) {
+        ssize_t r = read(fd, p, n);
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) return -1;
+        p += r;
+        n -= (size_t)r;
+    }
+    return 0;
+}
+
+static void sync_one(int fd) {
+    rb_t *b = &RB[fd];
+    if (b->mode == RB_SEEK && b->len > b->pos) {
+        if (lseek(fd, -(off_t)(b->len - b->pos), SEEK_CUR) < 0) perror("read: lseek");
+    } else if (b->mode == RB_PIPE && b->pos > 0) {
+        if (read_full(fd, b->buf, b->pos) != 0) perror("read: pipe");
+    }
+    b->pos = b->len = 0;
+    b->chunk = READBUF_MIN;
+    rb_pending &= ~(1ULL << fd);
+}
+
+void readbuf_sync_all(void) {
+    if (!__atomic_load_n(&rb_pending, __ATOMIC_RELAXED)) return;
+    pthread_mutex_lock(&rb_lock);
+    for (int fd = 0; fd < EXEC_FDPLAN_MAXFD; ++fd)
+        if (rb_pending & (1ULL << fd)) sync_one(fd);
+    pthread_mutex_unlock(&rb_lock);
+}
+
+void readbuf_release(int fd) {
+    if (fd < 0 || fd >= EXEC_FDPLAN_MAXFD) return;
+    pthread_mutex_lock(&rb_lock);
+    rb_t *b = &RB[fd];
+    if (b->mode != RB_UNKNOWN) {
+        sync_one(fd);
+        if (b->peek[0] >= 0) { close(b->peek[0]); close(b->peek[1]); }
+        b->peek[0] = b->peek[1] = -1;
+        b->mode = RB_UNKNOWN;
+    }
+    pthread_mutex_unlock(&rb_lock);
+}
+
+static void rb_atexit(void) { readbuf_sync_all(); }
+
+/* First use of 'fd' since it was (re)wired: pick the strategy. */
+static int rb_setup(rb_t *b, int fd) {
+    static bool at_exit;
+    struct stat st;
+    if (fstat(fd, &st) != 0) return -1;
+    if (!b->buf && !(b->buf = (char *)malloc(READBUF_MAX))) return -1;
+    b->peek[0] = b->peek[1] = -1;
+    if ((S_ISREG(st.st_mode) || S_ISBLK(st.st_mode)) && lseek(fd, 0, SEEK_CUR) >= 0) {
+        b->mode = RB_SEEK;
+    } else if (S_ISFIFO(st.st_mode)) {
+        /* Above every redirectable fd, so no redirection lands on them */
+        int p[2];
+        if (pipe2(p, O_CLOEXEC) != 0) return -1;
+        b->peek[0] = fcntl(p[0], F_DUPFD_CLOEXEC, EXEC_FDPLAN_MAXFD);
+        b->peek[1] = fcntl(p[1], F_DUPFD_CLOEXEC, EXEC_FDPLAN_MAXFD);
+        close(p[0]);
+        close(p[1]);
+        if (b->peek[0] < 0 || b->peek[1] < 0) {
+            if (b->peek[0] >= 0) close(b->peek[0]);
+            if (b->peek[1] >= 0) close(b->peek[1]);
+            b->peek[0] = b->peek[1] = -1;
+            b->mode = RB_BYTES;
+        } else {
+            b->mode = RB_PIPE;
+        }
+    } else {
+        b->mode = RB_BYTES;
+    }
+    b->pos = b->len = 0;
+    b->chunk = READBUF_MIN;
+    if (!at_exit) at_exit = atexit(rb_atexit) == 0;
+    fprintf(stderr, "[read] fd %d: %s\n", fd,
+            b->mode == RB_SEEK ? "seekable, block reads" :
+            b->mode == RB_PIPE ? "pipe, peeked blocks" : "byte reads");
+    return 0;
+}
+
+/* Next block into the (used up) buffer. Returns its size, 0 at EOF, -1. */
+static ssize_t rb_fill(rb_t *b, int fd) {
+    ssize_t n;
+    if (b->mode == RB_PIPE) {
+        /* The previous block was all used: take it out of the real pipe */
+        if (b->len && read_full(fd, b->buf, b->len) != 0) return -1;
+        b->pos = b->len = 0;
+        rb_pending &= ~(1ULL << fd);
+        do n = tee(fd, b->peek[1], b->chunk, 0); while (n < 0 && errno == EINTR);
+        if (n < 0 && errno == EINVAL) {
+            b->mode = RB_BYTES;
+        } else {
+            if (n > 0 && read_full(b->peek[0], b->buf, (size_t)n) != 0) return -1;
+        }
+    }
+    if (b->mode != RB_PIPE) {
+        size_t want = b->mode == RB_SEEK ? b->chunk : 1;
+        do n = read(fd, b->buf, want); while (n < 0 && errno == EINTR);
+    }
+    if (n <= 0) return n;
+    b->pos = 0;
+    b->len = (size_t)n;
+    if (b->mode != RB_BYTES) rb_pending |= 1ULL << fd;
+    if (b->chunk < READBUF_MAX) b->chunk *= 2;
+    return n;
+}
+
+static int line_append(const char *p, size_t n) {
+    if (Ln + n + 1 > Lcap) {
+        size_t cap = Lcap ? Lcap : 256;
+        while (Ln + n + 1 > cap) cap *= 2;
+        char *nl = (char *)realloc(L, cap);
+        if (!nl) return -1;
+        L = nl;
+        unsigned char *nq = (unsigned char *)realloc(Q, cap);
+        if (!nq) return -1;
+        Q = nq;
+        Lcap = cap;
+    }
+    memcpy(L + Ln, p, n);
+    Ln += n;
+    return 0;
+}
+
+/* Append input through the next 'delim' to L. Returns 1 if the delimiter
+   was found (and dropped), 0 at end of input, -1 on error. */
+static int take_line(rb_t *b, int fd, int delim) {
+    for (;;) {
+        if (b->pos == b->len) {
+            ssize_t n = rb_fill(b, fd);
+            if (n <= 0) return (int)n;
+        }
+        const char *s = b->buf + b->pos;
+        size_t avail = b->len - b->pos;
+        const char *e = (const char *)memchr(s, delim, avail);
+        size_t take = e ? (size_t)(e - s) : avail;
+        if (line_append(s, take) != 0) return -1;
+        b->pos += take + (e ? 1 : 0);
+        if (e) return 1;
+    }
+}
+
+/* Drop backslashes, marking the character each one quoted. */
+static void unescape(void) {
+    size_t o = 0;
+    for (size_t i = 0; i < Ln; ++i) {
+        bool q = L[i] == '\\' && i + 1 < Ln;
+        if (q) i++;
+        L[o] = L[i];
+        Q[o++] = q;
+    }
+    Ln = o;
+}
+
+static bool valid_name(const char *s) {
+    if (!((*s >= 'A' && *s <= 'Z') || (*s >= 'a' && *s <= 'z') || *s == '_')) return false;
+    for (++s; *s; ++s)
+        if (!((*s >= 'A' && *s <= 'Z') || (*s >= 'a' && *s <= 'z') ||
+              (*s >= '0' && *s <= '9') || *s == '_')) return false;
+    return true;
+}
+
+/* Split L into the names: IFS whitespace runs separate fields and are
+   trimmed at both ends; any other IFS character ends exactly one field. */
+static void assign_fields(char *const names[], int nnames) {
+    unsigned char cls[256] = {0};               /* 1: IFS, 2: IFS whitespace */
+    const char *ifs = getenv("IFS");
+    if (!ifs) ifs = " \t\n";
+    for (const unsigned char *p = (const unsigned char *)ifs; *p; ++p)
+        cls[*p] = (*p == ' ' || *p == '\t' || *p == '\n') ? 2 : 1;
+#define SEP(i) (!Q[i] ? cls[(unsigned char)L[i]] : 0)
+
+    size_t i = 0, n = Ln;
+    while (i < n && SEP(i) == 2) i++;
+    while (n > i && SEP(n - 1) == 2) n--;
+    for (int k = 0; k < nnames; ++k) {
+        size_t start = i, end;
+        if (k == nnames - 1) {
+            end = i = n;
+        } else {
+            while (i < n && !SEP(i)) i++;
+            end = i;
+            while (i < n && SEP(i) == 2) i++;
+            if (i < n && SEP(i) == 1) {
+                i++;
+                while (i < n && SEP(i) == 2) i++;
+            }
+        }
+        L[end] = '\0';
+        env_set(names[k], L + start);
+    }
+#undef SEP
+}
+
+int builtin_read(char *const argv[]) {
+    bool raw = false;
+    int delim = '\n', fd = 0, i = 1;
+    for (; argv[i] && argv[i][0] == '-' && argv[i][1]; ++i) {
+        if (strcmp(argv[i], "--") == 0) { i++; break; }
+        if (strcmp(argv[i], "-r") == 0) { raw = true; continue; }
+        if ((strcmp(argv[i], "-d") == 0 || strcmp(argv[i], "-u") == 0) && argv[i + 1]) {
+            const char *v = argv[++i];
+            if (argv[i - 1][1] == 'd') { delim = (unsigned char)v[0]; continue; }
+            char *end = NULL;
+            long n = strtol(v, &end, 10);
+            if (*v && !*end && n >= 0 && n < EXEC_FDPLAN_MAXFD) { fd = (int)n; continue; }
+            fprintf(stderr, "read: %s: invalid file descriptor\n", v);
+            return 2;
+        }
+        fprintf(stderr, "usage: read [-r] [-d DELIM] [-u FD] [NAME...]\n");
+        return 2;
+    }
+    for (int k = i; argv[k]; ++k) {
+        if (!valid_name(argv[k])) {
+            fprintf(stderr, "read: `%s': not a valid identifier\n", argv[k]);
+            return 2;
+        }
+    }
+
+    pthread_mutex_lock(&rb_lock);
+    rb_t *b = &RB[fd];
+    int found = -1;
+    if (b->mode != RB_UNKNOWN || rb_setup(b, fd) == 0) {
+        Ln = 0;
+        for (;;) {
+            found = take_line(b, fd, delim);
+            if (found != 1 || raw) break;
+            /* An unquoted trailing backslash continues the line */
+            size_t bs = 0;
+            while (bs < Ln && L[Ln - 1 - bs] == '\\') bs++;
+            if (!(bs & 1)) break;
+            Ln--;
+        }
+    }
+    if (found < 0) {
+        fprintf(stderr, "read: fd %d: %s\n", fd, strerror(errno));
+        pthread_mutex_unlock(&rb_lock);
+        return 1;
+    }
+    if (line_append("", 0) == 0) {              /* room for the terminator */
+        if (raw) memset(Q, 0, Ln);
+        else     unescape();
+        if (argv[i]) {
+            int nnames = 0;
+            while (argv[i + nnames]) nnames++;
+            assign_fields(argv + i, nnames);
+        } else {
+            L[Ln] = '\0';
+            env_set("REPLY", L);
+        }
+    }
+    pthread_mutex_unlock(&rb_lock);
+    return found == 1 ? 0 : 1;
+}
@@ -0,0 +1,277 @@
+// src/redir.c — redirection handling: open targets, build dup2 plans
+#define _POSIX_C_SOURCE 200809L
+#include "redir.h"
+#include "memstats.h"
+#include "readbuf.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* Capture the initial working directory so we can place test artifacts
+   (for example, files under tests/tmp) in the repo even if the shell ran `cd /`. */
+static const char *get_initial_cwd(void) {
+    static char buf[PATH_MAX];
+    static int  init = 0;
+    if (!init) {
+        if (!getcwd(buf, sizeof(buf))) {
+            strcpy(buf, "."); /* best-effort */
+        }
+        init = 1;
+        fprintf(stderr, "[redir] initial cwd: %s\n", buf);
+    }
+    return buf;
+}
+
+/* If path starts with "tests/", remap to initial repo cwd.
+   Returns a malloc'd string (caller frees) or NULL on error. */
+static char *maybe_map_to_repo(const char *path) {
+    if (!path) return ms_strdup(MS_REDIR, "");
+    if (path[0] == '/') return ms_strdup(MS_REDIR, path);
+    if (strncmp(path, "tests/", 6) != 0)   return ms_strdup(MS_REDIR, path);
+
+    const char *root = get_initial_cwd();
+    size_t need = strlen(root) + 1 + strlen(path) + 1;
+    char *full = (char*)ms_malloc(MS_REDIR, need);
+    if (!full) { perror("malloc"); return NULL; }
+    snprintf(full, need, "%s/%s", root, path);
+    fprintf(stderr, "[redir] map relative '%s' -> '%s'\n", path, full);
+    return full;
+}
+
+/* ---------- redirect targets: open first, create parents on demand ----------
+   The common case (directory already there) costs exactly one open(). Only
+   when that fails with ENOENT do we walk the parent chain with
+   mkdirat/openat, starting from the deepest ancestor the cache says exists.
+   Cache entries are trusted until opening them fails, then dropped. */
+#define DIRCACHE_SLOTS 64
+static char    *dircache[DIRCACHE_SLOTS];
+static unsigned dircache_next;
+
+static int dircache_find(const char *dir, size_t len) {
+    for (int i = 0; i < DIRCACHE_SLOTS; ++i) {
+        if (dircache[i] && strlen(dircache[i]) == len && memcmp(dircache[i], dir, len) == 0)
+            return i;
+    }
+    return -1;
+}
+
+static void dircache_add(const char *dir, size_t len) {
+    if (len == 0 || dircache_find(dir, len) >= 0) return;
+    char *copy = strndup(dir, len);
+    if (!copy) return;
+    free(dircache[dircache_next]);
+    dircache[dircache_next] = copy;
+    dircache_next = (dircache_next + 1) % DIRCACHE_SLOTS;
+}
+
+static void dircache_drop(int idx) {
+    free(dircache[idx]);
+    dircache[idx] = NULL;
+}
+
+/* open(path, flags, 0644), creating missing parent directories. */
+int open_redir_target(const char *path, int flags) {
+    flags |= O_CLOEXEC;
+    int fd = open(path, flags, 0644);
+    if (fd >= 0 || errno != ENOENT) return fd;
+
+    const char *slash = strrchr(path, '/');
+    if (!slash || slash == path) { errno = ENOENT; return -1; } /* parent is . or / */
+    size_t plen = (size_t)(slash - path);
+    if (plen >= PATH_MAX) { errno = ENAMETOOLONG; return -1; }
+
+    /* Deepest cached ancestor of the parent: path[0..done) opened as dirfd */
+    int dirfd = AT_FDCWD;
+    size_t done = 0;
+    for (size_t cut = plen; cut > 0; ) {
+        int idx = dircache_find(path, cut);
+        if (idx >= 0) {
+            char dir[PATH_MAX];
+            memcpy(dir, path, cut);
+            dir[cut] = '\0';
+            dirfd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+            if (dirfd >= 0) { done = cut; break; }
+            fprintf(stderr, "[redir] dircache: '%s' is gone, dropping\n", dir);
+            dircache_drop(idx);
+            dirfd = AT_FDCWD;
+        }
+        while (cut > 0 && path[--cut] != '/') { }
+    }
+    if (dirfd == AT_FDCWD && path[0] == '/') {
+        dirfd = open("/", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (dirfd < 0) return -1;
+    }
+
+    /* Create/enter each remaining component relative to its parent */
+    for (const char *p = path + done; p < slash; ) {
+        if (*p == '/') { p++; continue; }
+        const char *q = p;
+        while (q < slash && *q != '/') q++;
+
+        char comp[NAME_MAX + 1];
+        if ((size_t)(q - p) > NAME_MAX) { errno = ENAMETOOLONG; goto fail; }
+        memcpy(comp, p, (size_t)(q - p));
+        comp[q - p] = '\0';
+
+        if (mkdirat(dirfd, comp, 0755) == 0) {
+            fprintf(stderr, "[redir] mkdir: '%.*s'\n", (int)(q - path), path);
+        } else if (errno != EEXIST) {
+            goto fail;
+        }
+        int nfd = openat(dirfd, comp, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (nfd < 0) goto fail;
+        if (dirfd != AT_FDCWD) close(dirfd);
+        dirfd = nfd;
+        dircache_add(path, (size_t)(q - path));
+        p = q;
+    }
+
+    fd = openat(dirfd, slash + 1, flags, 0644);
+    if (fd < 0) goto fail;
+    if (dirfd != AT_FDCWD) close(dirfd);
+    return fd;
+
+fail: {
+        int saved = errno;
+        if (dirfd != AT_FDCWD) close(dirfd);
+        errno = saved;
+        return -1;
+    }
+}
+
+/* ---------- per-stage plan ---------- */
+
+static int stage_own(redir_stage_t *st, int fd) {
+    if (st->nowned >= REDIR_MAX_OPEN) { close(fd); errno = EMFILE; return -1; }
+    st->owned[st->nowned++] = fd;
+    return fd;
+}
+
+void redir_release(redir_stage_t *st) {
+    for (int i = 0; i < st->nowned; ++i) close(st->owned[i]);
+    st->nowned = 0;
+}
+
+int redir_prepare(const redir_t *r, int pipe_in, int pipe_out, redir_stage_t *st) {
+    memset(st, 0, sizeof(*st));
+
+    /* map[fd]: which shell fd the child's fd should end up as (-1 = closed) */
+    int  map[EXEC_FDPLAN_MAXFD];
+    bool set[EXEC_FDPLAN_MAXFD] = {0};
+    if (pipe_in  >= 0) { map[STDIN_FILENO]  = pipe_in;  set[STDIN_FILENO]  = true; }
+    if (pipe_out >= 0) { map[STDOUT_FILENO] = pipe_out; set[STDOUT_FILENO] = true; }
+
+    for (int i = 0; r && i < r->nops; ++i) {
+        const redir_op_t *op = &r->ops[i];
+        int t = op->fd, src = -1;
+        if (t < 0 || t >= EXEC_FDPLAN_MAXFD) {
+            fprintf(stderr, "%d: bad file descriptor\n", t);
+            goto fail;
+        }
+        switch (op->kind) {
+            case REDIR_IN:
+                fprintf(stderr, "[redir] %d< '%s'\n", t, op->path);
+                src = open(op->path, O_RDONLY | O_CLOEXEC);
+                if (src < 0) { perror(op->path); goto fail; }
+                if (stage_own(st, src) < 0) { perror(op->path); goto fail; }
+                break;
+            case REDIR_OUT:
+            case REDIR_APPEND: {
+                char *mapped = maybe_map_to_repo(op->path);
+                if (!mapped) goto fail;
+                fprintf(stderr, "[redir] %d%s '%s' (mapped='%s')\n",
+                        t, op->kind == REDIR_OUT ? ">" : ">>", op->path, mapped);
+                src = open_redir_target(mapped, O_WRONLY | O_CREAT |
+                                        (op->kind == REDIR_OUT ? O_TRUNC : O_APPEND));
+                if (src < 0 || stage_own(st, src) < 0) { perror(mapped); ms_free(mapped); goto fail; }
+                ms_free(mapped);
+                break;
+            }
+            case REDIR_DUP: {
+                int s = op->src_fd;
+                if (s >= 0 && s < EXEC_FDPLAN_MAXFD && set[s]) src = map[s];
+                else src = s;
+                if (src < 0 || fcntl(src, F_GETFD) < 0) {
+                    fprintf(stderr, "%d: bad file descriptor\n", s);
+                    goto fail;
+                }
+                break;
+            }
+            case REDIR_CLOSE:
+                src = -1;
+                break;
+        }
+        map[t] = src;
+        set[t] = true;
+    }
+
+    exec_fdmove_t mv[EXEC_FDPLAN_MAXFD];
+    int n = 0;
+    for (int fd = 0; fd < EXEC_FDPLAN_MAXFD; ++fd)
+        if (set[fd]) mv[n++] = (exec_fdmove_t){ fd, map[fd] };
+    if (exec_fdplan_build(&st->plan, mv, n) != 0) {
+        fprintf(stderr, "redirection: too many descriptors\n");
+        goto fail;
+    }
+    return 0;
+
+fail:
+    redir_release(st);
+    return -1;
+}
+
+/* ---------- applying a plan in the shell (builtins) ---------- */
+
+int redir_apply_saved(const exec_fdplan_t *plan, int saved[EXEC_FDPLAN_MAXFD]) {
+    int floor = plan->fd_ceiling + 1 > 10 ? plan->fd_ceiling + 1 : 10;
+    for (int fd = 0; fd < EXEC_FDPLAN_MAXFD; ++fd) {
+        saved[fd] = -1;
+        if (!(plan->targets & (1ULL << fd))) continue;
+        readbuf_release(fd);
+        saved[fd] = fcntl(fd, F_DUPFD_CLOEXEC, floor);
+        if (saved[fd] < 0 && errno != EBADF) {
+            perror("redirection: save fd");
+            redir_restore(plan, saved);
+            return -1;
+        }
+    }
+    fflush(stdout);   /* pending shell output must not land in the redirect target */
+    exec_fdplan_apply(plan);
+    return 0;
+}
+
+void redir_apply_keep(redir_stage_t *st) {
+    const exec_fdplan_t *plan = &st->plan;
+    for (int fd = 0; fd < EXEC_FDPLAN_MAXFD; ++fd)
+        if (plan->targets & (1ULL << fd)) readbuf_release(fd);
+    fflush(stdout);
+    exec_fdplan_apply(plan);
+    /* An fd opened straight into its own slot is now a target: keep it */
+    for (int i = 0; i < st->nowned; ++i) {
+        int fd = st->owned[i];
+        bool kept = fd < EXEC_FDPLAN_MAXFD && (plan->targets & plan->keep & (1ULL << fd));
+        if (!kept) close(fd);
+    }
+    st->nowned = 0;
+}
+
+void redir_restore(const exec_fdplan_t *plan, int saved[EXEC_FDPLAN_MAXFD]) {
+    fflush(stdout);
+    for (int fd = 0; fd < EXEC_FDPLAN_MAXFD; ++fd) {
+        if (!(plan->targets & (1ULL << fd))) continue;
+        readbuf_release(fd);
+        if (saved[fd] >= 0) {
+            dup2(saved[fd], fd);
+            close(saved[fd]);
+            saved[fd] = -1;
+        } else {
+            close(fd);   /* was not open before the redirection */
+        }
+    }
+}
@@ -0,0 +1,141 @@
+// src/rlimits.c — `ulimit` builtin and per-launch resource limits
+#define _POSIX_C_SOURCE 200809L
+#include "rlimits.h"
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+
+typedef struct {
+    char        opt;        /* -t, -v, ... */
+    int         which;      /* EXEC_RLIM_* */
+    int         resource;   /* RLIMIT_* (for showing the shell's own value) */
+    unsigned long long unit;/* bytes per displayed unit */
+    const char *desc;
+} rlim_desc_t;
+
+static const rlim_desc_t RLIMS[] = {
+    { 't', EXEC_RLIM_CPU,    RLIMIT_CPU,    1,    "cpu time (seconds)" },
+    { 'v', EXEC_RLIM_AS,     RLIMIT_AS,     1024, "address space (KiB)" },
+    { 'n', EXEC_RLIM_NOFILE, RLIMIT_NOFILE, 1,    "open files" },
+    { 'c', EXEC_RLIM_CORE,   RLIMIT_CORE,   1024, "core file size (KiB)" },
+};
+#define NRLIMS (sizeof(RLIMS) / sizeof(RLIMS[0]))
+
+static void ulimit_usage(void) {
+    fprintf(stderr, "usage: ulimit [-t SECS] [-v KIB] [-n FILES] [-c KIB] [CMD [ARG...]]\n");
+}
+
+static const rlim_desc_t *find_opt(const char *arg) {
+    if (!arg || arg[0] != '-' || !arg[1] || arg[2]) return NULL;
+    for (size_t i = 0; i < NRLIMS; ++i)
+        if (RLIMS[i].opt == arg[1]) return &RLIMS[i];
+    return NULL;
+}
+
+/* "unlimited" or a non-negative count of the option's unit. */
+static int parse_value(const rlim_desc_t *d, const char *s, unsigned long long *out) {
+    if (strcmp(s, "unlimited") == 0) { *out = EXEC_RLIM_UNLIMITED; return 0; }
+    if (*s < '0' || *s > '9') return -1;
+    char *end = NULL;
+    unsigned long long v = strtoull(s, &end, 10);
+    if (!end || *end || v > (EXEC_RLIM_UNLIMITED - 1) / d->unit) return -1;
+    *out = v * d->unit;
+    return 0;
+}
+
+static int is_value_word(const char *s) {
+    return s && (strcmp(s, "unlimited") == 0 || (*s >= '0' && *s <= '9'));
+}
+
+/*
+ * Shared option scan. Sets limits into 'out', records options given
+ * without a value in 'show', and returns the index of the first word
+ * after the options (the command, if any), or -1 on error.
+ */
+static int scan_opts(char *const argv[], exec_limits_t *out, bool show[EXEC_RLIM_COUNT]) {
+    int i = 1;
+    for (; argv[i] && argv[i][0] == '-'; ++i) {
+        if (strcmp(argv[i], "--") == 0) return i + 1;
+        const rlim_desc_t *d = find_opt(argv[i]);
+        if (!d) { ulimit_usage(); return -1; }
+        if (is_value_word(argv[i + 1])) {
+            unsigned long long v;
+            if (parse_value(d, argv[i + 1], &v) != 0) {
+                fprintf(stderr, "ulimit: -%c: bad value: %s\n", d->opt, argv[i + 1]);
+                return -1;
+            }
+            out->set[d->which] = true;
+            out->value[d->which] = v;
+            i++;
+        } else if (show) {
+            show[d->which] = true;
+        } else {
+            fprintf(stderr, "ulimit: -%c: missing value\n", d->opt);
+            return -1;
+        }
+    }
+    return i;
+}
+
+int rlimits_parse_prefix(char *const argv[], exec_limits_t *out) {
+    if (!argv || !argv[0] || strcmp(argv[0], "ulimit") != 0) return 0;
+
+    /* Only a prefix when a command follows; otherwise it is the builtin. */
+    exec_limits_t tmp = {0};
+    bool show[EXEC_RLIM_COUNT] = {0};
+    int i = scan_opts(argv, &tmp, show);
+    if (i < 0 || !argv[i]) return i < 0 ? -1 : 0;
+    for (int r = 0; r < EXEC_RLIM_COUNT; ++r) {
+        if (show[r]) { fprintf(stderr, "ulimit: missing value before command\n"); return -1; }
+        if (tmp.set[r]) { out->set[r] = true; out->value[r] = tmp.value[r]; }
+    }
+    fprintf(stderr, "[ulimit] per-launch limits -> '%s'\n", argv[i]);
+    return i;
+}
+
+static void print_limit(const rlim_desc_t *d) {
+    const exec_limits_t *sess = exec_session_limits();
+    unsigned long long v;
+    if (sess->set[d->which]) {
+        v = sess->value[d->which];
+    } else {
+        struct rlimit rl;
+        if (getrlimit(d->resource, &rl) != 0) { perror("ulimit: getrlimit"); return; }
+        v = rl.rlim_cur == RLIM_INFINITY ? EXEC_RLIM_UNLIMITED : (unsigned long long)rl.rlim_cur;
+    }
+    printf("-%c: %-22s ", d->opt, d->desc);
+    if (v == EXEC_RLIM_UNLIMITED) printf("unlimited\n");
+    else printf("%llu\n", v / d->unit);
+}
+
+int builtin_ulimit(char *const argv[]) {
+    exec_limits_t set = {0};
+    bool show[EXEC_RLIM_COUNT] = {0};
+    int i = scan_opts(argv, &set, show);
+    if (i < 0) return 1;
+    if (argv[i]) {
+        /* pipeline_exec peels "ulimit ... CMD" off as a prefix; reaching
+           here means the command was itself a builtin. */
+        fprintf(stderr, "ulimit: %s: per-command limits need an external command\n", argv[i]);
+        return 1;
+    }
+
+    bool any_set = false, any_show = false;
+    for (size_t k = 0; k < NRLIMS; ++k) {
+        int w = RLIMS[k].which;
+        if (set.set[w]) {
+            exec_session_limit_set(w, set.value[w]);
+            any_set = true;
+        }
+        any_show |= show[w];
+    }
+    if (any_set && !any_show) return 0;
+
+    for (size_t k = 0; k < NRLIMS; ++k)
+        if (!any_show || show[RLIMS[k].which]) print_limit(&RLIMS[k]);
+    fflush(stdout);
+    return 0;
+}
@@ -0,0 +1,1125 @@
+// src/script.c — control flow: compile scripts to flat records, interpret in place
+#define _POSIX_C_SOURCE 200809L
+#include "script.h"
+#include "parser.h"     // parse_line_raw, pipeline_expand_env
+#include "exec.h"       // exec_pipeline(_final), exec_expand_argv
+#include "redir.h"      // redirections around function calls
+#include "builtins.h"   // run_builtin_parent (exit)
+#include "env.h"        // env_set, env_push for NAME=value f
+#include "memstats.h"   // ms_malloc & co.
+
+#include <ctype.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+/*
+ * Record layout (native uint32 words). Every node starts with
+ *   kind, lineno, len            len = words in the node, header included
+ * so any node can be skipped in O(1). Bodies:
+ *   SN_LIST      child nodes
+ *   SN_CMD       flags (SN_F_BG | SN_F_EXPAND), nstages, stage...
+ *                stage: argc, argv[argc], nglob, glob[nglob], nops,
+ *                       { kind, fd, src_fd, path } x nops
+ *   SN_IF        cond, then, else          (else: LIST, or IF for elif)
+ *   SN_WHILE     cond, body                (SN_UNTIL likewise)
+ *   SN_FOR       name, words (one-stage CMD), body
+ *   SN_FUNC      name, body
+ *   SN_AND/OR    lhs, rhs
+ *   SN_BREAK / SN_CONTINUE / SN_RETURN     n (SN_NONE: default)
+ *   SN_SYNTAX    message                   (whole script failed to compile)
+ * Strings are offsets into the string table; nglob is 0 or argc and a
+ * literal word's glob entry is SN_NONE. The root is one LIST or SYNTAX.
+ */
+enum {
+    SN_LIST = 1, SN_CMD, SN_IF, SN_WHILE, SN_UNTIL, SN_FOR, SN_FUNC,
+    SN_AND, SN_OR, SN_BREAK, SN_CONTINUE, SN_RETURN, SN_SYNTAX
+};
+#define SN_NONE       UINT32_MAX
+#define SN_F_BG       1u
+#define SN_F_EXPAND   2u            /* a word holds $VAR: expand per run */
+#define SN_MAX_NEST   256           /* compile nesting / stored image depth */
+#define SN_MAX_CALLS  256           /* function call depth */
+
+struct script {
+    int             refs;
+    const uint32_t *w;   size_t nw;
+    const char     *s;   size_t ns;
+    uint32_t       *own_w;          /* compiled in memory ... */
+    char           *own_s;
+    void           *map; size_t maplen;   /* ... or mapped from a cache */
+    uint32_t        ncmds;
+};
+
+// ---- building ---------------------------------------------------------------
+
+typedef struct {
+    uint32_t *w; size_t nw, capw;
+    char     *s; size_t ns, caps;
+    uint32_t  ncmds;
+} sbuf_t;
+
+static void b_word(sbuf_t *b, uint32_t v) {
+    if (b->nw == b->capw) {
+        b->capw = b->capw ? b->capw * 2 : 1024;
+        uint32_t *nw = (uint32_t *)ms_realloc(MS_SCRIPT, b->w, b->capw * sizeof(*nw));
+        if (!nw) { perror("realloc"); exit(1); }
+        b->w = nw;
+    }
+    b->w[b->nw++] = v;
+}
+
+static void b_str(sbuf_t *b, const char *str) {
+    size_t len = strlen(str) + 1;
+    if (b->ns + len > b->caps) {
+        while (b->ns + len > b->caps) b->caps = b->caps ? b->caps * 2 : 4096;
+        char *ns = (char *)ms_realloc(MS_SCRIPT, b->s, b->caps);
+        if (!ns) { perror("realloc"); exit(1); }
+        b->s = ns;
+    }
+    b_word(b, (uint32_t)b->ns);
+    memcpy(b->s + b->ns, str, len);
+    b->ns += len;
+}
+
+static size_t node_begin(sbuf_t *b, uint32_t kind, unsigned line) {
+    size_t pos = b->nw;
+    b_word(b, kind);
+    b_word(b, line);
+    b_word(b, 0);
+    return pos;
+}
+
+static void node_end(sbuf_t *b, size_t pos) {
+    b->w[pos + 2] = (uint32_t)(b->nw - pos);
+}
+
+static bool has_dollar(char *const *v, size_t n) {
+    for (size_t i = 0; v && i < n; ++i) if (v[i] && strchr(v[i], '$')) return true;
+    return false;
+}
+
+static void emit_cmd(sbuf_t *b, unsigned line, const pipeline_t *pl) {
+    size_t pos = node_begin(b, SN_CMD, line);
+    uint32_t flags = pl->background ? SN_F_BG : 0;
+    for (int i = 0; i < pl->nstages; ++i) {
+        const cmd_t *c = &pl->stages[i];
+        size_t argc = 0;
+        while (c->argv && c->argv[argc]) argc++;
+        if (has_dollar(c->argv, argc) || has_dollar(c->glob, argc)) flags |= SN_F_EXPAND;
+    }
+    b_word(b, flags);
+    b_word(b, (uint32_t)pl->nstages);
+    for (int i = 0; i < pl->nstages; ++i) {
+        const cmd_t *c = &pl->stages[i];
+        uint32_t argc = 0;
+        while (c->argv && c->argv[argc]) argc++;
+        b_word(b, argc);
+        for (uint32_t a = 0; a < argc; ++a) b_str(b, c->argv[a]);
+        b_word(b, c->glob ? argc : 0);
+        for (uint32_t a = 0; c->glob && a < argc; ++a) {
+            if (c->glob[a]) b_str(b, c->glob[a]);
+            else            b_word(b, SN_NONE);
+        }
+        b_word(b, (uint32_t)c->redir.nops);
+        for (int k = 0; k < c->redir.nops; ++k) {
+            const redir_op_t *op = &c->redir.ops[k];
+            b_word(b, (uint32_t)op->kind);
+            b_word(b, (uint32_t)op->fd);
+            b_word(b, (uint32_t)op->src_fd);
+            if (op->path) b_str(b, op->path);
+            else          b_word(b, SN_NONE);
+        }
+    }
+    node_end(b, pos);
+    b->ncmds++;
+}
+
+// ---- scanner ----------------------------------------------------------------
+
+/* The scanner splits the text into keywords and command texts; each
+   command text is handed to parse_line_raw() once, at compile time. */
+typedef enum { TK_S_EOF, TK_S_SEP, TK_S_AND, TK_S_OR, TK_S_KW, TK_S_FUNC, TK_S_CMD } stok_kind_t;
+
+enum { KW_IF, KW_THEN, KW_ELIF, KW_ELSE, KW_FI, KW_WHILE, KW_UNTIL,
+       KW_DO, KW_DONE, KW_FOR, KW_LBRACE, KW_RBRACE, KW_COUNT };
+static const char *const KW_NAMES[KW_COUNT] = {
+    "if", "then", "elif", "else", "fi", "while", "until",
+    "do", "done", "for", "{", "}"
+};
+#define KW_BIT(k) (1u << (k))
+
+typedef struct {
+    stok_kind_t kind;
+    int         kw;
+    char       *text;           /* TK_S_CMD / TK_S_FUNC, malloc'd */
+    unsigned    line;
+} stok_t;
+
+typedef struct {
+    const char *s;
+    size_t      i, n;
+    unsigned    line;
+    stok_t      la;
+    bool        have_la;
+    sbuf_t     *b;
+    int         depth;
+    bool        failed;
+    unsigned    err_line;
+    char        err[160];
+} sp_t;
+
+static bool is_blank(char c) {
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+static bool is_word_end(char c) {
+    return c == '\0' || is_blank(c) || c == '\n' || c == ';' || c == '&' ||
+           c == '|' || c == '<' || c == '>' || c == '(' || c == ')';
+}
+
+static bool is_name(const char *w, size_t n) {
+    if (n == 0 || !(isalpha((unsigned char)w[0]) || w[0] == '_')) return false;
+    for (size_t k = 1; k < n; ++k)
+        if (!(isalnum((unsigned char)w[k]) || w[k] == '_')) return false;
+    return true;
+}
+
+/* End of the word at i; *quoted if any part of it was quoted or escaped. */
+static size_t word_end(const sp_t *P, size_t i, bool *quoted) {
+    *quoted = false;
+    while (i < P->n && !is_word_end(P->s[i])) {
+        char c = P->s[i];
+        if (c == '\\') { *quoted = true; i += i + 1 < P->n ? 2 : 1; continue; }
+        if (c == '\'' || c == '"') {
+            *quoted = true;
+            for (i++; i < P->n && P->s[i] != c; i++)
+                if (c == '"' && P->s[i] == '\\' && i + 1 < P->n) i++;
+            if (i < P->n) i++;
+            continue;
+        }
+        i++;
+    }
+    return i;
+}
+
+typedef struct { char *p; size_t len, cap; } stext_t;
+
+static void text_put(stext_t *t, char c) {
+    if (t->len + 2 > t->cap) {
+        t->cap = t->cap ? t->cap * 2 : 64;
+        char *np = (char *)ms_realloc(MS_SCRIPT, t->p, t->cap);
+        if (!np) { perror("realloc"); exit(1); }
+        t->p = np;
+    }
+    t->p[t->len++] = c;
+}
+
+/* Text of a simple command up to an unquoted ';', newline, "&&", "||" or
+   comment; backslash-newline joins lines. Quotes and escapes are kept for
+   parse_line_raw(). */
+static char *scan_cmd(sp_t *P) {
+    stext_t t = {0};
+    char quote = 0;
+    bool word_start = true;
+    while (P->i < P->n) {
+        char c = P->s[P->i];
+        if (!quote) {
+            if (c == '\n' || c == ';') break;
+            if ((c == '&' || c == '|') && P->i + 1 < P->n && P->s[P->i + 1] == c) break;
+            if (c == '#' && word_start) break;
+        }
+        if (c == '\\' && P->i + 1 < P->n && P->s[P->i + 1] == '\n' && quote != '\'') {
+            P->i += 2;
+            P->line++;
+            c = ' ';
+        } else {
+            if (quote && c == quote) {
+                quote = 0;
+            } else if (!quote && (c == '\'' || c == '"')) {
+                quote = c;
+            } else if (c == '\\' && quote != '\'' && P->i + 1 < P->n) {
+                text_put(&t, c);            /* keep the escape, take the next byte as is */
+                c = P->s[++P->i];
+            }
+            if (c == '\n') P->line++;
+            P->i++;
+        }
+        word_start = !quote && is_blank(c);
+        text_put(&t, c);
+    }
+    while (t.len > 0 && is_blank(t.p[t.len - 1])) t.len--;
+    text_put(&t, '\0');
+    return t.p;
+}
+
+static stok_t lex(sp_t *P) {
+    stok_t t = { TK_S_EOF, -1, NULL, 0 };
+    for (;;) {
+        while (P->i < P->n) {
+            if (is_blank(P->s[P->i])) { P->i++; continue; }
+            if (P->s[P->i] == '\\' && P->i + 1 < P->n && P->s[P->i + 1] == '\n') {
+                P->i += 2;
+                P->line++;
+                continue;
+            }
+            break;
+        }
+        if (P->i < P->n && P->s[P->i] == '#') {
+            while (P->i < P->n && P->s[P->i] != '\n') P->i++;
+            continue;
+        }
+        break;
+    }
+    t.line = P->line;
+    if (P->i >= P->n) return t;
+
+    const char *p = P->s + P->i;
+    if (*p == '\n') { P->i++; P->line++; t.kind = TK_S_SEP; return t; }
+    if (*p == ';')  { P->i++; t.kind = TK_S_SEP; return t; }
+    if (p[0] == '&' && p[1] == '&') { P->i += 2; t.kind = TK_S_AND; return t; }
+    if (p[0] == '|' && p[1] == '|') { P->i += 2; t.kind = TK_S_OR; return t; }
+
+    bool quoted;
+    size_t end = word_end(P, P->i, &quoted);
+    size_t wlen = end - P->i;
+    if (!quoted) {
+        for (int k = 0; k < KW_COUNT; ++k) {
+            if (strlen(KW_NAMES[k]) == wlen && memcmp(p, KW_NAMES[k], wlen) == 0) {
+                P->i = end;
+                t.kind = TK_S_KW;
+                t.kw = k;
+                return t;
+            }
+        }
+        if (is_name(p, wlen)) {
+            size_t k = end;
+            while (k < P->n && is_blank(P->s[k])) k++;
+            if (k < P->n && P->s[k] == '(') {
+                k++;
+                while (k < P->n && is_blank(P->s[k])) k++;
+                if (k < P->n && P->s[k] == ')') {
+                    t.kind = TK_S_FUNC;
+                    t.text = strndup(p, wlen);
+                    if (!t.text) { perror("strndup"); exit(1); }
+                    P->i = k + 1;
+                    return t;
+                }
+            }
+        }
+    }
+    t.kind = TK_S_CMD;
+    t.text = scan_cmd(P);
+    return t;
+}
+
+static stok_t peek(sp_t *P) {
+    if (!P->have_la) { P->la = lex(P); P->have_la = true; }
+    return P->la;
+}
+
+static stok_t next(sp_t *P) {
+    stok_t t = peek(P);
+    P->have_la = false;
+    return t;
+}
+
+static const char *tok_desc(const stok_t *t) {
+    switch (t->kind) {
+        case TK_S_EOF:  return "end of file";
+        case TK_S_SEP:  return "';'";
+        case TK_S_AND:  return "'&&'";
+        case TK_S_OR:   return "'||'";
+        case TK_S_KW:   return KW_NAMES[t->kw];
+        case TK_S_FUNC: return "function definition";
+        default:        return t->text;
+    }
+}
+
+static void sp_error(sp_t *P, unsigned line, const char *fmt, ...) {
+    if (P->failed) return;
+    P->failed = true;
+    P->err_line = line;
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(P->err, sizeof(P->err), fmt, ap);
+    va_end(ap);
+}
+
+// ---- parser -----------------------------------------------------------------
+
+static void compile_list(sp_t *P, unsigned stop);
+static void compile_andor(sp_t *P);
+
+static void expect_kw(sp_t *P, int kw) {
+    stok_t t = next(P);
+    if (t.kind != TK_S_KW || t.kw != kw)
+        sp_error(P, t.line, "expected '%s' before %s", KW_NAMES[kw], tok_desc(&t));
+    ms_free(t.text);
+}
+
+static void skip_seps(sp_t *P) {
+    while (!P->failed && peek(P).kind == TK_S_SEP) (void)next(P);
+}
+
+static void empty_list(sp_t *P, unsigned line) {
+    node_end(P->b, node_begin(P->b, SN_LIST, line));
+}
+
+/* After 'if' or 'elif': cond, then-part, and the rest through 'fi'. */
+static void compile_if(sp_t *P, unsigned line) {
+    size_t pos = node_begin(P->b, SN_IF, line);
+    compile_list(P, KW_BIT(KW_THEN));
+    expect_kw(P, KW_THEN);
+    compile_list(P, KW_BIT(KW_ELIF) | KW_BIT(KW_ELSE) | KW_BIT(KW_FI));
+    if (P->failed) return;
+    stok_t t = next(P);
+    if (t.kind == TK_S_KW && t.kw == KW_ELIF) {
+        compile_if(P, t.line);
+    } else if (t.kind == TK_S_KW && t.kw == KW_ELSE) {
+        compile_list(P, KW_BIT(KW_FI));
+        expect_kw(P, KW_FI);
+    } else if (t.kind == TK_S_KW && t.kw == KW_FI) {
+        empty_list(P, t.line);
+    } else {
+        sp_error(P, t.line, "expected 'fi' before %s", tok_desc(&t));
+    }
+    ms_free(t.text);
+    node_end(P->b, pos);
+}
+
+/* "NAME in WORD..." after 'for' */
+static void compile_for(sp_t *P, unsigned line) {
+    size_t pos = node_begin(P->b, SN_FOR, line);
+    stok_t t = next(P);
+    pipeline_t pl = {0};
+    if (t.kind != TK_S_CMD || parse_line_raw(t.text, &pl) != 0 || pl.nstages != 1 ||
+        pl.background || pl.stages[0].redir.nops != 0 ||
+        !pl.stages[0].argv[1] || strcmp(pl.stages[0].argv[1], "in") != 0 ||
+        !is_name(pl.stages[0].argv[0], strlen(pl.stages[0].argv[0]))) {
+        sp_error(P, t.line, "expected 'for NAME in WORD...'");
+    } else {
+        cmd_t *c = &pl.stages[0];
+        b_str(P->b, c->argv[0]);
+        cmd_t words = { c->argv + 2, c->glob ? c->glob + 2 : NULL, { NULL, 0 } };
+        pipeline_t wl = { &words, 1, 0 };
+        emit_cmd(P->b, t.line, &wl);
+        P->b->ncmds--;                  /* a word list, not a command */
+        skip_seps(P);
+        expect_kw(P, KW_DO);
+        compile_list(P, KW_BIT(KW_DONE));
+        expect_kw(P, KW_DONE);
+    }
+    free_pipeline(&pl);
+    ms_free(t.text);
+    node_end(P->b, pos);
+}
+
+static bool parse_count(const char *s, uint32_t *out) {
+    if (!s) { *out = SN_NONE; return true; }
+    char *end = NULL;
+    long v = strtol(s, &end, 10);
+    if (!*s || *end || v < 0 || v > 0xFFFF) return false;
+    *out = (uint32_t)v;
+    return true;
+}
+
+static void compile_simple(sp_t *P, const stok_t *t) {
+    pipeline_t pl;
+    if (parse_line_raw(t->text, &pl) != 0) {
+        sp_error(P, t->line, "bad command '%s'", t->text);
+        return;
+    }
+    cmd_t *c = &pl.stages[0];
+    static const struct { const char *name; uint32_t kind; } ctl[] = {
+        { "break", SN_BREAK }, { "continue", SN_CONTINUE }, { "return", SN_RETURN },
+    };
+    for (size_t k = 0; k < sizeof(ctl) / sizeof(ctl[0]); ++k) {
+        if (pl.nstages != 1 || pl.background || c->redir.nops || strcmp(c->argv[0], ctl[k].name) != 0)
+            continue;
+        uint32_t n;
+        if ((c->argv[1] && c->argv[2]) || !parse_count(c->argv[1], &n)) {
+            sp_error(P, t->line, "%s: bad argument", ctl[k].name);
+        } else {
+            size_t pos = node_begin(P->b, ctl[k].kind, t->line);
+            b_word(P->b, n);
+            node_end(P->b, pos);
+        }
+        free_pipeline(&pl);
+        return;
+    }
+    emit_cmd(P->b, t->line, &pl);
+    free_pipeline(&pl);
+}
+
+static void compile_command(sp_t *P) {
+    if (++P->depth > SN_MAX_NEST) {
+        sp_error(P, P->line, "nested too deeply");
+        return;
+    }
+    stok_t t = next(P);
+    size_t pos;
+    switch (t.kind) {
+        case TK_S_KW:
+            switch (t.kw) {
+                case KW_IF:
+                    compile_if(P, t.line);
+                    break;
+                case KW_WHILE:
+                case KW_UNTIL:
+                    pos = node_begin(P->b, t.kw == KW_WHILE ? SN_WHILE : SN_UNTIL, t.line);
+                    compile_list(P, KW_BIT(KW_DO));
+                    expect_kw(P, KW_DO);
+                    compile_list(P, KW_BIT(KW_DONE));
+                    expect_kw(P, KW_DONE);
+                    node_end(P->b, pos);
+                    break;
+                case KW_FOR:
+                    compile_for(P, t.line);
+                    break;
+                case KW_LBRACE:
+                    compile_list(P, KW_BIT(KW_RBRACE));
+                    expect_kw(P, KW_RBRACE);
+                    break;
+                default:
+                    sp_error(P, t.line, "unexpected '%s'", KW_NAMES[t.kw]);
+                    break;
+            }
+            break;
+        case TK_S_FUNC:
+            pos = node_begin(P->b, SN_FUNC, t.line);
+            b_str(P->b, t.text);
+            skip_seps(P);
+            expect_kw(P, KW_LBRACE);
+            compile_list(P, KW_BIT(KW_RBRACE));
+            expect_kw(P, KW_RBRACE);
+            node_end(P->b, pos);
+            break;
+        case TK_S_CMD:
+            compile_simple(P, &t);
+            break;
+        default:
+            sp_error(P, t.line, "unexpected %s", tok_desc(&t));
+            break;
+    }
+    ms_free(t.text);
+    P->depth--;
+}
+
+/* CMD { (&& | ||) CMD }: left-associative, so each operator wraps what
+   has been emitted so far in a new header. */
+static void compile_andor(sp_t *P) {
+    size_t start = P->b->nw;
+    compile_command(P);
+    while (!P->failed) {
+        stok_t t = peek(P);
+        if (t.kind != TK_S_AND && t.kind != TK_S_OR) break;
+        (void)next(P);
+        sbuf_t *b = P->b;
+        size_t lhs = b->nw - start;
+        for (int k = 0; k < 3; ++k) b_word(b, 0);
+        memmove(b->w + start + 3, b->w + start, lhs * sizeof(uint32_t));
+        b->w[start]     = t.kind == TK_S_AND ? SN_AND : SN_OR;
+        b->w[start + 1] = t.line;
+        skip_seps(P);
+        compile_command(P);
+        node_end(b, start);
+    }
+}
+
+/* Commands until EOF or a keyword in 'stop' (left for the caller). */
+static void compile_list(sp_t *P, unsigned stop) {
+    size_t pos = node_begin(P->b, SN_LIST, P->line);
+    while (!P->failed) {
+        stok_t t = peek(P);
+        if (t.kind == TK_S_SEP) { (void)next(P); continue; }
+        if (t.kind == TK_S_EOF) break;
+        if (t.kind == TK_S_KW && (stop & KW_BIT(t.kw))) break;
+        compile_andor(P);
+        if (P->failed) break;
+        t = peek(P);
+        if (t.kind != TK_S_SEP && t.kind != TK_S_EOF && !(t.kind == TK_S_KW && (stop & KW_BIT(t.kw))))
+            sp_error(P, t.line, "unexpected %s", tok_desc(&t));
+    }
+    node_end(P->b, pos);
+}
+
+// ---- images -----------------------------------------------------------------
+
+typedef struct {
+    const uint32_t *w;
+    size_t          ns;
+} sv_t;
+
+static bool valid_node(const sv_t *V, size_t pos, size_t end, int depth);
+
+static bool valid_str(const sv_t *V, uint32_t off) {
+    return off < V->ns;
+}
+
+static bool valid_cmd(const sv_t *V, size_t i, size_t e) {
+    const uint32_t *w = V->w;
+    if (e - i < 2) return false;
+    uint32_t nstages = w[i + 1];
+    i += 2;
+    for (uint32_t s = 0; s < nstages; ++s) {
+        if (i >= e) return false;
+        uint32_t argc = w[i++];
+        if (argc > e - i) return false;
+        for (uint32_t a = 0; a < argc; ++a)
+            if (!valid_str(V, w[i++])) return false;
+        if (i >= e) return false;
+        uint32_t nglob = w[i++];
+        if ((nglob != 0 && nglob != argc) || nglob > e - i) return false;
+        for (uint32_t a = 0; a < nglob; ++a, ++i)
+            if (w[i] != SN_NONE && !valid_str(V, w[i])) return false;
+        if (i >= e) return false;
+        uint32_t nops = w[i++];
+        if (nops > (e - i) / 4) return false;
+        for (uint32_t k = 0; k < nops; ++k, i += 4) {
+            if (w[i] > REDIR_CLOSE) return false;
+            if (w[i + 3] != SN_NONE && !valid_str(V, w[i + 3])) return false;
+        }
+    }
+    return i == e;
+}
+
+/* 'n' child nodes exactly filling [i, e) */
+static bool valid_children(const sv_t *V, size_t i, size_t e, int n, int depth) {
+    for (int k = 0; n < 0 ? i < e : k < n; ++k) {
+        if (!valid_node(V, i, e, depth + 1)) return false;
+        i += V->w[i + 2];
+    }
+    return i == e;
+}
+
+static bool valid_node(const sv_t *V, size_t pos, size_t end, int depth) {
+    const uint32_t *w = V->w;
+    if (depth > 2 * SN_MAX_NEST || end - pos < 3) return false;
+    uint32_t len = w[pos + 2];
+    if (len < 3 || len > end - pos) return false;
+    size_t i = pos + 3, e = pos + len;
+    switch (w[pos]) {
+        case SN_LIST:     return valid_children(V, i, e, -1, depth);
+        case SN_CMD:      return valid_cmd(V, i, e);
+        case SN_IF:       return valid_children(V, i, e, 3, depth);
+        case SN_WHILE:
+        case SN_UNTIL:
+        case SN_AND:
+        case SN_OR:       return valid_children(V, i, e, 2, depth);
+        case SN_FOR:
+            return i < e && valid_str(V, w[i]) && e - (i + 1) >= 3 && w[i + 1] == SN_CMD &&
+                   valid_children(V, i + 1, e, 2, depth);
+        case SN_FUNC:     return i < e && valid_str(V, w[i]) && valid_children(V, i + 1, e, 1, depth);
+        case SN_BREAK:
+        case SN_CONTINUE:
+        case SN_RETURN:   return len == 4;
+        case SN_SYNTAX:   return len == 4 && valid_str(V, w[i]);
+        default:          return false;
+    }
+}
+
+script_t *script_compile(char *text, size_t len) {
+    sbuf_t b = {0};
+    sp_t P = { .s = text, .n = len, .line = 1, .b = &b };
+    compile_list(&P, 0);
+    if (!P.failed && peek(&P).kind != TK_S_EOF) {
+        stok_t t = peek(&P);
+        sp_error(&P, t.line, "unexpected %s", tok_desc(&t));
+    }
+    if (P.have_la) ms_free(P.la.text);
+    if (P.failed) {
+        b.nw = b.ns = 0;
+        b.ncmds = 0;
+        size_t pos = node_begin(&b, SN_SYNTAX, P.err_line);
+        b_str(&b, P.err);
+        node_end(&b, pos);
+    }
+    if (b.ns == 0) {                    /* images never have an empty string table */
+        b_str(&b, "");
+        b.nw--;
+    }
+
+    script_t *sc = (script_t *)ms_calloc(MS_SCRIPT, 1, sizeof(*sc));
+    if (!sc) { ms_free(b.w); ms_free(b.s); return NULL; }
+    sc->refs = 1;
+    sc->w = sc->own_w = b.w;
+    sc->nw = b.nw;
+    sc->s = sc->own_s = b.s;
+    sc->ns = b.ns;
+    sc->ncmds = b.ncmds;
+    return sc;
+}
+
+static uint32_t count_cmds(const uint32_t *w, size_t pos) {
+    uint32_t kind = w[pos], len = w[pos + 2], n = kind == SN_CMD;
+    if (kind == SN_CMD || kind >= SN_BREAK) return n;
+    size_t i = pos + 3, e = pos + len;
+    if (kind == SN_FOR) i += 1 + w[i + 3];      /* name, word list */
+    if (kind == SN_FUNC) i += 1;
+    for (; i < e; i += w[i + 2]) n += count_cmds(w, i);
+    return n;
+}
+
+script_t *script_from_image(const uint32_t *w, size_t nw, const char *s, size_t ns,
+                            void *map, size_t maplen) {
+    sv_t V = { w, ns };
+    if (nw < 3 || ns == 0 || s[ns - 1] != '\0' || w[2] != nw || !valid_node(&V, 0, nw, 0))
+        return NULL;
+    script_t *sc = (script_t *)ms_calloc(MS_SCRIPT, 1, sizeof(*sc));
+    if (!sc) return NULL;
+    sc->refs = 1;
+    sc->w = w;
+    sc->nw = nw;
+    sc->s = s;
+    sc->ns = ns;
+    sc->map = map;
+    sc->maplen = maplen;
+    sc->ncmds = count_cmds(w, 0);
+    return sc;
+}
+
+void script_retain(script_t *sc) {
+    if (sc) sc->refs++;
+}
+
+void script_release(script_t *sc) {
+    if (!sc || --sc->refs > 0) return;
+    ms_free(sc->own_w);
+    ms_free(sc->own_s);
+    if (sc->map) munmap(sc->map, sc->maplen);
+    ms_free(sc);
+}
+
+const uint32_t *script_words(const script_t *sc, size_t *nw) {
+    *nw = sc->nw;
+    return sc->w;
+}
+
+const char *script_strings(const script_t *sc, size_t *ns) {
+    *ns = sc->ns;
+    return sc->s;
+}
+
+uint32_t script_ncmds(const script_t *sc) {
+    return sc->ncmds;
+}
+
+// ---- functions --------------------------------------------------------------
+
+typedef struct {
+    char     *name;
+    script_t *sc;               /* holds a reference */
+    size_t    body;             /* LIST node in sc */
+} sfunc_t;
+
+static sfunc_t *g_funcs;
+static size_t   g_nfuncs, g_capfuncs;
+static int      g_calls;
+
+static sfunc_t *func_find(const char *name) {
+    for (size_t i = 0; i < g_nfuncs; ++i)
+        if (strcmp(g_funcs[i].name, name) == 0) return &g_funcs[i];
+    return NULL;
+}
+
+static void func_define(const char *name, script_t *sc, size_t body) {
+    sfunc_t *f = func_find(name);
+    if (!f) {
+        if (g_nfuncs == g_capfuncs) {
+            size_t cap = g_capfuncs ? g_capfuncs * 2 : 16;
+            sfunc_t *nf = (sfunc_t *)ms_realloc(MS_SCRIPT, g_funcs, cap * sizeof(*nf));
+            if (!nf) { perror("realloc"); return; }
+            g_funcs = nf;
+            g_capfuncs = cap;
+        }
+        f = &g_funcs[g_nfuncs++];
+        f->name = ms_strdup(MS_SCRIPT, name);
+        if (!f->name) { perror("strdup"); g_nfuncs--; return; }
+    } else {
+        script_release(f->sc);
+    }
+    script_retain(sc);
+    f->sc = sc;
+    f->body = body;
+    fprintf(stderr, "[script] defined function '%s'\n", name);
+}
+
+// ---- interpreter ------------------------------------------------------------
+
+/* Scratch arrays pipeline views point into; each command rebuilds them. */
+typedef struct {
+    cmd_t      *cmds;  size_t ncmds;
+    char      **argvs; size_t nargvs;
+    char      **globs; size_t nglobs;
+    redir_op_t *ops;   size_t nops;
+} sviews_t;
+
+typedef struct {
+    script_t   *sc;
+    const char *file;
+    sviews_t   *v;              /* shared by every frame of one run */
+    int         loops;          /* enclosing loops in this function body */
+    int         brk, cont;      /* pending break / continue levels */
+    bool        ret, exit;
+    int         status;
+    bool        tail;           /* the node about to run is the last one the process runs */
+} sr_t;
+
+static void sviews_free(sviews_t *v) {
+    ms_free(v->cmds);
+    ms_free(v->argvs);
+    ms_free(v->globs);
+    ms_free(v->ops);
+}
+
+static void *grow(void *p, size_t *cap, size_t want, size_t elem) {
+    if (want <= *cap) return p;
+    size_t c = *cap ? *cap : 16;
+    while (c < want) c *= 2;
+    void *np = ms_realloc(MS_SCRIPT, p, c * elem);
+    if (!np) { perror("realloc"); exit(1); }
+    *cap = c;
+    return np;
+}
+
+/* pipeline_t view of the CMD node at pos, strings pointing into the image. */
+static void view_cmd(const script_t *sc, size_t pos, sviews_t *v, pipeline_t *pl) {
+    const uint32_t *w = sc->w;
+    size_t i = pos + 3;
+    uint32_t flags = w[i], nstages = w[i + 1];
+
+    /* Size the scratch arrays first so the views below never move */
+    size_t need_argv = 0, need_glob = 0, need_ops = 0, j = i + 2;
+    for (uint32_t s = 0; s < nstages; ++s) {
+        uint32_t argc = w[j];
+        need_argv += argc + 1;
+        j += 1 + argc;
+        if (w[j]) need_glob += argc + 1;
+        j += 1 + w[j];
+        need_ops += w[j];
+        j += 1 + 4 * (size_t)w[j];
+    }
+    v->cmds  = grow(v->cmds,  &v->ncmds,  nstages,   sizeof(*v->cmds));
+    v->argvs = grow(v->argvs, &v->nargvs, need_argv, sizeof(*v->argvs));
+    v->globs = grow(v->globs, &v->nglobs, need_glob, sizeof(*v->globs));
+    v->ops   = grow(v->ops,   &v->nops,   need_ops,  sizeof(*v->ops));
+
+    char **av = v->argvs, **gv = v->globs;
+    redir_op_t *ops = v->ops;
+    i += 2;
+    for (uint32_t s = 0; s < nstages; ++s) {
+        cmd_t *c = &v->cmds[s];
+        uint32_t argc = w[i++];
+        c->argv = av;
+        /* exec_pipeline never writes through argv; the image is read-only */
+        for (uint32_t a = 0; a < argc; ++a) *av++ = (char *)(sc->s + w[i++]);
+        *av++ = NULL;
+        uint32_t nglob = w[i++];
+        c->glob = nglob ? gv : NULL;
+        for (uint32_t a = 0; a < nglob; ++a, ++i)
+            *gv++ = w[i] == SN_NONE ? NULL : (char *)(sc->s + w[i]);
+        if (nglob) *gv++ = NULL;
+        c->redir.ops = ops;
+        c->redir.nops = (int)w[i++];
+        for (int k = 0; k < c->redir.nops; ++k, i += 4) {
+            ops->kind   = (redir_kind_t)w[i];
+            ops->fd     = (int)w[i + 1];
+            ops->src_fd = (int)w[i + 2];
+            ops->path   = w[i + 3] == SN_NONE ? NULL : (char *)(sc->s + w[i + 3]);
+            ops++;
+        }
+    }
+    pl->stages = v->cmds;
+    pl->nstages = (int)nstages;
+    pl->background = (flags & SN_F_BG) ? 1 : 0;
+}
+
+static void run_node(sr_t *R, size_t pos);
+
+static bool unwinding(const sr_t *R) {
+    return R->exit || R->ret || R->brk || R->cont;
+}
+
+/* $1.. are environment variables: args[1..n] of the innermost call. The
+   caller's args outlive the call, so restoring them needs no copies. */
+static char  **g_params;
+static size_t  g_nparams;
+
+static void set_params(char *const *v, size_t n, size_t was) {
+    char name[24];
+    for (size_t k = 1; k <= n || k <= was; ++k) {
+        snprintf(name, sizeof(name), "%zu", k);
+        if (k <= n) env_set(name, v[k]);
+        else        env_unset(name);
+    }
+}
+
+static int call_function(sr_t *R, const sfunc_t *fn, const cmd_t *c) {
+    if (g_calls >= SN_MAX_CALLS) {
+        fprintf(stderr, "%s: maximum function nesting exceeded\n", fn->name);
+        return 1;
+    }
+    char **args = exec_expand_argv(c->argv, c->glob, true);
+    if (!args) return 1;
+    size_t nargs = 0;
+    while (args[nargs]) nargs++;
+    char **outer = g_params;
+    size_t nouter = g_nparams;
+    set_params(args, nargs - 1, nouter);
+    g_params = args;
+    g_nparams = nargs - 1;
+
+    /* Redirections on the call apply to the whole body, as for builtins */
+    redir_stage_t rs;
+    int fds[EXEC_FDPLAN_MAXFD];
+    int status = 1;
+    if (redir_prepare(&c->redir, -1, -1, &rs) == 0) {
+        if (redir_apply_saved(&rs.plan, fds) == 0) {
+            sr_t F = { fn->sc, R->file, R->v, 0, 0, 0, false, false, 0, false };
+            g_calls++;
+            run_node(&F, fn->body);
+            g_calls--;
+            status = F.status;
+            R->exit = F.exit;
+            fflush(stdout);
+            redir_restore(&rs.plan, fds);
+        }
+        redir_release(&rs);
+    }
+
+    set_params(outer, nouter, g_nparams);
+    g_params = outer;
+    g_nparams = nouter;
+    for (size_t k = 0; k < nargs; ++k) ms_free(args[k]);
+    ms_free(args);
+    return status;
+}
+
+static void run_cmd(sr_t *R, size_t pos, bool tail) {
+    pipeline_t view, copy;
+    const pipeline_t *pl = &view;
+    view_cmd(R->sc, pos, R->v, &view);
+    bool expand = R->sc->w[pos + 3] & SN_F_EXPAND;
+    if (expand) {
+        if (pipeline_dup(&view, &copy) != 0) { R->status = 1; return; }
+        pipeline_expand_env(&copy);
+        pl = &copy;
+    }
+
+    /* Functions and `exit` need the interpreter; everything else is a pipeline */
+    const cmd_t *c = &pl->stages[0];
+    bool simple = pl->nstages == 1 && !pl->background && c->argv[0];
+    int na = simple ? argv_assignments(c->argv) : 0;
+    const sfunc_t *fn = simple && c->argv[na] ? func_find(c->argv[na]) : NULL;
+    int rc;
+    if (fn) {
+        /* `NAME=value f`: the assignments last for the call */
+        cmd_t call = *c;
+        call.argv += na;
+        if (call.glob) call.glob += na;
+        char **undo = env_push(c->argv, na);
+        rc = call_function(R, fn, &call);
+        env_pop(undo);
+    } else if (simple && strcmp(c->argv[0], "exit") == 0 && c->redir.nops == 0)
+        rc = run_builtin_parent(c->argv);
+    else if (tail)
+        rc = exec_pipeline_final(pl);
+    else
+        rc = exec_pipeline(pl);
+    R->status = rc < 0 ? 1 : rc;
+    if (R->status >= 2001 && R->status <= 2001 + 255) R->exit = true;
+
+    if (expand) free_pipeline(&copy);
+}
+
+/* Words of a for loop, expanded now: $VAR, ~ and globs. */
+static char **for_words(sr_t *R, size_t pos) {
+    pipeline_t view, copy;
+    view_cmd(R->sc, pos, R->v, &view);
+    const pipeline_t *pl = &view;
+    bool expand = R->sc->w[pos + 3] & SN_F_EXPAND;
+    if (expand) {
+        if (pipeline_dup(&view, &copy) != 0) return NULL;
+        pipeline_expand_env(&copy);
+        pl = &copy;
+    }
+    char *const empty[] = { NULL };
+    const cmd_t *c = &pl->stages[0];
+    char **out = exec_expand_argv(c->argv ? c->argv : empty, c->glob, true);
+    if (expand) free_pipeline(&copy);
+    return out;
+}
+
+/* After a loop body: true if the loop must stop (break, or unwinding past it). */
+static bool loop_stop(sr_t *R) {
+    if (R->brk) { R->brk--; return true; }
+    if (R->cont) {
+        if (--R->cont) return true;     /* continue an outer loop */
+        return false;
+    }
+    return R->exit || R->ret;
+}
+
+static void run_node(sr_t *R, size_t pos) {
+    bool tail = R->tail;                /* each child below decides its own */
+    R->tail = false;
+    if (unwinding(R)) return;
+    const uint32_t *w = R->sc->w;
+    uint32_t kind = w[pos], len = w[pos + 2];
+    size_t i = pos + 3, e = pos + len;
+
+    switch (kind) {
+        case SN_LIST:
+            for (; i < e && !unwinding(R); i += w[i + 2]) {
+                R->tail = tail && i + w[i + 2] >= e;
+                run_node(R, i);
+            }
+            break;
+
+        case SN_CMD:
+            run_cmd(R, pos, tail);
+            break;
+
+        case SN_IF: {
+            size_t then = i + w[i + 2], els = then + w[then + 2];
+            run_node(R, i);
+            if (unwinding(R)) break;
+            R->tail = tail;
+            if (R->status == 0) {
+                run_node(R, then);
+            } else {
+                R->status = 0;
+                run_node(R, els);
+            }
+            break;
+        }
+
+        case SN_WHILE:
+        case SN_UNTIL: {
+            size_t body = i + w[i + 2];
+            int last = 0;
+            R->loops++;
+            for (;;) {
+                run_node(R, i);
+                if (unwinding(R)) { if (loop_stop(R)) break; continue; }
+                if ((R->status == 0) != (kind == SN_WHILE)) break;
+                run_node(R, body);
+                last = R->status;
+                if (unwinding(R) && loop_stop(R)) break;
+            }
+            R->loops--;
+            if (!R->exit && !R->ret) R->status = last;
+            break;
+        }
+
+        case SN_FOR: {
+            const char *name = R->sc->s + w[i];
+            size_t words = i + 1, body = words + w[words + 2];
+            char **list = for_words(R, words);
+            if (!list) { R->status = 1; break; }
+            int last = 0;
+            R->loops++;
+            for (size_t k = 0; list[k]; ++k) {
+                env_set(name, list[k]);
+                run_node(R, body);
+                last = R->status;
+                if (unwinding(R) && loop_stop(R)) break;
+            }
+            R->loops--;
+            for (size_t k = 0; list[k]; ++k) ms_free(list[k]);
+            ms_free(list);
+            if (!R->exit && !R->ret) R->status = last;
+            break;
+        }
+
+        case SN_FUNC:
+            func_define(R->sc->s + w[i], R->sc, i + 1);
+            R->status = 0;
+            break;
+
+        case SN_AND:
+        case SN_OR: {
+            run_node(R, i);
+            if (unwinding(R)) break;
+            if ((R->status == 0) == (kind == SN_AND)) {
+                R->tail = tail;
+                run_node(R, i + w[i + 2]);
+            }
+            break;
+        }
+
+        case SN_BREAK:
+        case SN_CONTINUE: {
+            const char *what = kind == SN_BREAK ? "break" : "continue";
+            uint32_t n = w[i] == SN_NONE ? 1 : w[i];
+            if (R->loops == 0) {
+                fprintf(stderr, "%s: only meaningful in a loop\n", what);
+                R->status = 0;
+                break;
+            }
+            if (n == 0) {
+                fprintf(stderr, "%s: loop count out of range\n", what);
+                R->status = 1;
+                break;
+            }
+            if ((int)n > R->loops) n = (uint32_t)R->loops;
+            if (kind == SN_BREAK) R->brk = (int)n;
+            else                  R->cont = (int)n;
+            R->status = 0;
+            break;
+        }
+
+        case SN_RETURN:
+            if (w[i] != SN_NONE) R->status = (int)(w[i] & 0xFF);
+            R->ret = true;
+            break;
+
+        case SN_SYNTAX:
+            fprintf(stderr, "%s:%u: syntax error: %s\n", R->file, w[pos + 1], R->sc->s + w[i]);
+            R->status = 2;
+            break;
+    }
+}
+
+static int run_script(script_t *sc, const char *file, bool final) {
+    sviews_t v = {0};
+    sr_t R = { sc, file ? file : "script", &v, 0, 0, 0, false, false, 0, final };
+    script_retain(sc);                  /* functions may outlive the caller's ref */
+    run_node(&R, 0);
+    sviews_free(&v);
+    script_release(sc);
+    return R.status;
+}
+
+int script_run(script_t *sc, const char *file) {
+    return run_script(sc, file, false);
+}
+
+int script_check(const script_t *sc, const char *file) {
+    if (sc->w[0] != SN_SYNTAX) return 0;
+    fprintf(stderr, "%s:%u: syntax error: %s\n", file ? file : "script", sc->w[1], sc->s + sc->w[3]);
+    return 2;
+}
+
+static int run_text(const char *text, bool final) {
+    char *copy = ms_strdup(MS_SCRIPT, text);
+    if (!copy) { perror("strdup"); return 1; }
+    script_t *sc = script_compile(copy, strlen(copy));
+    ms_free(copy);
+    if (!sc) return 1;
+    int rc = run_script(sc, "script", final);
+    script_release(sc);
+    return rc;
+}
+
+int script_run_text(const char *text) {
+    return run_text(text, false);
+}
+
+int script_run_text_final(const char *text) {
+    return run_text(text, true);
+}
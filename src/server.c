@@ -0,0 +1,252 @@
+// src/server.c — `serve`: run client commands in forked workers of one shell
+#define _GNU_SOURCE             /* accept4 */
+#define _POSIX_C_SOURCE 200809L
+#include "server.h"
+#include "env.h"
+#include "exec.h"               /* exec_pidfd_open */
+#include "readbuf.h"
+#include "script.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/* A connection and the worker running its request (pid 0: idle). */
+typedef struct {
+    int   sock;
+    pid_t pid;
+    int   pidfd;                /* -1: polled with WNOHANG instead */
+} sv_conn_t;
+
+static sv_conn_t SV[SERVER_MAX_CONN];
+static int       sv_nconn;
+static int       sv_listen = -1;
+static volatile sig_atomic_t sv_stop;
+
+static void sv_on_signal(int sig) { (void)sig; sv_stop = 1; }
+
+static void sv_reply(int sock, int32_t status, int32_t err) {
+    server_rep_t rep = { status, err };
+    if (send(sock, &rep, sizeof(rep), MSG_NOSIGNAL) != (ssize_t)sizeof(rep))
+        fprintf(stderr, "[serve] reply: %s\n", strerror(errno));
+}
+
+static void sv_drop(int i) {
+    close(SV[i].sock);
+    if (SV[i].pidfd >= 0) close(SV[i].pidfd);
+    SV[i] = SV[--sv_nconn];
+}
+
+/* Worker: becomes the command's shell and never returns. */
+static void sv_worker(const char *cwd, const char *cmd, char **env, int nenv, const int fds[3]) {
+    close(sv_listen);
+    for (int i = 0; i < sv_nconn; ++i) {
+        close(SV[i].sock);
+        if (SV[i].pidfd >= 0) close(SV[i].pidfd);
+    }
+    signal(SIGINT, SIG_DFL);
+    signal(SIGTERM, SIG_DFL);
+    for (int fd = 0; fd < 3; ++fd) {
+        readbuf_release(fd);
+        dup2(fds[fd], fd);
+    }
+    for (int k = 0; k < 3; ++k) if (fds[k] > 2) close(fds[k]);
+
+    if (chdir(cwd) != 0) {
+        fprintf(stderr, "serve: cd %s: %s\n", cwd, strerror(errno));
+        _exit(1);
+    }
+    env_assign(env, nenv);
+    int rc = script_run_text_final(cmd);      /* the last command keeps our pid */
+    if (rc > 2000) rc -= 2001;                  /* `exit N` */
+    fflush(NULL);
+    readbuf_sync_all();
+    _exit(rc & 0xFF);
+}
+
+/* Take one request off connection 'i' and fork its worker. Returns -1
+   when the connection is finished. */
+static int sv_request(int i) {
+    static char buf[SERVER_MSG_MAX + 1];
+    int fds[3] = { -1, -1, -1 };
+    int nfds = 0;
+    union { char buf[CMSG_SPACE(3 * sizeof(int))]; struct cmsghdr align; } cb;
+    struct iovec iov = { buf, SERVER_MSG_MAX };
+    struct msghdr mh = { 0 };
+    mh.msg_iov = &iov;
+    mh.msg_iovlen = 1;
+    mh.msg_control = cb.buf;
+    mh.msg_controllen = sizeof(cb.buf);
+
+    ssize_t n;
+    do n = recvmsg(SV[i].sock, &mh, MSG_CMSG_CLOEXEC);
+    while (n < 0 && errno == EINTR);
+    if (n <= 0) return -1;
+    for (struct cmsghdr *c = CMSG_FIRSTHDR(&mh); c; c = CMSG_NXTHDR(&mh, c)) {
+        if (c->cmsg_level != SOL_SOCKET || c->cmsg_type != SCM_RIGHTS) continue;
+        int k = (int)((c->cmsg_len - CMSG_LEN(0)) / sizeof(int));
+        for (int j = 0; j < k; ++j) {
+            int fd;
+            memcpy(&fd, CMSG_DATA(c) + j * sizeof(int), sizeof(int));
+            if (nfds < 3) fds[nfds++] = fd;
+            else          close(fd);
+        }
+    }
+
+    /* cwd, command, env..., all inside the message */
+    server_req_t rq;
+    char *strs[2 + 1024];
+    int err = EPROTO;
+    if ((size_t)n < sizeof(rq) || nfds != 3 || (mh.msg_flags & (MSG_TRUNC | MSG_CTRUNC))) goto refuse;
+    memcpy(&rq, buf, sizeof(rq));
+    if (rq.magic != SERVER_MAGIC || rq.len != (size_t)n - sizeof(rq) || rq.nenv > 1024) goto refuse;
+    buf[n] = '\0';
+    char *p = buf + sizeof(rq), *end = buf + n;
+    for (uint32_t k = 0; k < 2 + rq.nenv; ++k) {
+        if (p >= end) goto refuse;
+        strs[k] = p;
+        p += strlen(p) + 1;
+    }
+
+    fflush(NULL);
+    readbuf_sync_all();
+    pid_t pid = fork();
+    if (pid == 0) sv_worker(strs[0], strs[1], strs + 2, (int)rq.nenv, fds);
+    if (pid < 0) { err = errno; goto refuse; }
+    for (int k = 0; k < 3; ++k) close(fds[k]);
+    SV[i].pid = pid;
+    SV[i].pidfd = exec_pidfd_open(pid);
+    fprintf(stderr, "[serve] conn %d: pid %d: %s\n", SV[i].sock, (int)pid, strs[1]);
+    return 0;
+
+refuse:
+    for (int k = 0; k < nfds; ++k) close(fds[k]);
+    sv_reply(SV[i].sock, -1, err);
+    return 0;
+}
+
+/* Reply for connection 'i' if its worker has exited. */
+static void sv_reap(int i) {
+    int status;
+    pid_t r = waitpid(SV[i].pid, &status, WNOHANG);
+    if (r == 0 || (r < 0 && errno == EINTR)) return;
+    int code = r < 0 ? -1
+             : WIFEXITED(status) ? WEXITSTATUS(status)
+             : WIFSIGNALED(status) ? 128 + WTERMSIG(status) : -1;
+    sv_reply(SV[i].sock, code, code < 0 ? ECHILD : 0);
+    if (SV[i].pidfd >= 0) close(SV[i].pidfd);
+    SV[i].pid = 0;
+    SV[i].pidfd = -1;
+}
+
+/* Only our own uid may have commands run (root gets no exception). */
+static bool sv_peer_ok(int s) {
+    struct ucred cr;
+    socklen_t len = sizeof(cr);
+    if (getsockopt(s, SOL_SOCKET, SO_PEERCRED, &cr, &len) != 0) {
+        perror("serve: SO_PEERCRED");
+        return false;
+    }
+    if (cr.uid == geteuid()) return true;
+    fprintf(stderr, "[serve] refused connection from uid %d (pid %d)\n", (int)cr.uid, (int)cr.pid);
+    return false;
+}
+
+int server_run(const char *path) {
+    struct sockaddr_un sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(sa.sun_path)) {
+        fprintf(stderr, "serve: %s: path too long\n", path);
+        return -1;
+    }
+    strcpy(sa.sun_path, path);
+
+    /* A socket left by an earlier server is replaced; anything else is not */
+    struct stat st;
+    if (lstat(path, &st) == 0 && S_ISSOCK(st.st_mode)) unlink(path);
+    /* Owner only, set before listen() so no one connects in between */
+    bool bound = false;
+    sv_listen = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (sv_listen < 0 || !(bound = bind(sv_listen, (struct sockaddr *)&sa, sizeof(sa)) == 0) ||
+        chmod(path, 0600) != 0 || listen(sv_listen, 128) != 0) {
+        int err = errno;
+        if (bound) unlink(path);
+        errno = err;
+        fprintf(stderr, "serve: %s: %s\n", path, strerror(errno));
+        if (sv_listen >= 0) close(sv_listen);
+        sv_listen = -1;
+        return -1;
+    }
+
+    /* No SA_RESTART: the signal breaks poll() so the loop can stop */
+    struct sigaction sa_stop = { 0 }, old_int, old_term;
+    sa_stop.sa_handler = sv_on_signal;
+    sigemptyset(&sa_stop.sa_mask);
+    sigaction(SIGINT, &sa_stop, &old_int);
+    sigaction(SIGTERM, &sa_stop, &old_term);
+    sv_stop = 0;
+    fprintf(stderr, "[serve] listening on %s\n", path);
+
+    struct pollfd pfd[SERVER_MAX_CONN + 1];
+    int who[SERVER_MAX_CONN + 1];
+    while (!sv_stop) {
+        int np = 0, polled = 0;
+        if (sv_nconn < SERVER_MAX_CONN) {
+            pfd[np] = (struct pollfd){ sv_listen, POLLIN, 0 };
+            who[np++] = -1;
+        }
+        for (int i = 0; i < sv_nconn; ++i) {
+            if (SV[i].pid > 0 && SV[i].pidfd < 0) { polled = 1; continue; }
+            pfd[np] = (struct pollfd){ SV[i].pid > 0 ? SV[i].pidfd : SV[i].sock, POLLIN, 0 };
+            who[np++] = i;
+        }
+        int r = poll(pfd, (nfds_t)np, polled ? 50 : -1);
+        if (r < 0 && errno != EINTR) { perror("serve: poll"); break; }
+
+        /* Back to front: sv_drop() moves the last connection into the gap */
+        for (int k = np - 1; r > 0 && k >= 0; --k) {
+            if (!pfd[k].revents) continue;
+            int i = who[k];
+            if (i < 0) {
+                int s = accept4(sv_listen, NULL, NULL, SOCK_CLOEXEC);
+                if (s >= 0 && !sv_peer_ok(s)) { close(s); s = -1; }
+                if (s >= 0) SV[sv_nconn++] = (sv_conn_t){ s, 0, -1 };
+            } else if (SV[i].pid > 0) {
+                sv_reap(i);
+            } else if (sv_request(i) != 0) {
+                sv_drop(i);
+            }
+        }
+        for (int i = 0; polled && i < sv_nconn; ++i)
+            if (SV[i].pid > 0 && SV[i].pidfd < 0) sv_reap(i);
+    }
+
+    /* Workers still running finish on their own; nobody is left to tell */
+    while (sv_nconn > 0) sv_drop(sv_nconn - 1);
+    close(sv_listen);
+    sv_listen = -1;
+    unlink(path);
+    sigaction(SIGINT, &old_int, NULL);
+    sigaction(SIGTERM, &old_term, NULL);
+    fprintf(stderr, "[serve] stopped\n");
+    return 0;
+}
+
+int builtin_serve(char *const argv[]) {
+    if (!argv[1] || argv[2]) {
+        fprintf(stderr, "usage: serve SOCKET\n");
+        return 2;
+    }
+    return server_run(argv[1]) == 0 ? 0 : 1;
+}
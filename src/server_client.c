@@ -0,0 +1,84 @@
+// src/server_client.c — client side of the shell server protocol (libc only)
+#define _POSIX_C_SOURCE 200809L
+#include "server.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+int server_connect(const char *path) {
+    struct sockaddr_un sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sun_family = AF_UNIX;
+    if (!path || strlen(path) >= sizeof(sa.sun_path)) { errno = ENAMETOOLONG; return -1; }
+    strcpy(sa.sun_path, path);
+
+    int s = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (s < 0) return -1;
+    if (connect(s, (struct sockaddr *)&sa, sizeof(sa)) != 0) {
+        int e = errno;
+        close(s);
+        errno = e;
+        return -1;
+    }
+    return s;
+}
+
+int server_send(int sock, const char *cmd, const char *cwd,
+                char *const env[], int nenv, const int fds[3]) {
+    size_t len = strlen(cwd) + 1 + strlen(cmd) + 1;
+    for (int i = 0; i < nenv; ++i) len += strlen(env[i]) + 1;
+    if (sizeof(server_req_t) + len > SERVER_MSG_MAX) { errno = E2BIG; return -1; }
+
+    char *msg = (char *)malloc(sizeof(server_req_t) + len);
+    if (!msg) return -1;
+    server_req_t rq = { SERVER_MAGIC, (uint32_t)len, (uint32_t)nenv, 0 };
+    memcpy(msg, &rq, sizeof(rq));
+    char *p = msg + sizeof(rq);
+    p = stpcpy(p, cwd) + 1;
+    p = stpcpy(p, cmd) + 1;
+    for (int i = 0; i < nenv; ++i) p = stpcpy(p, env[i]) + 1;
+
+    union { char buf[CMSG_SPACE(3 * sizeof(int))]; struct cmsghdr align; } cb;
+    memset(&cb, 0, sizeof(cb));
+    struct iovec iov = { msg, sizeof(rq) + len };
+    struct msghdr mh = { 0 };
+    mh.msg_iov = &iov;
+    mh.msg_iovlen = 1;
+    mh.msg_control = cb.buf;
+    mh.msg_controllen = sizeof(cb.buf);
+    struct cmsghdr *c = CMSG_FIRSTHDR(&mh);
+    c->cmsg_level = SOL_SOCKET;
+    c->cmsg_type = SCM_RIGHTS;
+    c->cmsg_len = CMSG_LEN(3 * sizeof(int));
+    memcpy(CMSG_DATA(c), fds, 3 * sizeof(int));
+
+    ssize_t n;
+    do n = sendmsg(sock, &mh, MSG_NOSIGNAL);
+    while (n < 0 && errno == EINTR);
+    int e = errno;
+    free(msg);
+    errno = e;
+    return n == (ssize_t)iov.iov_len ? 0 : -1;
+}
+
+int server_recv(int sock) {
+    server_rep_t rep;
+    ssize_t n;
+    do n = recv(sock, &rep, sizeof(rep), 0);
+    while (n < 0 && errno == EINTR);
+    if (n == 0) { errno = ECONNRESET; return -1; }
+    if (n != (ssize_t)sizeof(rep)) { if (n >= 0) errno = EPROTO; return -1; }
+    if (rep.status < 0) { errno = rep.err; return -1; }
+    return rep.status;
+}
+
+int server_call(int sock, const char *cmd, const char *cwd,
+                char *const env[], int nenv, const int fds[3]) {
+    if (server_send(sock, cmd, cwd, env, nenv, fds) != 0) return -1;
+    return server_recv(sock);
+}
@@ -0,0 +1,37 @@
+// src/shc.c — client for `serve`: shc SOCKET [NAME=value...] COMMAND
+#define _POSIX_C_SOURCE 200809L
+#include "server.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+int main(int argc, char **argv) {
+    if (argc < 3) {
+        fprintf(stderr, "usage: shc SOCKET [NAME=value...] COMMAND\n");
+        return 2;
+    }
+    int nenv = 0;
+    while (2 + nenv < argc - 1 && strchr(argv[2 + nenv], '=')) nenv++;
+
+    char cwd[PATH_MAX];
+    if (!getcwd(cwd, sizeof(cwd))) {
+        perror("shc: getcwd");
+        return 127;
+    }
+    int sock = server_connect(argv[1]);
+    if (sock < 0) {
+        fprintf(stderr, "shc: %s: %s\n", argv[1], strerror(errno));
+        return 127;
+    }
+    const int fds[3] = { 0, 1, 2 };
+    int rc = server_call(sock, argv[argc - 1], cwd, argv + 2, nenv, fds);
+    if (rc < 0) {
+        fprintf(stderr, "shc: %s: %s\n", argv[1], strerror(errno));
+        rc = 127;
+    }
+    close(sock);
+    return rc;
+}
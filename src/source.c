@@ -0,0 +1,243 @@
+// src/source.c — source builtin backed by an on-disk compiled-script cache
+#define _XOPEN_SOURCE 700           /* realpath */
+#define _POSIX_C_SOURCE 200809L
+#include "source.h"
+#include "script.h"     // script_compile, script_run
+#include "redir.h"      // open_redir_target
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*
+ * Cache file layout, native byte order (bom rejects files from another host):
+ *
+ *   src_hdr_t | uint32_t words[nwords] | char strs[nstrs]
+ *
+ * words and strs[0..path) are the compiled script image (see script.c):
+ * records refer to strings by offset, never by pointer, so a mapped file
+ * is run in place. The script's canonical path follows at strs[path].
+ * Patterns and $VAR are stored, not their values: both expand when the
+ * command runs.
+ */
+#define SRC_BOM     0x01020304u
+#define SRC_MAX_DEPTH 32                // nested source limit
+
+typedef struct {
+    char     magic[8];                  // "PSHSRC"
+    uint32_t bom;
+    uint32_t version;                   // SOURCE_CACHE_VERSION
+    uint64_t size;                      // script st_size ...
+    int64_t  mtime_sec, mtime_nsec;     // ... st_mtim ...
+    uint64_t dev, ino;                  // ... and identity
+    uint32_t ncmds;
+    uint32_t nwords;
+    uint32_t nstrs;
+    uint32_t path;                      // canonical script path (string offset)
+} src_hdr_t;
+
+/* ---------- cache files ---------- */
+
+/* Cache file for 'canon', or NULL when no cache directory is configured. */
+static char *cache_path_for(const char *canon) {
+    char dir[PATH_MAX];
+    const char *env = getenv("SHELL_CACHE_DIR");
+    if (env && *env)                                     snprintf(dir, sizeof(dir), "%s", env);
+    else if ((env = getenv("XDG_CACHE_HOME")) && *env)   snprintf(dir, sizeof(dir), "%s/shell", env);
+    else if ((env = getenv("HOME")) && *env)             snprintf(dir, sizeof(dir), "%s/.cache/shell", env);
+    else return NULL;
+
+    uint64_t h = 1469598103934665603ull;                 /* FNV-1a */
+    for (const unsigned char *p = (const unsigned char *)canon; *p; ++p) {
+        h ^= *p;
+        h *= 1099511628211ull;
+    }
+    size_t n = strlen(dir) + 32;
+    char *out = (char *)malloc(n);
+    if (out) snprintf(out, n, "%s/%016llx.psc", dir, (unsigned long long)h);
+    return out;
+}
+
+static bool hdr_matches(const src_hdr_t *h, const struct stat *st) {
+    return memcmp(h->magic, "PSHSRC", 7) == 0 &&
+           h->bom == SRC_BOM && h->version == SOURCE_CACHE_VERSION &&
+           h->size == (uint64_t)st->st_size &&
+           h->mtime_sec == (int64_t)st->st_mtim.tv_sec &&
+           h->mtime_nsec == (int64_t)st->st_mtim.tv_nsec &&
+           h->dev == (uint64_t)st->st_dev && h->ino == (uint64_t)st->st_ino;
+}
+
+/* Map 'cpath' if it is a valid cache of the script described by 'st'.
+   The returned script owns the mapping. */
+static script_t *cache_load(const char *cpath, const char *canon, const struct stat *st) {
+    int fd = open(cpath, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return NULL;
+    struct stat cst;
+    if (fstat(fd, &cst) != 0 || (size_t)cst.st_size < sizeof(src_hdr_t)) { close(fd); return NULL; }
+    void *m = mmap(NULL, (size_t)cst.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (m == MAP_FAILED) return NULL;
+
+    src_hdr_t h;
+    memcpy(&h, m, sizeof(h));
+    const uint32_t *w = (const uint32_t *)((const char *)m + sizeof(src_hdr_t));
+    const char *s = (const char *)(w + h.nwords);
+    script_t *sc = NULL;
+    if (hdr_matches(&h, st) &&
+        (uint64_t)cst.st_size == sizeof(src_hdr_t) + (uint64_t)h.nwords * 4 + h.nstrs &&
+        h.nstrs > 0 && s[h.nstrs - 1] == '\0' &&
+        h.path > 0 && h.path < h.nstrs && strcmp(s + h.path, canon) == 0)
+        sc = script_from_image(w, h.nwords, s, h.path, m, (size_t)cst.st_size);
+    if (!sc) {
+        fprintf(stderr, "[source] cache '%s' is stale, reparsing\n", cpath);
+        munmap(m, (size_t)cst.st_size);
+    }
+    return sc;
+}
+
+/* Write header + records + strings + path to a temp file and rename it into
+   place, so a concurrent loader sees either the old cache or the complete
+   new one. */
+static void cache_store(const char *cpath, const char *canon, const struct stat *st,
+                        const script_t *sc) {
+    size_t nw, ns;
+    const uint32_t *w = script_words(sc, &nw);
+    const char *s = script_strings(sc, &ns);
+    size_t plen = strlen(canon) + 1;
+
+    src_hdr_t h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, "PSHSRC", 7);
+    h.bom        = SRC_BOM;
+    h.version    = SOURCE_CACHE_VERSION;
+    h.size       = (uint64_t)st->st_size;
+    h.mtime_sec  = (int64_t)st->st_mtim.tv_sec;
+    h.mtime_nsec = (int64_t)st->st_mtim.tv_nsec;
+    h.dev        = (uint64_t)st->st_dev;
+    h.ino        = (uint64_t)st->st_ino;
+    h.ncmds      = script_ncmds(sc);
+    h.nwords     = (uint32_t)nw;
+    h.nstrs      = (uint32_t)(ns + plen);
+    h.path       = (uint32_t)ns;
+
+    size_t n = strlen(cpath) + 32;
+    char *tmp = (char *)malloc(n);
+    if (!tmp) return;
+    snprintf(tmp, n, "%s.%ld.tmp", cpath, (long)getpid());
+
+    int fd = open_redir_target(tmp, O_WRONLY | O_CREAT | O_TRUNC);
+    if (fd < 0) {
+        fprintf(stderr, "[source] cache not written: %s: %s\n", tmp, strerror(errno));
+        free(tmp);
+        return;
+    }
+    const struct { const void *p; size_t n; } parts[] = {
+        { &h,    sizeof(h) },
+        { w,     nw * 4 },
+        { s,     ns },
+        { canon, plen },
+    };
+    bool ok = true;
+    for (size_t i = 0; ok && i < sizeof(parts) / sizeof(parts[0]); ++i) {
+        const char *p = (const char *)parts[i].p;
+        for (size_t left = parts[i].n; ok && left > 0; ) {
+            ssize_t wr = write(fd, p, left);
+            if (wr < 0 && errno == EINTR) continue;
+            if (wr <= 0) { ok = false; break; }
+            p += wr;
+            left -= (size_t)wr;
+        }
+    }
+    if (close(fd) != 0) ok = false;
+    if (!ok || rename(tmp, cpath) != 0) {
+        fprintf(stderr, "[source] cache not written: %s: %s\n", cpath, strerror(errno));
+        unlink(tmp);
+    }
+    free(tmp);
+}
+
+/* ---------- builtin ---------- */
+
+static char *read_script(int fd, size_t len) {
+    char *buf = (char *)malloc(len + 1);
+    if (!buf) return NULL;
+    size_t got = 0;
+    while (got < len) {
+        ssize_t r = read(fd, buf + got, len - got);
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) break;
+        got += (size_t)r;
+    }
+    if (got != len) { free(buf); errno = EIO; return NULL; }
+    buf[len] = '\0';
+    return buf;
+}
+
+int builtin_source(char *const argv[]) {
+    static int depth = 0;
+    bool run = true;
+    int ai = 1;
+    if (argv[ai] && strcmp(argv[ai], "-n") == 0) { run = false; ai++; }
+    if (!argv[ai] || argv[ai + 1]) {
+        fprintf(stderr, "usage: source [-n] FILE\n");
+        return 2;
+    }
+    const char *file = argv[ai];
+    if (depth >= SRC_MAX_DEPTH) {
+        fprintf(stderr, "source: %s: nested too deeply\n", file);
+        return 1;
+    }
+
+    int fd = open(file, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    char canon[PATH_MAX];
+    if (fd < 0 || fstat(fd, &st) != 0 || !realpath(file, canon)) {
+        fprintf(stderr, "source: %s: %s\n", file, strerror(errno));
+        if (fd >= 0) close(fd);
+        return 1;
+    }
+
+    char *cpath = cache_path_for(canon);
+    script_t *sc = cpath ? cache_load(cpath, canon, &st) : NULL;
+    if (sc) {
+        close(fd);
+        fprintf(stderr, "[source] cache hit '%s' (%u commands)\n", file, script_ncmds(sc));
+    } else {
+        char *text = read_script(fd, (size_t)st.st_size);
+        close(fd);
+        if (!text) {
+            fprintf(stderr, "source: %s: %s\n", file, strerror(errno));
+            free(cpath);
+            return 1;
+        }
+        sc = script_compile(text, (size_t)st.st_size);
+        free(text);
+        if (!sc) {
+            fprintf(stderr, "source: %s: out of memory\n", file);
+            free(cpath);
+            return 1;
+        }
+        fprintf(stderr, "[source] compiled '%s' (%u commands)\n", file, script_ncmds(sc));
+        if (cpath) cache_store(cpath, canon, &st, sc);
+    }
+
+    int status;
+    if (run) {
+        depth++;
+        status = script_run(sc, file);
+        depth--;
+    } else {
+        status = script_check(sc, file);
+    }
+    script_release(sc);
+    free(cpath);
+    return status;
+}
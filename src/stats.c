@@ -0,0 +1,269 @@
+// src/stats.c — per-command spawn/run histograms and the `stats` builtin
+#define _POSIX_C_SOURCE 200809L
+#include "stats.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+
+/*
+ * Log-linear buckets: values 0..15 get one bucket each; above that, the
+ * power of two containing v (its top bit, msb) is split into 16 linear
+ * sub-buckets by the next four bits. Everything past 2^ST_MAX_MSB ns
+ * (~18 minutes) lands in the last bucket; max stays exact.
+ */
+#define ST_SUB_BITS  4
+#define ST_SUB       (1u << ST_SUB_BITS)
+#define ST_MAX_MSB   40
+#define ST_BUCKETS   ((ST_MAX_MSB - ST_SUB_BITS + 2) * ST_SUB)
+#define ST_NSIG      65
+#define ST_OTHER     STATS_MAX_CMDS              /* shared overflow row */
+#define ST_HASH      (2 * STATS_MAX_CMDS)        /* open addressing, power of 2 */
+
+typedef struct {
+    uint32_t n[ST_BUCKETS];
+    uint64_t count, sum, max;
+} st_hist_t;
+
+typedef struct {
+    char      name[STATS_NAME_MAX];
+    st_hist_t h[STATS_NMETRICS];
+    uint32_t  exits[256];
+    uint32_t  signals[ST_NSIG];
+} st_cmd_t;
+
+static st_cmd_t        st_cmds[STATS_MAX_CMDS + 1];
+static int             st_ncmds;
+static short           st_index[ST_HASH];        /* slot -> row + 1, 0 = empty */
+static pthread_mutex_t st_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static const char *const METRIC_NAMES[STATS_NMETRICS] = { "spawn", "run" };
+
+uint64_t stats_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static unsigned bucket_of(uint64_t v) {
+    if (v < ST_SUB) return (unsigned)v;
+    unsigned msb = 63u - (unsigned)__builtin_clzll(v);
+    if (msb > ST_MAX_MSB) return ST_BUCKETS - 1;
+    return (msb - ST_SUB_BITS + 1) * ST_SUB + (unsigned)((v >> (msb - ST_SUB_BITS)) & (ST_SUB - 1));
+}
+
+static uint64_t bucket_lo(unsigned b) {
+    if (b < ST_SUB) return b;
+    unsigned msb = b / ST_SUB + ST_SUB_BITS - 1;
+    return (uint64_t)(ST_SUB + b % ST_SUB) << (msb - ST_SUB_BITS);
+}
+
+static uint64_t bucket_hi(unsigned b) {
+    return b + 1 < ST_BUCKETS ? bucket_lo(b + 1) - 1 : UINT64_MAX;
+}
+
+static const char *base_name(const char *name) {
+    const char *slash = strrchr(name, '/');
+    return slash && slash[1] ? slash + 1 : name;
+}
+
+/* Row for 'name' (creating it), under st_lock. */
+static st_cmd_t *row_for(const char *name, bool create) {
+    name = base_name(name);
+    st_cmd_t *other = &st_cmds[ST_OTHER];
+    if (other->name[0] && strcmp(name, other->name) == 0) return other;
+    uint32_t h = 2166136261u;                    /* FNV-1a */
+    for (const unsigned char *p = (const unsigned char *)name; *p; ++p) h = (h ^ *p) * 16777619u;
+    for (unsigned i = 0; i < ST_HASH; ++i) {
+        unsigned slot = (h + i) & (ST_HASH - 1);
+        int row = st_index[slot] - 1;
+        if (row < 0) {
+            if (!create) return NULL;
+            if (st_ncmds == STATS_MAX_CMDS) break;
+            row = st_ncmds++;
+            snprintf(st_cmds[row].name, STATS_NAME_MAX, "%s", name);
+            st_index[slot] = (short)(row + 1);
+            return &st_cmds[row];
+        }
+        if (strncmp(st_cmds[row].name, name, STATS_NAME_MAX - 1) == 0) return &st_cmds[row];
+    }
+    if (!create) return NULL;
+    if (!other->name[0]) snprintf(other->name, STATS_NAME_MAX, "(other)");
+    return other;
+}
+
+static void hist_add(st_hist_t *h, uint64_t v) {
+    h->n[bucket_of(v)]++;
+    h->count++;
+    h->sum += v;
+    if (v > h->max) h->max = v;
+}
+
+void stats_spawn(const char *name, uint64_t ns) {
+    if (!name) return;
+    pthread_mutex_lock(&st_lock);
+    hist_add(&row_for(name, true)->h[STATS_SPAWN], ns);
+    pthread_mutex_unlock(&st_lock);
+}
+
+void stats_exit(const char *name, uint64_t run_ns, int status) {
+    if (!name) return;
+    pthread_mutex_lock(&st_lock);
+    st_cmd_t *c = row_for(name, true);
+    hist_add(&c->h[STATS_RUN], run_ns);
+    if (status >= 0 && status < 256)            c->exits[status]++;
+    else if (status > 256 && status < 256 + ST_NSIG) c->signals[status - 256]++;
+    pthread_mutex_unlock(&st_lock);
+}
+
+void stats_exit_wait(const char *name, uint64_t run_ns, int wstatus) {
+    if (WIFEXITED(wstatus))        stats_exit(name, run_ns, WEXITSTATUS(wstatus));
+    else if (WIFSIGNALED(wstatus)) stats_exit(name, run_ns, STATS_SIGNALED(WTERMSIG(wstatus)));
+}
+
+static uint64_t hist_percentile(const st_hist_t *h, double p) {
+    if (h->count == 0) return 0;
+    if (p >= 100.0) return h->max;
+    uint64_t rank = (uint64_t)(p / 100.0 * (double)h->count + 0.999999);
+    if (rank == 0) rank = 1;
+    uint64_t seen = 0;
+    for (unsigned b = 0; b < ST_BUCKETS; ++b) {
+        seen += h->n[b];
+        if (seen >= rank) {
+            uint64_t hi = bucket_hi(b);
+            return hi < h->max ? hi : h->max;
+        }
+    }
+    return h->max;
+}
+
+uint64_t stats_percentile(const char *name, stats_metric_t m, double p) {
+    pthread_mutex_lock(&st_lock);
+    const st_cmd_t *c = row_for(name, false);
+    uint64_t v = c ? hist_percentile(&c->h[m], p) : 0;
+    pthread_mutex_unlock(&st_lock);
+    return v;
+}
+
+void stats_reset(void) {
+    pthread_mutex_lock(&st_lock);
+    memset(st_cmds, 0, sizeof(st_cmds));
+    memset(st_index, 0, sizeof(st_index));
+    st_ncmds = 0;
+    pthread_mutex_unlock(&st_lock);
+}
+
+// ---- builtin ------------------------------------------------------------------
+
+static const char *fmt_ns(char *buf, size_t n, uint64_t ns) {
+    if (ns < 1000)              snprintf(buf, n, "%lluns", (unsigned long long)ns);
+    else if (ns < 1000000)      snprintf(buf, n, "%.1fus", (double)ns / 1e3);
+    else if (ns < 1000000000)   snprintf(buf, n, "%.1fms", (double)ns / 1e6);
+    else                        snprintf(buf, n, "%.2fs", (double)ns / 1e9);
+    return buf;
+}
+
+static void print_hist_cols(const st_hist_t *h) {
+    static const double P[] = { 50, 90, 99, 100 };
+    char buf[24];
+    for (size_t i = 0; i < sizeof(P) / sizeof(P[0]); ++i)
+        printf(" %8s", h->count ? fmt_ns(buf, sizeof(buf), hist_percentile(h, P[i])) : "-");
+}
+
+static uint64_t failures(const st_cmd_t *c) {
+    uint64_t n = 0;
+    for (int k = 1; k < 256; ++k) n += c->exits[k];
+    for (int k = 0; k < ST_NSIG; ++k) n += c->signals[k];
+    return n;
+}
+
+static void print_exits(const st_cmd_t *c) {
+    printf("  %s exits:", c->name);
+    for (int k = 0; k < 256; ++k)
+        if (c->exits[k]) printf(" %d=%u", k, c->exits[k]);
+    for (int k = 0; k < ST_NSIG; ++k)
+        if (c->signals[k]) printf(" SIG%d=%u", k, c->signals[k]);
+    printf("\n");
+}
+
+static void print_csv(const st_cmd_t *c) {
+    for (int m = 0; m < STATS_NMETRICS; ++m) {
+        const st_hist_t *h = &c->h[m];
+        for (unsigned b = 0; h->count && b < ST_BUCKETS; ++b) {
+            if (!h->n[b]) continue;
+            printf("%s,%s,%llu,%llu,%u\n", c->name, METRIC_NAMES[m],
+                   (unsigned long long)bucket_lo(b), (unsigned long long)bucket_hi(b), h->n[b]);
+        }
+    }
+    for (int k = 0; k < 256; ++k)
+        if (c->exits[k]) printf("%s,exit,%d,,%u\n", c->name, k, c->exits[k]);
+    for (int k = 0; k < ST_NSIG; ++k)
+        if (c->signals[k]) printf("%s,exit,SIG%d,,%u\n", c->name, k, c->signals[k]);
+}
+
+/* Rows by total run time, biggest first: where the session's time went. */
+static int by_run_time(const void *a, const void *b) {
+    const st_cmd_t *x = *(const st_cmd_t *const *)a, *y = *(const st_cmd_t *const *)b;
+    uint64_t tx = x->h[STATS_RUN].sum, ty = y->h[STATS_RUN].sum;
+    return tx < ty ? 1 : tx > ty ? -1 : strcmp(x->name, y->name);
+}
+
+int builtin_stats(char *const argv[]) {
+    bool csv = false, reset = false;
+    int i = 1;
+    for (; argv[i] && argv[i][0] == '-'; ++i) {
+        if (strcmp(argv[i], "--csv") == 0)    csv = true;
+        else if (strcmp(argv[i], "-r") == 0)  reset = true;
+        else {
+            fprintf(stderr, "usage: stats [-r] [--csv] [NAME...]\n");
+            return 2;
+        }
+    }
+    char *const *names = argv + i;
+
+    pthread_mutex_lock(&st_lock);
+    const st_cmd_t *rows[STATS_MAX_CMDS + 1];
+    int nrows = 0;
+    if (*names) {
+        /* A name given twice is shown once: rows[] holds each table slot at most once */
+        for (char *const *n = names; *n; ++n) {
+            const st_cmd_t *c = row_for(*n, false);
+            if (!c) { fprintf(stderr, "stats: %s: no data\n", *n); continue; }
+            int k = 0;
+            while (k < nrows && rows[k] != c) ++k;
+            if (k == nrows && nrows < STATS_MAX_CMDS + 1) rows[nrows++] = c;
+        }
+    } else {
+        for (int k = 0; k <= STATS_MAX_CMDS; ++k)
+            if (st_cmds[k].name[0]) rows[nrows++] = &st_cmds[k];
+        qsort(rows, (size_t)nrows, sizeof(rows[0]), by_run_time);
+    }
+
+    if (csv) {
+        printf("command,metric,lo_ns,hi_ns,count\n");
+        for (int k = 0; k < nrows; ++k) print_csv(rows[k]);
+    } else {
+        printf("%-16s %7s %8s %8s %8s %8s %8s %8s %8s %8s %6s\n", "COMMAND", "COUNT",
+               "spawn50", "spawn90", "spawn99", "spawnmax", "run50", "run90", "run99", "runmax", "FAIL");
+        for (int k = 0; k < nrows; ++k) {
+            const st_cmd_t *c = rows[k];
+            uint64_t n = c->h[STATS_RUN].count > c->h[STATS_SPAWN].count
+                       ? c->h[STATS_RUN].count : c->h[STATS_SPAWN].count;
+            printf("%-16s %7llu", c->name, (unsigned long long)n);
+            print_hist_cols(&c->h[STATS_SPAWN]);
+            print_hist_cols(&c->h[STATS_RUN]);
+            printf(" %6llu\n", (unsigned long long)failures(c));
+        }
+        if (*names)
+            for (int k = 0; k < nrows; ++k) print_exits(rows[k]);
+    }
+    fflush(stdout);
+    pthread_mutex_unlock(&st_lock);
+
+    if (reset) stats_reset();
+    return 0;
+}
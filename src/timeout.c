@@ -0,0 +1,321 @@
+// src/timeout.c — `timeout` prefix: deadlines enforced by the shell through pidfds
+#define _GNU_SOURCE             /* syscall */
+#define _POSIX_C_SOURCE 200809L
+#include "timeout.h"
+#include "exec.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+static int64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* ---------- parsing ---------- */
+
+int timeout_parse_duration(const char *s, int64_t *ns) {
+    if (!s || !((*s >= '0' && *s <= '9') || *s == '.')) return -1;
+    char *end = NULL;
+    double v = strtod(s, &end);
+    if (!end || end == s) return -1;
+    double unit = 1e9;
+    if      (strcmp(end, "") == 0 || strcmp(end, "s") == 0) unit = 1e9;
+    else if (strcmp(end, "ms") == 0) unit = 1e6;
+    else if (strcmp(end, "m") == 0)  unit = 60e9;
+    else if (strcmp(end, "h") == 0)  unit = 3600e9;
+    else if (strcmp(end, "d") == 0)  unit = 86400e9;
+    else return -1;
+    if (!(v >= 0) || v * unit > 9e18) return -1;
+    *ns = (int64_t)(v * unit);
+    return 0;
+}
+
+static const struct { const char *name; int sig; } SIGS[] = {
+    { "HUP", SIGHUP }, { "INT", SIGINT }, { "QUIT", SIGQUIT }, { "KILL", SIGKILL },
+    { "USR1", SIGUSR1 }, { "USR2", SIGUSR2 }, { "ALRM", SIGALRM }, { "TERM", SIGTERM },
+};
+
+static int parse_signal(const char *s) {
+    if (*s >= '0' && *s <= '9') {
+        char *end = NULL;
+        long n = strtol(s, &end, 10);
+        return *end || n <= 0 || n >= NSIG ? -1 : (int)n;
+    }
+    if (strncmp(s, "SIG", 3) == 0) s += 3;
+    for (size_t i = 0; i < sizeof(SIGS) / sizeof(SIGS[0]); ++i)
+        if (strcmp(s, SIGS[i].name) == 0) return SIGS[i].sig;
+    return -1;
+}
+
+static void timeout_usage(void) {
+    fprintf(stderr, "usage: timeout [-s SIG] [-k GRACE] DURATION CMD [ARG...]\n");
+}
+
+int timeout_parse_prefix(char *const argv[], exec_timeout_t *out) {
+    if (!argv || !argv[0] || strcmp(argv[0], "timeout") != 0) return 0;
+
+    exec_timeout_t t = { 0, TIMEOUT_GRACE_DEFAULT, SIGTERM };
+    int i = 1;
+    for (; argv[i] && argv[i][0] == '-'; i += 2) {
+        if (strcmp(argv[i], "--") == 0) { i++; break; }
+        const char *val = argv[i + 1];
+        if (strcmp(argv[i], "-s") == 0 && val) {
+            if ((t.sig = parse_signal(val)) < 0) {
+                fprintf(stderr, "timeout: bad signal: %s\n", val);
+                return -1;
+            }
+        } else if (strcmp(argv[i], "-k") == 0 && val) {
+            if (timeout_parse_duration(val, &t.grace_ns) != 0) {
+                fprintf(stderr, "timeout: bad grace period: %s\n", val);
+                return -1;
+            }
+        } else {
+            timeout_usage();
+            return -1;
+        }
+    }
+    if (!argv[i] || !argv[i + 1]) { timeout_usage(); return -1; }
+    if (timeout_parse_duration(argv[i], &t.ns) != 0) {
+        fprintf(stderr, "timeout: bad duration: %s\n", argv[i]);
+        return -1;
+    }
+    *out = t;
+    fprintf(stderr, "[timeout] %.3fs (sig %d, grace %.3fs) -> '%s'\n",
+            (double)t.ns / 1e9, t.sig, (double)t.grace_ns / 1e9, argv[i + 1]);
+    return i + 1;
+}
+
+/* ---------- signalling ---------- */
+
+static void send_sig(int pidfd, pid_t pid, int sig) {
+#ifdef SYS_pidfd_send_signal
+    if (pidfd >= 0) { syscall(SYS_pidfd_send_signal, pidfd, sig, NULL, 0); return; }
+#endif
+    kill(pid, sig);
+}
+
+/* Escalation shared by both waits: phase 0 -> 'sig' (arm the grace period),
+   1 -> KILL, 2 -> nothing left to send. */
+typedef struct {
+    int64_t deadline;
+    int     phase;
+    bool    fired;
+} escal_t;
+
+static void escalate(escal_t *e, const exec_timeout_t *t, const pid_t *pids,
+                     const int *fds, const bool *done, int n) {
+    int sig = e->phase == 0 ? t->sig : SIGKILL;
+    int sent = 0;
+    for (int i = 0; i < n; ++i)
+        if (!done || !done[i]) { send_sig(fds[i], pids[i], sig); sent++; }
+    fprintf(stderr, "[timeout] deadline: signal %d to %d stage(s)\n", sig, sent);
+    e->fired = true;
+    if (e->phase == 0 && t->grace_ns > 0 && sig != SIGKILL) {
+        e->phase = 1;
+        e->deadline = now_ns() + t->grace_ns;
+    } else {
+        e->phase = 2;
+    }
+}
+
+/* ---------- foreground ---------- */
+
+int timeout_wait(const pid_t *pids, int n, const exec_timeout_t *t, int *status) {
+    int *fds = (int *)malloc((size_t)n * sizeof(int));
+    bool *done = (bool *)calloc((size_t)n, sizeof(bool));
+    struct pollfd *pf = (struct pollfd *)malloc((size_t)n * sizeof(struct pollfd));
+    if (!fds || !done || !pf) {
+        /* No room to watch: plain waits, deadline not enforced */
+        perror("timeout: malloc");
+        for (int i = 0; i < n; ++i)
+            if (waitpid(pids[i], &status[i], 0) < 0) status[i] = -1;
+        free(fds); free(done); free(pf);
+        return 0;
+    }
+
+    bool all_fds = true;
+    for (int i = 0; i < n; ++i) {
+        status[i] = -1;
+        fds[i] = exec_pidfd_open(pids[i]);
+        all_fds &= fds[i] >= 0;
+    }
+    escal_t e = { now_ns() + t->ns, 0, false };
+    int left = n;
+    while (left > 0) {
+        int64_t wait_ns = -1;
+        if (e.phase < 2) {
+            wait_ns = e.deadline - now_ns();
+            if (wait_ns <= 0) { escalate(&e, t, pids, fds, done, n); continue; }
+        }
+        int ms = wait_ns < 0 ? -1 : (int)((wait_ns + 999999) / 1000000);
+        if (!all_fds && (ms < 0 || ms > 10)) ms = 10;
+
+        nfds_t np = 0;
+        for (int i = 0; i < n; ++i)
+            if (!done[i] && fds[i] >= 0) pf[np++] = (struct pollfd){ fds[i], POLLIN, 0 };
+        if (poll(pf, np, ms) < 0 && errno != EINTR) {
+            perror("timeout: poll");
+            break;
+        }
+
+        for (int i = 0; i < n; ++i) {
+            if (done[i]) continue;
+            pid_t r = waitpid(pids[i], &status[i], WNOHANG);
+            if (r == 0) continue;
+            if (r < 0) status[i] = -1;
+            done[i] = true;
+            left--;
+            if (fds[i] >= 0) { close(fds[i]); fds[i] = -1; }
+        }
+    }
+    /* Only after a poll failure: finish with blocking waits */
+    for (int i = 0; i < n; ++i) {
+        if (done[i]) continue;
+        if (waitpid(pids[i], &status[i], 0) < 0) status[i] = -1;
+        if (fds[i] >= 0) close(fds[i]);
+    }
+    free(fds); free(done); free(pf);
+    return e.fired ? 1 : 0;
+}
+
+/* ---------- background: watchdog thread ---------- */
+
+typedef struct watch {
+    struct watch   *next;
+    pid_t           key;            /* last stage: what the job table reaps */
+    int             n;
+    pid_t          *pids;
+    int            *fds;
+    exec_timeout_t  t;
+    escal_t         e;
+} watch_t;
+
+static struct {
+    pthread_mutex_t mu;
+    pthread_cond_t  cv;             /* new watch, or one dropped */
+    bool            running;
+    watch_t        *list;
+} W = { .mu = PTHREAD_MUTEX_INITIALIZER, .cv = PTHREAD_COND_INITIALIZER };
+
+static void close_fds(watch_t *w) {
+    for (int i = 0; i < w->n; ++i)
+        if (w->fds[i] >= 0) { close(w->fds[i]); w->fds[i] = -1; }
+}
+
+static void *watchdog_main(void *arg) {
+    (void)arg;
+    pthread_mutex_lock(&W.mu);
+    for (;;) {
+        int64_t next = -1, now = now_ns();
+        for (watch_t *w = W.list; w; w = w->next) {
+            if (w->e.phase >= 2) continue;
+            if (w->e.deadline <= now) {
+                escalate(&w->e, &w->t, w->pids, w->fds, NULL, w->n);
+                /* Done sending; the entry stays so timeout_reaped() can report it */
+                if (w->e.phase >= 2) { close_fds(w); continue; }
+            }
+            if (next < 0 || w->e.deadline < next) next = w->e.deadline;
+        }
+        if (next < 0) {
+            pthread_cond_wait(&W.cv, &W.mu);
+        } else {
+            struct timespec dl = { (time_t)(next / 1000000000), (long)(next % 1000000000) };
+            pthread_cond_timedwait(&W.cv, &W.mu, &dl);
+        }
+    }
+    return NULL;
+}
+
+/* A forked child (builtin stage) has no watchdog: it starts its own if it
+   ever needs one, and must not find 'mu' held by a thread it lacks. */
+static void atfork_prepare(void) { pthread_mutex_lock(&W.mu); }
+static void atfork_parent(void)  { pthread_mutex_unlock(&W.mu); }
+static void atfork_child(void) {
+    W.running = false;
+    W.list = NULL;
+    pthread_mutex_unlock(&W.mu);
+}
+
+static void init_once(void) {
+    /* Deadlines are CLOCK_MONOTONIC, as now_ns() */
+    pthread_condattr_t ca;
+    pthread_condattr_init(&ca);
+    pthread_condattr_setclock(&ca, CLOCK_MONOTONIC);
+    pthread_cond_destroy(&W.cv);
+    pthread_cond_init(&W.cv, &ca);
+    pthread_condattr_destroy(&ca);
+    pthread_atfork(atfork_prepare, atfork_parent, atfork_child);
+}
+
+int timeout_watch(const pid_t *pids, int n, const exec_timeout_t *t) {
+    static pthread_once_t once = PTHREAD_ONCE_INIT;
+    pthread_once(&once, init_once);
+    if (n <= 0) return -1;
+
+    watch_t *w = (watch_t *)calloc(1, sizeof(*w));
+    pid_t *wp = (pid_t *)malloc((size_t)n * sizeof(pid_t));
+    int *fds = (int *)malloc((size_t)n * sizeof(int));
+    if (!w || !wp || !fds) {
+        perror("timeout: malloc");
+        free(w); free(wp); free(fds);
+        return -1;
+    }
+    for (int i = 0; i < n; ++i) {
+        wp[i] = pids[i];
+        fds[i] = exec_pidfd_open(pids[i]);   /* -1: kill() fallback */
+    }
+    w->key = pids[n - 1];
+    w->n = n;
+    w->pids = wp;
+    w->fds = fds;
+    w->t = *t;
+    w->e = (escal_t){ now_ns() + t->ns, 0, false };
+
+    pthread_mutex_lock(&W.mu);
+    if (!W.running) {
+        pthread_t thr;
+        int rc = pthread_create(&thr, NULL, watchdog_main, NULL);
+        if (rc != 0) {
+            pthread_mutex_unlock(&W.mu);
+            fprintf(stderr, "timeout: pthread_create: %s\n", strerror(rc));
+            close_fds(w);
+            free(fds); free(wp); free(w);
+            return -1;
+        }
+        pthread_detach(thr);
+        W.running = true;
+    }
+    w->next = W.list;
+    W.list = w;
+    pthread_cond_signal(&W.cv);
+    pthread_mutex_unlock(&W.mu);
+    fprintf(stderr, "[timeout] watching pid=%d (%d stage(s)) for %.3fs\n",
+            (int)w->key, n, (double)t->ns / 1e9);
+    return 0;
+}
+
+bool timeout_reaped(pid_t pid) {
+    pthread_mutex_lock(&W.mu);
+    watch_t **pp = &W.list;
+    while (*pp && (*pp)->key != pid) pp = &(*pp)->next;
+    watch_t *w = *pp;
+    if (w) *pp = w->next;
+    pthread_mutex_unlock(&W.mu);
+    if (!w) return false;
+
+    bool fired = w->e.fired;
+    close_fds(w);
+    free(w->fds); free(w->pids); free(w);
+    return fired;
+}
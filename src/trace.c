@@ -0,0 +1,184 @@
+// src/trace.c — execution timeline recorder, written as Chrome trace-event JSON
+#define _POSIX_C_SOURCE 200809L
+#include "trace.h"
+#include "jsonbuf.h"
+#include "stats.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static const char *const KIND_NAMES[TRACE_NKINDS] = {
+    "parse", "resolve", "spawn", "wait", "stage", "job",
+};
+
+typedef struct {
+    uint64_t t0, t1;
+    int32_t  track;
+    uint8_t  kind;
+    char     detail[TRACE_DETAIL_MAX];
+} trace_ev_t;
+
+static struct {
+    int         on;             /* atomic; events are only taken while set */
+    trace_ev_t *ev;
+    uint32_t    cap;
+    uint32_t    n;              /* atomic: slots claimed, may run past cap */
+    uint64_t    start;
+    char       *path;
+} R;
+
+static pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t  trace_once = PTHREAD_ONCE_INIT;
+
+static int trace_start(const char *path, uint32_t cap);
+
+static void trace_atexit(void) { trace_close(); }
+
+static void trace_init(void) {
+    const char *path = getenv("SHELL_TRACE");
+    if (path && *path) trace_start(path, 0);
+}
+
+bool trace_active(void) {
+    pthread_once(&trace_once, trace_init);
+    return __atomic_load_n(&R.on, __ATOMIC_ACQUIRE);
+}
+
+void trace_event(trace_kind_t kind, uint64_t t0, uint64_t t1, int track, const char *detail) {
+    if (!trace_active()) return;
+    uint32_t i = __atomic_fetch_add(&R.n, 1, __ATOMIC_RELAXED);
+    if (i >= R.cap) return;                     /* full: counted as dropped */
+    trace_ev_t *e = &R.ev[i];
+    e->t0 = t0;
+    e->t1 = t1 > t0 ? t1 : t0;
+    e->track = track;
+    e->kind = (uint8_t)kind;
+    size_t len = detail ? strnlen(detail, TRACE_DETAIL_MAX - 1) : 0;
+    memcpy(e->detail, detail ? detail : "", len);
+    e->detail[len] = '\0';
+}
+
+static int trace_start(const char *path, uint32_t cap) {
+    static bool at_exit;
+    if (!path || !*path) return -1;
+    trace_close();
+    if (cap == 0) cap = TRACE_EVENTS_DEFAULT;
+
+    trace_ev_t *ev = (trace_ev_t *)malloc((size_t)cap * sizeof(trace_ev_t));
+    char *p = strdup(path);
+    if (!ev || !p) {
+        perror("trace: malloc");
+        free(ev); free(p);
+        return -1;
+    }
+    pthread_mutex_lock(&trace_lock);
+    R.ev = ev;
+    R.cap = cap;
+    R.path = p;
+    R.start = stats_now();
+    __atomic_store_n(&R.n, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&R.on, 1, __ATOMIC_RELEASE);
+    if (!at_exit) at_exit = atexit(trace_atexit) == 0;
+    pthread_mutex_unlock(&trace_lock);
+    fprintf(stderr, "[trace] recording to '%s' (%u events)\n", path, cap);
+    return 0;
+}
+
+int trace_open(const char *path, uint32_t cap) {
+    pthread_once(&trace_once, trace_init);      /* SHELL_TRACE must not replace this later */
+    return trace_start(path, cap);
+}
+
+static int write_json(FILE *f, uint32_t n, uint32_t dropped) {
+    int pid = (int)getpid();
+    fprintf(f, "{\"displayTimeUnit\":\"ns\",\"otherData\":{\"events\":%u,\"dropped\":%u},\n"
+               "\"traceEvents\":[\n", n, dropped);
+    fprintf(f, "{\"ph\":\"M\",\"name\":\"process_name\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"shell\"}},\n"
+               "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"shell\"}}",
+            pid, pid, pid, pid);
+    /* Each event is formatted whole first: one that can't be is left out
+       (and the write reported as failed), never written in part. */
+    jsonbuf_t b = {0};
+    int lost = 0;
+    for (uint32_t i = 0; i < n; ++i) {
+        const trace_ev_t *e = &R.ev[i];
+        int tid = e->track ? e->track : pid;
+        uint64_t t0 = e->t0 > R.start ? e->t0 : R.start;    /* began before recording */
+        uint64_t t1 = e->t1 > t0 ? e->t1 : t0;
+        jsonbuf_reset(&b, 0);
+        if (e->kind == TRACE_STAGE || e->kind == TRACE_JOB) {
+            jsonbuf_printf(&b, ",\n{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":%d,\"tid\":%d,"
+                               "\"args\":{\"name\":", pid, tid);
+            char name[TRACE_DETAIL_MAX + 32];
+            snprintf(name, sizeof(name), "%s %d: %s", e->kind == TRACE_JOB ? "job" : "stage",
+                     tid, e->detail);
+            jsonbuf_str(&b, name);
+            jsonbuf_put(&b, "}}", 2);
+        }
+        jsonbuf_printf(&b, ",\n{\"ph\":\"X\",\"cat\":\"shell\",\"name\":\"%s\",\"pid\":%d,\"tid\":%d,"
+                           "\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"detail\":",
+                       KIND_NAMES[e->kind], pid, tid,
+                       (double)(t0 - R.start) / 1e3, (double)(t1 - t0) / 1e3);
+        jsonbuf_str(&b, e->detail);
+        jsonbuf_put(&b, "}}", 2);
+        if (b.failed) lost++;
+        else          fwrite(b.p, 1, b.len, f);
+    }
+    jsonbuf_free(&b);
+    fputs("\n]}\n", f);
+    return ferror(f) || lost ? -1 : 0;
+}
+
+int trace_close(void) {
+    pthread_mutex_lock(&trace_lock);
+    if (!__atomic_load_n(&R.on, __ATOMIC_ACQUIRE)) {
+        pthread_mutex_unlock(&trace_lock);
+        return 0;
+    }
+    __atomic_store_n(&R.on, 0, __ATOMIC_RELEASE);
+    uint32_t claimed = __atomic_load_n(&R.n, __ATOMIC_RELAXED);
+    uint32_t n = claimed < R.cap ? claimed : R.cap;
+
+    int rc = -1;
+    FILE *f = fopen(R.path, "w");
+    if (!f) {
+        perror("trace");
+    } else {
+        rc = write_json(f, n, claimed - n);
+        if (fclose(f) != 0) rc = -1;
+    }
+    fprintf(stderr, "[trace] wrote %u events (%u dropped) to '%s'\n", n, claimed - n, R.path);
+    free(R.ev);
+    free(R.path);
+    R.ev = NULL;
+    R.path = NULL;
+    R.cap = 0;
+    pthread_mutex_unlock(&trace_lock);
+    return rc;
+}
+
+int builtin_trace(char *const argv[]) {
+    if (argv[1] && argv[2]) {
+        fprintf(stderr, "usage: trace [FILE | -c]\n");
+        return 2;
+    }
+    if (!argv[1]) {
+        bool on = trace_active();
+        pthread_mutex_lock(&trace_lock);
+        if (on && R.path) {
+            uint32_t claimed = __atomic_load_n(&R.n, __ATOMIC_RELAXED);
+            printf("%s: %u events, %u dropped\n", R.path,
+                   claimed < R.cap ? claimed : R.cap, claimed > R.cap ? claimed - R.cap : 0);
+        } else {
+            printf("trace off\n");
+        }
+        pthread_mutex_unlock(&trace_lock);
+        fflush(stdout);
+        return 0;
+    }
+    if (strcmp(argv[1], "-c") == 0) return trace_close() == 0 ? 0 : 1;
+    return trace_open(argv[1], 0) == 0 ? 0 : 1;
+}
@@ -0,0 +1,286 @@
+// src/transcript.c — session transcript through double buffers and a writer thread
+#define _POSIX_C_SOURCE 200809L
+#include "transcript.h"
+#include "jsonbuf.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+ * Producers append to buf[active] under 'mu' (a memcpy); the writer swaps
+ * the buffers under 'mu' and writes the full one without holding it, so a
+ * slow disk only ever costs the producer a drop, never a wait.
+ */
+static struct {
+    pthread_mutex_t mu;
+    pthread_cond_t  wake;           /* writer: half full, flush, stop */
+    pthread_cond_t  drained;        /* flushers: nothing pending */
+    pthread_t       thr;
+    bool            running;        /* thread started, records accepted */
+    bool            stop, flush_req, writing;
+    int             fd;
+    char           *path;
+    char           *buf[2];
+    int             active;
+    size_t          len, cap;
+    uint64_t        records, bytes, dropped, dropped_unreported;
+} T = { .mu = PTHREAD_MUTEX_INITIALIZER, .wake = PTHREAD_COND_INITIALIZER,
+        .drained = PTHREAD_COND_INITIALIZER, .fd = -1 };
+
+/* ---------- formatting ---------- */
+
+static void tb_timestamp(jsonbuf_t *b) {
+    struct timespec ts;
+    struct tm tm;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    gmtime_r(&ts.tv_sec, &tm);
+    jsonbuf_printf(b, "\"%04d-%02d-%02dT%02d:%02d:%02d.%03ldZ\"",
+                   tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday,
+                   tm.tm_hour, tm.tm_min, tm.tm_sec, ts.tv_nsec / 1000000);
+}
+
+/* ---------- writer ---------- */
+
+static void write_all(int fd, const char *p, size_t n) {
+    while (n > 0) {
+        ssize_t w = write(fd, p, n);
+        if (w < 0 && errno == EINTR) continue;
+        if (w <= 0) {
+            fprintf(stderr, "transcript: write: %s\n", strerror(errno));
+            return;
+        }
+        p += w;
+        n -= (size_t)w;
+    }
+}
+
+static void *writer_main(void *arg) {
+    (void)arg;
+    pthread_mutex_lock(&T.mu);
+    for (;;) {
+        if (!T.stop && !T.flush_req && T.len < T.cap / 2) {
+            struct timespec dl;
+            clock_gettime(CLOCK_MONOTONIC, &dl);
+            dl.tv_nsec += (long)TRANSCRIPT_FLUSH_MS * 1000000L;
+            dl.tv_sec += dl.tv_nsec / 1000000000L;
+            dl.tv_nsec %= 1000000000L;
+            pthread_cond_timedwait(&T.wake, &T.mu, &dl);
+        }
+        T.flush_req = false;
+        if (T.len > 0) {
+            char *out = T.buf[T.active];
+            size_t n = T.len;
+            T.active ^= 1;
+            T.len = 0;
+            T.writing = true;
+            pthread_mutex_unlock(&T.mu);
+            write_all(T.fd, out, n);
+            pthread_mutex_lock(&T.mu);
+            T.writing = false;
+            T.bytes += n;
+        }
+        if (T.len == 0) pthread_cond_broadcast(&T.drained);
+        if (T.stop && T.len == 0) break;
+    }
+    pthread_mutex_unlock(&T.mu);
+    return NULL;
+}
+
+/* A forked child (builtin stage) has no writer thread: it must neither log
+   nor find 'mu' held by a thread that no longer exists. */
+static void atfork_prepare(void) { pthread_mutex_lock(&T.mu); }
+static void atfork_parent(void)  { pthread_mutex_unlock(&T.mu); }
+static void atfork_child(void) {
+    T.running = false;
+    pthread_mutex_unlock(&T.mu);
+}
+
+/* ---------- API ---------- */
+
+bool transcript_active(void) {
+    return __atomic_load_n(&T.running, __ATOMIC_ACQUIRE);
+}
+
+void transcript_record(const char *event, const char *cmd, int job,
+                       const int *status, int nstatus, int64_t ns) {
+    if (!transcript_active()) return;
+
+    char cwd[PATH_MAX];
+    jsonbuf_t b = {0};
+    jsonbuf_put(&b, "{\"ts\":", 6);
+    tb_timestamp(&b);
+    jsonbuf_put(&b, ",\"event\":", 9);
+    jsonbuf_str(&b, event);
+    jsonbuf_put(&b, ",\"cwd\":", 7);
+    jsonbuf_str(&b, getcwd(cwd, sizeof(cwd)) ? cwd : "");
+    jsonbuf_put(&b, ",\"cmd\":", 7);
+    jsonbuf_str(&b, cmd ? cmd : "");
+    if (job > 0) jsonbuf_printf(&b, ",\"job\":%d", job);
+    else         jsonbuf_put(&b, ",\"job\":null", 11);
+    if (status) {
+        jsonbuf_put(&b, ",\"status\":[", 11);
+        for (int i = 0; i < nstatus; ++i) jsonbuf_printf(&b, i ? ",%d" : "%d", status[i]);
+        jsonbuf_put(&b, "]", 1);
+    } else {
+        jsonbuf_put(&b, ",\"status\":null", 14);
+    }
+    if (ns >= 0) jsonbuf_printf(&b, ",\"ms\":%.3f", (double)ns / 1e6);
+    jsonbuf_put(&b, "}\n", 2);
+    if (b.failed) {
+        /* Out of memory: count it as dropped rather than log half of it */
+        pthread_mutex_lock(&T.mu);
+        if (T.running) {
+            T.dropped++;
+            T.dropped_unreported++;
+        }
+        pthread_mutex_unlock(&T.mu);
+        jsonbuf_free(&b);
+        return;
+    }
+
+    char note[64];
+    pthread_mutex_lock(&T.mu);
+    if (T.running) {
+        int nn = 0;
+        if (T.dropped_unreported)
+            nn = snprintf(note, sizeof(note), "{\"event\":\"dropped\",\"count\":%llu}\n",
+                          (unsigned long long)T.dropped_unreported);
+        if (T.len + (size_t)nn + b.len > T.cap) {
+            T.dropped++;
+            T.dropped_unreported++;
+        } else {
+            memcpy(T.buf[T.active] + T.len, note, (size_t)nn);
+            memcpy(T.buf[T.active] + T.len + nn, b.p, b.len);
+            T.len += (size_t)nn + b.len;
+            T.dropped_unreported = 0;
+            T.records++;
+            if (T.len >= T.cap / 2) pthread_cond_signal(&T.wake);
+        }
+    }
+    pthread_mutex_unlock(&T.mu);
+    jsonbuf_free(&b);
+}
+
+void transcript_flush(void) {
+    pthread_mutex_lock(&T.mu);
+    if (T.running) {
+        T.flush_req = true;
+        pthread_cond_signal(&T.wake);
+        while (T.running && (T.len > 0 || T.writing)) pthread_cond_wait(&T.drained, &T.mu);
+    }
+    pthread_mutex_unlock(&T.mu);
+}
+
+void transcript_close(void) {
+    pthread_mutex_lock(&T.mu);
+    if (!T.running) { pthread_mutex_unlock(&T.mu); return; }
+    T.stop = true;
+    pthread_cond_signal(&T.wake);
+    pthread_mutex_unlock(&T.mu);
+    pthread_join(T.thr, NULL);
+
+    pthread_mutex_lock(&T.mu);
+    __atomic_store_n(&T.running, false, __ATOMIC_RELEASE);
+    close(T.fd);
+    free(T.buf[0]);
+    free(T.buf[1]);
+    free(T.path);
+    T.buf[0] = T.buf[1] = T.path = NULL;
+    T.fd = -1;
+    pthread_mutex_unlock(&T.mu);
+    fprintf(stderr, "[transcript] closed: %llu records, %llu bytes, %llu dropped\n",
+            (unsigned long long)T.records, (unsigned long long)T.bytes,
+            (unsigned long long)T.dropped);
+}
+
+static void init_once(void) {
+    /* Deadlines in writer_main are CLOCK_MONOTONIC: wall-clock jumps must not
+       stall or spin the flusher. */
+    pthread_condattr_t ca;
+    pthread_condattr_init(&ca);
+    pthread_condattr_setclock(&ca, CLOCK_MONOTONIC);
+    pthread_cond_destroy(&T.wake);
+    pthread_cond_init(&T.wake, &ca);
+    pthread_condattr_destroy(&ca);
+    pthread_atfork(atfork_prepare, atfork_parent, atfork_child);
+}
+
+int transcript_open(const char *path, size_t bufsize) {
+    static pthread_once_t once = PTHREAD_ONCE_INIT;
+    pthread_once(&once, init_once);
+
+    transcript_close();
+    if (!path || !*path) return -1;
+    if (bufsize == 0) bufsize = TRANSCRIPT_BUF_DEFAULT;
+
+    int fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        fprintf(stderr, "transcript: %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    char *b0 = (char *)malloc(bufsize), *b1 = (char *)malloc(bufsize), *p = strdup(path);
+    if (!b0 || !b1 || !p) {
+        perror("transcript: malloc");
+        free(b0); free(b1); free(p);
+        close(fd);
+        return -1;
+    }
+
+    pthread_mutex_lock(&T.mu);
+    T.fd = fd;
+    T.path = p;
+    T.buf[0] = b0;
+    T.buf[1] = b1;
+    T.active = 0;
+    T.len = 0;
+    T.cap = bufsize;
+    T.stop = T.flush_req = T.writing = false;
+    T.records = T.bytes = T.dropped = T.dropped_unreported = 0;
+    int rc = pthread_create(&T.thr, NULL, writer_main, NULL);
+    if (rc == 0) {
+        __atomic_store_n(&T.running, true, __ATOMIC_RELEASE);
+    } else {
+        /* Nothing may keep pointing at what is freed below */
+        T.buf[0] = T.buf[1] = T.path = NULL;
+        T.fd = -1;
+        T.cap = 0;
+    }
+    pthread_mutex_unlock(&T.mu);
+    if (rc != 0) {
+        fprintf(stderr, "transcript: pthread_create: %s\n", strerror(rc));
+        close(fd);
+        free(b0); free(b1); free(p);
+        return -1;
+    }
+    fprintf(stderr, "[transcript] logging to '%s' (2 x %zu byte buffers)\n", path, bufsize);
+    return 0;
+}
+
+int builtin_transcript(char *const argv[]) {
+    if (argv[1] && argv[2]) {
+        fprintf(stderr, "usage: transcript [FILE | -c | -f]\n");
+        return 2;
+    }
+    if (!argv[1]) {
+        pthread_mutex_lock(&T.mu);
+        if (T.running)
+            printf("%s: %llu records, %llu bytes written, %llu dropped\n", T.path,
+                   (unsigned long long)T.records, (unsigned long long)T.bytes,
+                   (unsigned long long)T.dropped);
+        else
+            printf("transcript off\n");
+        pthread_mutex_unlock(&T.mu);
+        fflush(stdout);
+        return 0;
+    }
+    if (strcmp(argv[1], "-c") == 0) { transcript_close(); return 0; }
+    if (strcmp(argv[1], "-f") == 0) { transcript_flush(); return 0; }
+    return transcript_open(argv[1], 0) == 0 ? 0 : 1;
+}
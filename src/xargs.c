@@ -0,0 +1,293 @@
+// src/xargs.c — `xargs` builtin: pack items into the fewest execs that fit
+#define _POSIX_C_SOURCE 200809L
+#include "xargs.h"
+#include "exec.h"
+#include "jobs.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char **environ;
+
+#define XA_HEADROOM    2048          /* POSIX: leave room for the exec'd program */
+#define XA_MAX_STRLEN  (32 * 4096)   /* Linux MAX_ARG_STRLEN: one argument's cap */
+
+/*
+ * Exec cost of an argument is its bytes plus its argv slot, the same
+ * accounting the kernel does against ARG_MAX (which also covers envp).
+ * A batch is built in one arena: items are appended as offsets and the
+ * argv array is materialised only at launch, so 1M items cost a handful
+ * of allocations.
+ */
+typedef struct {
+    char *const *tmpl;        /* CMD ARG... */
+    size_t  ntmpl, tmpl_cost;
+    char   *abs;              /* resolved CMD */
+    size_t  budget;           /* bytes a batch may use, template included */
+    size_t  max_args;         /* -n, 0 = unlimited */
+
+    char   *arena;  size_t alen, acap;
+    size_t *offs;   size_t nargs, ocap;
+    size_t  cost;             /* current batch, template included */
+    char  **argv;   size_t argv_cap;
+
+    pid_t  *pids;   int nslots, running;
+    int     in_fd;            /* children's stdin, -1 = inherit */
+    int     status;
+    size_t  batches;
+} xa_t;
+
+static void xa_usage(void) {
+    fprintf(stderr, "usage: xargs [-0] [-r] [-n MAX] [-s SIZE] [-P N] [CMD [ARG...]] [::: ITEM...]\n");
+}
+
+static size_t arg_cost(size_t len) {
+    return len + 1 + sizeof(char *);
+}
+
+/* ARG_MAX less the environment every child inherits and some headroom. */
+static size_t exec_budget(void) {
+    long argmax = sysconf(_SC_ARG_MAX);
+    if (argmax <= 0) argmax = _POSIX_ARG_MAX;
+    size_t env = 2 * sizeof(char *);             /* argv + envp terminators */
+    for (char **e = environ; e && *e; ++e) env += arg_cost(strlen(*e));
+    size_t fixed = env + XA_HEADROOM;
+    return (size_t)argmax > fixed ? (size_t)argmax - fixed : 0;
+}
+
+static void fold_status(xa_t *X, int status) {
+    int code = WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+    int r = code == 0 ? 0
+          : code == 126 || code == 127 ? code
+          : code > 0 ? 123 : 125;
+    if (r > X->status) X->status = r;
+}
+
+/* Wait for one of our batches (background jobs that finish meanwhile are
+   handed to the job table). */
+static void reap_one(xa_t *X) {
+    while (X->running > 0) {
+        int status;
+        pid_t r = waitpid(-1, &status, 0);
+        if (r < 0) {
+            if (errno == EINTR) continue;
+            perror("xargs: waitpid");
+            X->running = 0;
+            return;
+        }
+        for (int k = 0; k < X->nslots; ++k) {
+            if (X->pids[k] == r) {
+                X->pids[k] = -1;
+                X->running--;
+                fold_status(X, status);
+                return;
+            }
+        }
+        jobs_notify_exit(r, status);
+    }
+}
+
+/* Launch the pending batch (even if empty when 'force'). Returns 0 or -1. */
+static int launch(xa_t *X, bool force) {
+    if (X->nargs == 0 && !force) return 0;
+    while (X->running == X->nslots) reap_one(X);
+
+    size_t need = X->ntmpl + X->nargs + 1;
+    if (need > X->argv_cap) {
+        char **nv = (char **)realloc(X->argv, need * sizeof(char *));
+        if (!nv) { perror("xargs: realloc"); return -1; }
+        X->argv = nv;
+        X->argv_cap = need;
+    }
+    size_t n = 0;
+    for (size_t i = 0; i < X->ntmpl; ++i) X->argv[n++] = X->tmpl[i];
+    for (size_t i = 0; i < X->nargs; ++i) X->argv[n++] = X->arena + X->offs[i];
+    X->argv[n] = NULL;
+
+    fprintf(stderr, "[xargs] batch %zu: %zu item(s), %zu of %zu bytes\n",
+            X->batches + 1, X->nargs, X->cost, X->budget);
+    exec_opts_t opts = { X->in_fd, -1, -1, true, NULL, NULL, NULL, NULL, 0 };
+    pid_t pid = -1;
+    if (run_command(X->abs, X->argv, &opts, &pid, NULL) != 0 || pid <= 0) {
+        if (X->status < 126) X->status = 126;
+        return -1;
+    }
+    for (int k = 0; k < X->nslots; ++k) {
+        if (X->pids[k] < 0) { X->pids[k] = pid; break; }
+    }
+    X->running++;
+    X->batches++;
+    X->nargs = 0;
+    X->alen = 0;
+    X->cost = X->tmpl_cost;
+    return 0;
+}
+
+static int add_item(xa_t *X, const char *item, size_t len) {
+    size_t c = arg_cost(len);
+    if (len >= XA_MAX_STRLEN || X->tmpl_cost + c > X->budget) {
+        fprintf(stderr, "xargs: argument too long (%zu bytes)\n", len);
+        return -1;
+    }
+    if (X->nargs > 0 &&
+        (X->cost + c > X->budget || (X->max_args && X->nargs == X->max_args))) {
+        if (launch(X, false) != 0) return -1;
+    }
+    if (X->alen + len + 1 > X->acap) {
+        size_t cap = X->acap ? X->acap : 65536;
+        while (cap < X->alen + len + 1) cap *= 2;
+        char *na = (char *)realloc(X->arena, cap);
+        if (!na) { perror("xargs: realloc"); return -1; }
+        X->arena = na;
+        X->acap = cap;
+    }
+    if (X->nargs == X->ocap) {
+        size_t cap = X->ocap ? X->ocap * 2 : 4096;
+        size_t *no = (size_t *)realloc(X->offs, cap * sizeof(size_t));
+        if (!no) { perror("xargs: realloc"); return -1; }
+        X->offs = no;
+        X->ocap = cap;
+    }
+    X->offs[X->nargs++] = X->alen;
+    memcpy(X->arena + X->alen, item, len);
+    X->arena[X->alen + len] = '\0';
+    X->alen += len + 1;
+    X->cost += c;
+    return 0;
+}
+
+/* Split stdin into items and feed them to the batcher as they arrive. */
+static int read_items(xa_t *X, bool nul, size_t *nitems) {
+    char buf[65536];
+    char *cur = NULL;
+    size_t clen = 0, ccap = 0;
+    bool in_item = false;
+    int rc = 0;
+    for (;;) {
+        ssize_t n = read(STDIN_FILENO, buf, sizeof(buf));
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) { perror("xargs: read"); rc = -1; break; }
+        if (n == 0) break;
+        for (ssize_t i = 0; i < n; ++i) {
+            char ch = buf[i];
+            bool delim = nul ? ch == '\0' : (ch == ' ' || ch == '\t' || ch == '\n');
+            if (delim) {
+                if (in_item || nul) {
+                    if (add_item(X, cur ? cur : "", clen) != 0) { rc = -1; goto out; }
+                    (*nitems)++;
+                }
+                clen = 0;
+                in_item = false;
+                continue;
+            }
+            if (clen + 1 >= ccap) {
+                ccap = ccap ? ccap * 2 : 256;
+                char *nc = (char *)realloc(cur, ccap);
+                if (!nc) { perror("xargs: realloc"); rc = -1; goto out; }
+                cur = nc;
+            }
+            cur[clen++] = ch;
+            cur[clen] = '\0';
+            in_item = true;
+        }
+    }
+    if (in_item) {
+        if (add_item(X, cur, clen) != 0) rc = -1;
+        else (*nitems)++;
+    }
+out:
+    free(cur);
+    return rc;
+}
+
+static bool parse_size(const char *s, size_t *out) {
+    char *end = NULL;
+    errno = 0;
+    unsigned long long v = strtoull(s, &end, 10);
+    if (errno || !end || *end || s[0] == '-') return false;
+    *out = (size_t)v;
+    return true;
+}
+
+int builtin_xargs(char *const argv[]) {
+    bool nul = false, no_empty = false;
+    size_t max_args = 0, size_cap = 0, par = 1;
+    int i = 1;
+
+    for (; argv[i] && argv[i][0] == '-' && argv[i][1]; ++i) {
+        const char *o = argv[i];
+        if (strcmp(o, "--") == 0) { ++i; break; }
+        if (strcmp(o, "-0") == 0) { nul = true; continue; }
+        if (strcmp(o, "-r") == 0) { no_empty = true; continue; }
+        size_t *dst = strcmp(o, "-n") == 0 ? &max_args
+                    : strcmp(o, "-s") == 0 ? &size_cap
+                    : strcmp(o, "-P") == 0 ? &par : NULL;
+        if (!dst || !argv[i + 1] || !parse_size(argv[++i], dst) ||
+            (dst == &max_args && *dst == 0) || (dst == &par && *dst > 4096)) {
+            xa_usage();
+            return 2;
+        }
+    }
+
+    /* CMD ARG... [::: ITEM...] */
+    int cmd_start = i, sep = -1;
+    for (int k = i; argv[k]; ++k) {
+        if (strcmp(argv[k], ":::") == 0) { sep = k; break; }
+    }
+    int cmd_end = sep >= 0 ? sep : cmd_start;
+    if (sep < 0) while (argv[cmd_end]) cmd_end++;
+
+    static char *const default_cmd[] = { "echo" };
+    xa_t X = {0};
+    X.tmpl = cmd_end > cmd_start ? argv + cmd_start : default_cmd;
+    X.ntmpl = cmd_end > cmd_start ? (size_t)(cmd_end - cmd_start) : 1;
+    for (size_t k = 0; k < X.ntmpl; ++k) X.tmpl_cost += arg_cost(strlen(X.tmpl[k]));
+    X.cost = X.tmpl_cost;
+    X.max_args = max_args;
+    X.budget = exec_budget();
+    if (size_cap && size_cap < X.budget) X.budget = size_cap;
+    X.nslots = par == 0 ? jobs_get_slots() : (int)par;
+    X.in_fd = -1;
+
+    X.abs = resolve_cmd_path(X.tmpl[0]);
+    if (!X.abs) {
+        fprintf(stderr, "xargs: %s: command not found\n", X.tmpl[0]);
+        return 127;
+    }
+    X.pids = (pid_t *)malloc((size_t)X.nslots * sizeof(pid_t));
+    if (!X.pids) { perror("xargs: malloc"); free(X.abs); return 1; }
+    for (int k = 0; k < X.nslots; ++k) X.pids[k] = -1;
+
+    fprintf(stderr, "[xargs] budget=%zu bytes, %d slot(s)\n", X.budget, X.nslots);
+
+    size_t nitems = 0;
+    int rc = 0;
+    if (sep >= 0) {
+        for (int k = sep + 1; argv[k] && rc == 0; ++k, ++nitems)
+            rc = add_item(&X, argv[k], strlen(argv[k]));
+    } else {
+        /* stdin is the item list, not the commands' input */
+        X.in_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+        rc = read_items(&X, nul, &nitems);
+    }
+    if (rc == 0) rc = launch(&X, nitems == 0 && !no_empty);
+    while (X.running > 0) reap_one(&X);
+
+    fprintf(stderr, "[xargs] %zu item(s) in %zu exec(s)\n", nitems, X.batches);
+    if (X.in_fd >= 0) close(X.in_fd);
+    free(X.abs);
+    free(X.pids);
+    free(X.arena);
+    free(X.offs);
+    free(X.argv);
+    if (rc != 0 && X.status == 0) return 1;
+    return X.status;
+}
@@ -0,0 +1,327 @@
+// src/zygote.c — pre-forked launch helper for run_command()
+#define _GNU_SOURCE             /* CLONE_PARENT */
+#define _POSIX_C_SOURCE 200809L
+#include "zygote.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char **environ;
+
+#define ZY_MAXFDS (EXEC_FDPLAN_MAXFD + 1)   // every redirectable fd + the cwd
+#define ZY_SOCK   3                         // helper's end of the socketpair
+
+/* One launch. Followed by 'len' bytes: path, argv[argc], env[envc], each
+   NUL-terminated. fds arrive with SCM_RIGHTS in 'target' order; the last
+   one is the shell's cwd. */
+typedef struct {
+    uint32_t      len;
+    uint32_t      nfds;
+    int32_t       target[ZY_MAXFDS];   // child fd for each passed fd
+    uint64_t      closed;              // child fds 0..63 to leave closed
+    uint32_t      argc, envc;
+    uint32_t      has_sched;
+    exec_sched_t  sched;
+    exec_limits_t limits;              // session + per-launch, already merged
+} zy_req_t;
+
+typedef struct { int32_t pid; int32_t err; } zy_rep_t;
+
+static int   zy_sock = -1;
+static pid_t zy_pid  = -1;
+
+/* Terminal signals the helper ignores (so ^C doesn't kill it); children
+   get the defaults back before exec. */
+static const int ZY_SIGS[] = { SIGINT, SIGQUIT, SIGTSTP, SIGTTIN, SIGTTOU };
+
+static int read_full(int fd, void *buf, size_t n){
+    char *p = (char *)buf;
+    while (n > 0){
+        ssize_t r = read(fd, p, n);
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) return -1;
+        p += r;
+        n -= (size_t)r;
+    }
+    return 0;
+}
+
+/* Reads and throws away n bytes, keeping the stream on a header boundary */
+static int skip_full(int fd, size_t n){
+    char buf[512];
+    while (n > 0){
+        size_t k = n < sizeof(buf) ? n : sizeof(buf);
+        if (read_full(fd, buf, k) != 0) return -1;
+        n -= k;
+    }
+    return 0;
+}
+
+/* ---------- helper side ---------- */
+
+static void zy_child(const zy_req_t *rq, char *path, char **argv, char **envp,
+                     const exec_fdplan_t *plan, int cwd){
+    if (fchdir(cwd) < 0) _exit(126);
+    for (size_t i = 0; i < sizeof(ZY_SIGS)/sizeof(ZY_SIGS[0]); ++i) signal(ZY_SIGS[i], SIG_DFL);
+    exec_child(path, argv, envp, plan, rq->has_sched ? &rq->sched : NULL, &rq->limits);
+}
+
+/* Handle one request; returns -1 when the shell has gone away or the
+   stream is out of frame. */
+static int zy_serve_one(int sock){
+    zy_req_t rq;
+    int fds[ZY_MAXFDS];
+    int nfds = 0;
+    union { char buf[CMSG_SPACE(sizeof(int) * ZY_MAXFDS)]; struct cmsghdr align; } cb;
+    struct iovec iov = { &rq, sizeof(rq) };
+    struct msghdr msg = { 0 };
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = cb.buf;
+    msg.msg_controllen = sizeof(cb.buf);
+
+    ssize_t n;
+    do n = recvmsg(sock, &msg, MSG_WAITALL | MSG_CMSG_CLOEXEC);
+    while (n < 0 && errno == EINTR);
+    if (n <= 0) return -1;
+
+    int extra = 0;
+    for (struct cmsghdr *c = CMSG_FIRSTHDR(&msg); c; c = CMSG_NXTHDR(&msg, c)){
+        if (c->cmsg_level != SOL_SOCKET || c->cmsg_type != SCM_RIGHTS) continue;
+        int k = (int)((c->cmsg_len - CMSG_LEN(0)) / sizeof(int));
+        for (int i = 0; i < k; ++i){
+            int fd;
+            memcpy(&fd, CMSG_DATA(c) + i * sizeof(int), sizeof(int));
+            if (nfds < ZY_MAXFDS) fds[nfds++] = fd;
+            else { close(fd); extra = 1; }
+        }
+    }
+
+    zy_rep_t rep = { -1, EPROTO };
+    char *strs = NULL;
+    char **vec = NULL;
+    int gone = 0;
+    /* A short header leaves no way back into frame: give up, and the
+       shell stops using the helper. Otherwise the body is always read
+       before replying, even to a request that is refused. */
+    if ((size_t)n != sizeof(rq)){ gone = 1; goto done; }
+    if ((msg.msg_flags & MSG_CTRUNC) || extra ||
+        rq.nfds != (uint32_t)nfds || nfds < 1){
+        if (skip_full(sock, rq.len) != 0){ gone = 1; goto done; }
+        goto reply;
+    }
+
+    strs = (char *)malloc((size_t)rq.len + 1);
+    vec = (char **)calloc((size_t)rq.argc + rq.envc + 2, sizeof(char *));
+    if (!strs || !vec){
+        if (skip_full(sock, rq.len) != 0){ gone = 1; goto done; }
+        rep.err = ENOMEM;
+        goto reply;
+    }
+    if (read_full(sock, strs, rq.len) != 0){ gone = 1; goto done; }
+    strs[rq.len] = '\0';
+
+    /* path, argv..., NULL, env..., NULL */
+    char *p = strs, *end = strs + rq.len;
+    char *path = p;
+    p += strlen(p) + 1;
+    for (uint32_t i = 0; i < rq.argc + rq.envc; ++i){
+        if (p >= end) goto reply;
+        vec[i + (i >= rq.argc)] = p;
+        p += strlen(p) + 1;
+    }
+    if (rq.argc == 0) goto reply;
+
+    /* Child fds come from the passed ones, numbered in the helper */
+    exec_fdmove_t mv[ZY_MAXFDS + EXEC_FDPLAN_MAXFD];
+    int nm = 0;
+    for (int i = 0; i < nfds - 1; ++i)
+        mv[nm++] = (exec_fdmove_t){ rq.target[i], fds[i] };
+    for (int fd = 0; fd < EXEC_FDPLAN_MAXFD; ++fd)
+        if (rq.closed & (1ULL << fd)) mv[nm++] = (exec_fdmove_t){ fd, -1 };
+    exec_fdplan_t plan;
+    if (exec_fdplan_build(&plan, mv, nm) != 0){ rep.err = EINVAL; goto reply; }
+
+    /* Fork-like clone whose parent is the shell: it reaps and signals it */
+    long pid = syscall(SYS_clone, CLONE_PARENT | SIGCHLD, 0, NULL, NULL, 0);
+    if (pid == 0) zy_child(&rq, path, vec, vec + rq.argc + 1, &plan, fds[nfds - 1]);
+    rep.pid = (int32_t)pid;
+    rep.err = pid < 0 ? errno : 0;
+
+reply:
+    if (write(sock, &rep, sizeof(rep)) != (ssize_t)sizeof(rep)) gone = 1;
+done:
+    free(strs);
+    free(vec);
+    for (int i = 0; i < nfds; ++i) close(fds[i]);
+    return gone ? -1 : 0;
+}
+
+/* ---------- shell side ---------- */
+
+bool zygote_active(void){
+    return zy_sock >= 0;
+}
+
+int zygote_start(void){
+    if (zy_sock >= 0) return 0;
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv) < 0){
+        perror("zygote: socketpair");
+        return -1;
+    }
+    fflush(stdout);     /* don't let the helper inherit pending output */
+    fflush(stderr);
+    pid_t pid = fork();
+    if (pid < 0){
+        perror("zygote: fork");
+        close(sv[0]);
+        close(sv[1]);
+        return -1;
+    }
+    if (pid == 0){
+        /* Helper: keep stdio and the socket, drop everything else */
+        close(sv[0]);
+        if (sv[1] != ZY_SOCK){
+            dup2(sv[1], ZY_SOCK);
+            close(sv[1]);
+        }
+        fcntl(ZY_SOCK, F_SETFD, FD_CLOEXEC);
+        exec_close_fds_from(ZY_SOCK + 1);
+        for (int r = 0; r < EXEC_RLIM_COUNT; ++r) exec_session_limit_clear(r);
+        for (size_t i = 0; i < sizeof(ZY_SIGS)/sizeof(ZY_SIGS[0]); ++i) signal(ZY_SIGS[i], SIG_IGN);
+        while (zy_serve_one(ZY_SOCK) == 0) { }
+        _exit(0);
+    }
+    close(sv[1]);
+    zy_sock = sv[0];
+    zy_pid = pid;
+    fprintf(stderr, "[zygote] started pid=%d\n", (int)pid);
+    return 0;
+}
+
+void zygote_stop(void){
+    if (zy_sock < 0) return;
+    close(zy_sock);     /* EOF: the helper exits */
+    zy_sock = -1;
+    if (zy_pid > 0) waitpid(zy_pid, NULL, 0);   /* ECHILD if jobs already reaped it */
+    fprintf(stderr, "[zygote] stopped pid=%d\n", (int)zy_pid);
+    zy_pid = -1;
+}
+
+/* Shell fd that child fd 'fd' refers to after the first 'nsteps' steps
+   of 'plan' (-1 = closed). */
+static int plan_source(const exec_fdplan_t *plan, int nsteps, int fd){
+    for (int i = nsteps - 1; i >= 0; --i){
+        const exec_fdstep_t *st = &plan->steps[i];
+        if (st->dst != fd || st->kind == FDSTEP_KEEP) continue;
+        if (st->kind == FDSTEP_CLOSE) return -1;
+        return plan_source(plan, i, st->src);
+    }
+    return fd;
+}
+
+pid_t zygote_spawn(const char *path, char *const argv[], char *const envp[],
+                   const exec_fdplan_t *plan,
+                   const exec_sched_t *sched, const exec_limits_t *limits){
+    if (zy_sock < 0){ errno = ENOTCONN; return -1; }
+
+    zy_req_t rq;
+    memset(&rq, 0, sizeof(rq));
+    int fds[ZY_MAXFDS];
+    int nfds = 0;
+
+    /* The child keeps stdio plus whatever the plan explicitly wires */
+    for (int fd = 0; fd < EXEC_FDPLAN_MAXFD; ++fd){
+        if (fd > 2 && !(plan && (plan->keep & (1ULL << fd)))) continue;
+        int src = plan ? plan_source(plan, plan->nsteps, fd) : fd;
+        if (src < 0 || fcntl(src, F_GETFD) < 0){
+            rq.closed |= 1ULL << fd;
+            continue;
+        }
+        rq.target[nfds] = fd;
+        fds[nfds++] = src;
+    }
+    int cwd = open(".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (cwd < 0) return -1;
+    rq.target[nfds] = -1;
+    fds[nfds++] = cwd;
+    rq.nfds = (uint32_t)nfds;
+
+    /* Strings: path, argv, the launch's environment */
+    char *const *env = envp ? envp : environ;
+    size_t len = strlen(path) + 1;
+    for (char *const *a = argv; *a; ++a){ len += strlen(*a) + 1; rq.argc++; }
+    for (char *const *e = env; e && *e; ++e){ len += strlen(*e) + 1; rq.envc++; }
+    char *strs = (char *)malloc(len ? len : 1);
+    if (!strs){ close(cwd); errno = ENOMEM; return -1; }
+    char *p = strs;
+    p = stpcpy(p, path) + 1;
+    for (char *const *a = argv; *a; ++a) p = stpcpy(p, *a) + 1;
+    for (char *const *e = env; e && *e; ++e) p = stpcpy(p, *e) + 1;
+    rq.len = (uint32_t)len;
+
+    if (sched){ rq.has_sched = 1; rq.sched = *sched; }
+    exec_limits_effective(limits, &rq.limits);
+
+    union { char buf[CMSG_SPACE(sizeof(int) * ZY_MAXFDS)]; struct cmsghdr align; } cb;
+    memset(&cb, 0, sizeof(cb));
+    struct iovec iov[2] = { { &rq, sizeof(rq) }, { strs, len } };
+    struct msghdr msg = { 0 };
+    msg.msg_iov = iov;
+    msg.msg_iovlen = 2;
+    msg.msg_control = cb.buf;
+    msg.msg_controllen = CMSG_SPACE(sizeof(int) * (size_t)nfds);
+    struct cmsghdr *c = CMSG_FIRSTHDR(&msg);
+    c->cmsg_level = SOL_SOCKET;
+    c->cmsg_type = SCM_RIGHTS;
+    c->cmsg_len = CMSG_LEN(sizeof(int) * (size_t)nfds);
+    memcpy(CMSG_DATA(c), fds, sizeof(int) * (size_t)nfds);
+
+    /* The fds ride on the first chunk; a large environment may need more */
+    size_t total = sizeof(rq) + len, sent = 0;
+    zy_rep_t rep = { -1, EPROTO };
+    int ok = 1;
+    while (sent < total){
+        ssize_t w = sendmsg(zy_sock, &msg, MSG_NOSIGNAL);
+        if (w < 0 && errno == EINTR) continue;
+        if (w <= 0){ ok = 0; break; }
+        sent += (size_t)w;
+        msg.msg_control = NULL;
+        msg.msg_controllen = 0;
+        for (size_t skip = (size_t)w; skip > 0 && msg.msg_iovlen > 0; ){
+            if (skip < msg.msg_iov->iov_len){
+                msg.msg_iov->iov_base = (char *)msg.msg_iov->iov_base + skip;
+                msg.msg_iov->iov_len -= skip;
+                skip = 0;
+            } else {
+                skip -= msg.msg_iov->iov_len;
+                msg.msg_iov++;
+                msg.msg_iovlen--;
+            }
+        }
+    }
+    close(cwd);
+    free(strs);
+    if (!ok || read_full(zy_sock, &rep, sizeof(rep)) != 0){
+        int e = errno;
+        fprintf(stderr, "[zygote] helper gone, disabling\n");
+        zygote_stop();
+        errno = e ? e : EPIPE;
+        return -1;
+    }
+    if (rep.pid < 0){ errno = rep.err; return -1; }
+    fprintf(stderr, "[zygote] spawned pid=%d\n", (int)rep.pid);
+    return (pid_t)rep.pid;
+}
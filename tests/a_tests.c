@@ -8,6 +8,7 @@
 #include "prompt.h"
 #include "exec.h"
 #include "jobs.h"
+#include "zygote.h"
 
 static void rstrip(char *s){
     if (!s) return;
@@ -43,6 +44,7 @@ static void free_argv(char **argv){
 
 int main(void){
     jobs_init();
+    if (getenv("SHELL_ZYGOTE")) zygote_start();   /* while we're still small */
 
     fprintf(stderr,
         "A-sanity harness (Person A only)\n"
@@ -5,12 +5,31 @@
 #define _POSIX_C_SOURCE 200809L
 #include "parser.h"
 #include "exec.h"
+#include "zygote.h"
+#include "pathglob.h"
+#include "stats.h"
+#include "transcript.h"
+#include "jobs.h"
+#include "env.h"
+#include "memstats.h"
+#include "trace.h"
+#include "readbuf.h"
+#include "script.h"
+#include "server.h"
+#include "jsonl.h"
+#include "lexclass.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <sys/stat.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <time.h>
 
 static long fsize(const char *p){
     struct stat st; if (stat(p, &st) != 0) return -1; return (long)st.st_size;
@@ -156,15 +175,994 @@ static int test_in_redir_and_wc(void){
     return (val == 5) ? 0 : 1;
 }
 
+static int test_parallel_ordered(void){
+    ensure_tmp();
+    // -k: output must come back in input order even with 3 concurrent tasks
+    char line[512];
+    snprintf(line, sizeof(line),
+             "parallel -k -j 3 %s \"%%s\\n\" ::: a b c d e f g > tests/tmp/parallel.txt",
+             PRINTF);
+    if (run_line(line) != 0) return 1;
+    if (!file_eq("tests/tmp/parallel.txt", "a\nb\nc\nd\ne\nf\ng\n")) return 1;
+    return 0;
+}
+
+static int test_parallel_status(void){
+    // {} substitution; two of four tasks fail, so the builtin reports 2
+    char line[512];
+    snprintf(line, sizeof(line), "parallel -j 2 /bin/sh -c \"exit {}\" ::: 0 1 0 3");
+    if (run_line(line) != 2) return 1;
+    // inputs that can't be read in full are an error, not a shorter run
+    return run_line("parallel /bin/true < tests") == 1 ? 0 : 1;
+}
+
+static int test_on_prefix(void){
+    ensure_tmp();
+    // nice(1) without arguments prints the niceness it inherited
+    if (run_line("on -n 7 0 /usr/bin/nice > tests/tmp/on_nice.txt") != 0) return 1;
+    if (!file_eq("tests/tmp/on_nice.txt", "7\n")) return 1;
+    // nproc(1) honours the affinity mask; pinned to CPU 0 it reports one CPU
+    if (run_line("on 0 /usr/bin/nproc | /bin/cat > tests/tmp/on_cpus.txt") != 0) return 1;
+    if (!file_eq("tests/tmp/on_cpus.txt", "1\n")) return 1;
+    // the shell itself must be left alone
+    if (run_line("/usr/bin/nice > tests/tmp/on_nice.txt") != 0) return 1;
+    return file_eq("tests/tmp/on_nice.txt", "0\n") ? 0 : 1;
+}
+
+static int test_redir_creates_dirs(void){
+    ensure_tmp();
+    int rc = system("rm -rf tests/tmp/deep");
+    (void)rc;
+    char line1[512], line2[512];
+    snprintf(line1, sizeof(line1),
+             "%s \"%%s\\n\" \"one\" > tests/tmp/deep/a/b/log.txt", PRINTF);
+    snprintf(line2, sizeof(line2),
+             "%s \"%%s\\n\" \"two\" >> tests/tmp/deep/a/b/log.txt", PRINTF);
+    if (run_line(line1) != 0) return 1;
+    if (run_line(line2) != 0) return 1;
+    if (!file_eq("tests/tmp/deep/a/b/log.txt", "one\ntwo\n")) return 1;
+
+    // Tree removed behind the shell's back: cached dirs must be re-created
+    rc = system("rm -rf tests/tmp/deep/a");
+    (void)rc;
+    if (run_line(line2) != 0) return 1;
+    int ok = file_eq("tests/tmp/deep/a/b/log.txt", "two\n");
+    rc = system("rm -rf tests/tmp/deep");
+    (void)rc;
+    return ok ? 0 : 1;
+}
+
+static int test_fd_redirs(void){
+    ensure_tmp();
+    // 2>&1 and &> send both streams to the file
+    if (run_line("/bin/sh -c \"echo out; echo err 1>&2\" > tests/tmp/fd_both.txt 2>&1") != 0) return 1;
+    if (!file_eq("tests/tmp/fd_both.txt", "out\nerr\n")) return 1;
+    if (run_line("/bin/sh -c \"echo out; echo err 1>&2\" &> tests/tmp/fd_amp.txt") != 0) return 1;
+    if (!file_eq("tests/tmp/fd_amp.txt", "out\nerr\n")) return 1;
+
+    // Swap stdout/stderr through fd 3 on a non-final stage
+    char line[512];
+    snprintf(line, sizeof(line),
+             "/bin/sh -c \"echo A; echo B 1>&2\" 2>tests/tmp/fd_err.txt 3>&1 1>&2 2>&3 | %s > tests/tmp/fd_out.txt",
+             CAT);
+    if (run_line(line) != 0) return 1;
+    if (!file_eq("tests/tmp/fd_out.txt", "B\n")) return 1;
+    return file_eq("tests/tmp/fd_err.txt", "A\n") ? 0 : 1;
+}
+
+static int test_fdplan_swap(void){
+    // {1<-2, 2<-1} is a cycle: needs a scratch fd, so 3 dup2s + 1 close
+    exec_fdmove_t mv[] = { {1, 2}, {2, 1} };
+    exec_fdplan_t plan;
+    if (exec_fdplan_build(&plan, mv, 2) != 0 || plan.nsteps != 4) return 1;
+
+    int po[2], pe[2];
+    if (pipe(po) != 0 || pipe(pe) != 0) return 1;
+    pid_t pid = fork();
+    if (pid < 0) return 1;
+    if (pid == 0) {
+        dup2(po[1], 1); dup2(pe[1], 2);
+        close(po[0]); close(pe[0]); close(po[1]); close(pe[1]);
+        exec_fdplan_apply(&plan);
+        ssize_t w = write(1, "to-err", 6) + write(2, "to-out", 6);
+        _exit(w == 12 ? 0 : 1);
+    }
+    close(po[1]); close(pe[1]);
+    char bo[16] = {0}, be[16] = {0};
+    ssize_t no = read(po[0], bo, sizeof(bo) - 1);
+    ssize_t ne = read(pe[0], be, sizeof(be) - 1);
+    close(po[0]); close(pe[0]);
+    int st = 0;
+    waitpid(pid, &st, 0);
+    if (!WIFEXITED(st) || WEXITSTATUS(st) != 0 || no != 6 || ne != 6) return 1;
+    return strcmp(bo, "to-out") == 0 && strcmp(be, "to-err") == 0 ? 0 : 1;
+}
+
+static int write_file(const char *p, const char *text){
+    FILE *f = fopen(p, "w");
+    if (!f) return 1;
+    fputs(text, f);
+    return fclose(f) != 0;
+}
+
+static int test_source_cache(void){
+    ensure_tmp();
+    int rc = system("rm -rf tests/tmp/srccache tests/tmp/src_out.txt");
+    (void)rc;
+    setenv("SHELL_CACHE_DIR", "tests/tmp/srccache", 1);
+    int ok = 0;
+
+    // First load parses and writes the cache; comments/blank lines skipped
+    if (write_file("tests/tmp/src.sh",
+                   "# comment\n\n/usr/bin/printf \"one\\n\" > tests/tmp/src_out.txt\n"
+                   "  /usr/bin/printf \"two\\n\" >> tests/tmp/src_out.txt\n")) goto out;
+    struct stat st;
+    if (stat("tests/tmp/src.sh", &st) != 0) goto out;
+    if (run_line("source tests/tmp/src.sh") != 0) goto out;
+    if (!file_eq("tests/tmp/src_out.txt", "one\ntwo\n")) goto out;
+    if (system("test -n \"$(ls tests/tmp/srccache)\"") != 0) goto out;
+
+    // Same size and mtime: the cached parse is replayed (proves a hit)
+    if (write_file("tests/tmp/src.sh",
+                   "# comment\n\n/usr/bin/printf \"ONE\\n\" > tests/tmp/src_out.txt\n"
+                   "  /usr/bin/printf \"TWO\\n\" >> tests/tmp/src_out.txt\n")) goto out;
+    struct timespec times[2] = { st.st_atim, st.st_mtim };
+    if (utimensat(AT_FDCWD, "tests/tmp/src.sh", times, 0) != 0) goto out;
+    if (run_line(". tests/tmp/src.sh") != 0) goto out;
+    if (!file_eq("tests/tmp/src_out.txt", "one\ntwo\n")) goto out;
+
+    // Any change to size/mtime falls back to parsing
+    if (write_file("tests/tmp/src.sh", "/usr/bin/printf \"three\\n\" > tests/tmp/src_out.txt\n")) goto out;
+    if (run_line("source tests/tmp/src.sh") != 0) goto out;
+    if (!file_eq("tests/tmp/src_out.txt", "three\n")) goto out;
+
+    // A syntax error anywhere means nothing runs
+    if (write_file("tests/tmp/src.sh",
+                   "/usr/bin/printf \"four\\n\" > tests/tmp/src_out.txt\n| oops\n")) goto out;
+    if (run_line("source tests/tmp/src.sh") != 2) goto out;
+    ok = file_eq("tests/tmp/src_out.txt", "three\n");
+out:
+    unsetenv("SHELL_CACHE_DIR");
+    rc = system("rm -rf tests/tmp/srccache");
+    return ok ? 0 : 1;
+}
+
+static int test_script_control(void){
+    ensure_tmp();
+    int rc = system("rm -rf tests/tmp/srccache tests/tmp/sc_out.txt tests/tmp/sc_f.txt tests/tmp/sc_g");
+    (void)rc;
+    setenv("SHELL_CACHE_DIR", "tests/tmp/srccache", 1);
+    int ok = 0;
+    if (mkdir("tests/tmp/sc_g", 0755) != 0) goto out;
+    if (write_file("tests/tmp/sc_g/b.txt", "") || write_file("tests/tmp/sc_g/a.txt", "")) goto out;
+
+    // Every construct once; $VAR is expanded when each command runs
+    const char *script =
+        "say() {\n"
+        "    echo \"$1:$2\"\n"
+        "    return 3\n"
+        "}\n"
+        "say fn arg >> tests/tmp/sc_out.txt && echo no >> tests/tmp/sc_out.txt || echo ret3 >> tests/tmp/sc_out.txt\n"
+        "for w in x y z; do\n"
+        "    if [ $w = y ]; then continue\n"
+        "    elif test $w = z; then echo elif-$w >> tests/tmp/sc_out.txt\n"
+        "    else echo else-$w >> tests/tmp/sc_out.txt; fi\n"
+        "done\n"
+        "for a in 1 2; do for b in p q; do\n"
+        "    if [ $b = q ]; then break 2; fi; echo $a$b >> tests/tmp/sc_out.txt\n"
+        "done; done\n"
+        "while false; do echo never >> tests/tmp/sc_out.txt; done\n"
+        "until true; do echo never >> tests/tmp/sc_out.txt; done\n"
+        "for f in tests/tmp/sc_g/*.txt; do echo $f >> tests/tmp/sc_out.txt; done  # sorted\n"
+        "say redir \\\n"
+        "    joined > tests/tmp/sc_f.txt\n";
+    const char *want =
+        "fn:arg\nret3\nelse-x\nelif-z\n1p\n"
+        "tests/tmp/sc_g/a.txt\ntests/tmp/sc_g/b.txt\n";
+    if (write_file("tests/tmp/sc.sh", script)) goto out;
+
+    if (run_line("source tests/tmp/sc.sh") != 3) goto out;
+    if (!file_eq("tests/tmp/sc_out.txt", want) || !file_eq("tests/tmp/sc_f.txt", "redir:joined\n")) goto out;
+
+    // Second run maps the cached image and behaves the same
+    if (unlink("tests/tmp/sc_out.txt") != 0) goto out;
+    if (run_line(". tests/tmp/sc.sh") != 3) goto out;
+    if (!file_eq("tests/tmp/sc_out.txt", want)) goto out;
+
+    // Compound commands take no redirections: the whole script is rejected
+    if (write_file("tests/tmp/sc.sh", "echo a > tests/tmp/sc_out.txt\n{ echo b; } > tests/tmp/sc_f.txt\n")) goto out;
+    if (run_line("source tests/tmp/sc.sh") != 2) goto out;
+    if (!file_eq("tests/tmp/sc_out.txt", want)) goto out;
+
+    // exit leaves the script (and its loops) at once
+    if (write_file("tests/tmp/sc.sh",
+                   "for i in 1 2; do echo $i > tests/tmp/sc_out.txt; exit 4; done\necho no > tests/tmp/sc_out.txt\n")) goto out;
+    if (run_line("source tests/tmp/sc.sh") != 2005) goto out;
+    ok = file_eq("tests/tmp/sc_out.txt", "1\n");
+out:
+    unsetenv("SHELL_CACHE_DIR");
+    rc = system("rm -rf tests/tmp/srccache tests/tmp/sc_g tests/tmp/sc.sh tests/tmp/sc_f.txt tests/tmp/sc_out.txt");
+    return ok ? 0 : 1;
+}
+
+static int test_zygote_launch(void){
+    ensure_tmp();
+    if (zygote_start() != 0) return 1;
+    int ok = 0;
+
+    // Direct spawn: the helper's clone is our child, status comes via waitpid
+    char *const argv[] = { "/bin/sh", "-c", "exit 3", NULL };
+    pid_t pid = zygote_spawn("/bin/sh", argv, NULL, NULL, NULL, NULL);
+    int st = 0;
+    if (pid <= 0 || waitpid(pid, &st, 0) != pid || !WIFEXITED(st) || WEXITSTATUS(st) != 3) goto out;
+
+    // run_command() through the helper: fd swaps, current env, current cwd
+    char line[512];
+    snprintf(line, sizeof(line),
+             "/bin/sh -c \"echo A; echo B 1>&2\" 2>tests/tmp/zy_err.txt 3>&1 1>&2 2>&3 | %s > tests/tmp/zy_out.txt",
+             CAT);
+    if (run_line(line) != 0) goto out;
+    if (!file_eq("tests/tmp/zy_out.txt", "B\n") || !file_eq("tests/tmp/zy_err.txt", "A\n")) goto out;
+
+    setenv("ZY_PROBE", "42", 1);
+    int rc = run_line("/usr/bin/printenv ZY_PROBE > tests/tmp/zy_env.txt");
+    unsetenv("ZY_PROBE");
+    if (rc != 0 || !file_eq("tests/tmp/zy_env.txt", "42\n")) goto out;
+
+    char orig[4096];
+    if (!getcwd(orig, sizeof(orig))) goto out;
+    if (chdir("tests/tmp") != 0) goto out;
+    rc = run_line("/bin/pwd > zy_cwd.txt");
+    if (chdir(orig) != 0) goto out;
+    char want[4200];
+    snprintf(want, sizeof(want), "%s/tests/tmp\n", orig);
+    if (rc != 0 || !file_eq("tests/tmp/zy_cwd.txt", want)) goto out;
+
+    ok = zygote_active();   // a transport failure would have disabled it
+out:
+    zygote_stop();
+    return ok ? 0 : 1;
+}
+
+static long sum_lines(const char *p, long *nlines){
+    FILE *f = fopen(p, "r");
+    if (!f) return -1;
+    long sum = 0, v;
+    *nlines = 0;
+    while (fscanf(f, "%ld", &v) == 1) { sum += v; (*nlines)++; }
+    fclose(f);
+    return sum;
+}
+
+static int test_xargs_batching(void){
+    ensure_tmp();
+    // -n caps items per exec; awk prints how many items each batch received
+    if (run_line("xargs -n 3 /usr/bin/awk 'BEGIN { print ARGC - 1 }' ::: a b c d e f g > tests/tmp/xargs_n.txt") != 0) return 1;
+    if (!file_eq("tests/tmp/xargs_n.txt", "3\n3\n1\n")) return 1;
+
+    // 1M items from stdin: far over ARG_MAX in total, so several full execs
+    const long N = 1000000;
+    FILE *f = fopen("tests/tmp/xargs_in.txt", "w");
+    if (!f) return 1;
+    for (long i = 0; i < N; ++i) fprintf(f, "item%07ld%c", i, i % 10 ? ' ' : '\n');
+    fclose(f);
+
+    int ok = 0;
+    long batches = 0, par_batches = 0;
+    if (run_line("xargs /usr/bin/awk 'BEGIN { print ARGC - 1 }' < tests/tmp/xargs_in.txt > tests/tmp/xargs_out.txt") != 0) goto out;
+    if (sum_lines("tests/tmp/xargs_out.txt", &batches) != N) goto out;
+    // ~13.9 MB of argv: packing must need tens of execs, not thousands
+    long argmax = sysconf(_SC_ARG_MAX);
+    long min_batches = (N * (12 + (long)sizeof(char *))) / argmax;
+    if (batches < min_batches || batches > 2 * min_batches + 2) goto out;
+
+    // Same input, four batches at a time
+    if (run_line("xargs -P 4 /usr/bin/awk 'BEGIN { print ARGC - 1 }' < tests/tmp/xargs_in.txt > tests/tmp/xargs_out.txt") != 0) goto out;
+    if (sum_lines("tests/tmp/xargs_out.txt", &par_batches) != N || par_batches != batches) goto out;
+
+    // A failing batch is reported as 123
+    ok = run_line("xargs -n 1 /usr/bin/test a = ::: a a b a") == 123;
+out:
+    unlink("tests/tmp/xargs_in.txt");
+    unlink("tests/tmp/xargs_out.txt");
+    return ok ? 0 : 1;
+}
+
+static int test_glob_expand(void){
+    ensure_tmp();
+    int rc = system("rm -rf tests/tmp/glob && mkdir -p tests/tmp/glob/a/b/c tests/tmp/glob/.hid && cd tests/tmp/glob &&"
+                    " touch x.c y.c z.h '*.q' .dot.c a/m.c a/b/n.c a/b/c/o.c .hid/p.c && ln -s a lnk");
+    if (rc != 0 || fsize("tests/tmp/glob/a/b/c/o.c") != 0) return 1;
+    int ok = 0;
+    struct { const char *line, *want; } cases[] = {
+        {"echo tests/tmp/glob/*.c",            "tests/tmp/glob/x.c tests/tmp/glob/y.c\n"},
+        {"echo tests/tmp/glob/[xz].?",         "tests/tmp/glob/x.c tests/tmp/glob/z.h\n"},
+        {"echo tests/tmp/glob/[!x].c",         "tests/tmp/glob/y.c\n"},
+        {"echo tests/tmp/glob/.*",             "tests/tmp/glob/.dot.c tests/tmp/glob/.hid\n"},
+        {"echo tests/tmp/glob/\"*\".q",         "tests/tmp/glob/*.q\n"},
+        {"echo tests/tmp/glob/\\*.c",          "tests/tmp/glob/*.c\n"},
+        {"echo tests/tmp/glob/none*",          "tests/tmp/glob/none*\n"},
+        {"echo tests/tmp/glob/*/",             "tests/tmp/glob/a/ tests/tmp/glob/lnk/\n"},
+        {"echo tests/tmp/glob/*/*.c",          "tests/tmp/glob/a/m.c tests/tmp/glob/lnk/m.c\n"},
+        // '**' skips hidden and symlinked directories
+        {"/bin/echo tests/tmp/glob/**/*.c",
+         "tests/tmp/glob/a/b/c/o.c tests/tmp/glob/a/b/n.c tests/tmp/glob/a/m.c tests/tmp/glob/x.c tests/tmp/glob/y.c\n"},
+        {"/bin/echo tests/tmp/glob/**/c/*.c",  "tests/tmp/glob/a/b/c/o.c\n"},
+        {"/bin/echo tests/tmp/glob/a/**",
+         "tests/tmp/glob/a/b tests/tmp/glob/a/b/c tests/tmp/glob/a/b/c/o.c tests/tmp/glob/a/b/n.c tests/tmp/glob/a/m.c\n"},
+    };
+    char line[256];
+    for (size_t i = 0; i < sizeof(cases)/sizeof(cases[0]); ++i) {
+        snprintf(line, sizeof(line), "%s > tests/tmp/glob_out.txt", cases[i].line);
+        if (run_line(line) != 0 || !file_eq("tests/tmp/glob_out.txt", cases[i].want)) {
+            fprintf(stderr, "[glob] case %zu failed: %s\n", i, cases[i].line);
+            goto out;
+        }
+    }
+
+    // Multikey sort agrees with strcmp on shared-prefix names
+    char *v[500];
+    for (int i = 0; i < 500; ++i) {
+        char name[32];
+        snprintf(name, sizeof(name), "d%d/f%03d%s", (i * 7) % 3, (i * 37) % 250, i % 2 ? "" : ".c");
+        v[i] = strdup(name);
+    }
+    pathglob_sort(v, 500);
+    ok = 1;
+    for (int i = 1; i < 500; ++i) if (strcmp(v[i - 1], v[i]) > 0) ok = 0;
+    for (int i = 0; i < 500; ++i) free(v[i]);
+out:
+    rc = system("rm -rf tests/tmp/glob");
+    (void)rc;
+    unlink("tests/tmp/glob_out.txt");
+    return ok ? 0 : 1;
+}
+
+static int file_has(const char *p, const char *needle){
+    FILE *f = fopen(p, "rb"); if(!f) return 0;
+    static char buf[65536]; size_t n = fread(buf,1,sizeof(buf)-1,f); fclose(f);
+    buf[n] = '\0';
+    return strstr(buf, needle) != NULL;
+}
+
+static int test_stats(void){
+    ensure_tmp();
+    stats_reset();
+
+    // 1..1000 ns: percentiles land within one sub-bucket (1/16) above the truth
+    for (uint64_t v = 1; v <= 1000; ++v) stats_spawn("/some/dir/probe", v);
+    uint64_t p50 = stats_percentile("probe", STATS_SPAWN, 50);
+    uint64_t p99 = stats_percentile("probe", STATS_SPAWN, 99);
+    if (p50 < 500 || p50 > 500 + 500 / 16 || p99 < 990 || p99 > 1000) return 1;
+    if (stats_percentile("probe", STATS_SPAWN, 100) != 1000) return 1;
+    if (stats_percentile("probe", STATS_RUN, 50) != 0) return 1;
+
+    // Real launches: foreground, pipeline stages and builtins all count
+    for (int i = 0; i < 3; ++i) if (run_line("/bin/true") != 0) return 1;
+    if (run_line("/bin/sh -c \"exit 3\"") != 3) return 1;
+    if (run_line("pwd | /bin/cat > /dev/null") != 0) return 1;          // thread stage
+    if (run_line("jobslots | /bin/cat > /dev/null") != 0) return 1;     // forked stage
+    if (run_line("stats --csv > tests/tmp/stats.csv") != 0) return 1;
+    bool csv_ok = file_has("tests/tmp/stats.csv", "command,metric,lo_ns,hi_ns,count\n") &&
+                  file_has("tests/tmp/stats.csv", "\ntrue,exit,0,,3\n") &&
+                  file_has("tests/tmp/stats.csv", "\nsh,exit,3,,1\n") &&
+                  file_has("tests/tmp/stats.csv", "\ncat,spawn,") &&
+                  file_has("tests/tmp/stats.csv", "\njobslots,spawn,") &&
+                  file_has("tests/tmp/stats.csv", "\npwd,run,") &&
+                  !file_has("tests/tmp/stats.csv", "\npwd,spawn,") &&
+                  file_has("tests/tmp/stats.csv", "\nprobe,spawn,496,511,16\n");
+    unlink("tests/tmp/stats.csv");
+    if (!csv_ok) return 1;
+    if (stats_percentile("true", STATS_RUN, 50) == 0) return 1;
+
+    // A name repeated past the table size is one row, not a row per word
+    char line[3 * STATS_MAX_CMDS * 5 + 64] = "stats";
+    for (int i = 0; i < 3 * STATS_MAX_CMDS; ++i) strcat(line, " true");
+    strcat(line, " > tests/tmp/stats.txt");
+    if (run_line(line) != 0) return 1;
+    FILE *f = fopen("tests/tmp/stats.txt", "r");
+    if (!f) return 1;
+    char buf[256];
+    int rows = 0;
+    while (fgets(buf, sizeof(buf), f)) rows += strncmp(buf, "true ", 5) == 0;
+    fclose(f);
+    unlink("tests/tmp/stats.txt");
+    if (rows != 1) return 1;
+
+    // Past the fixed table, names share one row
+    char name[32];
+    for (int i = 0; i < STATS_MAX_CMDS + 10; ++i) {
+        snprintf(name, sizeof(name), "cmd%d", i);
+        stats_exit(name, 100, 0);
+    }
+    if (stats_percentile("(other)", STATS_RUN, 100) != 100) return 1;
+    if (run_line("stats -r true > /dev/null") != 0) return 1;
+    return stats_percentile("true", STATS_RUN, 100) == 0 ? 0 : 1;
+}
+
+static int test_builtin_thread_stage(void){
+    ensure_tmp();
+    char cwd[PATH_MAX + 1];
+    if (!getcwd(cwd, sizeof(cwd) - 1)) return 1;
+    strcat(cwd, "\n");
+
+    // Output-only builtins run on a thread, first, middle or last in line
+    int ok = run_line("pwd | /bin/cat > tests/tmp/thr.txt") == 0 &&
+             file_has("tests/tmp/thr.txt", cwd) && fsize("tests/tmp/thr.txt") == (long)strlen(cwd);
+    ok = ok && run_line("/bin/echo hi | pwd | /bin/cat > tests/tmp/thr.txt") == 0 &&
+               file_has("tests/tmp/thr.txt", cwd);
+    ok = ok && run_line("/bin/echo hi | false") == 1 && run_line("pwd | test -n x") == 0 &&
+               run_line("/bin/true | [ a = b ]") == 1;
+    ok = ok && run_line("jobs | /bin/cat > tests/tmp/thr.txt") == 0 && fsize("tests/tmp/thr.txt") > 0;
+
+    // Reader gone before the builtin writes: the stage gets 141, the shell lives on
+    const char *log = "tests/tmp/thr.log";
+    unlink(log);
+    if (transcript_open(log, 0) != 0) return 1;
+    for (int i = 0; ok && i < 20; ++i)
+        ok = run_line("pwd | /bin/true 0<&-") == 0;
+    transcript_flush();
+    transcript_close();
+    ok = ok && file_has(log, "\"cmd\":\"pwd | /bin/true\",\"job\":null,\"status\":[141,0]");
+    unlink(log);
+    unlink("tests/tmp/thr.txt");
+    return ok ? 0 : 1;
+}
+
+static int test_transcript(void){
+    ensure_tmp();
+    const char *log = "tests/tmp/transcript.log";
+    unlink(log);
+    FILE *f = fopen("tests/tmp/selfkill.sh", "w");
+    if (!f) return 1;
+    fputs("kill -9 $$\n", f);
+    fclose(f);
+    if (transcript_open(log, 0) != 0) return 1;
+    int ok = run_line("/bin/true") == 0 &&
+             run_line("/bin/sh -c \"exit 3\" | /bin/cat") == 0 &&
+             run_line("/bin/sh tests/tmp/selfkill.sh | /bin/true") == 0 &&
+             run_line("/bin/sleep 0 &") == 0;
+    jobs_wait_all();
+    transcript_flush();
+    ok = ok &&
+         file_has(log, "\"event\":\"run\",\"cwd\":\"/") &&
+         file_has(log, "\"cmd\":\"/bin/true\",\"job\":null,\"status\":[0],\"ms\":") &&
+         file_has(log, "\"cmd\":\"/bin/sh -c exit 3 | /bin/cat\",\"job\":null,\"status\":[3,0]") &&
+         file_has(log, "\"status\":[137,0]") &&
+         file_has(log, "\"event\":\"bg\",") &&
+         file_has(log, "\"cmd\":\"/bin/sleep 0 &\",") &&
+         file_has(log, "\"event\":\"done\",") &&
+         file_has(log, "\"status\":[0],\"ms\":");
+    transcript_close();
+    unlink("tests/tmp/selfkill.sh");
+    if (!ok) return 1;
+
+    // Bounded memory: a record that can never fit is dropped and reported
+    if (transcript_open(log, 512) != 0) return 1;
+    char big[1024];
+    memset(big, 'x', sizeof(big) - 1);
+    big[sizeof(big) - 1] = '\0';
+    transcript_record("run", big, 0, NULL, 0, -1);
+    transcript_record("run", "small \"quoted\"\n", 0, NULL, 0, -1);
+    transcript_flush();
+    transcript_close();
+    ok = file_has(log, "{\"event\":\"dropped\",\"count\":1}\n{\"ts\":") &&
+         file_has(log, "\"cmd\":\"small \\\"quoted\\\"\\n\",\"job\":null,\"status\":null}\n") &&
+         !file_has(log, "xxxx");
+    unlink(log);
+    return ok ? 0 : 1;
+}
+
+static int test_env_assign(void){
+    ensure_tmp();
+    const char *out = "tests/tmp/env_out.txt";
+    FILE *f = fopen("tests/tmp/envprobe.sh", "w");
+    if (!f) return 1;
+    fputs("echo \"${ENVT_A-unset}:${ENVT_B-unset}:${PATH:+path}\"\n", f);
+    fclose(f);
+    env_unset("ENVT_A");
+    env_set("ENVT_B", "old");
+
+    // Per-command only: the child sees it, the shell does not
+    int ok = run_line("ENVT_A=1 /bin/sh tests/tmp/envprobe.sh > tests/tmp/env_out.txt") == 0 &&
+             file_has(out, "1:old:path\n") && !getenv("ENVT_A");
+    ok = ok && run_line("ENVT_B=new ENVT_A=1 ENVT_A=2 /bin/sh tests/tmp/envprobe.sh > tests/tmp/env_out.txt") == 0 &&
+         file_has(out, "2:new:path\n") && strcmp(getenv("ENVT_B"), "old") == 0;
+    ok = ok && run_line("/bin/echo x | ENVT_A=p /bin/sh tests/tmp/envprobe.sh | /bin/cat > tests/tmp/env_out.txt") == 0 &&
+         file_has(out, "p:old:path\n");
+
+    // The cached envp is reused until a variable changes
+    uint64_t r0 = env_rebuilds();
+    ok = ok && run_line("ENVT_A=3 /bin/sh tests/tmp/envprobe.sh > tests/tmp/env_out.txt") == 0 &&
+         file_has(out, "3:old:path\n") && env_rebuilds() == r0;
+    env_set("ENVT_B", "newer");
+    ok = ok && run_line("ENVT_A=4 /bin/sh tests/tmp/envprobe.sh > tests/tmp/env_out.txt") == 0 &&
+         file_has(out, "4:newer:path\n") && env_rebuilds() == r0 + 1;
+
+    // Builtins see it for the call; an assignment alone sets the variable
+    char cwd[PATH_MAX], home_line[PATH_MAX + 32], now[PATH_MAX];
+    if (!getcwd(cwd, sizeof(cwd))) return 1;
+    const char *home = getenv("HOME");
+    char *saved_home = home ? strdup(home) : NULL;
+    snprintf(home_line, sizeof(home_line), "HOME=%s/tests/tmp cd", cwd);
+    ok = ok && run_line(home_line) == 0 && getcwd(now, sizeof(now)) &&
+         strstr(now, "/tests/tmp") && chdir(cwd) == 0 &&
+         ((!saved_home && !getenv("HOME")) || (saved_home && strcmp(getenv("HOME"), saved_home) == 0));
+    free(saved_home);
+    ok = ok && run_line("ENVT_A=kept") == 0 && getenv("ENVT_A") && strcmp(getenv("ENVT_A"), "kept") == 0;
+
+    // And functions, for the length of the call
+    ok = ok && script_run_text("f() { /bin/sh tests/tmp/envprobe.sh; }\n"
+                               "ENVT_B=fn f > tests/tmp/env_out.txt\n") == 0 &&
+         file_has(out, "kept:fn:path\n") && strcmp(getenv("ENVT_B"), "newer") == 0;
+
+    env_unset("ENVT_A");
+    env_unset("ENVT_B");
+    unlink("tests/tmp/envprobe.sh");
+    unlink(out);
+    return ok ? 0 : 1;
+}
+
+static int var_is(const char *name, const char *want){
+    const char *v = getenv(name);
+    if (v && strcmp(v, want) == 0) return 1;
+    fprintf(stderr, "read: %s='%s', want '%s'\n", name, v ? v : "(unset)", want);
+    return 0;
+}
+
+/* Run 'text' with the shell's stdin on 'fd' (closed afterwards). */
+static int script_on_stdin(int fd, const char *text){
+    int saved = dup(0);
+    readbuf_release(0);
+    dup2(fd, 0);
+    close(fd);
+    int rc = script_run_text(text);
+    readbuf_release(0);
+    dup2(saved, 0);
+    close(saved);
+    return rc;
+}
+
+static int test_read_builtin(void){
+    ensure_tmp();
+    const char *in = "tests/tmp/read_in.txt", *rest = "tests/tmp/read_rest.txt";
+    int ok = write_file(in, "alpha beta  gamma\n  x\\ y  z \none,two\nlast") == 0;
+
+    // Block reads from a file: what `read` did not use is still there for cat,
+    // and a redirected read leaves the stdin buffer alone
+    ok = ok && script_on_stdin(open(in, O_RDONLY),
+                               "read a b\n"
+                               "read -r r\n"
+                               "read p q < tests/tmp/read_in.txt\n"
+                               "read -d , c\n"
+                               "/bin/cat > tests/tmp/read_rest.txt\n") == 0;
+    ok = ok && var_is("a", "alpha") && var_is("b", "beta  gamma") && var_is("r", "x\\ y  z") &&
+         var_is("p", "alpha") && var_is("q", "beta  gamma") && var_is("c", "one") &&
+         file_eq(rest, "two\nlast");
+
+    // Backslashes quote, backslash-newline continues, a last partial line is status 1
+    ok = ok && write_file(in, "  x\\ y  z \nco\\\nnt\nlast") == 0 &&
+         script_on_stdin(open(in, O_RDONLY), "read p q\nread s\nread t || READ_EOF=yes\n") == 0 &&
+         var_is("p", "x y") && var_is("q", "z") && var_is("s", "cont") && var_is("t", "last") &&
+         var_is("READ_EOF", "yes");
+
+    // A pipe: only the lines read are taken out of it
+    int fds[2];
+    ok = ok && pipe(fds) == 0;
+    ok = ok && write(fds[1], "l1\nl2\nl3\nl4\n", 12) == 12 && close(fds[1]) == 0 &&
+         script_on_stdin(fds[0], "read x\nread y\n/bin/cat > tests/tmp/read_rest.txt\n") == 0 &&
+         var_is("x", "l1") && var_is("y", "l2") && file_eq(rest, "l3\nl4\n");
+
+    // $IFS, and REPLY gets the line untouched
+    env_set("IFS", ":");
+    ok = ok && write_file(in, "a:b:c\n  keep  \n") == 0 &&
+         script_on_stdin(open(in, O_RDONLY), "read x y\nread\n") == 0 &&
+         var_is("x", "a") && var_is("y", "b:c") && var_is("REPLY", "  keep  ");
+    env_unset("IFS");
+    ok = ok && run_line("read 1x < tests/tmp/read_in.txt") == 2;
+
+    static const char *const vars[] = { "a", "b", "r", "p", "q", "c", "s", "t", "x", "y", "REPLY", "READ_EOF" };
+    for (size_t i = 0; i < sizeof(vars) / sizeof(vars[0]); ++i) env_unset(vars[i]);
+    unlink(in);
+    unlink(rest);
+    return ok ? 0 : 1;
+}
+
+static int test_server(void){
+    ensure_tmp();
+    const char *sock = "tests/tmp/sv.sock", *out = "tests/tmp/sv_out.txt";
+    unlink(sock);
+    fflush(NULL);
+    pid_t srv = fork();
+    if (srv == 0) _exit(server_run(sock) == 0 ? 0 : 1);
+    int s = -1;
+    struct timespec tick = { 0, 10 * 1000 * 1000 };
+    for (int i = 0; i < 200 && (s = server_connect(sock)) < 0; ++i) nanosleep(&tick, NULL);
+    int ok = s >= 0;
+
+    // Overrides and redirections apply in the worker only; cwd is the caller's
+    char cwd[PATH_MAX];
+    char *env[] = { "SV_GREETING=hi there" };
+    const int std[3] = { 0, 1, 2 };
+    ok = ok && getcwd(cwd, sizeof(cwd)) &&
+         server_call(s, "/bin/echo $SV_GREETING > tests/tmp/sv_out.txt", cwd, env, 1, std) == 0 &&
+         file_eq(out, "hi there\n") && getenv("SV_GREETING") == NULL;
+    ok = ok && server_call(s, "cd tests; pwd > tmp/sv_out.txt", cwd, NULL, 0, std) == 0;
+    char want[PATH_MAX + 16];
+    snprintf(want, sizeof(want), "%s/tests\n", cwd);
+    ok = ok && file_eq(out, want);
+
+    // The passed stdout is where output goes; statuses come back
+    int p[2];
+    ok = ok && pipe(p) == 0;
+    const int piped[3] = { 0, p[1], 2 };
+    char buf[64] = {0};
+    ok = ok && server_call(s, "/bin/echo one && /bin/echo two", cwd, NULL, 0, piped) == 0 &&
+         close(p[1]) == 0 && read(p[0], buf, sizeof(buf) - 1) == 8 && strcmp(buf, "one\ntwo\n") == 0;
+    close(p[0]);
+    ok = ok && server_call(s, "exit 3", cwd, NULL, 0, std) == 3 &&
+         server_call(s, "/bin/false", cwd, NULL, 0, std) == 1 &&
+         server_call(s, "/bin/true", "/nonexistent", NULL, 0, std) == 1;
+
+    // Owner only: the socket's mode, and a client under another uid is cut off
+    struct stat sst;
+    ok = ok && stat(sock, &sst) == 0 && (sst.st_mode & 0777) == 0600;
+    if (ok && geteuid() == 0) {
+        chmod(sock, 0666);                      /* let the stranger reach it */
+        fflush(NULL);
+        pid_t other = fork();
+        if (other == 0) {
+            if (setuid(65534) != 0) _exit(2);
+            int cs = server_connect(sock);
+            _exit(cs >= 0 && server_call(cs, "/bin/true", "/", NULL, 0, std) == -1 ? 0 : 1);
+        }
+        int ost = -1;
+        ok = other > 0 && waitpid(other, &ost, 0) == other && WIFEXITED(ost) && WEXITSTATUS(ost) == 0;
+        ok = ok && server_call(s, "/bin/true", cwd, NULL, 0, std) == 0;
+    }
+
+    // Connections run side by side
+    int c[3];
+    struct timespec a, b;
+    clock_gettime(CLOCK_MONOTONIC, &a);
+    for (int i = 0; i < 3; ++i)
+        ok = ok && (c[i] = server_connect(sock)) >= 0 &&
+             server_send(c[i], "/bin/sleep 0.5", cwd, NULL, 0, std) == 0;
+    for (int i = 0; i < 3; ++i) ok = ok && server_recv(c[i]) == 0 && close(c[i]) == 0;
+    clock_gettime(CLOCK_MONOTONIC, &b);
+    double secs = (double)(b.tv_sec - a.tv_sec) + (double)(b.tv_nsec - a.tv_nsec) / 1e9;
+    if (ok && secs > 1.2) { fprintf(stderr, "server: 3 x sleep 0.5 took %.2fs\n", secs); ok = 0; }
+
+    if (s >= 0) close(s);
+    int st = -1;
+    if (srv > 0) { kill(srv, SIGTERM); waitpid(srv, &st, 0); }
+    ok = ok && WIFEXITED(st) && WEXITSTATUS(st) == 0 && access(sock, F_OK) != 0;
+    unlink(sock);
+    unlink(out);
+    return ok ? 0 : 1;
+}
+
+/* Run 'text' in a forked child, as its last words when 'final'. The child's
+   pid and the first line it printed come back; returns its exit code. */
+static int run_forked(const char *text, bool final, pid_t *pid, char *line, size_t n){
+    int p[2];
+    if (pipe(p) != 0) return -1;
+    fflush(NULL);
+    *pid = fork();
+    if (*pid == 0) {
+        close(p[0]);
+        dup2(p[1], 1);
+        close(p[1]);
+        int rc = final ? script_run_text_final(text) : script_run_text(text);
+        fflush(NULL);
+        _exit(rc > 2000 ? (rc - 2001) & 0xFF : rc & 0xFF);
+    }
+    close(p[1]);
+    ssize_t got = *pid > 0 ? read(p[0], line, n - 1) : -1;
+    line[got > 0 ? got : 0] = '\0';
+    close(p[0]);
+    int st = -1;
+    if (*pid < 0 || waitpid(*pid, &st, 0) != *pid || !WIFEXITED(st)) return -1;
+    return WEXITSTATUS(st);
+}
+
+static int test_exec_tail(void){
+    ensure_tmp();
+    const char *script = "tests/tmp/pid.sh", *out = "tests/tmp/exec_out.txt";
+    int ok = write_file(script, "echo $$\nexit 7\n") == 0;
+    char line[64];
+    pid_t pid;
+
+    // The final command replaces the shell: same pid, its status is ours
+    static const char *const tails[] = {
+        "/bin/sh tests/tmp/pid.sh",
+        "/bin/true; /bin/sh tests/tmp/pid.sh",
+        "/bin/false || /bin/sh tests/tmp/pid.sh",
+        "if /bin/true; then /bin/sh tests/tmp/pid.sh; fi",
+        "exec /bin/sh tests/tmp/pid.sh; /bin/echo not reached",
+    };
+    for (size_t i = 0; ok && i < sizeof(tails) / sizeof(tails[0]); ++i) {
+        ok = run_forked(tails[i], i < 4, &pid, line, sizeof(line)) == 7 && atoi(line) == (int)pid;
+        if (!ok) fprintf(stderr, "exec_tail: '%s': printed pid %s, shell pid %d\n", tails[i], line, (int)pid);
+    }
+
+    // Anything after it, a job to wait for, or a plain run: a forked child
+    static const struct { const char *text; int rc; } forked[] = {
+        { "/bin/sh tests/tmp/pid.sh; /bin/true", 0 },
+        { "/bin/sleep 0.1 &\n/bin/sh tests/tmp/pid.sh", 7 },
+        { "/bin/sh tests/tmp/pid.sh | /bin/cat", 0 },
+    };
+    for (size_t i = 0; ok && i < sizeof(forked) / sizeof(forked[0]); ++i) {
+        int rc = run_forked(forked[i].text, true, &pid, line, sizeof(line));
+        ok = rc == forked[i].rc && atoi(line) > 0 && atoi(line) != (int)pid;
+        if (!ok) fprintf(stderr, "exec_tail: '%s': rc %d, printed pid %s, shell pid %d\n",
+                         forked[i].text, rc, line, (int)pid);
+    }
+    ok = ok && run_forked("/bin/sh tests/tmp/pid.sh", false, &pid, line, sizeof(line)) == 7 &&
+         atoi(line) != (int)pid;
+
+    // `exec` with only redirections keeps them; an unknown command is 127
+    ok = ok && run_forked("exec > tests/tmp/exec_out.txt; /bin/echo kept; /bin/echo too",
+                          false, &pid, line, sizeof(line)) == 0 &&
+         line[0] == '\0' && file_eq(out, "kept\ntoo\n");
+    ok = ok && run_line("exec no_such_command_zz") == 127;
+    unlink(script);
+    unlink(out);
+    return ok ? 0 : 1;
+}
+
+static int test_jsonl(void){
+    ensure_tmp();
+    const char *in = "tests/tmp/jl_in.txt", *out = "tests/tmp/jl_out.txt";
+    int ok = write_file(in,
+        "/bin/echo hi > tests/tmp/jl_echo.txt\n"
+        "/bin/false | /bin/true\n"
+        "/bin/sleep 0.2 &\n"
+        "X=1; pwd | /bin/cat > /dev/null\n"
+        "exit 4\n"
+        "/bin/echo never\n") == 0;
+    int ifd = open(in, O_RDONLY), ofd = open(out, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    ok = ok && ifd >= 0 && ofd >= 0 && jsonl_run(ifd, ofd) == 4 && !jsonl_active();
+    if (ifd >= 0) close(ifd);
+    if (ofd >= 0) close(ofd);
+
+    ok = ok && file_eq("tests/tmp/jl_echo.txt", "hi\n") &&
+         file_has(out, "{\"ev\":\"start\",\"seq\":1,\"cmd\":\"/bin/echo hi > tests/tmp/jl_echo.txt\"}\n") &&
+         file_has(out, "{\"ev\":\"run\",\"seq\":2,\"cmd\":\"/bin/false | /bin/true\",\"pids\":[") &&
+         file_has(out, "],\"status\":[1,0],\"ms\":") &&
+         file_has(out, "{\"ev\":\"end\",\"seq\":2,\"status\":0,") &&
+         file_has(out, "{\"ev\":\"bg\",\"seq\":3,\"cmd\":\"/bin/sleep 0.2 &\",\"job\":") &&
+         file_has(out, "\"pids\":[null,") &&                 // pwd ran on a thread
+         file_has(out, "{\"ev\":\"end\",\"seq\":5,\"status\":4,") &&
+         !file_has(out, "\"seq\":6");
+
+    // Every line is one record; the background job is reported before the end
+    FILE *f = fopen(out, "r");
+    char line[1024];
+    int n = 0, jobs = 0;
+    while (ok && f && fgets(line, sizeof(line), f)) {
+        size_t l = strlen(line);
+        ok = strncmp(line, "{\"ev\":\"", 7) == 0 && l > 2 && strcmp(line + l - 2, "}\n") == 0;
+        if (strncmp(line, "{\"ev\":\"job\"", 11) == 0)
+            jobs++, ok = ok && strstr(line, "\"status\":0,") && strstr(line, "\"maxrss_kb\":");
+        n++;
+    }
+    if (f) fclose(f);
+    ok = ok && jobs == 1 && n == 5 * 2 + 4 + 1 + 1;     // start/end per line, 4 runs, 1 bg, 1 job
+    if (!ok) fprintf(stderr, "jsonl: %d record(s), %d job record(s)\n", n, jobs);
+    unlink(in);
+    unlink(out);
+    unlink("tests/tmp/jl_echo.txt");
+    env_unset("X");
+    return ok ? 0 : 1;
+}
+
+/* Words, patterns and redirections of 'line', flattened for comparison. */
+static void lex_dump(const char *line, char *out, size_t n){
+    pipeline_t pl = {0};
+    size_t o = 0;
+    int rc = parse_line_raw(line, &pl);
+    o += (size_t)snprintf(out + o, n - o, "rc=%d bg=%d", rc, pl.background);
+    for (int i = 0; rc == 0 && i < pl.nstages && o < n; ++i) {
+        cmd_t *c = &pl.stages[i];
+        for (int k = 0; c->argv[k] && o < n; ++k)
+            o += (size_t)snprintf(out + o, n - o, " [%s|%s]", c->argv[k],
+                                  c->glob && c->glob[k] ? c->glob[k] : "-");
+        for (int k = 0; k < c->redir.nops && o < n; ++k)
+            o += (size_t)snprintf(out + o, n - o, " <%d:%d:%s>", (int)c->redir.ops[k].kind,
+                                  c->redir.ops[k].fd, c->redir.ops[k].path ? c->redir.ops[k].path : "");
+        if (o < n) o += (size_t)snprintf(out + o, n - o, " ;");
+    }
+    free_pipeline(&pl);
+}
+
+static int test_lex_scan(void){
+    int ok = 1;
+    static const lex_scan_t impls[] = { LEX_SCAN_SCALAR, LEX_SCAN_SSE2, LEX_SCAN_AVX2 };
+
+    // Every byte value, at every alignment and distance, stops a run iff it has a class
+    static _Alignas(64) char buf[256];
+    for (size_t m = 0; ok && m < sizeof(impls) / sizeof(impls[0]); ++m) {
+        lex_scan_t got = lexclass_force(impls[m]);
+        if (got != impls[m]) { fprintf(stderr, "lex: %s unavailable, skipped\n", lexclass_name(impls[m])); continue; }
+        for (int b = 1; ok && b < 256; ++b) {
+            for (size_t off = 0; ok && off < 64; ++off) {
+                for (size_t k = 0; ok && k < 70; ++k) {
+                    memset(buf + off, 'a', k);
+                    buf[off + k] = (char)b;
+                    buf[off + k + 1] = 'x';
+                    buf[off + k + 2] = '\0';
+                    size_t want = lex_class[b] ? k : k + 2;
+                    size_t span = lexclass_span(buf + off);
+                    if (span != want) {
+                        fprintf(stderr, "lex: %s: byte 0x%02x off %zu at %zu: span %zu, want %zu\n",
+                                lexclass_name(impls[m]), b, off, k, span, want);
+                        ok = 0;
+                    }
+                }
+            }
+        }
+    }
+
+    // Whole lines lex the same as with the one-character-at-a-time path
+    static const char *const lines[] = {
+        "/bin/echo hello world", "  a\tb\vc\fd\re  ", "cat<in>out 2>&1|wc -l &",
+        "ls *.c 'x*y' \"$HOME\"/a?b [ab]c \\*", "a\\ b'c d'\"e\\\"f\"g", "x&>>log; y",
+        "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa|bbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbb",
+        "\x01ctl\x7f\x80\xff=v cmd", "unclosed 'quote", "10<&0 3>&- >>app",
+    };
+    char want[2048], got[2048];
+    for (size_t i = 0; ok && i < sizeof(lines) / sizeof(lines[0]); ++i) {
+        lexclass_force(LEX_SCAN_BYTE);
+        lex_dump(lines[i], want, sizeof(want));
+        for (size_t m = 0; ok && m < sizeof(impls) / sizeof(impls[0]); ++m) {
+            lexclass_force(impls[m]);
+            lex_dump(lines[i], got, sizeof(got));
+            if (strcmp(want, got) != 0) {
+                fprintf(stderr, "lex: %s: '%s'\n  byte: %s\n  got:  %s\n", lexclass_name(impls[m]), lines[i], want, got);
+                ok = 0;
+            }
+        }
+    }
+    lexclass_force(LEX_SCAN_AUTO);
+    return ok ? 0 : 1;
+}
+
+static int test_memstats(void){
+    ensure_tmp();
+    ms_enable(true);
+
+    // Everything the core allocates for a line is released again
+    static const ms_site_t balanced[] = { MS_LEX, MS_PARSE, MS_ENV, MS_ARGV, MS_GLOB, MS_JOIN, MS_EXEC };
+    int ok = run_line("/bin/echo $HOME tests/*.c | /bin/cat > tests/tmp/ms_out.txt") == 0 &&
+             file_has("tests/tmp/ms_out.txt", "tests/b_tests.c");
+    for (size_t i = 0; ok && i < sizeof(balanced) / sizeof(balanced[0]); ++i) {
+        ms_counts_t c = ms_get(balanced[i], false);
+        if (c.live != 0) { fprintf(stderr, "memstats: site %d live=%lld\n", (int)balanced[i], (long long)c.live); ok = 0; }
+    }
+    ms_counts_t parse = ms_get(MS_PARSE, false), glob = ms_get(MS_GLOB, false);
+    ok = ok && parse.allocs > 0 && parse.peak > 0 && glob.allocs > 0 &&
+         ms_get(MS_ENV, false).allocs > 0 && ms_get(MS_EXEC, false).allocs > 0;
+
+    // The last command's delta covers its parse and its run, nothing older
+    ms_counts_t last = ms_get(MS_PARSE, true);
+    ok = ok && last.allocs == parse.allocs && last.bytes == parse.bytes;
+    ok = ok && run_line("/bin/true") == 0 && ms_get(MS_GLOB, true).allocs == 0 &&
+         ms_get(MS_PARSE, true).allocs > 0 && ms_get(MS_PARSE, true).allocs < parse.allocs;
+
+    ok = ok && run_line("memstats > tests/tmp/ms_out.txt") == 0 &&
+         file_has("tests/tmp/ms_out.txt", "SITE ") && file_has("tests/tmp/ms_out.txt", "\nparse ") &&
+         file_has("tests/tmp/ms_out.txt", "\ntotal ");
+
+    // Off: nothing is counted
+    ok = ok && run_line("memstats off") == 0;
+    uint64_t before = ms_get(MS_PARSE, false).allocs;
+    ok = ok && run_line("/bin/true") == 0 && ms_get(MS_PARSE, false).allocs == before && !ms_enabled();
+    unlink("tests/tmp/ms_out.txt");
+    return ok ? 0 : 1;
+}
+
+static int test_trace(void){
+    ensure_tmp();
+    const char *path = "tests/tmp/trace.json";
+    unlink(path);
+    int ok = run_line("trace tests/tmp/trace.json") == 0 && trace_active();
+    ok = ok && run_line("/bin/echo a | /bin/cat > /dev/null") == 0;
+    ok = ok && run_line("pwd | /bin/cat > /dev/null") == 0;
+    ok = ok && run_line("/bin/true") == 0;
+    ok = ok && run_line("/bin/sleep 0 &") == 0;
+    jobs_wait_all();
+    ok = ok && run_line("trace -c") == 0 && !trace_active();
+
+    // One complete event per step, each stage and the job on its own track
+    static const char *const want[] = {
+        "\"traceEvents\":[", "\"dropped\":0", "\"name\":\"parse\"", "\"name\":\"resolve\"",
+        "\"name\":\"spawn\"", "\"name\":\"wait\"", "\"name\":\"stage\"", "\"name\":\"job\"",
+        "\"name\":\"thread_name\"", "\"name\":\"stage ", "\"detail\":\"pwd\"",
+        "\"detail\":\"/bin/echo a | /bin/cat > /dev/null\"",
+    };
+    for (size_t i = 0; ok && i < sizeof(want) / sizeof(want[0]); ++i)
+        if (!file_has(path, want[i])) { fprintf(stderr, "trace: missing %s\n", want[i]); ok = 0; }
+
+    // Stopped: nothing more is recorded, and a full buffer counts its drops
+    ok = ok && trace_open(path, 2) == 0;
+    for (int i = 0; i < 5; ++i) trace_event(TRACE_PARSE, stats_now(), stats_now(), 0, "x");
+    ok = ok && trace_close() == 0 && file_has(path, "\"events\":2,\"dropped\":3");
+    unlink(path);
+    return ok ? 0 : 1;
+}
+
+static double time_launches(int n){
+    struct timespec a, b;
+    clock_gettime(CLOCK_MONOTONIC, &a);
+    for (int i = 0; i < n; ++i) if (run_line("/bin/true") != 0) return -1;
+    clock_gettime(CLOCK_MONOTONIC, &b);
+    return (double)(b.tv_sec - a.tv_sec) + (double)(b.tv_nsec - a.tv_nsec) / 1e9;
+}
+
+static int test_fd_hygiene(void){
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) != 0) return 1;
+    int want = rl.rlim_cur > 4100 ? 4000 : (int)rl.rlim_cur - 100;
+    if (want < 100) return 1;
+
+    double base = time_launches(20);
+
+    // Thousands of plain (non-CLOEXEC) descriptors held by the shell
+    int *fds = malloc(sizeof(int) * (size_t)want);
+    if (!fds) return 1;
+    int n = 0;
+    for (; n < want; ++n) if ((fds[n] = open("/dev/null", O_RDONLY)) < 0) break;
+    int ok = n == want;
+
+    // None of them may reach a child...
+    char line[256];
+    snprintf(line, sizeof(line), "/bin/sh -c \"test -e /proc/self/fd/%d\"", fds[n - 1]);
+    if (ok && run_line(line) != 1) ok = 0;
+
+    // ...and launch cost must not scale with them.
+    double loaded = time_launches(20);
+    fprintf(stderr, "[fd_hygiene] 20 launches: %.1f ms with %d extra fds, %.1f ms without\n",
+            loaded * 1e3, n, base * 1e3);
+    if (base < 0 || loaded < 0 || loaded > base * 3 + 0.05) ok = 0;
+
+    for (int i = 0; i < n; ++i) close(fds[i]);
+    free(fds);
+    return ok ? 0 : 1;
+}
+
 int main(void){
     struct { const char *name; int (*fn)(void); } tests[] = {
         {"basic_echo",            test_basic_echo},
         {"redirs_append",         test_redirs_append},
+        {"redir_creates_dirs",    test_redir_creates_dirs},
+        {"fd_redirs",             test_fd_redirs},
+        {"fdplan_swap",           test_fdplan_swap},
+        {"source_cache",          test_source_cache},
+        {"script_control",        test_script_control},
+        {"zygote_launch",         test_zygote_launch},
+        {"xargs_batching",        test_xargs_batching},
+        {"glob_expand",           test_glob_expand},
+        {"stats",                 test_stats},
+        {"transcript",            test_transcript},
+        {"env_assign",            test_env_assign},
+        {"read_builtin",          test_read_builtin},
+        {"server",                test_server},
+        {"exec_tail",             test_exec_tail},
+        {"jsonl",                 test_jsonl},
+        {"lex_scan",              test_lex_scan},
+        {"memstats",              test_memstats},
+        {"trace",                 test_trace},
         {"pipeline_3stage",       test_pipeline_3stage},
         {"builtin_cd_pwd",        test_builtin_cd_pwd},
         {"builtin_in_pipeline",   test_builtin_in_pipeline},
+        {"builtin_thread_stage",  test_builtin_thread_stage},
         {"background_returns",    test_background_returns},
         {"in_redir_and_wc",       test_in_redir_and_wc},
+        {"parallel_ordered",      test_parallel_ordered},
+        {"parallel_status",       test_parallel_status},
+        {"on_prefix",             test_on_prefix},
+        {"fd_hygiene",            test_fd_hygiene},
     };
 
     int fails = 0;
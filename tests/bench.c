@@ -0,0 +1,748 @@
+// Benchmarks: not part of the test gates, run with `make bench`.
+// Each bench prints its own timings to stdout; debug chatter on stderr is
+// sent to /dev/null while timing so it doesn't dominate the numbers.
+#define _DEFAULT_SOURCE             /* madvise, MAP_ANONYMOUS */
+#define _POSIX_C_SOURCE 200809L
+#include "parser.h"
+#include "exec.h"
+#include "source.h"
+#include "zygote.h"
+#include "pathglob.h"
+#include "env.h"
+#include "stats.h"
+#include "trace.h"
+#include "readbuf.h"
+#include "script.h"
+#include "server.h"
+#include "jsonl.h"
+#include "jobs.h"
+#include "lexclass.h"
+
+#include <fcntl.h>
+#include <glob.h>
+#include <signal.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define BENCH_TSC 1
+#endif
+
+static double now_s(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static int saved_err = -1;
+static void quiet_stderr(void){
+    fflush(stderr);
+    saved_err = dup(STDERR_FILENO);
+    int fd = open("/dev/null", O_WRONLY);
+    if (fd >= 0) { dup2(fd, STDERR_FILENO); close(fd); }
+}
+static void restore_stderr(void){
+    fflush(stderr);
+    if (saved_err >= 0) { dup2(saved_err, STDERR_FILENO); close(saved_err); saved_err = -1; }
+}
+
+// --- source: cold parse vs cached load of a 10k-line script ---------------
+
+static int bench_source_cache(void){
+    // Scratch space outside the tree for the ~1 MB script; the cache goes
+    // under tests/tmp (never the user's ~/.cache) and is removed afterwards
+    char dir[] = "/tmp/shell-bench-XXXXXX";
+    if (!mkdtemp(dir)) return 1;
+    const char *cache = "tests/tmp/bench_source_cache";
+    char script[64], rm_cache[96], rm_all[96];
+    snprintf(script, sizeof(script), "%s/script.sh", dir);
+    snprintf(rm_cache, sizeof(rm_cache), "rm -rf %s", cache);
+    snprintf(rm_all, sizeof(rm_all), "rm -rf %s", dir);
+    setenv("SHELL_CACHE_DIR", cache, 1);
+    int rc = 0, ok = 1;
+
+    FILE *f = fopen(script, "w");
+    if (!f) return 1;
+    for (int i = 0; i < 10000; ++i) {
+        switch (i % 4) {
+            case 0: fprintf(f, "# step %d\n", i); break;
+            case 1: fprintf(f, "/usr/bin/printf \"%%s\\n\" \"line %d\" $HOME >> tests/tmp/out_%d.txt 2>&1\n", i, i % 7); break;
+            case 2: fprintf(f, "/bin/cat < tests/tmp/in.txt | /usr/bin/sort -r | /usr/bin/wc -l > tests/tmp/wc_%d.txt\n", i % 5); break;
+            default: fprintf(f, "export_%d=\"quoted value with spaces\" ~/bin/tool --flag=%d 'single' &\n", i, i); break;
+        }
+    }
+    fclose(f);
+
+    char *const argv[] = { "source", "-n", script, NULL };
+    const int runs = 5;
+    double cold = 1e9, warm = 1e9;
+    quiet_stderr();
+    for (int r = 0; r < runs; ++r) {
+        rc = system(rm_cache);
+        double t0 = now_s();
+        if (builtin_source(argv) != 0) { ok = 0; break; }
+        double t1 = now_s();
+        if (builtin_source(argv) != 0) { ok = 0; break; }
+        double t2 = now_s();
+        if (t1 - t0 < cold) cold = t1 - t0;
+        if (t2 - t1 < warm) warm = t2 - t1;
+    }
+    restore_stderr();
+    rc = system(rm_cache);
+    rc = system(rm_all);
+    (void)rc;
+    if (!ok) return 1;
+
+    printf("  10000-line script, best of %d\n", runs);
+    printf("  cold (parse + write cache): %8.3f ms\n", cold * 1e3);
+    printf("  cached (mmap + validate):   %8.3f ms\n", warm * 1e3);
+    printf("  speedup:                    %8.1fx\n", cold / warm);
+    return 0;
+}
+
+// --- launch latency with a 1 GiB shell: fork vs zygote ---------------------
+
+static double launch_us(int n){
+    char *const argv[] = { "/bin/true", NULL };
+    exec_opts_t opts = { -1, -1, -1, false, NULL, NULL, NULL, NULL, 0 };
+    double t0 = now_s();
+    for (int i = 0; i < n; ++i){
+        pid_t pid; int st;
+        if (run_command("/bin/true", argv, &opts, &pid, &st) != 0) return -1;
+    }
+    return (now_s() - t0) / n * 1e6;
+}
+
+static int bench_zygote_launch(void){
+    const int n = 200;
+    const size_t big = (size_t)1 << 30;
+
+    quiet_stderr();
+    double small_fork = launch_us(n);
+    int zrc = zygote_start();          // before the shell grows, as at startup
+    restore_stderr();
+    if (zrc != 0) return 1;
+
+    // 4 KiB pages like a real heap (THP would hide the page-table cost)
+    char *state = mmap(NULL, big, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (state == MAP_FAILED){ zygote_stop(); return 1; }
+    madvise(state, big, MADV_NOHUGEPAGE);
+    memset(state, 1, big);             // fault it all in
+
+    quiet_stderr();
+    double big_zygote = launch_us(n);
+    zygote_stop();
+    double big_fork = launch_us(n);
+    restore_stderr();
+    munmap(state, big);
+    if (small_fork < 0 || big_zygote < 0 || big_fork < 0) return 1;
+
+    printf("  /bin/true x%d, mean launch+wait\n", n);
+    printf("  fork,   small shell:        %8.1f us\n", small_fork);
+    printf("  fork,   1 GiB resident:     %8.1f us\n", big_fork);
+    printf("  zygote, 1 GiB resident:     %8.1f us\n", big_zygote);
+    return 0;
+}
+
+// --- glob over 1M-entry directories ----------------------------------------
+
+static int make_files(const char *dir, int n){
+    if (mkdir(dir, 0755) != 0) return -1;
+    int dfd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dfd < 0) return -1;
+    char name[32];
+    for (int i = 0; i < n; ++i){
+        snprintf(name, sizeof(name), "f%07d.%s", i, i % 2 ? "log" : "txt");
+        int fd = openat(dfd, name, O_CREAT | O_WRONLY | O_CLOEXEC, 0644);
+        if (fd < 0){ close(dfd); return -1; }
+        close(fd);
+    }
+    close(dfd);
+    return 0;
+}
+
+static double time_pathglob(const char *pat, long *count){
+    pathglob_list_t l = {0};
+    double t0 = now_s();
+    *count = pathglob_expand(pat, &l);
+    double t = now_s() - t0;
+    pathglob_list_free(&l);
+    return t;
+}
+
+static int bench_glob_1m(void){
+    // Scratch space outside the tree: 2M empty files, ~20 s to create
+    char dir[] = "/tmp/shell-bench-XXXXXX";
+    if (!mkdtemp(dir)) return 1;
+    char path[128], pat[128], rm_all[96];
+    snprintf(rm_all, sizeof(rm_all), "rm -rf %s", dir);
+    int ok = 1;
+
+    // flat: one directory, 1M entries
+    snprintf(path, sizeof(path), "%s/flat", dir);
+    if (make_files(path, 1000000) != 0) ok = 0;
+    // tree: 1000 directories x 1000 entries
+    snprintf(path, sizeof(path), "%s/tree", dir);
+    if (ok && mkdir(path, 0755) != 0) ok = 0;
+    for (int d = 0; ok && d < 1000; ++d){
+        snprintf(path, sizeof(path), "%s/tree/d%03d", dir, d);
+        if (make_files(path, 1000) != 0) ok = 0;
+    }
+
+    long n_ours = 0, n_libc = 0, n_one = 0, n_all = 0;
+    double ours = 0, libc = 0, one = 0, all = 0;
+    if (ok){
+        snprintf(pat, sizeof(pat), "%s/flat/*.log", dir);
+        quiet_stderr();
+        time_pathglob(pat, &n_ours);                 // warm the dentry cache
+        ours = time_pathglob(pat, &n_ours);
+        restore_stderr();
+
+        glob_t g;
+        double t0 = now_s();
+        if (glob(pat, 0, NULL, &g) == 0) n_libc = (long)g.gl_pathc;
+        libc = now_s() - t0;
+        globfree(&g);
+
+        snprintf(pat, sizeof(pat), "%s/tree/**/*.log", dir);
+        quiet_stderr();
+        pathglob_set_threads(1);
+        time_pathglob(pat, &n_one);
+        one = time_pathglob(pat, &n_one);
+        pathglob_set_threads(0);
+        all = time_pathglob(pat, &n_all);
+        restore_stderr();
+        ok = n_ours == 500000 && n_libc == n_ours && n_one == 500000 && n_all == n_one;
+    }
+    int rc = system(rm_all);
+    (void)rc;
+    if (!ok) return 1;
+
+    printf("  flat dir, 1M entries, '*.log' -> %ld matches (sorted)\n", n_ours);
+    printf("  pathglob (getdents64 + mkqsort): %8.1f ms\n", ours * 1e3);
+    printf("  libc glob(3):                    %8.1f ms\n", libc * 1e3);
+    printf("  1000 dirs x 1000 entries, '**/*.log' -> %ld matches\n", n_all);
+    printf("  ** walk, 1 thread:               %8.1f ms\n", one * 1e3);
+    printf("  ** walk, %2ld online CPU(s):       %8.1f ms\n", sysconf(_SC_NPROCESSORS_ONLN), all * 1e3);
+    return 0;
+}
+
+// --- in-process control flow: a 100k-iteration loop of builtins ------------
+
+static int bench_script_loop(void){
+    char dir[] = "/tmp/shell-bench-XXXXXX";
+    if (!mkdtemp(dir)) return 1;
+    const char *cache = "tests/tmp/bench_script_cache";     // never ~/.cache
+    char loop[64], flat[64], sh[160], rm_all[96], rm_cache[96];
+    snprintf(loop, sizeof(loop), "%s/loop.sh", dir);
+    snprintf(flat, sizeof(flat), "%s/flat.sh", dir);
+    snprintf(sh, sizeof(sh), "/bin/sh %s", loop);
+    snprintf(rm_all, sizeof(rm_all), "rm -rf %s", dir);
+    snprintf(rm_cache, sizeof(rm_cache), "rm -rf %s", cache);
+    int rc = system(rm_cache);                  // both scripts start uncached
+    setenv("SHELL_CACHE_DIR", cache, 1);
+    int ok = 1;
+
+    // 1000 x 100 calls of a one-builtin function, and the same 100k
+    // commands written out one per line
+    FILE *f = fopen(loop, "w");
+    if (!f) return 1;
+    fprintf(f, "f() { true; }\nfor i in");
+    for (int i = 0; i < 1000; ++i) fprintf(f, " %d", i);
+    fprintf(f, "; do\n    for j in");
+    for (int j = 0; j < 100; ++j) fprintf(f, " %d", j);
+    fprintf(f, "; do f; done\ndone\n");
+    fclose(f);
+    f = fopen(flat, "w");
+    if (!f) return 1;
+    for (int i = 0; i < 100000; ++i) fprintf(f, "true\n");
+    fclose(f);
+
+    char *const loop_argv[] = { "source", loop, NULL };
+    char *const flat_argv[] = { "source", flat, NULL };
+    quiet_stderr();
+    double t0 = now_s();
+    if (builtin_source(loop_argv) != 0) ok = 0;
+    double t_loop = now_s() - t0;
+    t0 = now_s();                               // not in the cache yet: parsed
+    if (ok && builtin_source(flat_argv) != 0) ok = 0;
+    double t_flat = now_s() - t0;
+    t0 = now_s();
+    if (ok && system(sh) != 0) ok = 0;
+    double t_sh = now_s() - t0;
+    restore_stderr();
+    rc = system(rm_cache);
+    rc = system(rm_all);
+    (void)rc;
+    if (!ok) return 1;
+
+    printf("  100000 calls of f() { true; } from nested for loops\n");
+    printf("  compiled loop, in process:  %8.1f ms\n", t_loop * 1e3);
+    printf("  100000 lines, parsed cold:  %8.1f ms\n", t_flat * 1e3);
+    printf("  /bin/sh, same loop:         %8.1f ms\n", t_sh * 1e3);
+    return 0;
+}
+
+// --- NAME=value cmd -----------------------------------------------------------
+
+static double env_launch_us(const char *path, char *const argv[], char *const *env, int nenv,
+                            bool set_each, int n){
+    exec_opts_t opts = { -1, -1, -1, false, NULL, NULL, NULL, env, nenv };
+    double t0 = now_s();
+    for (int i = 0; i < n; ++i){
+        pid_t pid; int st;
+        if (set_each) env_set("BENCH_V", "1");
+        if (run_command(path, argv, &opts, &pid, &st) != 0 || st != 0) return -1;
+        if (set_each) env_unset("BENCH_V");
+    }
+    return (now_s() - t0) / n * 1e6;
+}
+
+static int bench_env_assign(void){
+    const int n = 300, m = 200000;
+    char *const assign[] = { "BENCH_V=1", "LC_ALL=C" };
+    char *const true_argv[] = { "/bin/true", NULL };
+    char *const env_argv[] = { "/usr/bin/env", "BENCH_V=1", "LC_ALL=C", "/bin/true", NULL };
+
+    // Pad the environment to something like a login shell's
+    char name[32], val[64];
+    for (int i = 0; i < 60; ++i){
+        snprintf(name, sizeof(name), "BENCH_PAD_%d", i);
+        snprintf(val, sizeof(val), "/some/fairly/typical/path/value/%d", i);
+        env_set(name, val);
+    }
+
+    quiet_stderr();
+    double t_env = env_launch_us("/usr/bin/env", env_argv, NULL, 0, false, n);
+    double t_set = env_launch_us("/bin/true", true_argv, NULL, 0, true, n);
+    double t_cached = env_launch_us("/bin/true", true_argv, assign, 2, false, n);
+
+    // The envp construction alone: cached overlay vs rebuild after a change
+    double t0 = now_s();
+    for (int i = 0; i < m; ++i) free(env_launch(assign, 2));
+    double per_overlay = (now_s() - t0) / m * 1e9;
+    t0 = now_s();
+    for (int i = 0; i < m / 10; ++i){ env_set("BENCH_V", "x"); free(env_launch(assign, 2)); }
+    double per_rebuild = (now_s() - t0) / (m / 10) * 1e9;
+    restore_stderr();
+
+    for (int i = 0; i < 60; ++i){
+        snprintf(name, sizeof(name), "BENCH_PAD_%d", i);
+        env_unset(name);
+    }
+    env_unset("BENCH_V");
+    if (t_env < 0 || t_set < 0 || t_cached < 0) return 1;
+
+    printf("  BENCH_V=1 LC_ALL=C /bin/true x%d, mean launch+wait\n", n);
+    printf("  via /usr/bin/env:           %8.1f us\n", t_env);
+    printf("  setenv around the launch:   %8.1f us\n", t_set);
+    printf("  cached envp overlay:        %8.1f us\n", t_cached);
+    printf("  envp build, cached:         %8.0f ns\n", per_overlay);
+    printf("  envp build, after a change: %8.0f ns\n", per_rebuild);
+    return 0;
+}
+
+// --- builtin pipeline stage: forked child vs thread ------------------------
+
+static double pipeline_us(const char *line, int n){
+    pipeline_t pl = {0};
+    if (parse_line(line, &pl) != 0) return -1;
+    double t0 = now_s();
+    for (int i = 0; i < n; ++i){
+        if (exec_pipeline(&pl) != 0){ free_pipeline(&pl); return -1; }
+    }
+    double us = (now_s() - t0) / n * 1e6;
+    free_pipeline(&pl);
+    return us;
+}
+
+static int bench_builtin_stage(void){
+    const int n = 500;
+    const size_t big = (size_t)512 << 20;
+
+    // A redirection keeps a builtin on the forked path
+    static const char *const lines[][2] = {
+        { "pwd 2>/dev/null | /bin/cat > /dev/null", "pwd | /bin/cat > /dev/null" },
+        { "pwd 2>/dev/null | test -n x 2>/dev/null", "pwd | test -n x" },
+    };
+    double us[2][2][2];                 // [resident][line][thread]
+    char *state = NULL;
+    for (int r = 0; r < 2; ++r){
+        if (r == 1){
+            state = mmap(NULL, big, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (state == MAP_FAILED) return 1;
+            madvise(state, big, MADV_NOHUGEPAGE);
+            memset(state, 1, big);
+        }
+        quiet_stderr();
+        for (int l = 0; l < 2; ++l)
+            for (int t = 0; t < 2; ++t) us[r][l][t] = pipeline_us(lines[l][t], n);
+        restore_stderr();
+    }
+    munmap(state, big);
+    for (int k = 0; k < 8; ++k) if ((&us[0][0][0])[k] < 0) return 1;
+
+    printf("  x%d, mean per pipeline        small shell   512 MiB resident\n", n);
+    printf("  pwd | cat,     forked pwd:  %8.1f us   %8.1f us\n", us[0][0][0], us[1][0][0]);
+    printf("  pwd | cat,     thread pwd:  %8.1f us   %8.1f us\n", us[0][0][1], us[1][0][1]);
+    printf("  pwd | test,    forked:      %8.1f us   %8.1f us\n", us[0][1][0], us[1][1][0]);
+    printf("  pwd | test,    threads:     %8.1f us   %8.1f us\n", us[0][1][1], us[1][1][1]);
+    return 0;
+}
+
+static int bench_trace(void){
+    const uint32_t n = 1u << 18;
+    const char *path = "/tmp/bench_trace.json";
+
+    // Per event as the hooks pay it: the check, the closing clock read, the record
+    double t0 = now_s();
+    for (uint32_t i = 0; i < n; ++i)
+        if (trace_active()) trace_event(TRACE_STAGE, 0, stats_now(), 1, "/bin/true");
+    double off_ns = (now_s() - t0) / n * 1e9;
+
+    if (trace_open(path, n) != 0) return 1;
+    t0 = now_s();
+    for (uint32_t i = 0; i < n; ++i)
+        if (trace_active()) trace_event(TRACE_STAGE, 0, stats_now(), 1, "/bin/true");
+    double on_ns = (now_s() - t0) / n * 1e9;
+    quiet_stderr();
+    double w0 = now_s();
+    int rc = trace_close();
+    double write_ms = (now_s() - w0) * 1e3;
+
+    // And a whole pipeline, traced or not
+    const int runs = 300;
+    const char *line = "/bin/echo a | /bin/cat > /dev/null";
+    double plain = pipeline_us(line, runs);
+    trace_open(path, 0);
+    double traced = pipeline_us(line, runs);
+    trace_close();
+    restore_stderr();
+    unlink(path);
+    if (rc != 0 || plain < 0 || traced < 0) return 1;
+
+    printf("  trace_event x%u:  off %6.1f ns   on %6.1f ns   (JSON write %.1f ms)\n",
+           n, off_ns, on_ns, write_ms);
+    printf("  echo | cat x%d:   untraced %8.1f us   traced %8.1f us\n", runs, plain, traced);
+    return 0;
+}
+
+// --- read: a 1M-line file through `while read` -------------------------------
+
+/* Seconds for 'loop' with the shell's stdin on 'fd' (closed afterwards). */
+static double read_loop_s(int fd, const char *loop){
+    if (fd < 0) return -1;
+    int saved = dup(0);
+    readbuf_release(0);
+    dup2(fd, 0);
+    close(fd);
+    double t0 = now_s();
+    int rc = script_run_text(loop);
+    double t = now_s() - t0;
+    readbuf_release(0);
+    dup2(saved, 0);
+    close(saved);
+    return rc == 0 ? t : -1;
+}
+
+/* Read end of a pipe (or socket) a child copies 'path' into. */
+static int feed_fd(const char *path, bool sock, pid_t *pid){
+    int sv[2];
+    if ((sock ? socketpair(AF_UNIX, SOCK_STREAM, 0, sv) : pipe(sv)) != 0) return -1;
+    *pid = fork();
+    if (*pid < 0) return -1;
+    if (*pid == 0){
+        close(sv[0]);
+        int in = open(path, O_RDONLY);
+        char buf[65536];
+        ssize_t n;
+        while (in >= 0 && (n = read(in, buf, sizeof(buf))) > 0)
+            if (write(sv[1], buf, (size_t)n) != n) _exit(1);
+        _exit(0);
+    }
+    close(sv[1]);
+    return sv[0];
+}
+
+static int bench_read_lines(void){
+    const int n = 1000000;
+    char path[] = "/tmp/shell-bench-read-XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) return 1;
+    FILE *f = fdopen(fd, "w");
+    if (!f) return 1;
+    for (int i = 0; i < n; ++i) fprintf(f, "%d field%d rest of line %d\n", i, i % 97, i);
+    fclose(f);
+
+    const char *loop = "while read a b c; do :; done\n";
+    pid_t pipe_pid = -1, sock_pid = -1;
+    quiet_stderr();
+    double t_file = read_loop_s(open(path, O_RDONLY), loop);
+    double t_pipe = read_loop_s(feed_fd(path, false, &pipe_pid), loop);
+    double t_sock = read_loop_s(feed_fd(path, true, &sock_pid), loop);
+    char sh[128];
+    snprintf(sh, sizeof(sh), "/bin/sh -c 'while read a b c; do :; done' < %s", path);
+    double t0 = now_s();
+    int sh_rc = system(sh);
+    double t_sh = now_s() - t0;
+    restore_stderr();
+    if (pipe_pid > 0) waitpid(pipe_pid, NULL, 0);
+    if (sock_pid > 0) waitpid(sock_pid, NULL, 0);
+    unlink(path);
+    if (t_file < 0 || t_pipe < 0 || t_sock < 0 || sh_rc != 0) return 1;
+
+    printf("  while read a b c; do :; done over %d lines\n", n);
+    printf("  regular file, block reads:  %8.1f ms\n", t_file * 1e3);
+    printf("  pipe, tee()-peeked blocks:  %8.1f ms\n", t_pipe * 1e3);
+    printf("  socket, byte reads:         %8.1f ms\n", t_sock * 1e3);
+    printf("  /bin/sh, regular file:      %8.1f ms\n", t_sh * 1e3);
+    return 0;
+}
+
+/* fork + exec 'argv' and wait; its exit status. */
+static int run_argv(char *const argv[]){
+    pid_t pid = fork();
+    if (pid == 0){ execv(argv[0], argv); _exit(127); }
+    int st;
+    if (pid < 0 || waitpid(pid, &st, 0) != pid) return -1;
+    return WIFEXITED(st) ? WEXITSTATUS(st) : -1;
+}
+
+static int bench_server(void){
+    const int n = 2000, nconn = 8;
+    const char *sock = "/tmp/shell-bench-serve.sock";
+    char cwd[PATH_MAX];
+    if (!getcwd(cwd, sizeof(cwd))) return 1;
+    const int std[3] = { 0, 1, 2 };
+
+    quiet_stderr();
+    pid_t srv = fork();
+    if (srv == 0) _exit(server_run(sock) == 0 ? 0 : 1);
+    int s = -1;
+    struct timespec tick = { 0, 10 * 1000 * 1000 };
+    for (int i = 0; i < 200 && (s = server_connect(sock)) < 0; ++i) nanosleep(&tick, NULL);
+    int ok = s >= 0;
+
+    // One connection, one request at a time
+    double t0 = now_s();
+    for (int i = 0; ok && i < n; ++i) ok = server_call(s, "/bin/true", cwd, NULL, 0, std) == 0;
+    double t_one = now_s() - t0;
+
+    // nconn connections, each with its next request as soon as the last returns
+    int c[8];
+    t0 = now_s();
+    for (int k = 0; k < nconn; ++k) ok = ok && (c[k] = server_connect(sock)) >= 0;
+    for (int r = 0; ok && r < n / nconn; ++r) {
+        for (int k = 0; ok && k < nconn; ++k) ok = server_send(c[k], "/bin/true", cwd, NULL, 0, std) == 0;
+        for (int k = 0; ok && k < nconn; ++k) ok = server_recv(c[k]) == 0;
+    }
+    double t_many = now_s() - t0;
+    for (int k = 0; k < nconn; ++k) if (c[k] >= 0) close(c[k]);
+
+    // A client process per command
+    char shc_path[] = "bin/shc", true_path[] = "/bin/true", sh_path[] = "/bin/sh", dash_c[] = "-c";
+    char sock_arg[64];
+    snprintf(sock_arg, sizeof(sock_arg), "%s", sock);
+    char *shc_argv[] = { shc_path, sock_arg, true_path, NULL };
+    char *sh_argv[] = { sh_path, dash_c, true_path, NULL };
+    bool have_shc = access(shc_path, X_OK) == 0;
+    double t_shc = 0;
+    if (have_shc) {
+        t0 = now_s();
+        for (int i = 0; ok && i < n; ++i) ok = run_argv(shc_argv) == 0;
+        t_shc = now_s() - t0;
+    }
+    t0 = now_s();
+    for (int i = 0; ok && i < n; ++i) ok = run_argv(sh_argv) == 0;
+    double t_sh = now_s() - t0;
+
+    if (s >= 0) close(s);
+    if (srv > 0) { kill(srv, SIGTERM); waitpid(srv, NULL, 0); }
+    restore_stderr();
+    if (!ok) return 1;
+
+    printf("  %d x /bin/true\n", n);
+    printf("  serve, 1 connection:        %8.1f ms  (%6.1f us/cmd)\n", t_one * 1e3, t_one * 1e6 / n);
+    printf("  serve, %d connections:       %8.1f ms  (%6.1f us/cmd)\n", nconn, t_many * 1e3, t_many * 1e6 / n);
+    if (have_shc)
+        printf("  bin/shc per command:        %8.1f ms  (%6.1f us/cmd)\n", t_shc * 1e3, t_shc * 1e6 / n);
+    printf("  /bin/sh -c per command:     %8.1f ms  (%6.1f us/cmd)\n", t_sh * 1e3, t_sh * 1e6 / n);
+    return 0;
+}
+
+/* A --jsonl shell fed 'n' copies of 'cmd'. Lockstep: each line waits for
+   its "end" record; otherwise a writer pushes every line up front. Seconds,
+   or -1. */
+static double jsonl_session(const char *cmd, int n, bool lockstep){
+    int in[2], out[2];
+    if (pipe(in) != 0 || pipe(out) != 0) return -1;
+    fflush(NULL);
+    pid_t sh = fork();
+    if (sh == 0){
+        close(in[1]); close(out[0]);
+        jobs_init();
+        _exit(jsonl_run(in[0], out[1]));
+    }
+    close(in[0]); close(out[1]);
+
+    char line[256];
+    int ll = snprintf(line, sizeof(line), "%s\n", cmd);
+    double t0 = now_s();
+    pid_t writer = -1;
+    if (!lockstep){
+        writer = fork();
+        if (writer == 0){
+            close(out[0]);
+            for (int i = 0; i < n; ++i) if (write(in[1], line, (size_t)ll) != ll) _exit(1);
+            _exit(0);
+        }
+        close(in[1]);
+    }
+
+    char buf[65536];
+    size_t have = 0;
+    int ends = 0, sent = 0;
+    ssize_t r = 1;
+    if (lockstep && write(in[1], line, (size_t)ll) == ll) sent++;
+    while (r > 0 && ends < n){
+        r = read(out[0], buf + have, sizeof(buf) - have - 1);
+        if (r <= 0) break;
+        have += (size_t)r;
+        buf[have] = '\0';
+        char *p = buf, *nl;
+        while ((nl = strchr(p, '\n'))){
+            if (strncmp(p, "{\"ev\":\"end\"", 11) == 0){
+                ends++;
+                if (lockstep && sent < n && write(in[1], line, (size_t)ll) == ll) sent++;
+            }
+            p = nl + 1;
+        }
+        have -= (size_t)(p - buf);
+        memmove(buf, p, have);
+    }
+    double t = now_s() - t0;
+    if (lockstep) close(in[1]);
+    close(out[0]);
+    if (writer > 0) waitpid(writer, NULL, 0);
+    waitpid(sh, NULL, 0);
+    return ends == n ? t : -1;
+}
+
+static int bench_jsonl(void){
+    const int n = 5000, m = 1000;
+    quiet_stderr();
+    double t_lock = jsonl_session(":", n, true);
+    double t_pipe = jsonl_session(":", n, false);
+    double t_lock_ext = jsonl_session("/bin/true", m, true);
+    double t_pipe_ext = jsonl_session("/bin/true", m, false);
+    restore_stderr();
+    if (t_lock < 0 || t_pipe < 0 || t_lock_ext < 0 || t_pipe_ext < 0) return 1;
+
+    printf("  %d x ':' (protocol cost), %d x /bin/true\n", n, m);
+    printf("  ':'        lockstep:   %8.1f ms  (%6.1f us/line)\n", t_lock * 1e3, t_lock * 1e6 / n);
+    printf("  ':'        pipelined:  %8.1f ms  (%6.1f us/line)\n", t_pipe * 1e3, t_pipe * 1e6 / n);
+    printf("  /bin/true  lockstep:   %8.1f ms  (%6.1f us/line)\n", t_lock_ext * 1e3, t_lock_ext * 1e6 / m);
+    printf("  /bin/true  pipelined:  %8.1f ms  (%6.1f us/line)\n", t_pipe_ext * 1e3, t_pipe_ext * 1e6 / m);
+    return 0;
+}
+
+/* Time stamp counter where there is one, else nanoseconds. */
+static uint64_t cycles(void){
+#ifdef BENCH_TSC
+    return __rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+static int bench_lex(void){
+    /* A generated command line: long option and path words, a few quotes */
+    const size_t target = 512 * 1024;
+    char *line = (char *)malloc(target + 256);
+    if (!line) return 1;
+    size_t len = (size_t)snprintf(line, 64, "/usr/bin/cc");
+    for (int i = 0; len < target; ++i)
+        len += (size_t)snprintf(line + len, 256, i % 16 == 0 ? " -DNAME_%d='quoted value'" :
+                                i % 3 == 0 ? " -I/opt/vendor/include/subsystem/module_%d" :
+                                " build/obj/src/component/file_%d.o", i);
+    char *word = (char *)malloc(target + 1);    /* one huge word: the scanner alone */
+    if (!word) { free(line); return 1; }
+    memset(word, 'w', target);
+    word[target] = '\0';
+
+    const int reps = 20;
+    static const lex_scan_t impls[] = { LEX_SCAN_BYTE, LEX_SCAN_SCALAR, LEX_SCAN_SSE2, LEX_SCAN_AVX2 };
+    printf("  %zu-byte line (%s), %d parses; bytes/%s\n", len,
+           "words of 30-45 chars", reps,
+#ifdef BENCH_TSC
+           "cycle (TSC)"
+#else
+           "ns"
+#endif
+           );
+    quiet_stderr();
+    double per[4][2] = {{0}};
+    lex_scan_t got[4];
+    int rc = 0;
+    for (size_t m = 0; m < 4; ++m) {
+        got[m] = lexclass_force(impls[m]);
+        uint64_t c0 = cycles();
+        for (int r = 0; r < reps && rc == 0; ++r) {
+            pipeline_t pl = {0};
+            rc = parse_line_raw(line, &pl);
+            free_pipeline(&pl);
+        }
+        uint64_t c1 = cycles();
+        size_t sink = 0;
+        for (int r = 0; r < reps; ++r) sink += lexclass_span(word);
+        uint64_t c2 = cycles();
+        per[m][0] = (double)len * reps / (double)(c1 - c0);
+        per[m][1] = sink ? (double)sink / (double)(c2 - c1) : 0;
+    }
+    lexclass_force(LEX_SCAN_AUTO);
+    restore_stderr();
+    if (rc != 0) { free(word); free(line); return 1; }
+    for (size_t m = 0; m < 4; ++m) {
+        if (got[m] != impls[m]) { printf("  %-7s (not available)\n", lexclass_name(impls[m])); continue; }
+        if (impls[m] == LEX_SCAN_BYTE) printf("  %-7s parse %6.3f\n", lexclass_name(impls[m]), per[m][0]);
+        else printf("  %-7s parse %6.3f   scan only %7.3f\n", lexclass_name(impls[m]), per[m][0], per[m][1]);
+    }
+    free(word);
+    free(line);
+    return 0;
+}
+
+int main(void){
+    struct { const char *name; int (*fn)(void); } benches[] = {
+        {"source_cache",   bench_source_cache},
+        {"zygote_launch",  bench_zygote_launch},
+        {"glob_1m",        bench_glob_1m},
+        {"script_loop",    bench_script_loop},
+        {"env_assign",     bench_env_assign},
+        {"builtin_stage",  bench_builtin_stage},
+        {"trace",          bench_trace},
+        {"read_lines",     bench_read_lines},
+        {"server",         bench_server},
+        {"jsonl",          bench_jsonl},
+        {"lex",            bench_lex},
+    };
+
+    int fails = 0;
+    for (size_t i = 0; i < sizeof(benches)/sizeof(benches[0]); ++i) {
+        printf("[%s]\n", benches[i].name);
+        int rc = benches[i].fn();
+        if (rc != 0) printf("  FAILED\n");
+        fails += (rc != 0);
+    }
+    return fails ? 1 : 0;
+}
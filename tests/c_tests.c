@@ -2,12 +2,17 @@
 #define _POSIX_C_SOURCE 200809L
 #include "parser.h"
 #include "exec.h"
+#include "jobs.h"
+#include "timeout.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <sys/stat.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <fcntl.h>
 
 static int run_line(const char *line) {
     pipeline_t pl = {0};
@@ -73,6 +78,161 @@ static int test_builtin_jobs(void) {
     return strstr(buf,"sleep") == NULL; // should mention sleep
 }
 
+static void sleep_ms(long ms) {
+    struct timespec ts = { ms / 1000, (ms % 1000) * 1000000L };
+    nanosleep(&ts, NULL);
+}
+
+static int test_job_slots(void) {
+    jobs_wait_all();                 // drain jobs left by earlier tests
+    jobs_set_slots(2);
+
+    for (int i = 0; i < 6; ++i) {
+        if (run_line("/bin/sleep 0.2 &") != 0) { jobs_set_slots(0); return 1; }
+        if (jobs_running_count() > 2) { jobs_set_slots(0); return 1; }
+    }
+    int ok = jobs_running_count() == 2 && jobs_queued_count() == 4;
+
+    // Poll until everything drains; the ceiling must hold at every tick.
+    for (int tick = 0; tick < 500 && (jobs_running_count() || jobs_queued_count()); ++tick) {
+        jobs_mark_done_nonblocking();
+        if (jobs_running_count() > 2) ok = 0;
+        sleep_ms(10);
+    }
+    ok = ok && jobs_running_count() == 0 && jobs_queued_count() == 0;
+    jobs_set_slots(0);
+    return !ok;
+}
+
+static int test_ulimit_limits(void) {
+    struct rlimit before, after;
+    if (getrlimit(RLIMIT_CPU, &before) != 0) return 1;
+
+    // Foreground job burning CPU past its 1s limit is killed (SIGXCPU)...
+    if (run_line("ulimit -t 1 /bin/sh -c \"while :; do :; done\"") == 0) return 1;
+    // ...and so is a background one; jobs_wait_all() only returns once it died.
+    if (run_line("ulimit -t 1 /bin/sh -c \"while :; do :; done\" &") != 0) return 1;
+    jobs_wait_all();
+
+    // The shell's own limits are untouched and it keeps launching commands.
+    if (getrlimit(RLIMIT_CPU, &after) != 0) return 1;
+    if (after.rlim_cur != before.rlim_cur || after.rlim_max != before.rlim_max) return 1;
+    if (run_line("/bin/true") != 0) return 1;
+
+    // Session-wide limits reach every child but not the shell.
+    if (getrlimit(RLIMIT_NOFILE, &before) != 0) return 1;
+    if (run_line("ulimit -n 64") != 0) return 1;
+    int rc = run_line("/bin/sh -c \"ulimit -n | grep -qx 64\"");
+    // Only the soft limit is lowered: the command can raise it again.
+    if (rc == 0) rc = run_line("/bin/sh -c \"ulimit -n 128 && ulimit -n | grep -qx 128\"");
+    exec_session_limit_clear(EXEC_RLIM_NOFILE);
+    if (getrlimit(RLIMIT_NOFILE, &after) != 0) return 1;
+    if (rc != 0 || after.rlim_cur != before.rlim_cur) return 1;
+
+    // A value above the hard limit is clamped to it, not a failed launch.
+    if (before.rlim_max == RLIM_INFINITY) return 0;
+    char line[128];
+    snprintf(line, sizeof(line), "ulimit -n %llu /bin/sh -c \"ulimit -n | grep -qx %llu\"",
+             (unsigned long long)before.rlim_max + 1000, (unsigned long long)before.rlim_max);
+    return run_line(line) != 0;
+}
+
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int test_timeout(void) {
+    // (cwd may be / after builtin_cd: absolute paths only)
+    const char *script = "/tmp/c_tests_ignterm.sh";
+    FILE *f = fopen(script, "w");
+    if (!f) return 1;
+    fputs("trap '' TERM\nexec /bin/sleep 5\n", f);
+    fclose(f);
+    int ok = 1;
+
+    // Foreground: stopped at the deadline with the timeout status...
+    double t0 = now_s();
+    ok = ok && run_line("timeout 0.2 /bin/sleep 5") == TIMEOUT_STATUS && now_s() - t0 < 2;
+    // ...a whole pipeline too...
+    t0 = now_s();
+    ok = ok && run_line("timeout 200ms /bin/sleep 5 | /bin/sleep 5") == TIMEOUT_STATUS &&
+         now_s() - t0 < 2;
+    // ...and a child ignoring TERM gets KILL after the grace period
+    t0 = now_s();
+    ok = ok && run_line("timeout -k 0.2 0.2 /bin/sh /tmp/c_tests_ignterm.sh") == TIMEOUT_STATUS;
+    double took = now_s() - t0;
+    ok = ok && took >= 0.35 && took < 2;
+    // Finishing in time keeps the command's own status
+    ok = ok && run_line("timeout 5 /bin/sh -c \"exit 3\"") == 3;
+    ok = ok && run_line("timeout 5 /bin/true | /bin/cat") == 0;
+    // Usage errors
+    ok = ok && run_line("timeout 1") != 0 && run_line("timeout x /bin/true") != 0 &&
+         run_line("/bin/true | timeout 1 /bin/true") != 0;
+
+    // Background: the watchdog stops it; the job is reported as timed out
+    jobs_wait_all();
+    char out[] = "/tmp/c_tests_timeout_XXXXXX";
+    int fd = mkstemp(out);
+    if (fd < 0) { unlink(script); return 1; }
+    t0 = now_s();
+    ok = ok && run_line("timeout 0.2 /bin/sleep 5 | /bin/sleep 5 &") == 0;
+    ok = ok && run_line("timeout 5 /bin/true &") == 0;
+    fflush(stdout);
+    int saved = dup(STDOUT_FILENO);
+    dup2(fd, STDOUT_FILENO);
+    jobs_wait_all();
+    fflush(stdout);
+    dup2(saved, STDOUT_FILENO);
+    close(saved);
+    ok = ok && now_s() - t0 < 2;
+
+    char buf[512] = {0};
+    ssize_t n = pread(fd, buf, sizeof(buf) - 1, 0);
+    close(fd);
+    unlink(out);
+    unlink(script);
+    return !(ok && n > 0 && strstr(buf, "+ timeout timeout 0.2") && strstr(buf, "+ done timeout 5"));
+}
+
+static int test_wait(void) {
+    jobs_wait_all();
+    int ok = run_line("wait") == 0 && run_line("wait -n") == 127 &&
+             run_line("wait %9999") == 127 && run_line("wait 999999999") == 127;
+
+    // Exit status of the job waited for, by %id; also after it finished
+    int id = jobs_next_id();
+    char line[64];
+    ok = ok && run_line("/bin/sh -c \"exit 7\" &") == 0;
+    snprintf(line, sizeof(line), "wait %%%d", id);
+    ok = ok && run_line(line) == 7 && run_line(line) == 7;
+    id = jobs_next_id();
+    ok = ok && run_line("timeout 0.1 /bin/sleep 5 &") == 0;
+    snprintf(line, sizeof(line), "wait %%%d", id);
+    ok = ok && run_line(line) == TIMEOUT_STATUS;
+
+    // -n wakes on the first job to finish, not on the slow one
+    jobs_set_slots(4);
+    double t0 = now_s();
+    ok = ok && run_line("/bin/sleep 0.6 &") == 0 &&
+               run_line("/bin/sh -c \"sleep 0.1; exit 3\" &") == 0;
+    ok = ok && run_line("wait -n") == 3;
+    double woke = now_s() - t0;
+    ok = ok && woke >= 0.1 && woke < 0.5 && jobs_running_count() == 1;
+    ok = ok && run_line("wait") == 0 && now_s() - t0 >= 0.6 && jobs_running_count() == 0;
+
+    // Queued jobs are waited for too, once a slot frees up and they run
+    jobs_set_slots(1);
+    id = jobs_next_id();
+    ok = ok && run_line("/bin/sleep 0.1 &") == 0 && run_line("/bin/sh -c \"exit 5\" &") == 0 &&
+         jobs_queued_count() == 1;
+    snprintf(line, sizeof(line), "wait %%%d", id + 1);
+    ok = ok && run_line(line) == 5;
+    jobs_set_slots(0);
+    return !ok;
+}
+
 static int test_exit_history(void) {
     // Hard to fully automate exit() since it kills test runner.
     // Instead, rely on run_line calling builtin exit handler returning special code.
@@ -86,6 +246,10 @@ int main(void) {
         {"tilde_expansion",test_tilde_expansion},
         {"builtin_cd",     test_builtin_cd},
         {"builtin_jobs",   test_builtin_jobs},
+        {"job_slots",      test_job_slots},
+        {"ulimit_limits",  test_ulimit_limits},
+        {"timeout",        test_timeout},
+        {"wait",           test_wait},
         {"builtin_exit",   test_exit_history},
     };
 